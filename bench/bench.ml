@@ -0,0 +1,542 @@
+(**************************************************************************)
+(*                                                                        *)
+(*    Copyright 2022 OCamlPro                                             *)
+(*                                                                        *)
+(*  All rights reserved. This file is distributed under the terms of the  *)
+(*  GNU Lesser General Public License version 2.1, with the special       *)
+(*  exception on linking described in the file LICENSE.                   *)
+(*                                                                        *)
+(**************************************************************************)
+
+(* Rendering micro-benchmarks over offscreen canvases.
+   Each scene is drawn repeatedly on square canvases of several sizes,
+   and the results are printed on the standard output as JSON, so that
+   they can be compared across commits. Pixel rates are computed from
+   the area of the bounding box of what each operation draws.
+   It doubles as a regression check: the image drawn by a single
+   operation of each scene can be recorded (-record), then compared to
+   the recorded one (-check), with some tolerance as text rendering
+   depends on the fonts installed; timings can likewise be compared to
+   those of a previous run (-baseline). The images of the scenes that
+   do not depend on fonts are kept in reference/ at size 64, and are
+   checked by dune build @runtest. *)
+
+open OcamlCanvas.V1
+
+let pi = acos(-1.)
+
+let min_time = ref 0.5
+let user_sizes = ref []
+let filter = ref ""
+let no_fonts = ref false
+let label = ref ""
+let record_dir = ref ""
+let check_dir = ref ""
+let tolerance = ref 2
+let max_diff = ref 0.1
+let baseline = ref []
+let max_slowdown = ref 20.0
+
+type scene = {
+  name : string;
+  (* Prepares the canvas, and returns a function performing one operation *)
+  setup : [`Offscreen] Canvas.t -> float -> (unit -> unit);
+  (* Number of pixels touched by one operation, given the canvas size *)
+  pixels : float -> float;
+  (* Whether the result depends on the fonts installed *)
+  fonts : bool;
+}
+
+let full s = s *. s
+
+let rect_fill name setup_style =
+  { name; pixels = full; fonts = false;
+    setup = (fun c s ->
+        setup_style c s;
+        fun () -> Canvas.fillRect c ~pos:(0.0, 0.0) ~size:(s, s)) }
+
+let star c s n =
+  (* A self-intersecting star, whose inner area differs
+     between the non-zero and even-odd fill rules *)
+  let r = s *. 0.5 in
+  Canvas.clearPath c;
+  for i = 0 to n - 1 do
+    let theta = float_of_int (i * (n / 2)) *. 2.0 *. pi /. float_of_int n in
+    let p = (r +. r *. cos theta, r +. r *. sin theta) in
+    if i = 0 then Canvas.moveTo c p else Canvas.lineTo c p
+  done;
+  Canvas.closePath c
+
+let curves c s =
+  Canvas.clearPath c;
+  Canvas.moveTo c (0.0, s *. 0.5);
+  for i = 0 to 7 do
+    let x = float_of_int i *. s /. 8.0 in
+    Canvas.bezierCurveTo c ~cp1:(x +. s /. 32.0, 0.0)
+      ~cp2:(x +. s *. 3.0 /. 32.0, s) ~p:(x +. s /. 8.0, s *. 0.5)
+  done;
+  Canvas.lineTo c (s, s);
+  Canvas.lineTo c (0.0, s);
+  Canvas.closePath c
+
+let zigzag c s =
+  Canvas.clearPath c;
+  Canvas.moveTo c (s *. 0.05, s *. 0.05);
+  for i = 1 to 16 do
+    let x = s *. 0.05 +. float_of_int i *. s *. 0.9 /. 16.0 in
+    let y = if i land 1 = 1 then s *. 0.95 else s *. 0.05 in
+    Canvas.lineTo c (x, y)
+  done
+
+let path_fill name build nonzero =
+  { name; pixels = full; fonts = false;
+    setup = (fun c s ->
+        Canvas.setFillColor c Color.orange;
+        fun () -> build c s; Canvas.fill c ~nonzero) }
+
+let path_stroke name setup_style =
+  { name; pixels = full; fonts = false;
+    setup = (fun c s ->
+        Canvas.setStrokeColor c Color.blue;
+        setup_style c s;
+        fun () -> zigzag c s; Canvas.stroke c) }
+
+(* Tiles the canvas with 16x16 small rectangles of alternating colors,
+   either through individual calls or through a command buffer *)
+let tiles name ~buffered =
+  { name; pixels = full; fonts = false;
+    setup = (fun c s ->
+        let w = s /. 16.0 in
+        let color i j = if (i + j) land 1 = 0 then Color.red else Color.blue in
+        if buffered then begin
+          let b = CommandBuffer.create () in
+          for i = 0 to 15 do
+            for j = 0 to 15 do
+              CommandBuffer.setFillColor b (color i j);
+              CommandBuffer.fillRect b
+                ~pos:(float_of_int i *. w, float_of_int j *. w) ~size:(w, w)
+            done
+          done;
+          fun () -> Canvas.execute c b
+        end else
+          fun () ->
+            for i = 0 to 15 do
+              for j = 0 to 15 do
+                Canvas.setFillColor c (color i j);
+                Canvas.fillRect c
+                  ~pos:(float_of_int i *. w, float_of_int j *. w) ~size:(w, w)
+              done
+            done) }
+
+(* A static overlay, either drawn directly or replayed from a picture *)
+let legend name ~picture =
+  { name; pixels = full; fonts = true;
+    setup = (fun c s ->
+        let draw c =
+          Canvas.setFillColor c Color.orange;
+          star c s 33;
+          Canvas.fill c ~nonzero:true;
+          Canvas.setStrokeColor c Color.blue;
+          Canvas.setLineWidth c (max 2.0 (s /. 32.0));
+          zigzag c s;
+          Canvas.stroke c;
+          Canvas.setFillColor c Color.black;
+          Canvas.setFont c "Liberation Sans" ~size:(s /. 16.0)
+            ~slant:Font.Roman ~weight:Font.regular;
+          Canvas.fillText c "Legend" (s *. 0.1, s *. 0.9)
+        in
+        if picture then begin
+          Canvas.beginPicture c;
+          draw c;
+          let pic = Canvas.endPicture c in
+          fun () -> Canvas.drawPicture c pic
+        end else
+          fun () -> draw c) }
+
+let text_run name size =
+  { name; pixels = (fun s -> s *. size *. 1.5); fonts = true;
+    setup = (fun c s ->
+        Canvas.setFillColor c Color.black;
+        Canvas.setFont c "Liberation Sans" ~size
+          ~slant:Font.Roman ~weight:Font.regular;
+        let text = "The quick brown fox jumps over the lazy dog. " in
+        let text = String.concat "" [ text; text; text; text ] in
+        let len = int_of_float (s /. size *. 2.0) in
+        let text = String.sub text 0 (min (String.length text) (max 8 len)) in
+        fun () -> Canvas.fillText c text (0.0, size)) }
+
+let blit name ~transformed =
+  { name; pixels = full; fonts = false;
+    setup = (fun c s ->
+        let n = int_of_float s in
+        let src = Canvas.createOffscreen ~size:(n, n) in
+        Canvas.setFillColor src (Color.of_argb 192 0 128 255);
+        Canvas.fillRect src ~pos:(0.0, 0.0) ~size:(s, s);
+        if transformed then begin
+          (* One sprite, rotated around the canvas center *)
+          let sprites =
+            Bigarray.(Array2.create float64 c_layout 1 15) in
+          let theta = pi /. 12.0 in
+          let ct = cos theta and st = sin theta in
+          let h = s *. 0.5 in
+          Array.iteri (fun i v -> sprites.{0, i} <- v)
+            [| 0.0; 0.0; s; s; -. h; -. h; s; s; 1.0;
+               ct; st; -. st; ct; h; h |];
+          fun () -> Canvas.blitBatch ~dst:c ~src sprites
+        end else
+          fun () -> Canvas.blit ~dst:c ~dpos:(0, 0) ~src
+                      ~spos:(0, 0) ~size:(n, n)) }
+
+let shadow name blur =
+  { name; pixels = full; fonts = false;
+    setup = (fun c s ->
+        Canvas.setFillColor c Color.green;
+        Canvas.setShadowColor c (Color.of_argb 128 0 0 0);
+        Canvas.setShadowBlur c blur;
+        Canvas.setShadowOffset c (4.0, 4.0);
+        fun () ->
+          Canvas.fillRect c ~pos:(s *. 0.1, s *. 0.1)
+            ~size:(s *. 0.7, s *. 0.7)) }
+
+(* A shadowed triangle whose bounding box has fractional coordinates,
+   ending at a lower fraction than it starts: the shape and its shadow
+   then span one more pixel than their truncated extent *)
+let shadow_fractional name =
+  { name; pixels = full; fonts = false;
+    setup = (fun c s ->
+        let x0 = floor (s *. 0.1) +. 0.7 and x1 = floor (s *. 0.8) +. 0.2 in
+        let y0 = floor (s *. 0.15) +. 0.6 and y1 = floor (s *. 0.85) +. 0.3 in
+        Canvas.setFillColor c Color.orange;
+        Canvas.setShadowColor c (Color.of_argb 128 0 0 0);
+        Canvas.setShadowBlur c 3.0;
+        Canvas.setShadowOffset c (2.5, 1.5);
+        fun () ->
+          Canvas.clearPath c;
+          Canvas.moveTo c (x0, y0);
+          Canvas.lineTo c (x1, (y0 +. y1) *. 0.5);
+          Canvas.lineTo c ((x0 +. x1) *. 0.5, y1);
+          Canvas.closePath c;
+          Canvas.fill c ~nonzero:true) }
+
+let clip_stack name depth =
+  { name; pixels = full; fonts = false;
+    setup = (fun c s ->
+        Canvas.setFillColor c Color.cyan;
+        fun () ->
+          Canvas.save c;
+          for i = 1 to depth do
+            let m = s *. 0.05 *. float_of_int i in
+            Canvas.clearPath c;
+            if i land 1 = 1 then
+              Canvas.rect c ~pos:(m, m) ~size:(s -. 2.0 *. m, s -. 2.0 *. m)
+            else
+              Canvas.arc c ~center:(s *. 0.5, s *. 0.5) ~radius:(s *. 0.5 -. m)
+                ~theta1:0.0 ~theta2:(2.0 *. pi) ~ccw:false;
+            Canvas.clip c ~nonzero:true
+          done;
+          Canvas.fillRect c ~pos:(0.0, 0.0) ~size:(s, s);
+          Canvas.restore c) }
+
+let composite_ops = CompositeOp.[
+  "source_over", SourceOver; "source_in", SourceIn;
+  "source_out", SourceOut; "source_atop", SourceAtop;
+  "destination_over", DestinationOver; "destination_in", DestinationIn;
+  "destination_out", DestinationOut; "destination_atop", DestinationAtop;
+  "lighter", Lighter; "copy", Copy; "xor", XOR;
+  "multiply", Multiply; "screen", Screen; "overlay", Overlay;
+  "darken", Darken; "lighten", Lighten;
+  "color_dodge", ColorDodge; "color_burn", ColorBurn;
+  "hard_light", HardLight; "soft_light", SoftLight;
+  "difference", Difference; "exclusion", Exclusion;
+  "hue", Hue; "saturation", Saturation;
+  "color", Color; "luminosity", Luminosity;
+]
+
+let scenes = [
+
+  rect_fill "fill_rect_solid" (fun c _s ->
+      Canvas.setFillColor c Color.red);
+
+  rect_fill "fill_rect_solid_transformed" (fun c s ->
+      Canvas.setFillColor c Color.red;
+      Canvas.translate c (s *. 0.5, s *. 0.5);
+      Canvas.rotate c (pi /. 6.0);
+      Canvas.translate c (-. s *. 0.5, -. s *. 0.5));
+
+  rect_fill "fill_rect_linear_gradient" (fun c s ->
+      let g = Canvas.createLinearGradient c
+                ~pos1:(0.0, 0.0) ~pos2:(s, s) in
+      Gradient.addColorStop g Color.red 0.0;
+      Gradient.addColorStop g Color.blue 1.0;
+      Canvas.setFillGradient c g);
+
+  rect_fill "fill_rect_radial_gradient" (fun c s ->
+      let g = Canvas.createRadialGradient c
+                ~center1:(s *. 0.5, s *. 0.5) ~rad1:0.0
+                ~center2:(s *. 0.5, s *. 0.5) ~rad2:(s *. 0.5) in
+      Gradient.addColorStop g Color.white 0.0;
+      Gradient.addColorStop g Color.green 1.0;
+      Canvas.setFillGradient c g);
+
+  path_fill "fill_path_star_nonzero" (fun c s -> star c s 33) true;
+  path_fill "fill_path_star_evenodd" (fun c s -> star c s 33) false;
+  path_fill "fill_path_curves_nonzero" curves true;
+  path_fill "fill_path_curves_evenodd" curves false;
+
+  path_stroke "stroke_thin" (fun c _s ->
+      Canvas.setLineWidth c 1.0);
+
+  path_stroke "stroke_thick_round" (fun c s ->
+      Canvas.setLineWidth c (max 2.0 (s /. 32.0));
+      Canvas.setLineJoin c Join.Round;
+      Canvas.setLineCap c Cap.Round);
+
+  path_stroke "stroke_thick_miter" (fun c s ->
+      Canvas.setLineWidth c (max 2.0 (s /. 32.0));
+      Canvas.setLineJoin c Join.Miter;
+      Canvas.setLineCap c Cap.Butt);
+
+  path_stroke "stroke_dashed" (fun c s ->
+      Canvas.setLineWidth c 2.0;
+      Canvas.setLineDash c [| s /. 32.0; s /. 64.0 |]);
+
+  tiles "tiles_calls" ~buffered:false;
+  tiles "tiles_buffered" ~buffered:true;
+
+  legend "legend_direct" ~picture:false;
+  legend "legend_picture" ~picture:true;
+
+  text_run "text_small" 12.0;
+  text_run "text_large" 48.0;
+
+  blit "blit" ~transformed:false;
+  blit "blit_transformed" ~transformed:true;
+
+  shadow "shadow_sharp" 0.0;
+  shadow "shadow_blur" 8.0;
+  shadow_fractional "shadow_fractional";
+
+  clip_stack "clip_stack_1" 1;
+  clip_stack "clip_stack_4" 4;
+
+] @ List.map (fun (name, op) ->
+    rect_fill ("composite_" ^ name) (fun c _s ->
+        Canvas.setFillColor c (Color.of_argb 160 32 128 224);
+        Canvas.setGlobalCompositeOperation c op)
+  ) composite_ops
+
+let now () =
+  Int64.to_float (Backend.getCurrentTimestamp ()) *. 1e-6
+
+(* Runs op in batches of growing size until min_time is elapsed,
+   and returns the number of operations and the time they took *)
+let measure op =
+  let rec loop batch ops time =
+    if time >= !min_time then ops, time
+    else begin
+      let t0 = now () in
+      for _ = 1 to batch do op () done;
+      let dt = now () -. t0 in
+      let batch = if dt < !min_time /. 10.0 then batch * 2 else batch in
+      loop batch (ops + batch) (time +. dt)
+    end
+  in
+  loop 1 0 0.0
+
+let image_file dir scene size =
+  Filename.concat dir (Printf.sprintf "%s_%d.png" scene.name size)
+
+(* Returns the largest channel difference between images a and b, and
+   the number of pixels having a channel differing by more than the
+   tolerance, or None if their sizes differ *)
+let compare_images a b =
+  let (w, h) = ImageData.getSize a in
+  if ImageData.getSize b <> (w, h) then None
+  else begin
+    let max_delta = ref 0 and differing = ref 0 in
+    for y = 0 to h - 1 do
+      for x = 0 to w - 1 do
+        let d = ref 0 in
+        for k = 0 to 3 do
+          d := max !d (abs (Bigarray.Array3.get a y x k -
+                            Bigarray.Array3.get b y x k))
+        done;
+        if !d > !max_delta then max_delta := !d;
+        if !d > !tolerance then incr differing
+      done
+    done;
+    Some (!max_delta, !differing)
+  end
+
+(* Records and/or checks the result of a single operation on a fresh
+   canvas; returns the JSON fields to report and whether it passed *)
+let check_image c scene size golden =
+  if !record_dir = "" && !check_dir = "" then [], true
+  else begin
+    let image = Canvas.getImageData c ~pos:(0, 0) ~size:(size, size) in
+    if !record_dir <> "" then
+      ImageData.exportPNG image (image_file !record_dir scene size);
+    if !check_dir = "" then [ "\"image\": \"recorded\"" ], true
+    else match golden with
+      | None -> [ "\"image\": \"missing\"" ], false
+      | Some golden ->
+          match compare_images image golden with
+          | None -> [ "\"image\": \"size_mismatch\"" ], false
+          | Some (max_delta, differing) ->
+              let percent =
+                100.0 *. float_of_int differing /. float_of_int (size * size) in
+              let ok = percent <= !max_diff in
+              [ Printf.sprintf "\"image\": \"%s\""
+                  (if ok then "ok" else "differs");
+                Printf.sprintf "\"max_delta\": %d" max_delta;
+                Printf.sprintf "\"diff_percent\": %.3f" percent ], ok
+  end
+
+(* Reads the timings of a previous run, as printed by this program *)
+let load_baseline filename =
+  let ic = open_in filename in
+  let rec loop acc =
+    match input_line ic with
+    | exception End_of_file -> close_in ic; acc
+    | line ->
+        let acc =
+          try
+            Scanf.sscanf line " { \"name\": %S, \"size\": %d, \
+                               \"ops\": %f, \"time_s\": %f, \"ns_per_op\": %f"
+              (fun name size _ _ ns -> ((name, size), ns) :: acc)
+          with Scanf.Scan_failure _ | Failure _ | End_of_file -> acc
+        in
+        loop acc
+  in
+  loop []
+
+let check_timing scene size ns_per_op =
+  match List.assoc (scene.name, size) !baseline with
+  | exception Not_found -> [], true
+  | base ->
+      let slowdown = (ns_per_op -. base) /. base *. 100.0 in
+      let ok = slowdown <= !max_slowdown in
+      [ Printf.sprintf "\"baseline_ns_per_op\": %.1f" base;
+        Printf.sprintf "\"slowdown_percent\": %.1f" slowdown;
+        Printf.sprintf "\"timing\": \"%s\""
+          (if ok then "ok" else "regressed") ], ok
+
+let run_scene scene size golden =
+  let s = float_of_int size in
+  let c = Canvas.createOffscreen ~size:(size, size) in
+  Canvas.setFillColor c Color.white;
+  Canvas.fillRect c ~pos:(0.0, 0.0) ~size:(s, s);
+  let op = scene.setup c s in
+  op (); (* also warms up caches, fonts and glyphs *)
+  let image_fields, image_ok = check_image c scene size golden in
+  if not image_ok then
+    Printf.eprintf "%s at size %d: image check failed\n%!" scene.name size;
+  let ops, time = measure op in
+  let ops = float_of_int ops in
+  let ns_per_op = time *. 1e9 /. ops in
+  let timing_fields, timing_ok = check_timing scene size ns_per_op in
+  let fields = [
+    Printf.sprintf "\"name\": \"%s\"" scene.name;
+    Printf.sprintf "\"size\": %d" size;
+    Printf.sprintf "\"ops\": %.0f" ops;
+    Printf.sprintf "\"time_s\": %.6f" time;
+    Printf.sprintf "\"ns_per_op\": %.1f" ns_per_op;
+    Printf.sprintf "\"ops_per_s\": %.1f" (ops /. time);
+    Printf.sprintf "\"mpixels_per_s\": %.3f"
+      (scene.pixels s *. ops /. time *. 1e-6);
+  ] @ image_fields @ timing_fields in
+  Printf.sprintf "    { %s }" (String.concat ", " fields),
+  image_ok && timing_ok
+
+let () =
+
+  Arg.parse [
+    "-time", Arg.Set_float min_time,
+    "<s> Minimum time spent on each scene and size (default 0.5)";
+    "-size", Arg.Int (fun n -> user_sizes := n :: !user_sizes),
+    "<n> Canvas size to run scenes at; may be repeated \
+     (default 64, 256 and 1024)";
+    "-filter", Arg.Set_string filter,
+    "<str> Only run scenes whose name contains str";
+    "-no-fonts", Arg.Set no_fonts,
+    " Skip the scenes whose result depends on the fonts installed";
+    "-label", Arg.Set_string label,
+    "<str> Label recorded in the output (e.g. a commit hash)";
+    "-record", Arg.Set_string record_dir,
+    "<dir> Save the image drawn by each scene to dir";
+    "-check", Arg.Set_string check_dir,
+    "<dir> Compare the image drawn by each scene to the one in dir";
+    "-tolerance", Arg.Set_int tolerance,
+    "<n> Channel difference above which pixels differ (default 2)";
+    "-max-diff", Arg.Set_float max_diff,
+    "<pct> Percentage of differing pixels allowed (default 0.1)";
+    "-baseline", Arg.String (fun f -> baseline := load_baseline f),
+    "<file> Compare timings to those of a previous run";
+    "-max-slowdown", Arg.Set_float max_slowdown,
+    "<pct> Slowdown allowed relative to the baseline (default 20)";
+  ] (fun _ -> raise (Arg.Bad "unexpected argument"))
+    "Usage: bench [options]\n\
+     Exits with status 1 if an image or timing check fails.";
+
+  Backend.(init { default_options with
+                  unix_backends = [ Headless; Wayland; X11 ] });
+
+  let matches name =
+    let n = String.length !filter and m = String.length name in
+    let rec at i = i + n <= m && (String.sub name i n = !filter || at (i + 1)) in
+    at 0
+  in
+
+  let sizes = if !user_sizes = [] then [ 64; 256; 1024 ]
+              else List.rev !user_sizes in
+
+  let jobs =
+    List.concat (List.map (fun scene ->
+        if matches scene.name && not (!no_fonts && scene.fonts) then
+          List.map (fun size -> scene, size) sizes
+        else []
+      ) scenes)
+  in
+
+  (* Reference images are decoded in the background, and handed
+     back from the event loop: scenes are thus run one after the
+     other, as soon as their reference image is available *)
+  let load_golden scene size =
+    if !check_dir = "" then Promise.return None
+    else
+      Promise.catch (fun () ->
+          Promise.bind
+            (ImageData.createFromPNG (image_file !check_dir scene size))
+            (fun golden -> Promise.return (Some golden)))
+        (fun _ -> Promise.return None)
+  in
+
+  let results = ref [] and passed = ref true in
+  let rec run_jobs = function
+    | [] -> Promise.return ()
+    | (scene, size) :: jobs ->
+        Promise.bind (load_golden scene size) (fun golden ->
+            let result, ok = run_scene scene size golden in
+            results := result :: !results;
+            passed := !passed && ok;
+            run_jobs jobs)
+  in
+
+  let finished = ref false in
+  ignore @@
+    Promise.bind (run_jobs jobs) (fun () ->
+        finished := true;
+        Backend.stop ();
+        Promise.return ());
+
+  let report () =
+    Printf.printf "{\n  \"label\": \"%s\",\n  \"min_time_s\": %g,\n  \
+                   \"passed\": %b,\n  \"results\": [\n%s\n  ]\n}\n"
+      (String.escaped !label) !min_time !passed
+      (String.concat ",\n" (List.rev !results));
+    if not !passed then exit 1
+  in
+
+  if !finished then report ()
+  else
+    Backend.run (fun state _ -> state, false) (fun () -> report ()) ()
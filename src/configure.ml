@@ -23,17 +23,18 @@ let () =
  (modules ocamlCanvas)
  (foreign_stubs
   (language c)
-  (names config util unicode point rect list hashtable event
+  (names config util lock defer frame stats trace unicode point rect list hashtable event
          gdi_keyboard gdi_backend gdi_target gdi_window gdi_surface
          qtz_keyboard qtz_backend qtz_target qtz_window qtz_surface
          x11_keysym x11_keyboard x11_backend x11_target x11_window x11_surface
          wl_backend wl_target wl_window wl_surface xdg-shell-protocol
+         hdl_backend hdl_target hdl_window hdl_surface
          window pixmap image_interpolation filters surface transform draw_instr
          font_desc gdi_font qtz_font unx_font font
-         gdi_impexp qtz_impexp unx_impexp impexp
-         path arc path2d polygon polygonize
+         gdi_impexp qtz_impexp unx_pool unx_watch unx_png_parallel unx_impexp impexp
+         path arc path2d polygon stroke polygonize
          gradient pattern draw_style color_composition poly_render
-         state canvas backend
+         state picture canvas command unx_render backend
          ml_convert ml_canvas)
   (flags (:standard) (:include ccopt.sexp)))
  (c_library_flags (:standard) (:include cclib.sexp))|};
@@ -22,7 +22,7 @@ let march_config _c =
 
 let gdi_config _c =
   [ "-DHAS_GDI"; "-DUNICODE"; "-D_UNICODE" ],
-  [ "-lkernel32"; "-lgdi32"; "-lgdiplus" ]
+  [ "-lkernel32"; "-lgdi32"; "-lgdiplus"; "-lole32" ]
 
 let qtz_config _c =
   [ "-DHAS_QUARTZ"; "-Qunused-arguments";
@@ -35,14 +35,14 @@ let x11_config c =
     query_or_default c "xcb xcb-image xcb-shm xcb-xkb xcb-keysyms"
       [] [ "-lxcb"; "-lxcb-image"; "-lxcb-shm"; "-lxcb-xkb"; "-lxcb-keysyms" ]
   in
-  "-DHAS_X11" :: cflags, libs
+  "-DHAS_X11" :: cflags, "-lpthread" :: libs
 
 let wl_config c =
   let cflags, libs =
     query_or_default c "wayland-client wayland-cursor xkbcommon"
       [] [ "-lwayland-client"; "-lwayland-cursor"; "-lxkbcommon" ]
   in
-  "-DHAS_WAYLAND" :: cflags, "-lrt" :: libs
+  "-DHAS_WAYLAND" :: cflags, "-lrt" :: "-lpthread" :: libs
 
 let fc_config c =
   let cflags, libs =
@@ -61,12 +61,19 @@ let ft_config c =
 
 let png_config c =
   let cflags, libs =
-    query_or_default c "libpng"
+    query_or_default c "libpng zlib"
       [ "-I/usr/include/libpng16"; ]
       [ "-lpng16"; "-lz" ]
   in
   cflags, libs
 
+let hdl_config c =
+  let fc_cflags, fc_libs = fc_config c in
+  let ft_cflags, ft_libs = ft_config c in
+  let png_cflags, png_libs = png_config c in
+  "-DHAS_HEADLESS" :: fc_cflags @ ft_cflags @ png_cflags,
+  "-lpthread" :: fc_libs @ ft_libs @ png_libs
+
 let march_test = {|
 #include <stdio.h>
 int main()
@@ -144,8 +151,29 @@ int main()
 
 let png_test = {|
 #include <png.h>
+#include <zlib.h>
+int main()
+{
+  png_uint_32 v = png_access_version_number();
+  const char *z = zlibVersion();
+  return 0;
+}
+|}
+
+let hdl_test = {|
+#include <time.h>
+#include <fontconfig/fontconfig.h>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include <png.h>
 int main()
 {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  FcConfig *fc = FcInitLoadConfigAndFonts();
+  FcConfigDestroy(fc);
+  FT_Library ft_library;
+  FT_Init_FreeType(&ft_library);
   png_uint_32 v = png_access_version_number();
   return 0;
 }
@@ -170,7 +198,8 @@ let () =
           (wl_config, wl_test);
           (fc_config, fc_test);
           (ft_config, ft_test);
-          (png_config, png_test); ]
+          (png_config, png_test);
+          (hdl_config, hdl_test); ]
     in
     C.Flags.write_sexp "ccopt.sexp" (fst options);
     C.Flags.write_sexp "cclib.sexp" (snd options))
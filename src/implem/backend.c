@@ -15,14 +15,19 @@
 #include <locale.h>
 
 #include "config.h"
+#include "util.h"
+#include "lock.h"
 #include "hashtable.h"
 #include "event.h"
+#include "frame.h"
+#include "trace.h"
 #include "window.h"
 #include "surface.h"
 #include "canvas.h"
 #include "canvas_internal.h"
 #include "poly_render.h"
 #include "impexp.h"
+#include "defer.h"
 
 #ifdef HAS_GDI
 #include "gdi/gdi_backend.h"
@@ -36,9 +41,67 @@
 #ifdef HAS_WAYLAND
 #include "wayland/wl_backend.h"
 #endif
+#ifdef HAS_HEADLESS
+#include "headless/hdl_backend.h"
+#endif
+#if defined HAS_X11 || defined HAS_WAYLAND || defined HAS_HEADLESS
+#include "unix/unx_watch.h"
+#endif
 
 static hashtable_t *_backend_id_to_canvas = NULL;
 
+/* Canvases may be created and destroyed from several threads at once */
+static lock_t _backend_id_lock = LOCK_INITIALIZER;
+
+/* Opt-in: events are then held until the next frame of their
+   canvas, which only visible canvases get */
+static bool _backend_coalesce_events = false;
+
+static bool
+_backend_deliver_event(
+  canvas_t *canvas,
+  event_t *event,
+  event_listener_t *next_listener)
+{
+  assert(canvas != NULL);
+  assert(event != NULL);
+
+  if (event->type == EVENT_RESIZE) {
+// Ensure width/height > 0
+    _canvas_set_size_internal(canvas,
+                              event->desc.resize.width,
+                              event->desc.resize.height);
+    /* Resizing may leave new areas to draw */
+    canvas_request_frame(canvas);
+  }
+
+  return event_notify(next_listener, event);
+}
+
+/* Sends the events held back by coalescing, the resize first,
+   so that the cursor position is seen relative to the new size */
+static void
+_backend_flush_events(
+  canvas_t *canvas,
+  event_listener_t *next_listener)
+{
+  assert(canvas != NULL);
+
+  event_t event;
+
+  if (canvas->pending_resize.type != EVENT_NULL) {
+    event = canvas->pending_resize;
+    canvas->pending_resize.type = EVENT_NULL;
+    _backend_deliver_event(canvas, &event, next_listener);
+  }
+
+  if (canvas->pending_cursor.type != EVENT_NULL) {
+    event = canvas->pending_cursor;
+    canvas->pending_cursor.type = EVENT_NULL;
+    _backend_deliver_event(canvas, &event, next_listener);
+  }
+}
+
 static bool
 _backend_process_event(
   event_t *event,
@@ -63,22 +126,48 @@ _backend_process_event(
 
   switch (event->type) {
     case EVENT_PRESENT: /* internal event */
-      surface_present(canvas->surface, &event->desc.present.data);
+      _canvas_present_internal(canvas, &event->desc.present.data);
       result = true;
       break;
+    case EVENT_FRAME:
+      _backend_flush_events(canvas, next_listener);
+      _canvas_begin_frame_internal(canvas);
+      if (_canvas_take_frame_internal(canvas) == true) {
+        int64_t trace_t = trace_begin();
+        result = event_notify(next_listener, event);
+        trace_end("frame", trace_t);
+      } else {
+        /* Still let listeners know an iteration has passed */
+        event->type = EVENT_IDLE;
+        event_notify(next_listener, event);
+        event->type = EVENT_FRAME;
+      }
+      result = _canvas_end_frame_internal(canvas, result);
+      break;
     case EVENT_RESIZE:
-// Ensure width/height > 0
-      _canvas_set_size_internal(canvas,
-                                event->desc.resize.width,
-                                event->desc.resize.height);
-      result = event_notify(next_listener, event);
+      if (_backend_coalesce_events == true) {
+        canvas->pending_resize = *event;
+        result = true;
+      } else {
+        result = _backend_deliver_event(canvas, event, next_listener);
+      }
+      break;
+    case EVENT_CURSOR:
+      if (_backend_coalesce_events == true) {
+        canvas->pending_cursor = *event;
+        result = true;
+      } else {
+        result = _backend_deliver_event(canvas, event, next_listener);
+      }
       break;
     case EVENT_CLOSE:
+      _backend_flush_events(canvas, next_listener);
       event_notify(next_listener, event);
       canvas_close(canvas);
       result = false; // true to prevent close ?
       break;
     default:
+      _backend_flush_events(canvas, next_listener);
       result = event_notify(next_listener, event);
       break;
   }
@@ -110,6 +199,34 @@ _backend_id_equal(
   return (*id1) == (*id2);
 }
 
+void
+backend_set_frame_rate(
+  int32_t rate)
+{
+  frame_set_rate(rate);
+}
+
+int32_t
+backend_get_frame_rate(
+  void)
+{
+  return frame_get_rate();
+}
+
+void
+backend_set_event_coalescing(
+  bool coalescing)
+{
+  _backend_coalesce_events = coalescing;
+}
+
+bool
+backend_get_event_coalescing(
+  void)
+{
+  return _backend_coalesce_events;
+}
+
 int64_t
 backend_get_time(
   void)
@@ -125,6 +242,7 @@ backend_get_time(
     case_QUARTZ(result = qtz_get_time());
     case_X11(result = x11_get_time());
     case_WAYLAND(/*result = wl_get_time()*/);
+    case_HEADLESS(result = hdl_get_time());
     default_fail();
   }
 
@@ -143,7 +261,7 @@ backend_init(
 
   if (_backend_id_to_canvas == NULL) {
     _backend_id_to_canvas = ht_new((key_hash_fun_t *)_backend_id_hash,
-                                   (key_equal_fun_t *)_backend_id_equal, 1024);
+                                   (key_equal_fun_t *)_backend_id_equal, 64);
     if (_backend_id_to_canvas == NULL) {
       return false;
     }
@@ -158,6 +276,7 @@ backend_init(
     case_QUARTZ(result = qtz_backend_init());
     case_X11(result = x11_backend_init());
     case_WAYLAND(/*result = wl_backend_init()*/);
+    case_HEADLESS(result = hdl_backend_init());
     default_ignore();
   }
 
@@ -171,6 +290,7 @@ backend_init(
       case_QUARTZ(qtz_backend_set_listener(&_backend_event_listener));
       case_X11(x11_backend_set_listener(&_backend_event_listener));
       case_WAYLAND(wl_backend_set_listener(&_backend_event_listener));
+      case_HEADLESS(hdl_backend_set_listener(&_backend_event_listener));
       default_fail();
     }
   }
@@ -186,16 +306,33 @@ backend_terminate(
     return;
   }
 
+  /* Work handed back by background tasks (e.g. decoded PNG files
+     whose promises are still pending) is run one last time, as
+     nothing would run it afterwards; the backend must still be up,
+     as it may create canvases. Stopping the workers first lets
+     them complete their tasks, but running the deferred functions
+     may start new ones, hence the loop. */
+  do {
+    impexp_terminate();
+    defer_process();
+  } while (defer_pending() == true);
+
   switch_IMPL() {
     case_GDI(gdi_backend_terminate());
     case_QUARTZ(qtz_backend_terminate());
     case_X11(x11_backend_terminate());
     case_WAYLAND(wl_backend_terminate());
+    case_HEADLESS(hdl_backend_terminate());
     default_fail();
   }
 
-  impexp_terminate();
+#if defined HAS_X11 || defined HAS_WAYLAND || defined HAS_HEADLESS
+  unx_watch_terminate();
+#endif
+  lock_acquire(&_backend_id_lock);
   ht_delete(_backend_id_to_canvas);
+  _backend_id_to_canvas = NULL;
+  lock_release(&_backend_id_lock);
   set_impl_type(IMPL_NONE);
 }
 
@@ -222,6 +359,7 @@ backend_run(
     case_QUARTZ(qtz_backend_run());
     case_X11(x11_backend_run());
     case_WAYLAND(wl_backend_run());
+    case_HEADLESS(hdl_backend_run());
     default_fail();
   }
 
@@ -241,6 +379,66 @@ backend_stop(
     case_QUARTZ(qtz_backend_stop());
     case_X11(x11_backend_stop());
     case_WAYLAND(wl_backend_stop());
+    case_HEADLESS(hdl_backend_stop());
+    default_ignore();
+  }
+}
+
+int32_t
+backend_watch_fd(
+  int fd,
+  int32_t flags,
+  watch_fun_t *fun,
+  void *data)
+{
+  assert(fd >= 0);
+  assert((flags & (WATCH_READ | WATCH_WRITE)) != 0);
+  assert(fun != NULL);
+
+  int32_t result = 0;
+
+  switch_IMPL() {
+    case_X11(result = unx_watch_fd(fd, flags, fun, data));
+    case_WAYLAND(result = unx_watch_fd(fd, flags, fun, data));
+    case_HEADLESS(result = unx_watch_fd(fd, flags, fun, data));
+    default_ignore();
+  }
+
+  return result;
+}
+
+int32_t
+backend_watch_timer(
+  int64_t delay,
+  int64_t period,
+  watch_fun_t *fun,
+  void *data)
+{
+  assert(fun != NULL);
+
+  int32_t result = 0;
+
+  switch_IMPL() {
+    case_X11(result = unx_watch_timer(max(0, delay), max(0, period),
+                                      fun, data));
+    case_WAYLAND(result = unx_watch_timer(max(0, delay), max(0, period),
+                                          fun, data));
+    case_HEADLESS(result = unx_watch_timer(max(0, delay), max(0, period),
+                                           fun, data));
+    default_ignore();
+  }
+
+  return result;
+}
+
+void
+backend_unwatch(
+  int32_t id)
+{
+  switch_IMPL() {
+    case_X11(unx_watch_remove(id));
+    case_WAYLAND(unx_watch_remove(id));
+    case_HEADLESS(unx_watch_remove(id));
     default_ignore();
   }
 }
@@ -250,6 +448,9 @@ backend_next_id(
   void)
 {
   static int32_t id = 0;
+
+  lock_acquire(&_backend_id_lock);
+
   int32_t old_id = id;
 
   do {
@@ -259,11 +460,16 @@ backend_next_id(
     }
     /* Exhausted ids (unlikely) */
     if (id == old_id) {
+      lock_release(&_backend_id_lock);
       return 0;
     }
   } while (ht_find(_backend_id_to_canvas, (void *)&id) != NULL);
 
-  return id;
+  int32_t result = id;
+
+  lock_release(&_backend_id_lock);
+
+  return result;
 }
 
 void
@@ -276,7 +482,9 @@ backend_add_canvas(
   /* Note: we do not retain the canvas here ; the canvas destruction
      function actually removes the canvas from this list (i.e. this
      is a weak pointer) */
+  lock_acquire(&_backend_id_lock);
   ht_add(_backend_id_to_canvas, (void *)&(canvas->id), (void *)canvas);
+  lock_release(&_backend_id_lock);
 }
 
 void
@@ -287,7 +495,9 @@ backend_remove_canvas(
   assert(canvas->id != 0);
 
   /* Note: we do not release the canvas here, for the reason explained above */
+  lock_acquire(&_backend_id_lock);
   ht_remove(_backend_id_to_canvas, (void *)&(canvas->id));
+  lock_release(&_backend_id_lock);
 }
 
 canvas_t *
@@ -297,5 +507,8 @@ backend_get_canvas(
   if (get_impl_type() == IMPL_NONE) {
     return NULL;
   }
-  return (canvas_t *)ht_find(_backend_id_to_canvas, (void *)&id);
+  lock_acquire(&_backend_id_lock);
+  canvas_t *canvas = (canvas_t *)ht_find(_backend_id_to_canvas, (void *)&id);
+  lock_release(&_backend_id_lock);
+  return canvas;
 }
@@ -16,12 +16,35 @@
 
 #include "config.h"
 #include "event.h"
+#include "watch.h"
 #include "canvas.h"
 
 int64_t
 backend_get_time(
   void);
 
+// Number of frame events sent per second to each visible
+// canvas; takes effect at the next frame, except on Quartz
+// where it takes effect the next time the loop is started
+void
+backend_set_frame_rate(
+  int32_t rate);
+
+int32_t
+backend_get_frame_rate(
+  void);
+
+// When enabled (the default), consecutive cursor and resize
+// events of a canvas are merged, and only the last ones are
+// sent, right before the next frame or any other event
+void
+backend_set_event_coalescing(
+  bool coalescing);
+
+bool
+backend_get_event_coalescing(
+  void);
+
 bool
 backend_init(
   impl_type_t impl_type);
@@ -38,6 +61,30 @@ void
 backend_stop(
   void);
 
+// Calls fun from the event loop whenever fd is ready for the
+// operations given in flags (WATCH_READ and/or WATCH_WRITE).
+// Only available on Unix backends; returns 0 otherwise.
+int32_t
+backend_watch_fd(
+  int fd,
+  int32_t flags,
+  watch_fun_t *fun,
+  void *data);
+
+// Calls fun from the event loop after delay microseconds,
+// then every period microseconds, unless period is 0.
+// Only available on Unix backends; returns 0 otherwise.
+int32_t
+backend_watch_timer(
+  int64_t delay,
+  int64_t period,
+  watch_fun_t *fun,
+  void *data);
+
+void
+backend_unwatch(
+  int32_t id);
+
 int32_t
 backend_next_id(
   void);
@@ -40,10 +40,17 @@
 #include "polygonize.h"
 #include "poly_render.h"
 #include "draw_instr.h"
+#include "picture.h"
+#include "picture_internal.h"
+#include "command.h"
 #include "image_interpolation.h"
 #include "filters.h"
 #include "backend.h"
+#include "trace.h"
 #include "canvas_internal.h"
+#if defined HAS_X11 || defined HAS_WAYLAND || defined HAS_HEADLESS
+#include "unix/unx_render.h"
+#endif
 
 IMPLEMENT_OBJECT_METHODS(canvas_t, canvas, _canvas_destroy)
 
@@ -134,6 +141,15 @@ _canvas_create_internal(
   canvas->height = height;
   canvas->clip_region = pixmap_null();
   canvas->clip_region_dirty = false;
+  canvas->frame_on_demand = false;
+  canvas->frame_requested = false;
+  canvas->pending_resize.type = EVENT_NULL;
+  canvas->pending_cursor.type = EVENT_NULL;
+  canvas->stats = NULL;
+  canvas->picture = NULL;
+  canvas->render = NULL;
+  canvas->present_pending = false;
+  canvas->present_requested = false;
 
   canvas->id = backend_next_id();
 
@@ -222,6 +238,21 @@ canvas_create_offscreen_from_png(
                                  0, 0, pixmap.width, pixmap.height, &pixmap);
 }
 
+canvas_t *
+canvas_create_offscreen_from_snapshot(
+  const char *filename) // as UTF-8
+{
+  assert(filename != NULL);
+
+  pixmap_t pixmap = { 0 };
+  bool res = impexp_import_snapshot(&pixmap, 0, 0, filename);
+  if (res == false) {
+    return NULL;
+  }
+  return _canvas_create_internal(CANVAS_OFFSCREEN, NULL,
+                                 0, 0, pixmap.width, pixmap.height, &pixmap);
+}
+
 static void (*_canvas_destroy_callback)(canvas_t *) = NULL;
 
 void
@@ -245,6 +276,12 @@ _canvas_destroy(
     _canvas_destroy_callback(canvas);
   }
 
+#if defined HAS_X11 || defined HAS_WAYLAND || defined HAS_HEADLESS
+  if (canvas->render != NULL) {
+    unx_render_destroy(canvas->render);
+  }
+#endif
+
   backend_remove_canvas(canvas);
 
   surface_destroy(canvas->surface);
@@ -262,6 +299,14 @@ _canvas_destroy(
     pixmap_destroy(canvas->clip_region);
   }
 
+  if (canvas->stats != NULL) {
+    free(canvas->stats);
+  }
+
+  if (canvas->picture != NULL) {
+    picture_release(canvas->picture);
+  }
+
   path2d_release(canvas->path_2d);
   list_delete(canvas->state_stack);
   state_destroy(canvas->state);
@@ -341,6 +386,176 @@ canvas_get_id(
   return canvas->id;
 }
 
+bool
+canvas_get_frame_on_demand(
+  const canvas_t *canvas)
+{
+  assert(canvas != NULL);
+
+  return canvas->frame_on_demand;
+}
+
+void
+canvas_set_frame_on_demand(
+  canvas_t *canvas,
+  bool on_demand)
+{
+  assert(canvas != NULL);
+
+  canvas->frame_on_demand = on_demand;
+}
+
+void
+canvas_request_frame(
+  canvas_t *canvas)
+{
+  assert(canvas != NULL);
+
+  canvas->frame_requested = true;
+}
+
+bool
+_canvas_take_frame_internal(
+  canvas_t *canvas)
+{
+  assert(canvas != NULL);
+
+  if (canvas->frame_on_demand == false) {
+    return true;
+  }
+  bool requested = canvas->frame_requested;
+  canvas->frame_requested = false;
+  return requested;
+}
+
+void
+_canvas_begin_frame_internal(
+  canvas_t *canvas)
+{
+  assert(canvas != NULL);
+
+#if defined HAS_X11 || defined HAS_WAYLAND || defined HAS_HEADLESS
+  if (canvas->render != NULL) {
+    /* While the previous frame awaits presentation,
+       the commands of this one are held back */
+    unx_render_begin_frame(canvas->render, canvas->present_pending);
+    canvas->present_requested = false;
+  }
+#endif
+}
+
+bool
+_canvas_end_frame_internal(
+  canvas_t *canvas,
+  bool present)
+{
+  assert(canvas != NULL);
+
+  if (canvas->render == NULL) {
+    return present;
+  }
+  canvas->present_requested = present;
+  return present || canvas->present_pending;
+}
+
+static void
+_canvas_present(
+  canvas_t *canvas,
+  present_data_t *present_data)
+{
+  assert(canvas != NULL);
+  assert(canvas->surface != NULL);
+  assert(present_data != NULL);
+
+  int64_t t = stats_start(canvas->stats);
+  surface_present(canvas->surface, present_data);
+  stats_stop(canvas->stats, STATS_TIME_PRESENT, t);
+  stats_add(canvas->stats, STATS_PRESENTS, 1);
+  stats_add(canvas->stats, STATS_BYTES_UPLOADED,
+            (int64_t)canvas->width * canvas->height * 4);
+}
+
+void
+_canvas_present_internal(
+  canvas_t *canvas,
+  present_data_t *present_data)
+{
+  assert(canvas != NULL);
+  assert(present_data != NULL);
+
+#if defined HAS_X11 || defined HAS_WAYLAND || defined HAS_HEADLESS
+  if (canvas->render != NULL) {
+    /* Show the previous frame once rasterized, then let the
+       current one through; it is shown at the next present */
+    if (canvas->present_pending == true) {
+      unx_render_wait(canvas->render);
+      _canvas_present(canvas, present_data);
+    }
+    unx_render_release(canvas->render);
+    canvas->present_pending = canvas->present_requested;
+    canvas->present_requested = false;
+    return;
+  }
+#endif
+
+  _canvas_present(canvas, present_data);
+}
+
+bool
+canvas_set_stats_enabled(
+  canvas_t *canvas,
+  bool enabled)
+{
+  assert(canvas != NULL);
+
+  if ((enabled == true) && (canvas->stats == NULL)) {
+    canvas->stats = (stats_t *)calloc(1, sizeof(stats_t));
+    if (canvas->stats == NULL) {
+      return false;
+    }
+  } else if ((enabled == false) && (canvas->stats != NULL)) {
+    free(canvas->stats);
+    canvas->stats = NULL;
+  }
+
+  return true;
+}
+
+bool
+canvas_get_stats_enabled(
+  const canvas_t *canvas)
+{
+  assert(canvas != NULL);
+
+  return canvas->stats != NULL;
+}
+
+void
+canvas_get_stats(
+  const canvas_t *canvas,
+  stats_t *stats)
+{
+  assert(canvas != NULL);
+  assert(stats != NULL);
+
+  if (canvas->stats != NULL) {
+    *stats = *canvas->stats;
+  } else {
+    memset(stats, 0, sizeof(stats_t));
+  }
+}
+
+void
+canvas_reset_stats(
+  canvas_t *canvas)
+{
+  assert(canvas != NULL);
+
+  if (canvas->stats != NULL) {
+    memset(canvas->stats, 0, sizeof(stats_t));
+  }
+}
+
 pair_t(int32_t)
 canvas_get_size(
   const canvas_t *canvas)
@@ -378,6 +593,8 @@ _canvas_set_size_internal(
   assert(canvas != NULL);
   assert(canvas->surface != NULL);
 
+  canvas_sync(canvas);
+
   _canvas_reset_state(canvas);
 
   width = max(1, width);
@@ -418,6 +635,21 @@ canvas_set_size(
   _canvas_set_size_internal(canvas, width, height);
 }
 
+size_t
+canvas_get_memory_size(
+  canvas_t *canvas)
+{
+  assert(canvas != NULL);
+  assert(canvas->surface != NULL);
+
+  size_t size = surface_get_memory_size(canvas->surface);
+  if (pixmap_valid(canvas->clip_region) == true) {
+    size += (size_t)canvas->clip_region.stride *
+      canvas->clip_region.height * sizeof(color_t_);
+  }
+  return size;
+}
+
 pair_t(int32_t)
 canvas_get_position(
   const canvas_t *canvas)
@@ -466,6 +698,9 @@ canvas_save(
     return false;
   }
   canvas->state = s;
+  if (canvas->picture != NULL) {
+    picture_add_save(canvas->picture);
+  }
   return true;
 }
 
@@ -485,6 +720,9 @@ canvas_restore(
       pixmap_destroy(canvas->clip_region);
     }
     canvas->clip_region_dirty = !list_is_empty(canvas->state->clip_path);
+    if (canvas->picture != NULL) {
+      picture_add_restore(canvas->picture);
+    }
   }
 }
 
@@ -1038,6 +1276,22 @@ canvas_line_to(
   path2d_line_to(c->path_2d, x, y, c->state->transform);
 }
 
+bool
+canvas_add_points(
+  canvas_t *c,
+  const double *coords,
+  const uint8_t *moves,
+  int32_t nb_points)
+{
+  assert(c != NULL);
+  assert(c->path_2d != NULL);
+  assert(c->state != NULL);
+  assert((coords != NULL) || (nb_points == 0));
+
+  return path2d_add_points(c->path_2d, coords, moves, nb_points,
+                           c->state->transform);
+}
+
 void
 canvas_arc(
   canvas_t *c,
@@ -1159,7 +1413,8 @@ _canvas_clip_fill_instr(
                      point((double)c->width, (double)c->height));
   poly_render(&(c->clip_region), instr->poly, &bbox,
               white, 1.0, color_transparent_black, 0, 0, 0,
-              ONE_MINUS_SRC, NULL, instr->non_zero, c->state->transform);
+              ONE_MINUS_SRC, NULL, instr->non_zero, c->state->transform,
+              c->stats);
 }
 
 static bool
@@ -1205,6 +1460,44 @@ _canvas_clip_region_ensure(
 }
 
 
+/* Renders p (in device space) with the shadow, composite operation
+   and clip region of the current state, or appends it to the picture
+   being recorded; transform maps the draw style to device space */
+static void
+_canvas_render_poly(
+  canvas_t *c,
+  const polygon_t *p,
+  const rect_t *bbox,
+  draw_style_t draw_style,
+  double global_alpha,
+  bool non_zero,
+  const transform_t *transform)
+{
+  assert(c != NULL);
+  assert(c->state != NULL);
+  assert(c->surface != NULL);
+  assert(p != NULL);
+  assert(bbox != NULL);
+  assert(transform != NULL);
+
+  if (c->picture != NULL) {
+    picture_add_poly(c->picture, p, bbox, draw_style, global_alpha,
+                     c->state->shadow_color, c->state->shadow_blur,
+                     c->state->shadow_offset_x, c->state->shadow_offset_y,
+                     c->state->global_composite_operation,
+                     non_zero, transform);
+    return;
+  }
+
+  pixmap_t pm = surface_get_raw_pixmap(c->surface);
+  poly_render(&pm, p, bbox, draw_style, global_alpha,
+              c->state->shadow_color, c->state->shadow_blur,
+              c->state->shadow_offset_x, c->state->shadow_offset_y,
+              c->state->global_composite_operation,
+              &(c->clip_region), non_zero, transform, c->stats);
+}
+
+
 void
 canvas_fill(
   canvas_t *c,
@@ -1215,26 +1508,30 @@ canvas_fill(
   assert(c->state != NULL);
   assert(c->surface != NULL);
 
+  int64_t trace_t = trace_begin();
+
   _canvas_clip_region_ensure(c);
 
   // TODO: initial size according to number of primitive
   polygon_t *p = polygon_create(1024, 16);
   if (p == NULL) {
+    trace_end("canvas_fill", trace_t);
     return;
   }
 
   rect_t bbox = { 0 };
-  if (polygonize(path2d_get_path(c->path_2d), p, &bbox) == true) {
-    pixmap_t pm = surface_get_raw_pixmap(c->surface);
-    poly_render(&pm, p, &bbox,
-                c->state->fill_style, c->state->global_alpha,
-                c->state->shadow_color, c->state->shadow_blur,
-                c->state->shadow_offset_x, c->state->shadow_offset_y,
-                c->state->global_composite_operation,
-                &(c->clip_region), non_zero, c->state->transform);
+  int64_t t = stats_start(c->stats);
+  bool polygonized = polygonize(path2d_get_path(c->path_2d), p, &bbox);
+  stats_stop(c->stats, STATS_TIME_POLYGONIZE, t);
+  if (polygonized == true) {
+    _canvas_render_poly(c, p, &bbox, c->state->fill_style,
+                        c->state->global_alpha, non_zero,
+                        c->state->transform);
   }
 
   polygon_destroy(p);
+
+  trace_end("canvas_fill", trace_t);
 }
 
 void
@@ -1248,16 +1545,22 @@ canvas_fill_path(
   assert(c->surface != NULL);
   assert(path != NULL);
 
+  int64_t trace_t = trace_begin();
+
   _canvas_clip_region_ensure(c);
 
   // TODO: initial size according to number of primitive
   polygon_t *p = polygon_create(1024, 16);
   if (p == NULL) {
+    trace_end("canvas_fill_path", trace_t);
     return;
   }
 
   rect_t bbox = { 0 };
-  if (polygonize(path2d_get_path(path), p, &bbox) == true) {
+  int64_t t = stats_start(c->stats);
+  bool polygonized = polygonize(path2d_get_path(path), p, &bbox);
+  stats_stop(c->stats, STATS_TIME_POLYGONIZE, t);
+  if (polygonized == true) {
 
     // Apply transformation
     for (int i = 0; i < p->nb_points; ++i) {
@@ -1278,53 +1581,151 @@ canvas_fill_path(
     bbox.p1 = point(xmin, ymin);
     bbox.p2 = point(xmax, ymax);
 
-    pixmap_t pm = surface_get_raw_pixmap(c->surface);
-    poly_render(&pm, p, &bbox,
-                c->state->fill_style, c->state->global_alpha,
-                c->state->shadow_color, c->state->shadow_blur,
-                c->state->shadow_offset_x, c->state->shadow_offset_y,
-                c->state->global_composite_operation,
-                &(c->clip_region), non_zero, c->state->transform);
+    _canvas_render_poly(c, p, &bbox, c->state->fill_style,
+                        c->state->global_alpha, non_zero,
+                        c->state->transform);
   }
 
   polygon_destroy(p);
+
+  trace_end("canvas_fill_path", trace_t);
 }
 
-void
-canvas_stroke(
-  canvas_t *c)
+static void
+_canvas_stroke_piece(
+  const polygon_t *piece,
+  void *data)
+{
+  assert(piece != NULL);
+  assert(data != NULL);
+
+  poly_coverage_add((poly_coverage_t *)data, piece);
+}
+
+static void
+_canvas_stroke_line(
+  point_t p1,
+  point_t p2,
+  double w,
+  void *data)
+{
+  assert(data != NULL);
+
+  poly_coverage_add_line((poly_coverage_t *)data, p1, p2, w);
+}
+
+static void
+_canvas_stroke_internal(
+  canvas_t *c,
+  path_t *path,
+  bool only_linear)
 {
   assert(c != NULL);
   assert(c->state != NULL);
   assert(c->surface != NULL);
-  assert(c->path_2d != NULL);
+  assert(path != NULL);
 
   _canvas_clip_region_ensure(c);
 
   // TODO: initial size according to number of primitive
-  polygon_t *p = polygon_create(1024, 16);
-  if (p == NULL) {
+  polygon_t *tp = polygon_create(1024, 16);
+  if (tp == NULL) {
     return;
   }
 
   rect_t bbox = { 0 };
-  if (polygonize_outline(path2d_get_path(c->path_2d),
-                         c->state->line_width, p, &bbox,
-                         c->state->join_type, c->state->cap_type,
-                         c->state->miter_limit,
-                         c->state->transform, true,
-                         c->state->line_dash, c->state->line_dash_len,
-                         c->state->line_dash_offset) == true) {
-    pixmap_t pm = surface_get_raw_pixmap(c->surface);
-    poly_render(&pm, p, &bbox,
-                c->state->stroke_style, c->state->global_alpha,
-                c->state->shadow_color, c->state->shadow_blur,
-                c->state->shadow_offset_x, c->state->shadow_offset_y,
-                c->state->global_composite_operation,
-                &(c->clip_region), true, c->state->transform);
+  int64_t t = stats_start(c->stats);
+  bool polygonized = polygonize_stroke(path, c->state->line_width, tp, &bbox,
+                                       c->state->transform, only_linear);
+  stats_stop(c->stats, STATS_TIME_POLYGONIZE, t);
+  if (polygonized == false) {
+    polygon_destroy(tp);
+    return;
+  }
+
+  pixmap_t pm = surface_get_raw_pixmap(c->surface);
+
+  bool has_shadow =
+    (c->state->shadow_blur > 0.0 ||
+     c->state->shadow_offset_x != 0.0 || c->state->shadow_offset_y != 0.0) &&
+    c->state->global_composite_operation != COPY &&
+    c->state->shadow_color.a != 0;
+
+  // Hairlines are drawn as antialiased lines, and long polylines
+  // are rasterized piece by piece, which avoids clipping a huge
+  // outline against every scanline
+  bool hairline =
+    stroke_is_hairline(c->state->line_width, c->state->transform);
+  if ((has_shadow == false) && (c->picture == NULL) &&
+      (hairline || (tp->nb_points >= STROKE_PIECES_THRESHOLD))) {
+    poly_coverage_t *cov = poly_coverage_create(&pm, &bbox);
+    if (cov != NULL) {
+      /* Pieces are rasterized as they are emitted,
+         this counts as offsetting time */
+      t = stats_start(c->stats);
+      if (hairline) {
+        polygon_offset_hairline(tp, c->state->line_width,
+                                c->state->transform, true,
+                                c->state->line_dash, c->state->line_dash_len,
+                                c->state->line_dash_offset,
+                                _canvas_stroke_line, cov);
+      } else {
+        polygon_offset_pieces(tp, c->state->line_width,
+                              c->state->join_type, c->state->cap_type,
+                              c->state->miter_limit, c->state->transform,
+                              true, c->state->line_dash,
+                              c->state->line_dash_len,
+                              c->state->line_dash_offset,
+                              _canvas_stroke_piece, cov);
+      }
+      stats_stop(c->stats, STATS_TIME_OFFSET, t);
+      poly_coverage_render(&pm, cov,
+                           c->state->stroke_style, c->state->global_alpha,
+                           c->state->global_composite_operation,
+                           &(c->clip_region), c->state->transform,
+                           c->stats);
+      poly_coverage_destroy(cov);
+      polygon_destroy(tp);
+      return;
+    }
+  }
+
+  polygon_t *p = polygon_create(1024, 16);
+  if (p == NULL) {
+    polygon_destroy(tp);
+    return;
   }
 
+  t = stats_start(c->stats);
+  polygon_offset(tp, p, c->state->line_width,
+                 c->state->join_type, c->state->cap_type,
+                 c->state->miter_limit, c->state->transform, true,
+                 c->state->line_dash, c->state->line_dash_len,
+                 c->state->line_dash_offset);
+  stats_stop(c->stats, STATS_TIME_OFFSET, t);
+
+  _canvas_render_poly(c, p, &bbox, c->state->stroke_style,
+                      c->state->global_alpha, true,
+                      c->state->transform);
+
   polygon_destroy(p);
+  polygon_destroy(tp);
+}
+
+void
+canvas_stroke(
+  canvas_t *c)
+{
+  assert(c != NULL);
+  assert(c->state != NULL);
+  assert(c->surface != NULL);
+  assert(c->path_2d != NULL);
+
+  int64_t trace_t = trace_begin();
+
+  _canvas_stroke_internal(c, path2d_get_path(c->path_2d), true);
+
+  trace_end("canvas_stroke", trace_t);
 }
 
 void
@@ -1337,32 +1738,11 @@ canvas_stroke_path(
   assert(c->surface != NULL);
   assert(path != NULL);
 
-  _canvas_clip_region_ensure(c);
-
-  // TODO: initial size according to number of primitive
-  polygon_t *p = polygon_create(1024, 16);
-  if (p == NULL) {
-    return;
-  }
+  int64_t trace_t = trace_begin();
 
-  rect_t bbox = { 0 };
-  if (polygonize_outline(path2d_get_path(path),
-                         c->state->line_width, p, &bbox,
-                         c->state->join_type, c->state->cap_type,
-                         c->state->miter_limit,
-                         c->state->transform, false,
-                         c->state->line_dash, c->state->line_dash_len,
-                         c->state->line_dash_offset) == true) {
-    pixmap_t pm = surface_get_raw_pixmap(c->surface);
-    poly_render(&pm, p, &bbox,
-                c->state->stroke_style, c->state->global_alpha,
-                c->state->shadow_color, c->state->shadow_blur,
-                c->state->shadow_offset_x, c->state->shadow_offset_y,
-                c->state->global_composite_operation,
-                &(c->clip_region), true, c->state->transform);
-  }
+  _canvas_stroke_internal(c, path2d_get_path(path), false);
 
-  polygon_destroy(p);
+  trace_end("canvas_stroke_path", trace_t);
 }
 
 void
@@ -1384,6 +1764,9 @@ canvas_clip(
   rect_t bbox = { 0 };
   if (polygonize(path2d_get_path(c->path_2d), p, &bbox) == true) {
     list_push(c->state->clip_path, path_fill_instr_create(p, non_zero));
+    if (c->picture != NULL) {
+      picture_add_clip(c->picture, p, non_zero);
+    }
   }
 
   polygon_destroy(p);
@@ -1413,6 +1796,9 @@ canvas_clip_path(
       transform_apply(c->state->transform, &(p->points[i]));
     }
     list_push(c->state->clip_path, path_fill_instr_create(p, non_zero));
+    if (c->picture != NULL) {
+      picture_add_clip(c->picture, p, non_zero);
+    }
   }
 
   polygon_destroy(p);
@@ -1476,23 +1862,24 @@ canvas_fill_rect(
   assert(c != NULL);
   assert(c->state != NULL);
 
+  int64_t trace_t = trace_begin();
+
   _canvas_clip_region_ensure(c);
 
   rect_t bbox = { 0 };
   polygon_t *p = _canvas_build_rect(c, x, y, width, height, &bbox);
   if (p == NULL) {
+    trace_end("canvas_fill_rect", trace_t);
     return;
   }
 
-  pixmap_t pm = surface_get_raw_pixmap(c->surface);
-  poly_render(&pm, p, &bbox,
-              c->state->fill_style, c->state->global_alpha,
-              c->state->shadow_color, c->state->shadow_blur,
-              c->state->shadow_offset_x, c->state->shadow_offset_y,
-              c->state->global_composite_operation,
-              &(c->clip_region), false, c->state->transform);
+  _canvas_render_poly(c, p, &bbox, c->state->fill_style,
+                      c->state->global_alpha, false,
+                      c->state->transform);
 
   polygon_destroy(p);
+
+  trace_end("canvas_fill_rect", trace_t);
 }
 
 void
@@ -1506,11 +1893,14 @@ canvas_stroke_rect(
   assert(c != NULL);
   assert(c->state != NULL);
 
+  int64_t trace_t = trace_begin();
+
   _canvas_clip_region_ensure(c);
 
   rect_t bbox = { 0 };
   polygon_t *p = _canvas_build_rect(c, x, y, width, height, &bbox);
   if (p == NULL) {
+    trace_end("canvas_stroke_rect", trace_t);
     return;
   }
 
@@ -1521,24 +1911,25 @@ canvas_stroke_rect(
   polygon_t *tp = polygon_create(16, 1);
   if (p == NULL) {
     polygon_destroy(p);
+    trace_end("canvas_stroke_rect", trace_t);
     return;
   }
 
+  int64_t t = stats_start(c->stats);
   polygon_offset(p, tp, c->state->line_width, JOIN_ROUND, CAP_BUTT,
                  c->state->miter_limit,
                  c->state->transform, true, c->state->line_dash,
                  c->state->line_dash_len, c->state->line_dash_offset);
+  stats_stop(c->stats, STATS_TIME_OFFSET, t);
 
-  pixmap_t pm = surface_get_raw_pixmap(c->surface);
-  poly_render(&pm, tp, &bbox,
-              c->state->stroke_style, c->state->global_alpha,
-              c->state->shadow_color, c->state->shadow_blur,
-              c->state->shadow_offset_x, c->state->shadow_offset_y,
-              c->state->global_composite_operation,
-              &(c->clip_region), true, c->state->transform);
+  _canvas_render_poly(c, tp, &bbox, c->state->stroke_style,
+                      c->state->global_alpha, true,
+                      c->state->transform);
 
   polygon_destroy(tp);
   polygon_destroy(p);
+
+  trace_end("canvas_stroke_rect", trace_t);
 }
 
 static bool
@@ -1573,6 +1964,8 @@ canvas_fill_text(
   assert(c->state != NULL);
   assert(text != NULL);
 
+  int64_t trace_t = trace_begin();
+
 /*
   double sx, sy;
   transform_extract_scale(c->state->transform, &sx, &sy);
@@ -1584,11 +1977,13 @@ canvas_fill_text(
   _canvas_clip_region_ensure(c);
 
   if (_canvas_prepare_font(c) == false) {
+    trace_end("canvas_fill_text", trace_t);
     return;
   }
 
   polygon_t *p = polygon_create(256, 8);
   if (p == NULL) {
+    trace_end("canvas_fill_text", trace_t);
     return;
   }
 
@@ -1599,17 +1994,16 @@ canvas_fill_text(
     rect_t bbox = { 0 };
     if (font_char_as_poly(c->font, c->state->transform,
                           chr, &pen, p, &bbox) == true) {
-      pixmap_t pm = surface_get_raw_pixmap(c->surface);
-      poly_render(&pm, p, &bbox,
-                  c->state->fill_style, c->state->global_alpha,
-                  c->state->shadow_color, c->state->shadow_blur,
-                  c->state->shadow_offset_x, c->state->shadow_offset_y,
-                  c->state->global_composite_operation,
-                  &(c->clip_region), true, c->state->transform);
+      stats_add(c->stats, STATS_GLYPHS, 1);
+      _canvas_render_poly(c, p, &bbox, c->state->fill_style,
+                          c->state->global_alpha, true,
+                          c->state->transform);
     }
   }
 
   polygon_destroy(p);
+
+  trace_end("canvas_fill_text", trace_t);
 }
 
 void
@@ -1624,14 +2018,18 @@ canvas_stroke_text(
   assert(c->state != NULL);
   assert(text != NULL);
 
+  int64_t trace_t = trace_begin();
+
   _canvas_clip_region_ensure(c);
 
   if (_canvas_prepare_font(c) == false) {
+    trace_end("canvas_stroke_text", trace_t);
     return;
   }
 
   polygon_t *p = polygon_create(256, 8);
   if (p == NULL) {
+    trace_end("canvas_stroke_text", trace_t);
     return;
   }
 
@@ -1643,126 +2041,618 @@ canvas_stroke_text(
     if (font_char_as_poly_outline(c->font, c->state->transform,
                                   chr, c->state->line_width,
                                   &pen, p, &bbox) == true) {
-      pixmap_t pm = surface_get_raw_pixmap(c->surface);
-      poly_render(&pm, p, &bbox,
-                  c->state->stroke_style, c->state->global_alpha,
-                  c->state->shadow_color, c->state->shadow_blur,
-                  c->state->shadow_offset_x, c->state->shadow_offset_y,
-                  c->state->global_composite_operation,
-                  &(c->clip_region), true, c->state->transform);
+      stats_add(c->stats, STATS_GLYPHS, 1);
+      _canvas_render_poly(c, p, &bbox, c->state->stroke_style,
+                          c->state->global_alpha, true,
+                          c->state->transform);
     }
   }
 
   polygon_destroy(p);
+
+  trace_end("canvas_stroke_text", trace_t);
 }
 
-void
-canvas_blit(
+/* Composites an area of sp onto dp, pixel for pixel, row by row */
+static void
+_canvas_blit_pixels(
   canvas_t *dc,
+  pixmap_t *dp,
   int32_t dx,
   int32_t dy,
-  const canvas_t *sc,
+  const pixmap_t *sp,
   int32_t sx,
   int32_t sy,
   int32_t width,
-  int32_t height)
+  int32_t height,
+  int32_t alpha)
 {
   assert(dc != NULL);
-  assert(dc->surface != NULL);
-  assert(sc != NULL);
-  assert(sc->surface != NULL);
+  assert(dp != NULL);
+  assert(sp != NULL);
 
-  bool draw_shadows =
-    (dc->state->shadow_blur > 0.0 ||
-     dc->state->shadow_offset_x != 0.0 ||
-     dc->state->shadow_offset_y != 0.0) &&
-    dc->state->global_composite_operation != COPY &&
-    dc->state->shadow_color.a != 0;
+  adjust_blit_info(dp->width, dp->height, dx, dy,
+                   sp->width, sp->height, sx, sy,
+                   width, height);
+  if ((width <= 0) || (height <= 0)) {
+    return;
+  }
 
-  const pixmap_t sp = surface_get_raw_pixmap((surface_t *)sc->surface);
+  bool clip = pixmap_valid(dc->clip_region);
+  composite_operation_t op = dc->state->global_composite_operation;
+
+  for (int32_t i = 0; i < height; ++i) {
+    const color_t_ *srow = &pixmap_at(*sp, sy + i, sx);
+    color_t_ *drow = &pixmap_at(*dp, dy + i, dx);
+    const color_t_ *crow =
+      clip ? &pixmap_at(dc->clip_region, dy + i, dx) : NULL;
+    for (int32_t j = 0; j < width; ++j) {
+      int draw_alpha = srow[j].a;
+      if (alpha != 255) {
+        draw_alpha = draw_alpha * alpha / 255;
+      }
+      if (crow != NULL) {
+        draw_alpha = draw_alpha * (255 - crow[j].a) / 255;
+      }
+      /* Sprites are mostly made of fully opaque or transparent
+         pixels, which source-over copies or leaves untouched */
+      if (op == SOURCE_OVER) {
+        if (draw_alpha == 255) {
+          drow[j] = srow[j];
+        } else if (draw_alpha != 0) {
+          drow[j] = comp_source_over(srow[j], drow[j], draw_alpha);
+        }
+      } else {
+        drow[j] = comp_compose(srow[j], drow[j], draw_alpha, op);
+      }
+    }
+  }
+}
+
+/* Renders the (sx,sy,sw,sh) area of sp onto the (dx,dy,dw,dh) area
+   of dc, through the transform t (which maps destination coordinates
+   to device coordinates), with interpolation; p is a scratch polygon */
+static void
+_canvas_blit_transformed(
+  canvas_t *dc,
+  const pixmap_t *sp,
+  polygon_t *p,
+  const transform_t *t,
+  double sx,
+  double sy,
+  double sw,
+  double sh,
+  double dx,
+  double dy,
+  double dw,
+  double dh,
+  double alpha)
+{
+  assert(dc != NULL);
+  assert(sp != NULL);
+  assert(p != NULL);
+  assert(t != NULL);
+
+  draw_style_t draw_style = (draw_style_t){ .type = DRAW_STYLE_PIXMAP,
+                                            .content.pixmap = sp };
+
+  point_t p1 = point(dx, dy);
+  point_t p2 = point(dx + dw, dy);
+  point_t p3 = point(dx + dw, dy + dh);
+  point_t p4 = point(dx, dy + dh);
+
+  transform_apply(t, &p1);
+  transform_apply(t, &p2);
+  transform_apply(t, &p3);
+  transform_apply(t, &p4);
+
+  polygon_reset(p);
+  polygon_add_point(p, p1);
+  polygon_add_point(p, p2);
+  polygon_add_point(p, p3);
+  polygon_add_point(p, p4);
+  polygon_end_subpoly(p, true);
+
+  rect_t bbox = rect(point(min4(p1.x, p2.x, p3.x, p4.x),
+                           min4(p1.y, p2.y, p3.y, p4.y)),
+                     point(max4(p1.x, p2.x, p3.x, p4.x),
+                           max4(p1.y, p2.y, p3.y, p4.y)));
+
+  /* Maps source pixels to device pixels */
+  transform_t st = *t;
+  transform_translate(&st, dx, dy);
+  transform_scale(&st, dw / sw, dh / sh);
+  transform_translate(&st, -sx, -sy);
+
+  /* Pictures only keep the source area (plus a margin
+     for interpolation), so they get a view on it */
+  pixmap_t view = pixmap_null();
+  if (dc->picture != NULL) {
+    int32_t x1 = max(0, (int32_t)floor(sx) - 1);
+    int32_t y1 = max(0, (int32_t)floor(sy) - 1);
+    int32_t x2 = min(sp->width, (int32_t)ceil(sx + sw) + 1);
+    int32_t y2 = min(sp->height, (int32_t)ceil(sy + sh) + 1);
+    if ((x2 <= x1) || (y2 <= y1)) {
+      return;
+    }
+    view = pixmap_sub(sp, x1, y1, x2 - x1, y2 - y1);
+    draw_style.content.pixmap = &view;
+    transform_translate(&st, (double)x1, (double)y1);
+  }
+
+  _canvas_render_poly(dc, p, &bbox, draw_style, alpha, false, &st);
+}
+
+static bool
+_canvas_draws_shadows(
+  const canvas_t *c)
+{
+  assert(c != NULL);
+
+  return (c->state->shadow_blur > 0.0 ||
+          c->state->shadow_offset_x != 0.0 ||
+          c->state->shadow_offset_y != 0.0) &&
+         c->state->global_composite_operation != COPY &&
+         c->state->shadow_color.a != 0;
+}
+
+void
+canvas_blit(
+  canvas_t *dc,
+  int32_t dx,
+  int32_t dy,
+  const canvas_t *sc,
+  int32_t sx,
+  int32_t sy,
+  int32_t width,
+  int32_t height)
+{
+  assert(dc != NULL);
+  assert(dc->surface != NULL);
+  assert(sc != NULL);
+  assert(sc->surface != NULL);
+
+  int64_t trace_t = trace_begin();
+
+  const pixmap_t sp = surface_get_raw_pixmap((surface_t *)sc->surface);
   pixmap_t dp = surface_get_raw_pixmap(dc->surface);
 
   if ((transform_is_pure_translation(dc->state->transform) == true) &&
-      (draw_shadows == false)) {
+      (_canvas_draws_shadows(dc) == false) && (dc->picture == NULL)) {
 
     double tx = 0.0, ty = 0.0;
     transform_extract_translation(dc->state->transform, &tx, &ty);
 
-    int32_t lo_x = max(dx + (int32_t)tx, 0);
-    int32_t hi_x = min(dx + (int32_t)tx + width, dc->width);
-    int32_t lo_y = max(dy + (int32_t)ty, 0);
-    int32_t hi_y = min(dy + (int32_t)ty + height, dc->height);
+    _canvas_blit_pixels(dc, &dp, dx + (int32_t)tx, dy + (int32_t)ty,
+                        &sp, sx, sy, width, height, 255);
 
-    for (int32_t i = lo_x; i < hi_x; i++) {
-      for (int32_t j = lo_y; j < hi_y; j++) {
+  } else {
 
-        int32_t uvx = i + sx - dx - (int32_t)tx;
-        int32_t uvy = j + sy - dy - (int32_t)ty;
-        if (uvx < 0 || uvx >= sc->width ||
-            uvy < 0 || uvy >= sc->height) {
-          continue;
-        }
+    polygon_t *p = polygon_create(8, 1);
+    if (p == NULL) {
+      trace_end("canvas_blit", trace_t);
+      return;
+    }
 
-        color_t_ fill_color = pixmap_at(sp, uvy, uvx);
-        int draw_alpha = fill_color.a;
-        if (pixmap_valid(dc->clip_region) == true) {
-          draw_alpha *= 255 - pixmap_at(dc->clip_region, j, i).a;
-          draw_alpha /= 255;
-        }
+    _canvas_blit_transformed(dc, &sp, p, dc->state->transform,
+                             (double)sx, (double)sy,
+                             (double)width, (double)height,
+                             (double)dx, (double)dy,
+                             (double)width, (double)height,
+                             dc->state->global_alpha);
+
+    polygon_destroy(p);
+  }
+
+  trace_end("canvas_blit", trace_t);
+}
+
+static int
+_canvas_sprite_compare(
+  const void *s1,
+  const void *s2)
+{
+  const canvas_sprite_t *sp1 = (const canvas_sprite_t *)s1;
+  const canvas_sprite_t *sp2 = (const canvas_sprite_t *)s2;
+
+  if (sp1->sy != sp2->sy) {
+    return (sp1->sy < sp2->sy) ? -1 : 1;
+  }
+  if (sp1->sx != sp2->sx) {
+    return (sp1->sx < sp2->sx) ? -1 : 1;
+  }
+  return 0;
+}
+
+static bool
+_canvas_is_integral(
+  double d)
+{
+  return (d == floor(d)) && (fabs(d) < (double)INT32_MAX);
+}
+
+void
+canvas_blit_batch(
+  canvas_t *dc,
+  const canvas_t *sc,
+  canvas_sprite_t *sprites,
+  int32_t count,
+  bool reorder)
+{
+  assert(dc != NULL);
+  assert(dc->surface != NULL);
+  assert(sc != NULL);
+  assert(sc->surface != NULL);
+  assert((sprites != NULL) || (count == 0));
+  assert(count >= 0);
+
+  int64_t trace_t = trace_begin();
+
+  if (count == 0) {
+    trace_end("canvas_blit_batch", trace_t);
+    return;
+  }
+
+  if (reorder == true) {
+    qsort(sprites, count, sizeof(canvas_sprite_t), _canvas_sprite_compare);
+  }
+
+  const pixmap_t sp = surface_get_raw_pixmap((surface_t *)sc->surface);
+  pixmap_t dp = surface_get_raw_pixmap(dc->surface);
+
+  bool fast = (transform_is_pure_translation(dc->state->transform) == true) &&
+              (_canvas_draws_shadows(dc) == false) && (dc->picture == NULL);
+
+  double tx = 0.0, ty = 0.0;
+  transform_extract_translation(dc->state->transform, &tx, &ty);
 
-        pixmap_at(dp, j, i) =
-          comp_compose(fill_color, pixmap_at(dp, j, i), draw_alpha,
-                       dc->state->global_composite_operation);
+  polygon_t *p = NULL;
+
+  for (int32_t k = 0; k < count; ++k) {
+
+    const canvas_sprite_t *s = &sprites[k];
+
+    if ((s->sw <= 0.0) || (s->sh <= 0.0) ||
+        (s->dw <= 0.0) || (s->dh <= 0.0) || (s->alpha <= 0.0)) {
+      continue;
+    }
+
+    double alpha = dc->state->global_alpha * min(s->alpha, 1.0);
+
+    /* Unscaled sprites at whole pixel positions are simply copied */
+    if ((fast == true) &&
+        (transform_is_pure_translation(&s->transform) == true) &&
+        (s->sw == s->dw) && (s->sh == s->dh)) {
+      double x = s->dx + s->transform.e + tx;
+      double y = s->dy + s->transform.f + ty;
+      if (_canvas_is_integral(x) && _canvas_is_integral(y) &&
+          _canvas_is_integral(s->sx) && _canvas_is_integral(s->sy) &&
+          _canvas_is_integral(s->sw) && _canvas_is_integral(s->sh)) {
+        _canvas_blit_pixels(dc, &dp, (int32_t)x, (int32_t)y,
+                            &sp, (int32_t)s->sx, (int32_t)s->sy,
+                            (int32_t)s->sw, (int32_t)s->sh,
+                            (int32_t)(alpha * 255.0 + 0.5));
+        continue;
       }
     }
 
-  } else {
+    if (p == NULL) {
+      p = polygon_create(8, 1);
+      if (p == NULL) {
+        trace_end("canvas_blit_batch", trace_t);
+        return;
+      }
+    }
 
-    draw_style_t draw_style = (draw_style_t){ .type = DRAW_STYLE_PIXMAP,
-                                              .content.pixmap = &sp };
+    transform_t t = *dc->state->transform;
+    transform_mul(&t, &s->transform);
 
-    polygon_t *p = polygon_create(8, 1);
+    _canvas_blit_transformed(dc, &sp, p, &t,
+                             s->sx, s->sy, s->sw, s->sh,
+                             s->dx, s->dy, s->dw, s->dh, alpha);
+  }
+
+  if (p != NULL) {
+    polygon_destroy(p);
+  }
+
+  trace_end("canvas_blit_batch", trace_t);
+}
+
+
+
+/* Render thread */
+
+bool
+canvas_set_threaded(
+  canvas_t *canvas,
+  bool threaded)
+{
+  assert(canvas != NULL);
+
+#if defined HAS_X11 || defined HAS_WAYLAND || defined HAS_HEADLESS
+  if ((threaded == true) && (canvas->render == NULL)) {
+    canvas->render = unx_render_create(canvas);
+    canvas->present_pending = false;
+    canvas->present_requested = false;
+    return canvas->render != NULL;
+  } else if ((threaded == false) && (canvas->render != NULL)) {
+    canvas_sync(canvas);
+    unx_render_destroy(canvas->render);
+    canvas->render = NULL;
+  }
+  return true;
+#else
+  return threaded == false;
+#endif
+}
+
+bool
+canvas_get_threaded(
+  const canvas_t *canvas)
+{
+  assert(canvas != NULL);
+
+  return canvas->render != NULL;
+}
+
+bool
+canvas_submit(
+  canvas_t *canvas,
+  const double *data,
+  size_t len)
+{
+  assert(canvas != NULL);
+  assert((data != NULL) || (len == 0));
+
+#if defined HAS_X11 || defined HAS_WAYLAND || defined HAS_HEADLESS
+  if (canvas->render != NULL) {
+    return unx_render_submit(canvas->render, data, len);
+  }
+#endif
+
+  return command_execute(canvas, data, len);
+}
+
+void
+canvas_sync(
+  canvas_t *canvas)
+{
+  assert(canvas != NULL);
+
+#if defined HAS_X11 || defined HAS_WAYLAND || defined HAS_HEADLESS
+  if (canvas->render == NULL) {
+    return;
+  }
+
+  /* Present the pending frame before letting the current
+     one through, so that it does not show any of the latter */
+  if (canvas->present_pending == true) {
+    unx_render_wait(canvas->render);
+    if (canvas->window != NULL) {
+      present_data_t pd;
+      memset((void *)&pd, 0, sizeof(present_data_t));
+      _canvas_present(canvas, &pd);
+    }
+    canvas->present_pending = false;
+  }
+
+  unx_render_release(canvas->render);
+  unx_render_wait(canvas->render);
+#endif
+}
+
+
+
+/* Pictures */
+
+bool
+canvas_begin_picture(
+  canvas_t *c)
+{
+  assert(c != NULL);
+
+  if (c->picture != NULL) {
+    return false;
+  }
+
+  c->picture = picture_create();
+
+  return c->picture != NULL;
+}
+
+picture_t *
+canvas_end_picture(
+  canvas_t *c)
+{
+  assert(c != NULL);
+
+  picture_t *pic = c->picture;
+  c->picture = NULL;
+
+  return pic;
+}
+
+/* Copies the points of src, mapped through t, into dst */
+static void
+_canvas_transform_poly(
+  const polygon_t *src,
+  polygon_t *dst,
+  const transform_t *t)
+{
+  assert(src != NULL);
+  assert(dst != NULL);
+  assert(t != NULL);
+
+  polygon_reset(dst);
+  for (int32_t i = 0; i < src->nb_subpolys; ++i) {
+    int32_t j = (i == 0) ? 0 : src->subpolys[i - 1] + 1;
+    for (; j <= src->subpolys[i]; ++j) {
+      polygon_add_point(dst, transform_apply_new(t, &src->points[j]));
+    }
+    polygon_end_subpoly(dst, src->subpoly_closed[i]);
+  }
+}
+
+static rect_t
+_canvas_transform_bbox(
+  const rect_t *bbox,
+  const transform_t *t)
+{
+  assert(bbox != NULL);
+  assert(t != NULL);
+
+  point_t p1 = transform_apply_new(t, &bbox->p1);
+  point_t p2 = transform_apply_new(t, &bbox->p2);
+  point_t bp3 = point(bbox->p2.x, bbox->p1.y);
+  point_t bp4 = point(bbox->p1.x, bbox->p2.y);
+  point_t p3 = transform_apply_new(t, &bp3);
+  point_t p4 = transform_apply_new(t, &bp4);
+
+  return rect(point(min4(p1.x, p2.x, p3.x, p4.x),
+                    min4(p1.y, p2.y, p3.y, p4.y)),
+              point(max4(p1.x, p2.x, p3.x, p4.x),
+                    max4(p1.y, p2.y, p3.y, p4.y)));
+}
+
+void
+canvas_draw_picture(
+  canvas_t *c,
+  const picture_t *pic,
+  const transform_t *t)
+{
+  assert(c != NULL);
+  assert(c->state != NULL);
+  assert(c->surface != NULL);
+  assert(pic != NULL);
+
+  int64_t trace_t = trace_begin();
+
+  /* Recording a picture into itself would never end */
+  if (pic == c->picture) {
+    trace_end("canvas_draw_picture", trace_t);
+    return;
+  }
+
+  /* Maps picture space to device space */
+  transform_t pt = *c->state->transform;
+  if (t != NULL) {
+    transform_mul(&pt, t);
+  }
+  bool identity = transform_is_identity(&pt);
+
+  polygon_t *p = NULL;
+  if (identity == false) {
+    p = polygon_create(1024, 16);
     if (p == NULL) {
+      trace_end("canvas_draw_picture", trace_t);
       return;
     }
+  }
+
+  /* Recorded clips only last for the duration of the picture,
+     so they are applied to a saved state */
+  double global_alpha = c->state->global_alpha;
+  int32_t depth = 0;
+  bool saved = false;
+  if (pic->has_clip == true) {
+    saved = canvas_save(c);
+    if (saved == false) {
+      if (p != NULL) {
+        polygon_destroy(p);
+      }
+      trace_end("canvas_draw_picture", trace_t);
+      return;
+    }
+  }
+
+  for (int32_t i = 0; i < pic->nb_items; ++i) {
+
+    const picture_item_t *item = &pic->items[i];
+    const polygon_t *ip = item->poly;
+    if ((ip != NULL) && (identity == false)) {
+      _canvas_transform_poly(item->poly, p, &pt);
+      ip = p;
+    }
+
+    switch (item->type) {
+
+      case PICTURE_ITEM_POLY: {
+        _canvas_clip_region_ensure(c);
+        rect_t bbox = item->bbox;
+        transform_t st = item->transform;
+        if (identity == false) {
+          bbox = _canvas_transform_bbox(&item->bbox, &pt);
+          st = pt;
+          transform_mul(&st, &item->transform);
+        }
+        draw_style_t draw_style = item->draw_style;
+        if (draw_style.type == DRAW_STYLE_PIXMAP) {
+          draw_style.content.pixmap = &item->image;
+        }
+        /* Shadows are not affected by the transform, as usual */
+        if (c->picture != NULL) {
+          picture_add_poly(c->picture, ip, &bbox, draw_style,
+                           item->global_alpha * global_alpha,
+                           item->shadow_color, item->shadow_blur,
+                           item->shadow_offset_x, item->shadow_offset_y,
+                           item->op, item->non_zero, &st);
+        } else {
+          pixmap_t pm = surface_get_raw_pixmap(c->surface);
+          poly_render(&pm, ip, &bbox, draw_style,
+                      item->global_alpha * global_alpha,
+                      item->shadow_color, item->shadow_blur,
+                      item->shadow_offset_x, item->shadow_offset_y,
+                      item->op, &(c->clip_region), item->non_zero, &st,
+                      c->stats);
+        }
+        break;
+      }
+
+      case PICTURE_ITEM_CLIP:
+        list_push(c->state->clip_path,
+                  path_fill_instr_create(ip, item->non_zero));
+        c->clip_region_dirty = true;
+        if (c->picture != NULL) {
+          picture_add_clip(c->picture, ip, item->non_zero);
+        }
+        break;
+
+      case PICTURE_ITEM_SAVE:
+        if ((saved == true) && (canvas_save(c) == true)) {
+          ++depth;
+        }
+        break;
+
+      case PICTURE_ITEM_RESTORE:
+        /* Unmatched restores do not reach the caller's state */
+        if (depth > 0) {
+          canvas_restore(c);
+          --depth;
+        }
+        break;
+
+      default:
+        assert(!"Invalid picture item");
+        break;
+    }
+  }
 
-    point_t p1 = point((double)dx, (double)dy);
-    point_t p2 = point((double)(dx + width), (double)dy);
-    point_t p3 = point((double)(dx + width), (double)(dy + height));
-    point_t p4 = point((double)dx, (double)(dy + height));
-
-    transform_apply(dc->state->transform, &p1);
-    transform_apply(dc->state->transform, &p2);
-    transform_apply(dc->state->transform, &p3);
-    transform_apply(dc->state->transform, &p4);
-
-    polygon_add_point(p, p1);
-    polygon_add_point(p, p2);
-    polygon_add_point(p, p3);
-    polygon_add_point(p, p4);
-    polygon_end_subpoly(p, true);
-
-    rect_t bbox = rect(point(min4(p1.x, p2.x, p3.x, p4.x),
-                             min4(p1.y, p2.y, p3.y, p4.y)),
-                       point(max4(p1.x, p2.x, p3.x, p4.x),
-                             max4(p1.y, p2.y, p3.y, p4.y)));
-
-    transform_t *temp_transform = transform_copy(dc->state->transform);
-    transform_translate(temp_transform, dx - sx, dy - sy);
-
-    pixmap_t pm = surface_get_raw_pixmap((surface_t *)dc->surface);
-    poly_render(&pm, p, &bbox,
-                draw_style, dc->state->global_alpha,
-                dc->state->shadow_color, dc->state->shadow_blur,
-                dc->state->shadow_offset_x, dc->state->shadow_offset_y,
-                dc->state->global_composite_operation,
-                &(dc->clip_region), false, temp_transform);
+  if (saved == true) {
+    for (; depth >= 0; --depth) {
+      canvas_restore(c);
+    }
+  }
 
+  if (p != NULL) {
     polygon_destroy(p);
-    transform_destroy(temp_transform);
   }
+
+  trace_end("canvas_draw_picture", trace_t);
 }
 
+
+
 /* Direct pixel access */
 
 color_t_
@@ -1844,10 +2734,27 @@ canvas_put_pixmap(
   assert(sp != NULL);
   assert(pixmap_valid(*sp) == true);
 
+  int64_t trace_t = trace_begin();
+
   pixmap_t dp = surface_get_raw_pixmap(c->surface);
   if (pixmap_valid(dp) == true) {
     pixmap_blit(&dp, dx, dy, sp, sx, sy, width, height);
   }
+
+  trace_end("canvas_put_pixmap", trace_t);
+}
+
+pixmap_t
+canvas_get_raw_pixmap(
+  canvas_t *c)
+{
+  assert(c != NULL);
+  assert(c->surface != NULL);
+
+  if (surface_set_compact(c->surface) == false) {
+    return pixmap_null();
+  }
+  return surface_get_raw_pixmap(c->surface);
 }
 
 /* Import / export functions */
@@ -1855,7 +2762,8 @@ canvas_put_pixmap(
 bool
 canvas_export_png(
   const canvas_t *c,
-  const char *filename) // as UTF-8
+  const char *filename, // as UTF-8
+  const impexp_png_options_t *options)
 {
   assert(c != NULL);
   assert(c->surface != NULL);
@@ -1865,7 +2773,26 @@ canvas_export_png(
   if (pixmap_valid(pm) == false) {
     return false;
   }
-  return impexp_export_png(&pm, filename);
+  return impexp_export_png(&pm, filename, options);
+}
+
+bool
+canvas_export_png_to_memory(
+  const canvas_t *c,
+  const impexp_png_options_t *options,
+  uint8_t **data,
+  size_t *size)
+{
+  assert(c != NULL);
+  assert(c->surface != NULL);
+  assert(data != NULL);
+  assert(size != NULL);
+
+  const pixmap_t pm = surface_get_raw_pixmap((surface_t *)c->surface);
+  if (pixmap_valid(pm) == false) {
+    return false;
+  }
+  return impexp_export_png_to_memory(&pm, options, data, size);
 }
 
 bool
@@ -1885,3 +2812,37 @@ canvas_import_png(
   }
   return impexp_import_png(&pm, x, y, filename);
 }
+
+bool
+canvas_export_snapshot(
+  const canvas_t *c,
+  const char *filename) // as UTF-8
+{
+  assert(c != NULL);
+  assert(c->surface != NULL);
+  assert(filename != NULL);
+
+  const pixmap_t pm = surface_get_raw_pixmap((surface_t *)c->surface);
+  if (pixmap_valid(pm) == false) {
+    return false;
+  }
+  return impexp_export_snapshot(&pm, filename);
+}
+
+bool
+canvas_import_snapshot(
+  canvas_t *c,
+  int32_t x,
+  int32_t y,
+  const char *filename) // as UTF-8
+{
+  assert(c != NULL);
+  assert(c->surface != NULL);
+  assert(filename != NULL);
+
+  pixmap_t pm = surface_get_raw_pixmap(c->surface);
+  if (pixmap_valid(pm) == false) {
+    return false;
+  }
+  return impexp_import_snapshot(&pm, x, y, filename);
+}
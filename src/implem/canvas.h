@@ -11,6 +11,7 @@
 #ifndef __CANVAS_H
 #define __CANVAS_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -25,6 +26,10 @@
 #include "draw_style.h"
 #include "polygonize.h"
 #include "color_composition.h"
+#include "impexp.h"
+#include "stats.h"
+#include "picture.h"
+#include "present_data.h"
 
 typedef struct canvas_t canvas_t;
 
@@ -66,6 +71,10 @@ canvas_t *
 canvas_create_offscreen_from_png(
   const char *filename);
 
+canvas_t *
+canvas_create_offscreen_from_snapshot(
+  const char *filename);
+
 void
 canvas_set_destroy_callback(
   void (*callback_function)(canvas_t *));
@@ -100,6 +109,68 @@ int32_t
 canvas_get_id(
   const canvas_t *canvas);
 
+// In on-demand mode, a canvas only gets a frame event
+// after canvas_request_frame has been called
+bool
+canvas_get_frame_on_demand(
+  const canvas_t *canvas);
+
+void
+canvas_set_frame_on_demand(
+  canvas_t *canvas,
+  bool on_demand);
+
+void
+canvas_request_frame(
+  canvas_t *canvas);
+
+// Tells whether the canvas should get a frame event,
+// consuming the pending request if in on-demand mode
+bool
+_canvas_take_frame_internal(
+  canvas_t *canvas);
+
+// Called by the backend before and after delivering a frame
+// event; the latter tells whether the canvas should then be
+// presented, given whether the listener asked for it
+void
+_canvas_begin_frame_internal(
+  canvas_t *canvas);
+
+bool
+_canvas_end_frame_internal(
+  canvas_t *canvas,
+  bool present);
+
+// Presents the canvas surface; threaded canvases present
+// their previous frame, once its commands have run
+void
+_canvas_present_internal(
+  canvas_t *canvas,
+  present_data_t *present_data);
+
+// Rendering statistics are only gathered once enabled,
+// disabling them discards those gathered so far
+bool
+canvas_set_stats_enabled(
+  canvas_t *canvas,
+  bool enabled);
+
+bool
+canvas_get_stats_enabled(
+  const canvas_t *canvas);
+
+// Copies the statistics gathered since they were last
+// reset (all zero if disabled)
+void
+canvas_get_stats(
+  const canvas_t *canvas,
+  stats_t *stats);
+
+void
+canvas_reset_stats(
+  canvas_t *canvas);
+
 pair_t(int32_t)
 canvas_get_size(
   const canvas_t *canvas);
@@ -116,6 +187,12 @@ _canvas_set_size_internal(
   int32_t width,
   int32_t height);
 
+// Approximate number of bytes held by the canvas pixels
+// (its surface, and its clip region if it has one)
+size_t
+canvas_get_memory_size(
+  canvas_t *canvas);
+
 pair_t(int32_t)
 canvas_get_position(
   const canvas_t *canvas);
@@ -370,6 +447,13 @@ canvas_line_to(
   double x,
   double y);
 
+bool
+canvas_add_points(
+  canvas_t *c,
+  const double *coords,
+  const uint8_t *moves,
+  int32_t nb_points);
+
 void
 canvas_arc(
   canvas_t *c,
@@ -507,6 +591,94 @@ canvas_blit(
   int32_t width,
   int32_t height);
 
+// One element of a batched blit: the source area, the destination
+// area (the source is scaled if sizes differ), an opacity, and
+// a transform applied to the destination area before the canvas one
+typedef struct canvas_sprite_t {
+  double sx; double sy; double sw; double sh;
+  double dx; double dy; double dw; double dh;
+  double alpha;
+  transform_t transform;
+} canvas_sprite_t;
+
+// Draws many areas of sc onto dc in one go. Sprites that are neither
+// scaled nor transformed (beyond a whole pixel translation) are copied
+// pixel for pixel. If reorder is true, the caller states that the
+// drawing order does not matter (e.g. the sprites do not overlap):
+// the sprites array is then sorted by source position, so that
+// the source is read more sequentially.
+void
+canvas_blit_batch(
+  canvas_t *dc,
+  const canvas_t *sc,
+  canvas_sprite_t *sprites,
+  int32_t count,
+  bool reorder);
+
+
+
+/* Render thread */
+
+// A threaded canvas runs the submitted commands on its own thread.
+// The commands submitted during a frame event only run once the
+// previous frame has been presented, and the frame itself is
+// presented at the next frame event. Only available on Unix
+// backends; returns false otherwise, or if the thread could
+// not be started.
+bool
+canvas_set_threaded(
+  canvas_t *c,
+  bool threaded);
+
+bool
+canvas_get_threaded(
+  const canvas_t *c);
+
+// Queues the len values of data, which must be valid commands
+// (see command_validate), to be run by the render thread; runs
+// them right away if the canvas is not threaded. Returns false
+// if they could not be queued.
+bool
+canvas_submit(
+  canvas_t *c,
+  const double *data,
+  size_t len);
+
+// Waits until all the submitted commands have run, presenting
+// the frame awaiting presentation first. Must be called before
+// any other access to a threaded canvas.
+void
+canvas_sync(
+  canvas_t *c);
+
+
+
+/* Pictures */
+
+// Starts recording a picture: until canvas_end_picture, filling,
+// stroking, clipping and blitting append polygons, already flattened
+// and outlined with the current state, to the picture instead of
+// rendering them. Direct pixel access is not recorded, nor are
+// clips set before recording started. Fails if already recording.
+bool
+canvas_begin_picture(
+  canvas_t *c);
+
+// Stops recording and returns the recorded picture (with a reference
+// count of 1), or NULL if the canvas was not recording
+picture_t *
+canvas_end_picture(
+  canvas_t *c);
+
+// Replays pic onto c, through the current transform composed with t
+// (if not NULL). The recorded opacity of each polygon is multiplied
+// by the current global alpha, and the current clip region applies.
+void
+canvas_draw_picture(
+  canvas_t *c,
+  const picture_t *pic,
+  const transform_t *t);
+
 
 
 /* Direct pixel access */
@@ -545,6 +717,15 @@ canvas_put_pixmap(
   int32_t width,
   int32_t height);
 
+// Returns the surface pixels themselves, without copying them,
+// with rows made contiguous (see surface_set_compact); returns
+// a null pixmap if the surface could not be made so
+// Do not free the data pointer, it belongs to the surface
+// and is only valid until the canvas is resized or destroyed
+pixmap_t
+canvas_get_raw_pixmap(
+  canvas_t *c);
+
 
 
 /* Import / export functions */
@@ -552,7 +733,15 @@ canvas_put_pixmap(
 bool
 canvas_export_png(
   const canvas_t *c,
-  const char *filename);
+  const char *filename,
+  const impexp_png_options_t *options);
+
+bool
+canvas_export_png_to_memory(
+  const canvas_t *c,
+  const impexp_png_options_t *options,
+  uint8_t **data,
+  size_t *size);
 
 bool
 canvas_import_png(
@@ -561,4 +750,16 @@ canvas_import_png(
   int32_t y,
   const char *filename);
 
+bool
+canvas_export_snapshot(
+  const canvas_t *c,
+  const char *filename);
+
+bool
+canvas_import_snapshot(
+  canvas_t *c,
+  int32_t x,
+  int32_t y,
+  const char *filename);
+
 #endif /* __CANVAS_H */
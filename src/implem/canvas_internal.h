@@ -15,11 +15,14 @@
 
 #include "object.h"
 #include "list.h"
+#include "event.h"
+#include "stats.h"
 #include "window.h"
 #include "surface.h"
 #include "state.h"
 #include "font.h"
 #include "path2d.h"
+#include "picture.h"
 #include "canvas.h"
 
 typedef struct canvas_t {
@@ -34,6 +37,15 @@ typedef struct canvas_t {
   path2d_t *path_2d;
   pixmap_t clip_region;
   bool clip_region_dirty;
+  bool frame_on_demand;
+  bool frame_requested;
+  event_t pending_resize; // held back until the next frame
+  event_t pending_cursor; // when coalescing events
+  stats_t *stats; // NULL unless enabled
+  picture_t *picture; // NULL unless recording
+  struct unx_render_t *render; // NULL unless threaded
+  bool present_pending; // threaded: last frame not yet presented
+  bool present_requested; // threaded: current frame to present
   int32_t id;
   canvas_type_t type;
 } canvas_t;
@@ -0,0 +1,317 @@
+/**************************************************************************/
+/*                                                                        */
+/*    Copyright 2022 OCamlPro                                             */
+/*                                                                        */
+/*  All rights reserved. This file is distributed under the terms of the  */
+/*  GNU Lesser General Public License version 2.1, with the special       */
+/*  exception on linking described in the file LICENSE.                   */
+/*                                                                        */
+/**************************************************************************/
+
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#include "color.h"
+#include "transform.h"
+#include "stroke.h"
+#include "color_composition.h"
+#include "trace.h"
+#include "canvas.h"
+#include "command.h"
+
+const int command_arity[COMMAND_COUNT] = {
+  [COMMAND_SAVE]                 = 0,
+  [COMMAND_RESTORE]              = 0,
+  [COMMAND_SET_TRANSFORM]        = 6,
+  [COMMAND_TRANSFORM]            = 6,
+  [COMMAND_TRANSLATE]            = 2,
+  [COMMAND_SCALE]                = 2,
+  [COMMAND_SHEAR]                = 2,
+  [COMMAND_ROTATE]               = 1,
+  [COMMAND_SET_LINE_WIDTH]       = 1,
+  [COMMAND_SET_JOIN_TYPE]        = 1,
+  [COMMAND_SET_CAP_TYPE]         = 1,
+  [COMMAND_SET_MITER_LIMIT]      = 1,
+  [COMMAND_SET_LINE_DASH_OFFSET] = 1,
+  [COMMAND_SET_STROKE_COLOR]     = 1,
+  [COMMAND_SET_FILL_COLOR]       = 1,
+  [COMMAND_SET_GLOBAL_ALPHA]     = 1,
+  [COMMAND_SET_COMP_OPERATION]   = 1,
+  [COMMAND_SET_SHADOW_COLOR]     = 1,
+  [COMMAND_SET_SHADOW_BLUR]      = 1,
+  [COMMAND_SET_SHADOW_OFFSET]    = 2,
+  [COMMAND_CLEAR_PATH]           = 0,
+  [COMMAND_CLOSE_PATH]           = 0,
+  [COMMAND_MOVE_TO]              = 2,
+  [COMMAND_LINE_TO]              = 2,
+  [COMMAND_ARC]                  = 6,
+  [COMMAND_ARC_TO]               = 5,
+  [COMMAND_QUADRATIC_CURVE_TO]   = 4,
+  [COMMAND_BEZIER_CURVE_TO]      = 6,
+  [COMMAND_RECT]                 = 4,
+  [COMMAND_ELLIPSE]              = 8,
+  [COMMAND_FILL]                 = 1,
+  [COMMAND_STROKE]               = 0,
+  [COMMAND_CLIP]                 = 1,
+  [COMMAND_FILL_RECT]            = 4,
+  [COMMAND_STROKE_RECT]          = 4,
+};
+
+/* Integer arguments are range-checked before conversion, as
+   converting an out-of-range double is undefined behavior;
+   the negated test also rejects NaNs */
+static bool
+_command_int(
+  double d,
+  int64_t min,
+  int64_t max,
+  int64_t *i)
+{
+  assert(i != NULL);
+
+  if (!((d >= (double)min) && (d <= (double)max))) {
+    return false;
+  }
+  *i = (int64_t)d;
+  return true;
+}
+
+static bool
+_command_color(
+  double d,
+  color_t_ *color)
+{
+  assert(color != NULL);
+
+  int64_t i = 0;
+  if (_command_int(d, INT32_MIN, UINT32_MAX, &i) == false) {
+    return false;
+  }
+  uint32_t u = (uint32_t)i;
+  *color = color_of_int(u);
+  return true;
+}
+
+bool
+command_validate(
+  const double *data,
+  size_t len)
+{
+  assert((data != NULL) || (len == 0));
+
+  size_t i = 0;
+  while (i < len) {
+
+    int64_t op = 0;
+    if ((_command_int(data[i], 0, COMMAND_COUNT - 1, &op) == false) ||
+        (len - i - 1 < (size_t)command_arity[op])) {
+      return false;
+    }
+    const double *a = data + i + 1;
+    i += 1 + command_arity[op];
+
+    int64_t n = 0;
+    color_t_ color = color_black;
+    bool ok = true;
+
+    switch ((command_op_t)op) {
+      case COMMAND_SET_JOIN_TYPE:
+        ok = _command_int(a[0], JOIN_ROUND, JOIN_BEVEL, &n);
+        break;
+      case COMMAND_SET_CAP_TYPE:
+        ok = _command_int(a[0], CAP_BUTT, CAP_ROUND, &n);
+        break;
+      case COMMAND_SET_COMP_OPERATION:
+        ok = _command_int(a[0], SOURCE_OVER, LUMINOSITY, &n);
+        break;
+      case COMMAND_SET_STROKE_COLOR:
+      case COMMAND_SET_FILL_COLOR:
+      case COMMAND_SET_SHADOW_COLOR:
+        ok = _command_color(a[0], &color);
+        break;
+      default:
+        break;
+    }
+
+    if (ok == false) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool
+command_execute(
+  canvas_t *c,
+  const double *data,
+  size_t len)
+{
+  assert(c != NULL);
+  assert((data != NULL) || (len == 0));
+
+  int64_t t = trace_begin();
+
+  bool ok = true;
+  size_t i = 0;
+  while (i < len) {
+
+    int64_t op = 0;
+    if ((_command_int(data[i], 0, COMMAND_COUNT - 1, &op) == false) ||
+        (len - i - 1 < (size_t)command_arity[op])) {
+      ok = false;
+      break;
+    }
+    const double *a = data + i + 1;
+    i += 1 + command_arity[op];
+
+    int64_t n = 0;
+    color_t_ color = color_black;
+    transform_t transform;
+
+    switch ((command_op_t)op) {
+      case COMMAND_SAVE:
+        canvas_save(c);
+        break;
+      case COMMAND_RESTORE:
+        canvas_restore(c);
+        break;
+      case COMMAND_SET_TRANSFORM:
+      case COMMAND_TRANSFORM:
+        transform = (transform_t){ .a = a[0], .b = a[1], .c = a[2],
+                                   .d = a[3], .e = a[4], .f = a[5] };
+        if (op == COMMAND_SET_TRANSFORM) {
+          canvas_set_transform(c, &transform);
+        } else {
+          canvas_transform(c, &transform);
+        }
+        break;
+      case COMMAND_TRANSLATE:
+        canvas_translate(c, a[0], a[1]);
+        break;
+      case COMMAND_SCALE:
+        canvas_scale(c, a[0], a[1]);
+        break;
+      case COMMAND_SHEAR:
+        canvas_shear(c, a[0], a[1]);
+        break;
+      case COMMAND_ROTATE:
+        canvas_rotate(c, a[0]);
+        break;
+      case COMMAND_SET_LINE_WIDTH:
+        canvas_set_line_width(c, a[0]);
+        break;
+      case COMMAND_SET_JOIN_TYPE:
+        ok = _command_int(a[0], JOIN_ROUND, JOIN_BEVEL, &n);
+        if (ok == true) {
+          canvas_set_join_type(c, (join_type_t)n);
+        }
+        break;
+      case COMMAND_SET_CAP_TYPE:
+        ok = _command_int(a[0], CAP_BUTT, CAP_ROUND, &n);
+        if (ok == true) {
+          canvas_set_cap_type(c, (cap_type_t)n);
+        }
+        break;
+      case COMMAND_SET_MITER_LIMIT:
+        canvas_set_miter_limit(c, a[0]);
+        break;
+      case COMMAND_SET_LINE_DASH_OFFSET:
+        canvas_set_line_dash_offset(c, a[0]);
+        break;
+      case COMMAND_SET_STROKE_COLOR:
+        ok = _command_color(a[0], &color);
+        if (ok == true) {
+          canvas_set_stroke_color(c, color);
+        }
+        break;
+      case COMMAND_SET_FILL_COLOR:
+        ok = _command_color(a[0], &color);
+        if (ok == true) {
+          canvas_set_fill_color(c, color);
+        }
+        break;
+      case COMMAND_SET_GLOBAL_ALPHA:
+        canvas_set_global_alpha(c, a[0]);
+        break;
+      case COMMAND_SET_COMP_OPERATION:
+        ok = _command_int(a[0], SOURCE_OVER, LUMINOSITY, &n);
+        if (ok == true) {
+          canvas_set_comp_operation(c, (composite_operation_t)n);
+        }
+        break;
+      case COMMAND_SET_SHADOW_COLOR:
+        ok = _command_color(a[0], &color);
+        if (ok == true) {
+          canvas_set_shadow_color(c, color);
+        }
+        break;
+      case COMMAND_SET_SHADOW_BLUR:
+        canvas_set_shadow_blur(c, a[0]);
+        break;
+      case COMMAND_SET_SHADOW_OFFSET:
+        canvas_set_shadow_offset(c, a[0], a[1]);
+        break;
+      case COMMAND_CLEAR_PATH:
+        canvas_clear_path(c);
+        break;
+      case COMMAND_CLOSE_PATH:
+        canvas_close_path(c);
+        break;
+      case COMMAND_MOVE_TO:
+        canvas_move_to(c, a[0], a[1]);
+        break;
+      case COMMAND_LINE_TO:
+        canvas_line_to(c, a[0], a[1]);
+        break;
+      case COMMAND_ARC:
+        canvas_arc(c, a[0], a[1], a[2], a[3], a[4], a[5] != 0.0);
+        break;
+      case COMMAND_ARC_TO:
+        canvas_arc_to(c, a[0], a[1], a[2], a[3], a[4]);
+        break;
+      case COMMAND_QUADRATIC_CURVE_TO:
+        canvas_quadratic_curve_to(c, a[0], a[1], a[2], a[3]);
+        break;
+      case COMMAND_BEZIER_CURVE_TO:
+        canvas_bezier_curve_to(c, a[0], a[1], a[2], a[3], a[4], a[5]);
+        break;
+      case COMMAND_RECT:
+        canvas_rect(c, a[0], a[1], a[2], a[3]);
+        break;
+      case COMMAND_ELLIPSE:
+        canvas_ellipse(c, a[0], a[1], a[2], a[3], a[4], a[5], a[6],
+                       a[7] != 0.0);
+        break;
+      case COMMAND_FILL:
+        canvas_fill(c, a[0] != 0.0);
+        break;
+      case COMMAND_STROKE:
+        canvas_stroke(c);
+        break;
+      case COMMAND_CLIP:
+        canvas_clip(c, a[0] != 0.0);
+        break;
+      case COMMAND_FILL_RECT:
+        canvas_fill_rect(c, a[0], a[1], a[2], a[3]);
+        break;
+      case COMMAND_STROKE_RECT:
+        canvas_stroke_rect(c, a[0], a[1], a[2], a[3]);
+        break;
+      default:
+        ok = false;
+        break;
+    }
+
+    if (ok == false) {
+      break;
+    }
+  }
+
+  trace_end("command_execute", t);
+
+  return ok;
+}
@@ -0,0 +1,81 @@
+/**************************************************************************/
+/*                                                                        */
+/*    Copyright 2022 OCamlPro                                             */
+/*                                                                        */
+/*  All rights reserved. This file is distributed under the terms of the  */
+/*  GNU Lesser General Public License version 2.1, with the special       */
+/*  exception on linking described in the file LICENSE.                   */
+/*                                                                        */
+/**************************************************************************/
+
+
+#ifndef __COMMAND_H
+#define __COMMAND_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "canvas.h"
+
+// A command buffer is a flat array of doubles, where each command is
+// an opcode followed by its arguments. Colors are stored as their
+// (signed) 32-bit integer value, booleans as 0 or 1, and join types,
+// cap types and composite operations as their enum value.
+typedef enum command_op_t {
+  COMMAND_SAVE                 = 0,  // -
+  COMMAND_RESTORE              = 1,  // -
+  COMMAND_SET_TRANSFORM        = 2,  // a b c d e f
+  COMMAND_TRANSFORM            = 3,  // a b c d e f
+  COMMAND_TRANSLATE            = 4,  // x y
+  COMMAND_SCALE                = 5,  // x y
+  COMMAND_SHEAR                = 6,  // x y
+  COMMAND_ROTATE               = 7,  // angle
+  COMMAND_SET_LINE_WIDTH       = 8,  // width
+  COMMAND_SET_JOIN_TYPE        = 9,  // join
+  COMMAND_SET_CAP_TYPE         = 10, // cap
+  COMMAND_SET_MITER_LIMIT      = 11, // limit
+  COMMAND_SET_LINE_DASH_OFFSET = 12, // offset
+  COMMAND_SET_STROKE_COLOR     = 13, // color
+  COMMAND_SET_FILL_COLOR       = 14, // color
+  COMMAND_SET_GLOBAL_ALPHA     = 15, // alpha
+  COMMAND_SET_COMP_OPERATION   = 16, // op
+  COMMAND_SET_SHADOW_COLOR     = 17, // color
+  COMMAND_SET_SHADOW_BLUR      = 18, // blur
+  COMMAND_SET_SHADOW_OFFSET    = 19, // x y
+  COMMAND_CLEAR_PATH           = 20, // -
+  COMMAND_CLOSE_PATH           = 21, // -
+  COMMAND_MOVE_TO              = 22, // x y
+  COMMAND_LINE_TO              = 23, // x y
+  COMMAND_ARC                  = 24, // x y r di df ccw
+  COMMAND_ARC_TO               = 25, // x1 y1 x2 y2 r
+  COMMAND_QUADRATIC_CURVE_TO   = 26, // cpx cpy x y
+  COMMAND_BEZIER_CURVE_TO      = 27, // cp1x cp1y cp2x cp2y x y
+  COMMAND_RECT                 = 28, // x y w h
+  COMMAND_ELLIPSE              = 29, // x y rx ry r di df ccw
+  COMMAND_FILL                 = 30, // non_zero
+  COMMAND_STROKE               = 31, // -
+  COMMAND_CLIP                 = 32, // non_zero
+  COMMAND_FILL_RECT            = 33, // x y w h
+  COMMAND_STROKE_RECT          = 34, // x y w h
+  COMMAND_COUNT
+} command_op_t;
+
+// Number of arguments following each opcode
+extern const int command_arity[COMMAND_COUNT];
+
+// Checks that the len values of data only hold well-formed commands
+bool
+command_validate(
+  const double *data,
+  size_t len);
+
+// Runs the len values of data as commands onto c. Stops at the first
+// malformed command (unknown opcode, missing or out-of-range argument)
+// and returns false; the commands preceding it have been run.
+bool
+command_execute(
+  canvas_t *c,
+  const double *data,
+  size_t len);
+
+#endif /* __COMMAND_H */
@@ -22,12 +22,13 @@ typedef enum os_type_t {
 } os_type_t;
 
 typedef enum impl_type_t {
-  IMPL_NONE    = 0,
-  IMPL_CANVAS  = 1,
-  IMPL_GDI     = 2,
-  IMPL_QUARTZ  = 3,
-  IMPL_X11     = 4,
-  IMPL_WAYLAND = 5
+  IMPL_NONE     = 0,
+  IMPL_CANVAS   = 1,
+  IMPL_GDI      = 2,
+  IMPL_QUARTZ   = 3,
+  IMPL_X11      = 4,
+  IMPL_WAYLAND  = 5,
+  IMPL_HEADLESS = 6
 } impl_type_t;
 
 #define switch_IMPL() switch (get_impl_type())
@@ -56,6 +57,12 @@ typedef enum impl_type_t {
 #define case_WAYLAND(s)
 #endif
 
+#ifdef HAS_HEADLESS
+#define case_HEADLESS(s) case IMPL_HEADLESS: { s; } break
+#else
+#define case_HEADLESS(s)
+#endif
+
 #define default_fail() default: assert(!"Missing implementation"); break
 #define default_ignore() default: break
 
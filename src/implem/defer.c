@@ -0,0 +1,108 @@
+/**************************************************************************/
+/*                                                                        */
+/*    Copyright 2022 OCamlPro                                             */
+/*                                                                        */
+/*  All rights reserved. This file is distributed under the terms of the  */
+/*  GNU Lesser General Public License version 2.1, with the special       */
+/*  exception on linking described in the file LICENSE.                   */
+/*                                                                        */
+/**************************************************************************/
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "lock.h"
+#include "defer.h"
+
+typedef struct defer_item_t {
+  defer_fun_t *fun;
+  void *data;
+  struct defer_item_t *next;
+} defer_item_t;
+
+static lock_t _defer_lock = LOCK_INITIALIZER;
+
+static defer_item_t *_defer_first = NULL;
+static defer_item_t *_defer_last = NULL;
+
+static int32_t _defer_expected = 0;
+
+void
+defer_expect(
+  void)
+{
+  lock_acquire(&_defer_lock);
+  ++_defer_expected;
+  lock_release(&_defer_lock);
+}
+
+void
+defer_cancel(
+  void)
+{
+  lock_acquire(&_defer_lock);
+  --_defer_expected;
+  lock_release(&_defer_lock);
+}
+
+bool
+defer_post(
+  defer_fun_t *fun,
+  void *data)
+{
+  assert(fun != NULL);
+
+  defer_item_t *item = (defer_item_t *)calloc(1, sizeof(defer_item_t));
+  if (item == NULL) {
+    return false;
+  }
+
+  item->fun = fun;
+  item->data = data;
+
+  lock_acquire(&_defer_lock);
+  if (_defer_last != NULL) {
+    _defer_last->next = item;
+  } else {
+    _defer_first = item;
+  }
+  _defer_last = item;
+  lock_release(&_defer_lock);
+
+  return true;
+}
+
+void
+defer_process(
+  void)
+{
+  /* Take the whole queue at once, so that functions posted
+     by the ones being run wait for the next frame */
+  lock_acquire(&_defer_lock);
+  defer_item_t *item = _defer_first;
+  _defer_first = NULL;
+  _defer_last = NULL;
+  lock_release(&_defer_lock);
+
+  while (item != NULL) {
+    defer_item_t *next = item->next;
+    lock_acquire(&_defer_lock);
+    --_defer_expected;
+    lock_release(&_defer_lock);
+    item->fun(item->data);
+    free(item);
+    item = next;
+  }
+}
+
+bool
+defer_pending(
+  void)
+{
+  lock_acquire(&_defer_lock);
+  bool result = (_defer_expected > 0);
+  lock_release(&_defer_lock);
+  return result;
+}
@@ -0,0 +1,50 @@
+/**************************************************************************/
+/*                                                                        */
+/*    Copyright 2022 OCamlPro                                             */
+/*                                                                        */
+/*  All rights reserved. This file is distributed under the terms of the  */
+/*  GNU Lesser General Public License version 2.1, with the special       */
+/*  exception on linking described in the file LICENSE.                   */
+/*                                                                        */
+/**************************************************************************/
+
+#ifndef __DEFER_H
+#define __DEFER_H
+
+#include <stdbool.h>
+
+typedef void defer_fun_t(void *data);
+
+// Deferring lets work done on other threads hand its result
+// back to the event loop thread. Every defer_post must be
+// announced beforehand by a call to defer_expect, from any
+// thread: the event loop keeps running while some are pending.
+
+void
+defer_expect(
+  void);
+
+// Withdraws an expectation whose function will never be posted
+void
+defer_cancel(
+  void);
+
+// Queues fun(data) for execution on the event loop thread;
+// may be called from any thread
+bool
+defer_post(
+  defer_fun_t *fun,
+  void *data);
+
+// Runs the queued functions, in order; called by the event
+// loops at every frame
+void
+defer_process(
+  void);
+
+// Tells whether some expected functions have not run yet
+bool
+defer_pending(
+  void);
+
+#endif /* __DEFER_H */
@@ -32,7 +32,8 @@ typedef enum {
   EVENT_BUTTON    = 7,
   EVENT_CURSOR    = 8,
 
-  EVENT_PRESENT = 64 // internal event
+  EVENT_PRESENT = 64, // internal event
+  EVENT_IDLE    = 65  // internal event, sent in place of a skipped frame
 } event_type_t;
 
 typedef enum {
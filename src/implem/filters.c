@@ -53,14 +53,16 @@ _filter_blur_box_h(
   assert(pixmap_valid(*dst));
   assert(src->width == dst->width);
   assert(src->height == dst->height);
+  assert(src->stride == dst->stride);
   assert(r >= 0);
 
   int32_t w = src->width;
   int32_t h = src->height;
+  int32_t s = src->stride;
   double iarr = 1.0 / ((double)(2 * r + 1));
 
   for (int32_t i = 0; i < h; ++i) {
-    int32_t ti = i * w, li = ti, ri = ti + r;
+    int32_t ti = i * s, li = ti, ri = ti + r;
     int32_t fv = src->data[ti].a;
     int32_t lv = src->data[ti + w - 1].a;
     int32_t val = (r + 1) * fv;
@@ -92,38 +94,40 @@ _filter_blur_box_v(
   assert(pixmap_valid(*dst));
   assert(src->width == dst->width);
   assert(src->height == dst->height);
+  assert(src->stride == dst->stride);
   assert(r >= 0);
 
   int32_t w = src->width;
   int32_t h = src->height;
+  int32_t s = src->stride;
   double iarr = 1.0 / ((double)(2 * r + 1));
 
   for (int32_t i = 0; i < w; ++i) {
-    int32_t ti = i, li = ti, ri = ti + r * w;
+    int32_t ti = i, li = ti, ri = ti + r * s;
     int32_t fv = src->data[ti].a;
-    int32_t lv = src->data[ti + w * (h-1)].a;
+    int32_t lv = src->data[ti + s * (h-1)].a;
     int32_t val = (r + 1) * fv;
     for (int32_t j = 0; j < r; ++j) {
-      val += src->data[ti + j*w].a;
+      val += src->data[ti + j*s].a;
     }
     for (int32_t j = 0; j <= r; ++j) {
       val += src->data[ri].a - fv;
       dst->data[ti].a = fastround(val * iarr);
-      ri += w;
-      ti += w;
+      ri += s;
+      ti += s;
     }
     for (int32_t j = r + 1; j < h - r; ++j) {
       val += src->data[ri].a - src->data[li].a;
       dst->data[ti].a = fastround(val * iarr);
-      li += w;
-      ri += w;
-      ti += w;
+      li += s;
+      ri += s;
+      ti += s;
     }
     for (int32_t j = h - r; j < h; ++j) {
       val += lv - src->data[li].a;
       dst->data[ti].a = fastround(val * iarr);
-      li += w;
-      ti += w;
+      li += s;
+      ti += s;
     }
   }
 }
@@ -148,7 +152,9 @@ filter_gaussian_blur_alpha(
   pixmap_t *src,
   double s)
 {
-  pixmap_t dst = pixmap_copy(*src);
+  assert(pixmap_is_compact(*src));
+
+  pixmap_t dst = pixmap_copy(src);
   if (pixmap_valid(dst) == true) {
     int32_t boxes[3] = { 0 };
     _filter_blur_compute_boxes(s, 3, boxes);
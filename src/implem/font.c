@@ -19,6 +19,7 @@
 #include "font_desc.h"
 #include "font.h"
 #include "font_internal.h"
+#include "trace.h"
 
 #ifdef HAS_GDI
 #include "gdi/gdi_font.h"
@@ -26,7 +27,7 @@
 #ifdef HAS_QUARTZ
 #include "quartz/qtz_font.h"
 #endif
-#if defined HAS_X11 || defined HAS_WAYLAND
+#if defined HAS_X11 || defined HAS_WAYLAND || defined HAS_HEADLESS
 #include "unix/unx_font.h"
 #endif
 
@@ -36,14 +37,19 @@ font_create(
 {
   font_t *f = NULL;
 
+  int64_t trace_t = trace_begin();
+
   switch_IMPL() {
     case_GDI(f = (font_t *)gdi_font_create(fd));
     case_QUARTZ(f = (font_t *)qtz_font_create(fd));
     case_X11(f = (font_t *)unx_font_create(fd));
     case_WAYLAND(f = (font_t *)unx_font_create(fd));
+    case_HEADLESS(f = (font_t *)unx_font_create(fd));
     default_fail();
   }
 
+  trace_end("font_create", trace_t);
+
   if (f == NULL) {
     return NULL;
   }
@@ -73,6 +79,7 @@ font_destroy(
     case_QUARTZ(qtz_font_destroy((qtz_font_t *)f));
     case_X11(unx_font_destroy((unx_font_t *)f));
     case_WAYLAND(unx_font_destroy((unx_font_t *)f));
+    case_HEADLESS(unx_font_destroy((unx_font_t *)f));
     default_fail();
   }
 }
@@ -115,6 +122,8 @@ font_char_as_poly(
       res = unx_font_char_as_poly((unx_font_t *)f, t, c, pen, p, bbox));
     case_WAYLAND(
       res = unx_font_char_as_poly((unx_font_t *)f, t, c, pen, p, bbox));
+    case_HEADLESS(
+      res = unx_font_char_as_poly((unx_font_t *)f, t, c, pen, p, bbox));
     default_fail();
   }
 
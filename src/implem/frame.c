@@ -0,0 +1,37 @@
+/**************************************************************************/
+/*                                                                        */
+/*    Copyright 2022 OCamlPro                                             */
+/*                                                                        */
+/*  All rights reserved. This file is distributed under the terms of the  */
+/*  GNU Lesser General Public License version 2.1, with the special       */
+/*  exception on linking described in the file LICENSE.                   */
+/*                                                                        */
+/**************************************************************************/
+
+#include <stdint.h>
+
+#include "util.h"
+#include "frame.h"
+
+static int32_t _frame_rate = FRAME_RATE_DEFAULT;
+
+void
+frame_set_rate(
+  int32_t rate)
+{
+  _frame_rate = max(1, min(rate, FRAME_RATE_MAX));
+}
+
+int32_t
+frame_get_rate(
+  void)
+{
+  return _frame_rate;
+}
+
+int64_t
+frame_get_interval(
+  void)
+{
+  return 1000000 / _frame_rate;
+}
@@ -0,0 +1,38 @@
+/**************************************************************************/
+/*                                                                        */
+/*    Copyright 2022 OCamlPro                                             */
+/*                                                                        */
+/*  All rights reserved. This file is distributed under the terms of the  */
+/*  GNU Lesser General Public License version 2.1, with the special       */
+/*  exception on linking described in the file LICENSE.                   */
+/*                                                                        */
+/**************************************************************************/
+
+#ifndef __FRAME_H
+#define __FRAME_H
+
+#include <stdint.h>
+
+// Frame pacing, shared by all backends
+// Frames are timer-driven; there is no VSync mode. On Wayland, a
+// window also waits for the compositor's frame callback, so its
+// frames follow the display refresh, up to the frame rate
+
+#define FRAME_RATE_DEFAULT 60
+#define FRAME_RATE_MAX 1000
+
+// The rate is clamped to [1, FRAME_RATE_MAX]
+void
+frame_set_rate(
+  int32_t rate);
+
+int32_t
+frame_get_rate(
+  void);
+
+// Time between two frames, in microseconds
+int64_t
+frame_get_interval(
+  void);
+
+#endif /* __FRAME_H */
@@ -23,6 +23,8 @@
 
 #include "../hashtable.h"
 #include "../event.h"
+#include "../frame.h"
+#include "../defer.h"
 #include "gdi_keyboard.h"
 #include "gdi_window_internal.h"
 #include "gdi_backend_internal.h"
@@ -221,22 +223,20 @@ static void
 _gdi_render_all_windows(
   void)
 {
+  defer_process();
+
   event_t evt;
   gdi_window_t *w = NULL;
-  hashtable_iterator_t *i = NULL;
   evt.type = EVENT_FRAME;
   evt.time = gdi_get_time();
-  i = ht_get_iterator(gdi_back->hwnd_to_win);
-  if (i != NULL) {
-    while ((w = (gdi_window_t *)ht_iterator_next(i)) != NULL) {
-      if (w->base.visible == true) {
-        evt.target = (void *)w;
-        if (event_notify(gdi_back->listener, &evt)) {
-          _gdi_present_window(w);
-        }
+  hashtable_iterator_t i = ht_get_iterator(gdi_back->hwnd_to_win);
+  while ((w = (gdi_window_t *)ht_iterator_next(&i)) != NULL) {
+    if (w->base.visible == true) {
+      evt.target = (void *)w;
+      if (event_notify(gdi_back->listener, &evt)) {
+        _gdi_present_window(w);
       }
     }
-    ht_free_iterator(i);
   }
 }
 
@@ -327,7 +327,7 @@ gdi_backend_run(
                                                      QS_ALLEVENTS))) {
         _gdi_render_all_windows();
         do {
-          gdi_back->next_frame += 1000000 / 60;
+          gdi_back->next_frame += frame_get_interval();
         } while (gdi_back->next_frame < cur_time);
       }
     }
@@ -355,7 +355,7 @@ _gdi_modal_timer_proc(
   if (timeout <= 4) {
     _gdi_render_all_windows();
     do {
-      gdi_back->next_frame += 1000000 / 60;
+      gdi_back->next_frame += frame_get_interval();
     } while (gdi_back->next_frame < cur_time);
   }
 }
@@ -14,6 +14,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
 
 #include <windows.h>
@@ -114,7 +115,7 @@ gdi_impexp_export_png(
   GpBitmap *bitmap = NULL;
   GpStatus status =
     GdipCreateBitmapFromScan0(pixmap->width, pixmap->height,
-                              pixmap->width * COLOR_SIZE,
+                              pixmap->stride * COLOR_SIZE,
                               PixelFormat32bppARGB,
                               (BYTE *)pixmap->data, &bitmap);
   if (status != Ok) {
@@ -129,6 +130,84 @@ gdi_impexp_export_png(
   return (status == Ok);
 }
 
+bool
+gdi_impexp_export_png_to_memory(
+  const pixmap_t *pixmap,
+  uint8_t **data,
+  size_t *size)
+{
+  assert(_gdi_impexp_initialized == true);
+  assert(pixmap != NULL);
+  assert(pixmap_valid(*pixmap));
+  assert(data != NULL);
+  assert(size != NULL);
+
+  bool res = false;
+
+  CLSID clsid;
+  if (_gdi_find_encoder(L"image/png", &clsid) == false) {
+    return false;
+  }
+
+  GpBitmap *bitmap = NULL;
+  GpStatus status =
+    GdipCreateBitmapFromScan0(pixmap->width, pixmap->height,
+                              pixmap->stride * COLOR_SIZE,
+                              PixelFormat32bppARGB,
+                              (BYTE *)pixmap->data, &bitmap);
+  if (status != Ok) {
+    return false;
+  }
+
+  IStream *stream = NULL;
+  HRESULT hr = CreateStreamOnHGlobal(NULL, TRUE, &stream);
+  if (FAILED(hr)) {
+    GdipDisposeImage((GpImage *)bitmap);
+    return false;
+  }
+
+  status = GdipSaveImageToStream((GpImage *)bitmap, stream, &clsid, NULL);
+  GdipDisposeImage((GpImage *)bitmap);
+  if (status != Ok) {
+    goto error;
+  }
+
+  STATSTG stat;
+  hr = stream->lpVtbl->Stat(stream, &stat, STATFLAG_NONAME);
+  if (FAILED(hr)) {
+    goto error;
+  }
+
+  HGLOBAL hglobal = NULL;
+  hr = GetHGlobalFromStream(stream, &hglobal);
+  if (FAILED(hr)) {
+    goto error;
+  }
+
+  size_t length = (size_t)stat.cbSize.QuadPart;
+  uint8_t *buffer = (uint8_t *)malloc(max(length, 1));
+  if (buffer == NULL) {
+    goto error;
+  }
+
+  const void *src = GlobalLock(hglobal);
+  if (src == NULL) {
+    free(buffer);
+    goto error;
+  }
+  memcpy(buffer, src, length);
+  GlobalUnlock(hglobal);
+
+  *data = buffer;
+  *size = length;
+
+  res = true;
+
+error:
+  stream->lpVtbl->Release(stream);
+  return res;
+}
+
 static bool
 _gdi_impexp_get_bitmap_size(
   GpBitmap *bitmap,
@@ -195,13 +274,15 @@ gdi_impexp_import_png( // Actually, this imports any supported format
     goto error;
   }
 
-  int32_t dwidth = 0, dheight = 0;
+  int32_t dwidth = 0, dheight = 0, dstride = 0;
   if (alloc == true) {
     dwidth = swidth;
     dheight = sheight;
+    dstride = swidth;
   } else {
     dwidth = pixmap->width;
     dheight = pixmap->height;
+    dstride = pixmap->stride;
   }
 
   int32_t sx = 0, sy = 0;
@@ -221,8 +302,8 @@ gdi_impexp_import_png( // Actually, this imports any supported format
 
   GpRect src_rect = { sx, sy, width, height };
   BitmapData bitmap_data = {
-    width, height, dwidth * COLOR_SIZE, PixelFormat32bppARGB,
-    (void *)data + (dy * dwidth + dx) * COLOR_SIZE, (UINT_PTR)NULL
+    width, height, dstride * COLOR_SIZE, PixelFormat32bppARGB,
+    (void *)data + (dy * dstride + dx) * COLOR_SIZE, (UINT_PTR)NULL
   };
   status = GdipBitmapLockBits(bitmap, &src_rect,
                               ImageLockModeRead | ImageLockModeUserInputBuf,
@@ -235,6 +316,7 @@ gdi_impexp_import_png( // Actually, this imports any supported format
     pixmap->data = data;
     pixmap->width = dwidth;
     pixmap->height = dheight;
+    pixmap->stride = dstride;
   }
 
   res = true;
@@ -8,6 +8,7 @@
 /*                                                                        */
 /**************************************************************************/
 
+
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
@@ -15,26 +16,91 @@
 
 #include "hashtable.h"
 
-typedef struct hashtable_entry_t hashtable_entry_t;
+/* Linear probing, with tombstones so that removing entries never moves
+   other entries around (which keeps iterators valid). Slots are located
+   by Fibonacci hashing, which spreads hashes whose low bits are poorly
+   distributed (such as aligned pointers) over the whole table. */
 
 typedef struct hashtable_entry_t {
-  const void *key;
+  const void *key; // NULL if empty, _ht_tombstone if removed
   void *val;
-  hashtable_entry_t *next;
+  hash_t hash;
 } hashtable_entry_t;
 
 typedef struct hashtable_t {
   key_hash_fun_t *key_hash;
   key_equal_fun_t *key_equal;
-  hashtable_entry_t **data;
-  size_t size;
+  hashtable_entry_t *entries;
+  size_t capacity; // always a power of 2
+  uint32_t capacity_log2;
+  size_t count; // live entries
+  size_t used; // live entries and tombstones
+  size_t iterators; // running iterators, during which growth is deferred
 } hashtable_t;
 
-typedef struct hashtable_iterator_t {
-  hashtable_t *hashtable;
-  hashtable_entry_t *entry;
-  hash_t current_hash;
-} hashtable_iterator_t;
+static const char _ht_tombstone_key = 0;
+#define _ht_tombstone ((const void *)&_ht_tombstone_key)
+
+#define _ht_live(e) (((e)->key != NULL) && ((e)->key != _ht_tombstone))
+
+/* Keep the table at most 3/4 full (tombstones included) */
+#define _ht_full(used,capacity) ((used) * 4 > (capacity) * 3)
+
+#define HT_MIN_CAPACITY_LOG2 3
+
+/* Index of iterators that have returned NULL */
+#define HT_ITERATOR_DONE SIZE_MAX
+
+static size_t
+_ht_slot(
+  uint32_t capacity_log2,
+  hash_t hash)
+{
+  return (size_t)((uint32_t)(hash * 2654435769u) >> (32 - capacity_log2));
+}
+
+static bool
+_ht_alloc(
+  hashtable_t *ht,
+  uint32_t capacity_log2)
+{
+  assert(ht != NULL);
+  assert(capacity_log2 >= HT_MIN_CAPACITY_LOG2);
+  assert(capacity_log2 < 32);
+
+  size_t capacity = (size_t)1 << capacity_log2;
+  hashtable_entry_t *entries =
+    (hashtable_entry_t *)calloc(capacity, sizeof(hashtable_entry_t));
+  if (entries == NULL) {
+    return false;
+  }
+
+  hashtable_entry_t *old_entries = ht->entries;
+  size_t old_capacity = ht->capacity;
+
+  ht->entries = entries;
+  ht->capacity = capacity;
+  ht->capacity_log2 = capacity_log2;
+  ht->used = ht->count;
+
+  /* Keys are known to be distinct, no need to compare them */
+  for (size_t i = 0; i < old_capacity; ++i) {
+    const hashtable_entry_t *e = &old_entries[i];
+    if (_ht_live(e)) {
+      size_t j = _ht_slot(capacity_log2, e->hash);
+      while (entries[j].key != NULL) {
+        j = (j + 1) & (capacity - 1);
+      }
+      entries[j] = *e;
+    }
+  }
+
+  if (old_entries != NULL) {
+    free(old_entries);
+  }
+
+  return true;
+}
 
 hashtable_t *
 ht_new(
@@ -49,14 +115,16 @@ ht_new(
   if (ht == NULL) {
     return NULL;
   }
-  ht->data = (hashtable_entry_t **)calloc(size, sizeof(hashtable_entry_t *));
-  if (ht->data == NULL) {
+  uint32_t capacity_log2 = HT_MIN_CAPACITY_LOG2;
+  while (_ht_full(size, (size_t)1 << capacity_log2) && (capacity_log2 < 31)) {
+    ++capacity_log2;
+  }
+  if (_ht_alloc(ht, capacity_log2) == false) {
     free(ht);
     return NULL;
   }
   ht->key_hash = key_hash;
   ht->key_equal = key_equal;
-  ht->size = size;
   return ht;
 }
 
@@ -65,34 +133,45 @@ ht_delete(
   hashtable_t *ht)
 {
   assert(ht != NULL);
-  assert(ht->data != NULL);
-  for (size_t i = 0; i < ht->size; ++i) {
-      hashtable_entry_t *n = ht->data[i];
-      hashtable_entry_t *e;
-      while ((e = n)) {
-        n = e->next;
-        free(e);
-      }
-  }
-  free(ht->data);
+  assert(ht->entries != NULL);
+  free(ht->entries);
   free(ht);
 }
 
-static hash_t
-_ht_key_hash(
+/* Returns the slot holding key, or if not present, the slot where
+   it should be inserted (the first tombstone met, if any) */
+static hashtable_entry_t *
+_ht_lookup(
   const hashtable_t *ht,
-  const void *key)
+  const void *key,
+  hash_t hash,
+  bool *found)
 {
-  return ht->key_hash(key) % ht->size;
-}
+  assert(ht != NULL);
+  assert(ht->entries != NULL);
+  assert(key != NULL);
+  assert(found != NULL);
 
-static hash_t
-_ht_key_equal(
-  const hashtable_t *ht,
-  const void *key1,
-  const void *key2)
-{
-  return ht->key_equal(key1, key2);
+  hashtable_entry_t *tombstone = NULL;
+  size_t mask = ht->capacity - 1;
+  size_t i = _ht_slot(ht->capacity_log2, hash);
+
+  /* The table is never full, so this terminates */
+  for (;;) {
+    hashtable_entry_t *e = &ht->entries[i];
+    if (e->key == NULL) {
+      *found = false;
+      return (tombstone != NULL) ? tombstone : e;
+    } else if (e->key == _ht_tombstone) {
+      if (tombstone == NULL) {
+        tombstone = e;
+      }
+    } else if ((e->hash == hash) && ht->key_equal(e->key, key)) {
+      *found = true;
+      return e;
+    }
+    i = (i + 1) & mask;
+  }
 }
 
 bool
@@ -102,26 +181,43 @@ ht_add(
   void *val)
 {
   assert(ht != NULL);
-  assert(ht->data != NULL);
-  hash_t h = _ht_key_hash(ht, key);
-  hashtable_entry_t **p = &(ht->data[h]);
-  hashtable_entry_t *e;
-  while ((e = *p)) {
-    if (_ht_key_equal(ht, e->key, key)) {
-      e->val = val;
+  assert(ht->entries != NULL);
+  assert(key != NULL);
+
+  hash_t hash = ht->key_hash(key);
+  bool found = false;
+  hashtable_entry_t *e = _ht_lookup(ht, key, hash, &found);
+  if (found == true) {
+    e->val = val;
+    return false;
+  }
+
+  /* Reusing a tombstone does not make the table any fuller. Rehashing
+     moves entries under the running iterators, if any: it is then put
+     off until only one empty slot (needed by lookups) would remain */
+  if ((e->key == NULL) && _ht_full(ht->used + 1, ht->capacity) &&
+      ((ht->iterators == 0) || (ht->used + 2 > ht->capacity))) {
+    /* Grow if mostly live entries, otherwise just purge tombstones */
+    uint32_t capacity_log2 = ht->capacity_log2;
+    if (_ht_full((ht->count + 1) * 2, ht->capacity)) {
+      if (capacity_log2 >= 31) {
+        return false;
+      }
+      ++capacity_log2;
+    }
+    if (_ht_alloc(ht, capacity_log2) == false) {
       return false;
-    } else {
-      p = &(e->next);
     }
+    e = _ht_lookup(ht, key, hash, &found);
   }
-  e = (hashtable_entry_t *)calloc(1, sizeof(hashtable_entry_t));
-  if (e == NULL) {
-    return false;
+
+  if (e->key == NULL) {
+    ht->used++;
   }
+  ht->count++;
   e->key = key;
   e->val = val;
-  e->next = NULL;
-  *p = e;
+  e->hash = hash;
   return true;
 }
 
@@ -131,20 +227,18 @@ ht_remove(
   const void *key)
 {
   assert(ht != NULL);
-  assert(ht->data != NULL);
-  hash_t h = _ht_key_hash(ht, key);
-  hashtable_entry_t **p = &(ht->data[h]);
-  hashtable_entry_t *e;
-  while ((e = *p)) {
-    if (_ht_key_equal(ht, e->key, key)) {
-      *p = e->next;
-      free(e);
-      return true;
-    } else {
-      p = &(e->next);
-    }
+  assert(ht->entries != NULL);
+  assert(key != NULL);
+
+  bool found = false;
+  hashtable_entry_t *e = _ht_lookup(ht, key, ht->key_hash(key), &found);
+  if (found == false) {
+    return false;
   }
-  return false;
+  e->key = _ht_tombstone;
+  e->val = NULL;
+  ht->count--;
+  return true;
 }
 
 void *
@@ -153,63 +247,51 @@ ht_find(
   const void *key)
 {
   assert(ht != NULL);
-  assert(ht->data != NULL);
-  hash_t h = _ht_key_hash(ht, key);
-  hashtable_entry_t *e = ht->data[h];
-  while (e) {
-    if (_ht_key_equal(ht, e->key, key)) {
-      return e->val;
-    } else {
-      e = e->next;
-    }
-  }
-  return NULL;
+  assert(ht->entries != NULL);
+  assert(key != NULL);
+
+  bool found = false;
+  hashtable_entry_t *e = _ht_lookup(ht, key, ht->key_hash(key), &found);
+  return (found == true) ? e->val : NULL;
 }
 
-static void
-_ht_iterator_skip_empty(
-  hashtable_iterator_t *i)
+size_t
+ht_count(
+  const hashtable_t *ht)
 {
-  assert(i != NULL);
-  assert(i->hashtable != NULL);
-  assert(i->hashtable->size > 0);
-  while ((i->entry == NULL) && (i->current_hash < i->hashtable->size - 1)) {
-    i->entry = i->hashtable->data[++(i->current_hash)];
-  }
+  assert(ht != NULL);
+  return ht->count;
 }
 
-hashtable_iterator_t *
+hashtable_iterator_t
 ht_get_iterator(
   hashtable_t *ht)
 {
   assert(ht != NULL);
-  assert(ht->data != NULL);
-  hashtable_iterator_t *i =
-    (hashtable_iterator_t *)calloc(1, sizeof(hashtable_iterator_t));
-  i->hashtable = ht;
-  i->entry = i->hashtable->data[0];
-  _ht_iterator_skip_empty(i);
+  assert(ht->entries != NULL);
+  ht->iterators++;
+  hashtable_iterator_t i = { ht, 0 };
   return i;
 }
 
-void
-ht_free_iterator(
-  hashtable_iterator_t *i)
-{
-  assert(i != NULL);
-  free(i);
-}
-
 void *
 ht_iterator_next(
   hashtable_iterator_t *i)
 {
   assert(i != NULL);
-  void *val = NULL;
-  if (i->entry != NULL) {
-    val = i->entry->val;
-    i->entry = i->entry->next;
-    _ht_iterator_skip_empty(i);
+  assert(i->hashtable != NULL);
+  hashtable_t *ht = i->hashtable;
+  if (i->index == HT_ITERATOR_DONE) {
+    return NULL;
   }
-  return val;
+  while (i->index < ht->capacity) {
+    const hashtable_entry_t *e = &ht->entries[i->index++];
+    if (_ht_live(e)) {
+      return e->val;
+    }
+  }
+  assert(ht->iterators > 0);
+  ht->iterators--;
+  i->index = HT_ITERATOR_DONE;
+  return NULL;
 }
@@ -20,9 +20,22 @@ typedef uint32_t hash_t;
 typedef hash_t key_hash_fun_t(const void *key);
 typedef bool key_equal_fun_t(const void *key1, const void *key2);
 
+// Open addressing hash table, growing as needed
 typedef struct hashtable_t hashtable_t;
-typedef struct hashtable_iterator_t hashtable_iterator_t;
 
+// Iterators live on the stack, and need not be freed, but must be
+// run until they return NULL. Entries may be removed or added while
+// iterating; added entries may or may not be visited. While iterators
+// are running, the table only grows once it is otherwise full, so
+// that other entries are visited exactly once; if it does grow, they
+// may be visited twice or not at all.
+typedef struct hashtable_iterator_t {
+  hashtable_t *hashtable;
+  size_t index;
+} hashtable_iterator_t;
+
+// The size is the number of entries the table
+// can hold before it first needs to grow
 hashtable_t *
 ht_new(
   key_hash_fun_t *key_hash,
@@ -33,6 +46,9 @@ void
 ht_delete(
   hashtable_t *ht);
 
+// Keys are not copied, and must remain valid while in the table.
+// Returns true if the key was added, false if it was already
+// present (its value is then replaced) or if growing failed.
 bool
 ht_add(
   hashtable_t *ht,
@@ -49,14 +65,15 @@ ht_find(
   const hashtable_t *ht,
   const void *key);
 
-hashtable_iterator_t *
+size_t
+ht_count(
+  const hashtable_t *ht);
+
+hashtable_iterator_t
 ht_get_iterator(
   hashtable_t *ht);
 
-void
-ht_free_iterator(
-  hashtable_iterator_t *i);
-
+// Returns NULL once every value has been visited
 void *
 ht_iterator_next(
   hashtable_iterator_t *i);
@@ -0,0 +1,203 @@
+/**************************************************************************/
+/*                                                                        */
+/*    Copyright 2022 OCamlPro                                             */
+/*                                                                        */
+/*  All rights reserved. This file is distributed under the terms of the  */
+/*  GNU Lesser General Public License version 2.1, with the special       */
+/*  exception on linking described in the file LICENSE.                   */
+/*                                                                        */
+/**************************************************************************/
+
+#ifdef HAS_HEADLESS
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <assert.h>
+
+#include "../event.h"
+#include "../defer.h"
+#include "../frame.h"
+#include "../unix/unx_watch.h"
+#include "hdl_backend.h"
+#include "hdl_window_internal.h"
+
+typedef struct hdl_backend_t {
+  hdl_window_t *windows;
+  bool running;
+  event_listener_t *listener;
+} hdl_backend_t;
+
+static hdl_backend_t *hdl_back = NULL;
+
+int64_t
+hdl_get_time(
+  void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+bool
+hdl_backend_init(
+  void)
+{
+  assert(hdl_back == NULL);
+
+  hdl_back = (hdl_backend_t *)calloc(1, sizeof(hdl_backend_t));
+  if (hdl_back == NULL) {
+    return false;
+  }
+
+  hdl_back->windows = NULL;
+  hdl_back->running = false;
+  hdl_back->listener = NULL;
+
+  return true;
+}
+
+void
+hdl_backend_terminate(
+  void)
+{
+  if (hdl_back == NULL) {
+    return;
+  }
+
+  free(hdl_back);
+
+  hdl_back = NULL;
+}
+
+void
+hdl_backend_add_window(
+  hdl_window_t *w)
+{
+  assert(hdl_back != NULL);
+  assert(w != NULL);
+
+  w->prev = NULL;
+  w->next = hdl_back->windows;
+  if (w->next != NULL) {
+    w->next->prev = w;
+  }
+  hdl_back->windows = w;
+}
+
+void
+hdl_backend_remove_window(
+  hdl_window_t *w)
+{
+  assert(hdl_back != NULL);
+  assert(w != NULL);
+
+  if (w->prev != NULL) {
+    w->prev->next = w->next;
+  } else {
+    hdl_back->windows = w->next;
+  }
+  if (w->next != NULL) {
+    w->next->prev = w->prev;
+  }
+  w->prev = NULL;
+  w->next = NULL;
+}
+
+void
+hdl_backend_set_listener(
+  event_listener_t *listener)
+{
+  assert(hdl_back != NULL);
+
+  if (listener != NULL) {
+    assert(listener->process_event != NULL);
+  }
+  hdl_back->listener = listener;
+}
+
+event_listener_t *
+hdl_backend_get_listener(
+  void)
+{
+  assert(hdl_back != NULL);
+
+  return hdl_back->listener;
+}
+
+static void
+_hdl_render_all_windows(
+  void)
+{
+  assert(hdl_back != NULL);
+
+  defer_process();
+
+  event_t evt;
+  hdl_window_t *w = hdl_back->windows;
+
+  evt.type = EVENT_FRAME;
+  evt.time = hdl_get_time();
+  while (w != NULL) {
+    /* The handler may close the current window */
+    hdl_window_t *next = w->next;
+    if (w->base.visible == true) {
+      evt.target = (void *)w;
+      /* Nothing to present to, so whether
+         the event was handled is irrelevant */
+      event_notify(hdl_back->listener, &evt);
+    }
+    w = next;
+  }
+}
+
+void
+hdl_backend_run(
+  void)
+{
+  assert(hdl_back != NULL);
+  assert(hdl_back->running == false);
+
+  int64_t next_frame = hdl_get_time();
+
+  hdl_back->running = true;
+
+  /* Keep running while background work has results to hand back,
+     or while file descriptors or timers are being watched */
+  while (hdl_back->running &&
+         ((hdl_back->windows != NULL) || defer_pending() ||
+          unx_watch_active())) {
+
+    int64_t current = hdl_get_time();
+    if (next_frame <= current) {
+
+      _hdl_render_all_windows();
+
+      /* Compute time until next frame, skip frames if needed */
+      current = hdl_get_time();
+      do {
+        next_frame += frame_get_interval();
+      } while (next_frame < current);
+    }
+
+    unx_watch_wait(-1, next_frame - current, NULL);
+  }
+
+  hdl_back->running = false;
+}
+
+void
+hdl_backend_stop(
+  void)
+{
+  assert(hdl_back != NULL);
+
+  hdl_back->running = false;
+}
+
+#else
+
+const int hdl_backend = 0;
+
+#endif /* HAS_HEADLESS */
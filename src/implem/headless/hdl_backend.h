@@ -0,0 +1,59 @@
+/**************************************************************************/
+/*                                                                        */
+/*    Copyright 2022 OCamlPro                                             */
+/*                                                                        */
+/*  All rights reserved. This file is distributed under the terms of the  */
+/*  GNU Lesser General Public License version 2.1, with the special       */
+/*  exception on linking described in the file LICENSE.                   */
+/*                                                                        */
+/**************************************************************************/
+
+#ifndef __HDL_BACKEND_H
+#define __HDL_BACKEND_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "../event.h"
+#include "hdl_window.h"
+
+int64_t
+hdl_get_time(
+  void);
+
+bool
+hdl_backend_init(
+  void);
+
+void
+hdl_backend_terminate(
+  void);
+
+void
+hdl_backend_add_window(
+  hdl_window_t *w);
+
+void
+hdl_backend_remove_window(
+  hdl_window_t *w);
+
+void
+hdl_backend_set_listener(
+  event_listener_t *listener);
+
+event_listener_t *
+hdl_backend_get_listener(
+  void);
+
+// Runs a synthetic frame loop, sending a frame event to every visible
+// window at a fixed rate ; it terminates by itself when no window is
+// left, as nothing could then generate any further event
+void
+hdl_backend_run(
+  void);
+
+void
+hdl_backend_stop(
+  void);
+
+#endif /* __HDL_BACKEND_H */
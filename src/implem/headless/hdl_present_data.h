@@ -0,0 +1,18 @@
+/**************************************************************************/
+/*                                                                        */
+/*    Copyright 2022 OCamlPro                                             */
+/*                                                                        */
+/*  All rights reserved. This file is distributed under the terms of the  */
+/*  GNU Lesser General Public License version 2.1, with the special       */
+/*  exception on linking described in the file LICENSE.                   */
+/*                                                                        */
+/**************************************************************************/
+
+#ifndef __HDL_PRESENT_DATA_H
+#define __HDL_PRESENT_DATA_H
+
+typedef struct hdl_present_data_t {
+  void *dummy;
+} hdl_present_data_t;
+
+#endif /* __HDL_PRESENT_DATA_H */
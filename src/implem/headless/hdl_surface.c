@@ -0,0 +1,127 @@
+/**************************************************************************/
+/*                                                                        */
+/*    Copyright 2022 OCamlPro                                             */
+/*                                                                        */
+/*  All rights reserved. This file is distributed under the terms of the  */
+/*  GNU Lesser General Public License version 2.1, with the special       */
+/*  exception on linking described in the file LICENSE.                   */
+/*                                                                        */
+/**************************************************************************/
+
+#ifdef HAS_HEADLESS
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#include "../config.h"
+#include "../color.h"
+#include "../pixmap.h"
+#include "hdl_target.h"
+#include "hdl_present_data.h"
+
+typedef struct surface_impl_hdl_t {
+  impl_type_t type;
+} surface_impl_hdl_t;
+
+surface_impl_hdl_t *
+surface_create_hdl_impl(
+  hdl_target_t *target,
+  int32_t width,
+  int32_t height,
+  color_t_ **data)
+{
+  assert(target != NULL);
+  assert(width > 0);
+  assert(height > 0);
+  assert(data != NULL);
+  assert(*data == NULL);
+
+  surface_impl_hdl_t *impl =
+    (surface_impl_hdl_t *)calloc(1, sizeof(surface_impl_hdl_t));
+  if (impl == NULL) {
+    return NULL;
+  }
+
+  *data = (color_t_ *)calloc(width * height, sizeof(color_t_));
+  if (*data == NULL) {
+    free(impl);
+    return NULL;
+  }
+
+  impl->type = IMPL_HEADLESS;
+
+  return impl;
+}
+
+void
+surface_destroy_hdl_impl(
+  surface_impl_hdl_t *impl)
+{
+  assert(impl != NULL);
+  assert(impl->type == IMPL_HEADLESS);
+
+  /* The data is freed by the generic surface code */
+}
+
+bool
+surface_resize_hdl_impl(
+  surface_impl_hdl_t *impl,
+  int32_t s_width,
+  int32_t s_height,
+  int32_t s_stride,
+  color_t_ **s_data,
+  int32_t d_width,
+  int32_t d_height,
+  int32_t d_stride,
+  int32_t d_rows,
+  color_t_ **d_data)
+{
+  assert(impl != NULL);
+  assert(s_width > 0);
+  assert(s_height > 0);
+  assert(s_stride >= s_width);
+  assert(s_data != NULL);
+  assert(*s_data != NULL);
+  assert(d_width > 0);
+  assert(d_height > 0);
+  assert(d_stride >= d_width);
+  assert(d_rows >= d_height);
+  assert(d_data != NULL);
+  assert(*d_data == NULL);
+
+  *d_data = (color_t_ *)calloc((size_t)d_stride * d_rows, sizeof(color_t_));
+  if (*d_data == NULL) {
+    return false;
+  }
+
+  pixmap_t sp = pixmap_strided(s_width, s_height, s_stride, *s_data);
+  pixmap_t dp = pixmap_strided(d_width, d_height, d_stride, *d_data);
+  pixmap_blit(&dp, 0, 0, &sp, 0, 0, d_width, d_height);
+
+  free(*s_data);
+
+  return true;
+}
+
+void
+surface_present_hdl_impl(
+  surface_impl_hdl_t *impl,
+  int32_t width,
+  int32_t height,
+  hdl_present_data_t *present_data)
+{
+  assert(impl != NULL);
+  assert(present_data != NULL);
+  assert(width > 0);
+  assert(height > 0);
+
+  /* Nothing to present to */
+}
+
+#else
+
+const int hdl_surface = 0;
+
+#endif /* HAS_HEADLESS */
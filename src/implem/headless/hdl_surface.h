@@ -0,0 +1,54 @@
+/**************************************************************************/
+/*                                                                        */
+/*    Copyright 2022 OCamlPro                                             */
+/*                                                                        */
+/*  All rights reserved. This file is distributed under the terms of the  */
+/*  GNU Lesser General Public License version 2.1, with the special       */
+/*  exception on linking described in the file LICENSE.                   */
+/*                                                                        */
+/**************************************************************************/
+
+#ifndef __HDL_SURFACE_H
+#define __HDL_SURFACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "../color.h"
+#include "hdl_target.h"
+#include "hdl_present_data.h"
+
+typedef struct surface_impl_hdl_t surface_impl_hdl_t;
+
+surface_impl_hdl_t *
+surface_create_hdl_impl(
+  hdl_target_t *target,
+  int32_t width,
+  int32_t height,
+  color_t_ **data);
+
+void
+surface_destroy_hdl_impl(
+  surface_impl_hdl_t *impl);
+
+bool
+surface_resize_hdl_impl(
+  surface_impl_hdl_t *impl,
+  int32_t s_width,
+  int32_t s_height,
+  int32_t s_stride,
+  color_t_ **s_data,
+  int32_t d_width,
+  int32_t d_height,
+  int32_t d_stride,
+  int32_t d_rows,
+  color_t_ **d_data);
+
+void
+surface_present_hdl_impl(
+  surface_impl_hdl_t *impl,
+  int32_t width,
+  int32_t height,
+  hdl_present_data_t *present_data);
+
+#endif /* __HDL_SURFACE_H */
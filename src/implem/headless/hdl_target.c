@@ -0,0 +1,37 @@
+/**************************************************************************/
+/*                                                                        */
+/*    Copyright 2022 OCamlPro                                             */
+/*                                                                        */
+/*  All rights reserved. This file is distributed under the terms of the  */
+/*  GNU Lesser General Public License version 2.1, with the special       */
+/*  exception on linking described in the file LICENSE.                   */
+/*                                                                        */
+/**************************************************************************/
+
+#ifdef HAS_HEADLESS
+
+#include <stdlib.h>
+#include <assert.h>
+
+#include "hdl_target.h"
+
+hdl_target_t *
+hdl_target_create(
+  void)
+{
+  return (hdl_target_t *)calloc(1, sizeof(hdl_target_t));
+}
+
+void
+hdl_target_destroy(
+  hdl_target_t *target)
+{
+  assert(target != NULL);
+  free(target);
+}
+
+#else
+
+const int hdl_target = 0;
+
+#endif /* HAS_HEADLESS */
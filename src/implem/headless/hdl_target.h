@@ -0,0 +1,26 @@
+/**************************************************************************/
+/*                                                                        */
+/*    Copyright 2022 OCamlPro                                             */
+/*                                                                        */
+/*  All rights reserved. This file is distributed under the terms of the  */
+/*  GNU Lesser General Public License version 2.1, with the special       */
+/*  exception on linking described in the file LICENSE.                   */
+/*                                                                        */
+/**************************************************************************/
+
+#ifndef __HDL_TARGET_H
+#define __HDL_TARGET_H
+
+typedef struct hdl_target_t {
+  void *dummy;
+} hdl_target_t;
+
+hdl_target_t *
+hdl_target_create(
+  void);
+
+void
+hdl_target_destroy(
+  hdl_target_t *target);
+
+#endif /* __HDL_TARGET_H */
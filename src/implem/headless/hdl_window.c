@@ -0,0 +1,125 @@
+/**************************************************************************/
+/*                                                                        */
+/*    Copyright 2022 OCamlPro                                             */
+/*                                                                        */
+/*  All rights reserved. This file is distributed under the terms of the  */
+/*  GNU Lesser General Public License version 2.1, with the special       */
+/*  exception on linking described in the file LICENSE.                   */
+/*                                                                        */
+/**************************************************************************/
+
+#ifdef HAS_HEADLESS
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#include "../util.h"
+#include "hdl_backend.h"
+#include "hdl_target.h"
+#include "hdl_window_internal.h"
+
+hdl_window_t *
+hdl_window_create(
+  bool decorated,
+  const char *title,
+  int32_t x,
+  int32_t y,
+  int32_t width,
+  int32_t height)
+{
+  hdl_window_t *window = (hdl_window_t *)calloc(1, sizeof(hdl_window_t));
+  if (window == NULL) {
+    return NULL;
+  }
+
+  window->base.visible = false;
+  window->base.decorated = decorated;
+  window->base.x = x;
+  window->base.y = y;
+  window->base.width = max(1, width);
+  window->base.height = max(1, height);
+
+  hdl_backend_add_window(window);
+
+  return window;
+}
+
+void
+hdl_window_destroy(
+  hdl_window_t *window)
+{
+  assert(window != NULL);
+
+  hdl_backend_remove_window(window);
+  free(window);
+}
+
+hdl_target_t *
+hdl_window_get_target(
+  hdl_window_t *window)
+{
+  assert(window != NULL);
+
+  return hdl_target_create();
+}
+
+void
+hdl_window_set_title(
+  hdl_window_t *window,
+  const char *title)
+{
+  assert(window != NULL);
+  assert(title != NULL);
+
+  /* Nothing to show the title on */
+}
+
+void
+hdl_window_set_size(
+  hdl_window_t *window,
+  int32_t width,
+  int32_t height)
+{
+  assert(window != NULL);
+
+  window->base.width = width;
+  window->base.height = height;
+}
+
+void
+hdl_window_set_position(
+  hdl_window_t *window,
+  int32_t x,
+  int32_t y)
+{
+  assert(window != NULL);
+
+  window->base.x = x;
+  window->base.y = y;
+}
+
+void
+hdl_window_show(
+  hdl_window_t *window)
+{
+  assert(window != NULL);
+
+  /* Visibility is tracked by the common window code */
+}
+
+void
+hdl_window_hide(
+  hdl_window_t *window)
+{
+  assert(window != NULL);
+
+  /* Visibility is tracked by the common window code */
+}
+
+#else
+
+const int hdl_window = 0;
+
+#endif /* HAS_HEADLESS */
@@ -0,0 +1,63 @@
+/**************************************************************************/
+/*                                                                        */
+/*    Copyright 2022 OCamlPro                                             */
+/*                                                                        */
+/*  All rights reserved. This file is distributed under the terms of the  */
+/*  GNU Lesser General Public License version 2.1, with the special       */
+/*  exception on linking described in the file LICENSE.                   */
+/*                                                                        */
+/**************************************************************************/
+
+#ifndef __HDL_WINDOW_H
+#define __HDL_WINDOW_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "hdl_target.h"
+
+typedef struct hdl_window_t hdl_window_t;
+
+hdl_window_t *
+hdl_window_create(
+  bool decorated,
+  const char *title,
+  int32_t x,
+  int32_t y,
+  int32_t width,
+  int32_t height);
+
+void
+hdl_window_destroy(
+  hdl_window_t *window);
+
+hdl_target_t *
+hdl_window_get_target(
+  hdl_window_t *window);
+
+void
+hdl_window_set_title(
+  hdl_window_t *window,
+  const char *title);
+
+void
+hdl_window_set_size(
+  hdl_window_t *window,
+  int32_t width,
+  int32_t height);
+
+void
+hdl_window_set_position(
+  hdl_window_t *window,
+  int32_t x,
+  int32_t y);
+
+void
+hdl_window_show(
+  hdl_window_t *window);
+
+void
+hdl_window_hide(
+  hdl_window_t *window);
+
+#endif /* __HDL_WINDOW_H */
@@ -0,0 +1,27 @@
+/**************************************************************************/
+/*                                                                        */
+/*    Copyright 2022 OCamlPro                                             */
+/*                                                                        */
+/*  All rights reserved. This file is distributed under the terms of the  */
+/*  GNU Lesser General Public License version 2.1, with the special       */
+/*  exception on linking described in the file LICENSE.                   */
+/*                                                                        */
+/**************************************************************************/
+
+#ifndef __HDL_WINDOW_INTERNAL_H
+#define __HDL_WINDOW_INTERNAL_H
+
+#include "../window_internal.h"
+
+typedef struct hdl_window_t {
+
+  /* Common to all windows */
+  window_t base;
+
+  /* Specific to headless windows */
+  struct hdl_window_t *prev;
+  struct hdl_window_t *next;
+
+} hdl_window_t;
+
+#endif /* __HDL_WINDOW_INTERNAL_H */
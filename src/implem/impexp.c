@@ -11,10 +11,17 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <string.h>
 #include <assert.h>
 
 #include "config.h"
+#include "util.h"
+#include "unicode.h"
+#include "color.h"
 #include "pixmap.h"
+#include "impexp.h"
+#include "trace.h"
 
 #ifdef HAS_GDI
 #include "gdi/gdi_impexp.h"
@@ -22,10 +29,30 @@
 #ifdef HAS_QUARTZ
 #include "quartz/qtz_impexp.h"
 #endif
-#if defined HAS_X11 || defined HAS_WAYLAND
+#if defined HAS_X11 || defined HAS_WAYLAND || defined HAS_HEADLESS
 #include "unix/unx_impexp.h"
 #endif
 
+#if defined HAS_GDI || defined HAS_QUARTZ
+/* Backends without a worker pool decode synchronously */
+static bool
+_impexp_import_png_now(
+  const char *filename,
+  impexp_import_done_fun_t *fun,
+  void *data)
+{
+  assert(filename != NULL);
+  assert(fun != NULL);
+
+  pixmap_t pixmap = pixmap_null();
+  if (impexp_import_png(&pixmap, 0, 0, filename) == false) {
+    pixmap = pixmap_null();
+  }
+  fun(pixmap, data);
+  return true;
+}
+#endif /* HAS_GDI || HAS_QUARTZ */
+
 bool
 impexp_init(
   void)
@@ -37,6 +64,7 @@ impexp_init(
     case_QUARTZ(res = qtz_impexp_init());
     case_X11(res = unx_impexp_init());
     case_WAYLAND(res = unx_impexp_init());
+    case_HEADLESS(res = unx_impexp_init());
     default_fail();
   }
 
@@ -52,6 +80,7 @@ impexp_terminate(
     case_QUARTZ(qtz_impexp_terminate());
     case_X11(unx_impexp_terminate());
     case_WAYLAND(unx_impexp_terminate());
+    case_HEADLESS(unx_impexp_terminate());
     default_fail();
   }
 }
@@ -59,7 +88,8 @@ impexp_terminate(
 bool
 impexp_export_png(
   const pixmap_t *pixmap,
-  const char *filename)
+  const char *filename,
+  const impexp_png_options_t *options)
 {
   assert(pixmap != NULL);
   assert(pixmap_valid(*pixmap));
@@ -67,14 +97,62 @@ impexp_export_png(
 
   bool res = false;
 
+  const impexp_png_options_t default_options = impexp_png_options_default();
+  if (options == NULL) {
+    options = &default_options;
+  }
+
+  int64_t trace_t = trace_begin();
+
   switch_IMPL() {
     case_GDI(res = gdi_impexp_export_png(pixmap, filename));
     case_QUARTZ(res = qtz_impexp_export_png(pixmap, filename));
-    case_X11(res = unx_impexp_export_png(pixmap, filename));
-    case_WAYLAND(res = unx_impexp_export_png(pixmap, filename));
+    case_X11(res = unx_impexp_export_png(pixmap, filename, options));
+    case_WAYLAND(res = unx_impexp_export_png(pixmap, filename, options));
+    case_HEADLESS(res = unx_impexp_export_png(pixmap, filename, options));
     default_fail();
   }
 
+  trace_end("png_encode", trace_t);
+
+  return res;
+}
+
+bool
+impexp_export_png_to_memory(
+  const pixmap_t *pixmap,
+  const impexp_png_options_t *options,
+  uint8_t **data,
+  size_t *size)
+{
+  assert(pixmap != NULL);
+  assert(pixmap_valid(*pixmap));
+  assert(data != NULL);
+  assert(size != NULL);
+
+  bool res = false;
+
+  const impexp_png_options_t default_options = impexp_png_options_default();
+  if (options == NULL) {
+    options = &default_options;
+  }
+
+  int64_t trace_t = trace_begin();
+
+  switch_IMPL() {
+    case_GDI(res = gdi_impexp_export_png_to_memory(pixmap, data, size));
+    case_QUARTZ(res = qtz_impexp_export_png_to_memory(pixmap, data, size));
+    case_X11(res = unx_impexp_export_png_to_memory(pixmap, options,
+                                                   data, size));
+    case_WAYLAND(res = unx_impexp_export_png_to_memory(pixmap, options,
+                                                       data, size));
+    case_HEADLESS(res = unx_impexp_export_png_to_memory(pixmap, options,
+                                                        data, size));
+    default_fail();
+  }
+
+  trace_end("png_encode", trace_t);
+
   return res;
 }
 
@@ -90,13 +168,184 @@ impexp_import_png(
 
   bool res = false;
 
+  int64_t trace_t = trace_begin();
+
   switch_IMPL() {
     case_GDI(res = gdi_impexp_import_png(pixmap, x, y, filename));
     case_QUARTZ(res = qtz_impexp_import_png(pixmap, x, y, filename));
     case_X11(res = unx_impexp_import_png(pixmap, x, y, filename));
     case_WAYLAND(res = unx_impexp_import_png(pixmap, x, y, filename));
+    case_HEADLESS(res = unx_impexp_import_png(pixmap, x, y, filename));
+    default_fail();
+  }
+
+  trace_end("png_decode", trace_t);
+
+  return res;
+}
+
+bool
+impexp_import_png_async(
+  const char *filename,
+  impexp_import_done_fun_t *fun,
+  void *data)
+{
+  assert(filename != NULL);
+  assert(fun != NULL);
+
+  bool res = false;
+
+  switch_IMPL() {
+    case_GDI(res = _impexp_import_png_now(filename, fun, data));
+    case_QUARTZ(res = _impexp_import_png_now(filename, fun, data));
+    case_X11(res = unx_impexp_import_png_async(filename, fun, data));
+    case_WAYLAND(res = unx_impexp_import_png_async(filename, fun, data));
+    case_HEADLESS(res = unx_impexp_import_png_async(filename, fun, data));
     default_fail();
   }
 
   return res;
 }
+
+static FILE *
+_impexp_open(
+  const char *filename,
+  bool write)
+{
+  assert(filename != NULL);
+
+#if defined(_WIN32) || defined(_WIN64)
+  wchar_t *wfilename = mbs_to_wcs(filename);
+  if (wfilename == NULL) {
+    return NULL;
+  }
+  FILE *fp = _wfopen(wfilename, write ? L"wb" : L"rb");
+  free(wfilename);
+  return fp;
+#else
+  return fopen(filename, write ? "wb" : "rb");
+#endif
+}
+
+static void
+_impexp_put_uint32_le(
+  uint8_t *p,
+  uint32_t v)
+{
+  p[0] = (uint8_t)(v >> 0);
+  p[1] = (uint8_t)(v >> 8);
+  p[2] = (uint8_t)(v >> 16);
+  p[3] = (uint8_t)(v >> 24);
+}
+
+static uint32_t
+_impexp_get_uint32_le(
+  const uint8_t *p)
+{
+  return ((uint32_t)p[0] << 0) | ((uint32_t)p[1] << 8) |
+         ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+bool
+impexp_export_snapshot(
+  const pixmap_t *pixmap,
+  const char *filename)
+{
+  assert(pixmap != NULL);
+  assert(pixmap_valid(*pixmap));
+  assert(filename != NULL);
+
+  FILE *fp = _impexp_open(filename, true);
+  if (fp == NULL) {
+    return false;
+  }
+
+  uint8_t header[IMPEXP_SNAPSHOT_HEADER_SIZE] = { 0 };
+  memcpy(header, IMPEXP_SNAPSHOT_MAGIC, 8);
+  _impexp_put_uint32_le(header + 8, (uint32_t)pixmap->width);
+  _impexp_put_uint32_le(header + 12, (uint32_t)pixmap->height);
+
+  bool res = (fwrite(header, IMPEXP_SNAPSHOT_HEADER_SIZE, 1, fp) == 1);
+
+  if (pixmap_is_compact(*pixmap) == true) {
+    res = res &&
+      (fwrite(pixmap->data, (size_t)pixmap->width * COLOR_SIZE,
+              pixmap->height, fp) == (size_t)pixmap->height);
+  } else {
+    for (int32_t i = 0; res && (i < pixmap->height); ++i) {
+      res = (fwrite(&pixmap_at(*pixmap, i, 0),
+                    (size_t)pixmap->width * COLOR_SIZE, 1, fp) == 1);
+    }
+  }
+
+  if (fclose(fp) != 0) {
+    res = false;
+  }
+
+  return res;
+}
+
+bool
+impexp_import_snapshot(
+  pixmap_t *pixmap,
+  int32_t dx,
+  int32_t dy,
+  const char *filename)
+{
+  assert(pixmap != NULL);
+  assert((pixmap->data != NULL) ||
+         ((dx == 0) && (dy == 0)));
+  assert((pixmap->data == NULL) || pixmap_valid(*pixmap));
+  assert(filename != NULL);
+
+  FILE *fp = _impexp_open(filename, false);
+  if (fp == NULL) {
+    return false;
+  }
+
+  bool res = false;
+
+  uint8_t header[IMPEXP_SNAPSHOT_HEADER_SIZE] = { 0 };
+  if ((fread(header, IMPEXP_SNAPSHOT_HEADER_SIZE, 1, fp) != 1) ||
+      (memcmp(header, IMPEXP_SNAPSHOT_MAGIC, 8) != 0)) {
+    goto error;
+  }
+
+  uint32_t swidth = _impexp_get_uint32_le(header + 8);
+  uint32_t sheight = _impexp_get_uint32_le(header + 12);
+  if ((swidth == 0) || (sheight == 0) ||
+      ((uint64_t)swidth * sheight > INT32_MAX / COLOR_SIZE)) {
+    goto error;
+  }
+
+  if (pixmap->data == NULL) {
+    /* Whole snapshot: a single read straight into the new pixmap */
+    pixmap_t pm = pixmap((int32_t)swidth, (int32_t)sheight, NULL);
+    res = (pm.data != NULL) &&
+          (fread(pm.data, (size_t)swidth * COLOR_SIZE,
+                 sheight, fp) == sheight);
+    if (res == true) {
+      *pixmap = pm;
+    } else {
+      pixmap_destroy(pm);
+    }
+  } else {
+    int32_t sx = 0, sy = 0;
+    int32_t width = (int32_t)swidth, height = (int32_t)sheight;
+    adjust_blit_info(pixmap->width, pixmap->height, dx, dy,
+                     (int32_t)swidth, (int32_t)sheight, sx, sy,
+                     width, height);
+    res = true;
+    for (int32_t i = 0; res && (i < height); ++i) {
+      long offset = IMPEXP_SNAPSHOT_HEADER_SIZE +
+        ((long)(sy + i) * (long)swidth + sx) * COLOR_SIZE;
+      res = (fseek(fp, offset, SEEK_SET) == 0) &&
+            (fread(&pixmap_at(*pixmap, dy + i, dx),
+                   (size_t)width * COLOR_SIZE, 1, fp) == 1);
+    }
+  }
+
+error:
+  fclose(fp);
+  return res;
+}
@@ -12,10 +12,47 @@
 #define __IMPEXP_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include "pixmap.h"
 
+typedef enum impexp_filter_t {
+  IMPEXP_FILTER_ADAPTIVE = 0,
+  IMPEXP_FILTER_NONE     = 1,
+  IMPEXP_FILTER_SUB      = 2,
+  IMPEXP_FILTER_UP       = 3,
+  IMPEXP_FILTER_AVERAGE  = 4,
+  IMPEXP_FILTER_PAETH    = 5
+} impexp_filter_t;
+
+typedef enum impexp_strategy_t {
+  IMPEXP_STRATEGY_DEFAULT      = 0,
+  IMPEXP_STRATEGY_FILTERED     = 1,
+  IMPEXP_STRATEGY_HUFFMAN_ONLY = 2,
+  IMPEXP_STRATEGY_RLE          = 3,
+  IMPEXP_STRATEGY_FIXED        = 4
+} impexp_strategy_t;
+
+// PNG encoding options; a negative level selects the encoder default.
+// In parallel mode, strips of rows are filtered and deflated on all
+// processors. These are only hints: backends relying on the system
+// image codecs (GDI+, ImageIO) ignore them.
+typedef struct impexp_png_options_t {
+  int32_t level;
+  impexp_filter_t filter;
+  impexp_strategy_t strategy;
+  bool parallel;
+} impexp_png_options_t;
+
+#define impexp_png_options_default() \
+  ((impexp_png_options_t){ -1, IMPEXP_FILTER_ADAPTIVE, \
+                           IMPEXP_STRATEGY_DEFAULT, false })
+
+// Receives the result of an asynchronous import, from an unspecified
+// thread; the pixmap is null on failure, and owned by the callee
+typedef void impexp_import_done_fun_t(pixmap_t pixmap, void *data);
+
 bool
 impexp_init(
   void);
@@ -24,10 +61,21 @@ void
 impexp_terminate(
   void);
 
+// Options may be NULL, in which case the defaults are used
 bool
 impexp_export_png(
   const pixmap_t *pixmap,
-  const char *filename);
+  const char *filename,
+  const impexp_png_options_t *options);
+
+// On success, *data points to a buffer of *size bytes,
+// allocated with malloc, that the caller must free
+bool
+impexp_export_png_to_memory(
+  const pixmap_t *pixmap,
+  const impexp_png_options_t *options,
+  uint8_t **data,
+  size_t *size);
 
 bool
 impexp_import_png(
@@ -36,4 +84,35 @@ impexp_import_png(
   int32_t y,
   const char *filename);
 
+// Decodes the given file into a new pixmap on a background thread
+// (or right away on backends that lack one), then calls fun
+bool
+impexp_import_png_async(
+  const char *filename,
+  impexp_import_done_fun_t *fun,
+  void *data);
+
+// Snapshots hold a 16 bytes header (the IMPEXP_SNAPSHOT_MAGIC signature,
+// then the width and height as little-endian 32-bit integers),
+// followed by the pixels in memory order (compact BGRA rows).
+// They need no decoding, and can even be memory-mapped straight
+// into an image data, starting at offset IMPEXP_SNAPSHOT_HEADER_SIZE.
+#define IMPEXP_SNAPSHOT_MAGIC "OCNVBGRA"
+#define IMPEXP_SNAPSHOT_HEADER_SIZE 16
+
+bool
+impexp_export_snapshot(
+  const pixmap_t *pixmap,
+  const char *filename);
+
+// Same as impexp_import_png: if the pixmap has no data, it is
+// allocated with the snapshot size, otherwise the snapshot is
+// copied into it at the given position
+bool
+impexp_import_snapshot(
+  pixmap_t *pixmap,
+  int32_t x,
+  int32_t y,
+  const char *filename);
+
 #endif /* __IMPEXP_H */
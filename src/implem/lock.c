@@ -0,0 +1,40 @@
+/**************************************************************************/
+/*                                                                        */
+/*    Copyright 2022 OCamlPro                                             */
+/*                                                                        */
+/*  All rights reserved. This file is distributed under the terms of the  */
+/*  GNU Lesser General Public License version 2.1, with the special       */
+/*  exception on linking described in the file LICENSE.                   */
+/*                                                                        */
+/**************************************************************************/
+
+
+#include <assert.h>
+
+#include "lock.h"
+
+void
+lock_acquire(
+  lock_t *l)
+{
+  assert(l != NULL);
+
+#if defined(_WIN32) || defined(_WIN64)
+  AcquireSRWLockExclusive(l);
+#else
+  pthread_mutex_lock(l);
+#endif
+}
+
+void
+lock_release(
+  lock_t *l)
+{
+  assert(l != NULL);
+
+#if defined(_WIN32) || defined(_WIN64)
+  ReleaseSRWLockExclusive(l);
+#else
+  pthread_mutex_unlock(l);
+#endif
+}
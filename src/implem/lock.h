@@ -0,0 +1,36 @@
+/**************************************************************************/
+/*                                                                        */
+/*    Copyright 2022 OCamlPro                                             */
+/*                                                                        */
+/*  All rights reserved. This file is distributed under the terms of the  */
+/*  GNU Lesser General Public License version 2.1, with the special       */
+/*  exception on linking described in the file LICENSE.                   */
+/*                                                                        */
+/**************************************************************************/
+
+
+#ifndef __LOCK_H
+#define __LOCK_H
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
+typedef SRWLOCK lock_t;
+#define LOCK_INITIALIZER SRWLOCK_INIT
+#else
+#include <pthread.h>
+typedef pthread_mutex_t lock_t;
+#define LOCK_INITIALIZER PTHREAD_MUTEX_INITIALIZER
+#endif
+
+// Locks are meant to be statically allocated and
+// initialized with LOCK_INITIALIZER; they are not recursive
+
+void
+lock_acquire(
+  lock_t *l);
+
+void
+lock_release(
+  lock_t *l);
+
+#endif /* __LOCK_H */
@@ -12,11 +12,15 @@
 #define __OBJECT_H
 
 #include <stdlib.h>
+#include <stdatomic.h>
 #include <assert.h>
 
+// The reference count is atomic, so that objects (e.g. styles or
+// paths) may be retained and released from several domains; the
+// objects themselves are not otherwise synchronized
 typedef struct object_t {
   void *data;
-  int32_t count;
+  atomic_int_fast32_t count;
 } object_t;
 
 #define INHERITS(type)                                                        \
@@ -38,7 +42,7 @@ static type * prefix##_alloc(void)                                            \
   type *o = (type *)malloc(sizeof(type));                                     \
   if (o != NULL) {                                                            \
     ((object_t *)o)->data = NULL;                                             \
-    ((object_t *)o)->count = 1;                                               \
+    atomic_init(&((object_t *)o)->count, 1);                                  \
   }                                                                           \
   return o;                                                                   \
 }                                                                             \
@@ -46,9 +50,10 @@ static type * prefix##_alloc(void)                                            \
 type * prefix##_retain(type *o)                                               \
 {                                                                             \
   assert(o != NULL);                                                          \
-  assert((((object_t *)o)->count) > 0);                                       \
+  assert(atomic_load(&((object_t *)o)->count) > 0);                           \
                                                                               \
-  ++((object_t *)o)->count;                                                   \
+  atomic_fetch_add_explicit(&((object_t *)o)->count, 1,                       \
+                            memory_order_relaxed);                            \
   return o;                                                                   \
 }                                                                             \
                                                                               \
@@ -57,9 +62,10 @@ static void destroy(type *o);                                                 \
 void prefix##_release(type *o)                                                \
 {                                                                             \
   assert(o != NULL);                                                          \
-  assert((((object_t *)o)->count) > 0);                                       \
+  assert(atomic_load(&((object_t *)o)->count) > 0);                           \
                                                                               \
-  if (--(((object_t *)o)->count) == 0) {                                      \
+  if (atomic_fetch_sub_explicit(&((object_t *)o)->count, 1,                   \
+                                memory_order_acq_rel) == 1) {                 \
     destroy(o);                                                               \
   }                                                                           \
 }                                                                             \
@@ -74,7 +80,7 @@ void prefix##_set_data(type *o, void *data)                                   \
 void * prefix##_get_data(type *o)                                             \
 {                                                                             \
   assert(o != NULL);                                                          \
-  assert(((object_t *)o)->count > 0);                                         \
+  assert(atomic_load(&((object_t *)o)->count) > 0);                           \
                                                                               \
   return ((object_t *)o)->data;                                               \
 }
@@ -146,6 +146,19 @@ path_empty(
   return (path->nb_prims <= 0);
 }
 
+bool
+path_reserve(
+  path_t *path,
+  int32_t nb_new_prims,
+  int32_t nb_new_points)
+{
+  assert(path != NULL);
+  assert(nb_new_prims >= 0);
+  assert(nb_new_points >= 0);
+
+  return _path_ensures(path, nb_new_prims, nb_new_points);
+}
+
 bool
 path_add_close_path(
   path_t *path)
@@ -44,6 +44,12 @@ bool
 path_empty(
   path_t *path);
 
+bool
+path_reserve(
+  path_t *path,
+  int32_t nb_new_prims,
+  int32_t nb_new_points);
+
 bool
 path_add_close_path(
   path_t *path);
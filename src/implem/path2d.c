@@ -8,6 +8,7 @@
 /*                                                                        */
 /**************************************************************************/
 
+#include <stdint.h>
 #include <stdbool.h>
 #include <assert.h>
 
@@ -133,6 +134,48 @@ path2d_line_to(
   return path_add_line_to(path2d->path, p.x, p.y);
 }
 
+bool
+path2d_add_points(
+  path2d_t *path2d,
+  const double *coords,
+  const uint8_t *moves,
+  int32_t nb_points,
+  const transform_t *t)
+{
+  assert(path2d != NULL);
+  assert(path2d->path != NULL);
+  assert((coords != NULL) || (nb_points == 0));
+  assert(nb_points >= 0);
+
+  // Reserve space once, so that no reallocation occurs below
+  if (path_reserve(path2d->path, nb_points, nb_points) == false) {
+    return false;
+  }
+
+  for (int32_t i = 0; i < nb_points; ++i) {
+
+    double x = coords[2 * i];
+    double y = coords[2 * i + 1];
+    bool is_move = (moves == NULL) ? (i == 0) : (moves[i] != 0);
+
+    point_t p = point(x, y);
+    if (t != NULL) {
+      transform_apply(t, &p);
+    }
+
+    _path2d_update_first_last(path2d, p.x, p.y, x, y, x, y, is_move);
+
+    bool res = is_move ?
+      path_add_move_to(path2d->path, p.x, p.y) :
+      path_add_line_to(path2d->path, p.x, p.y);
+    if (res == false) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
 bool
 path2d_quadratic_curve_to(
   path2d_t *path2d,
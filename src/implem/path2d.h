@@ -11,6 +11,9 @@
 #ifndef __PATH2D_H
 #define __PATH2D_H
 
+#include <stdint.h>
+#include <stdbool.h>
+
 #include "object.h"
 #include "path.h"
 #include "transform.h"
@@ -45,6 +48,17 @@ path2d_line_to(
   double y,
   const transform_t *t);
 
+// Adds nb_points points given as consecutive x/y coordinates,
+// all as lines, except for the points with a non-zero move flag,
+// or for the first point when no move flags are given
+bool
+path2d_add_points(
+  path2d_t *path2d,
+  const double *coords,
+  const uint8_t *moves,
+  int32_t nb_points,
+  const transform_t *t);
+
 void
 path2d_arc(
   path2d_t *path2d,
@@ -32,7 +32,7 @@ pattern_create(
   }
 
   p->repeat = repeat;
-  p->image = pixmap_copy(*image);
+  p->image = pixmap_copy(image);
   if (pixmap_valid(p->image) == false) {
     free(p);
     return NULL;
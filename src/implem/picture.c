@@ -0,0 +1,211 @@
+/**************************************************************************/
+/*                                                                        */
+/*    Copyright 2022 OCamlPro                                             */
+/*                                                                        */
+/*  All rights reserved. This file is distributed under the terms of the  */
+/*  GNU Lesser General Public License version 2.1, with the special       */
+/*  exception on linking described in the file LICENSE.                   */
+/*                                                                        */
+/**************************************************************************/
+
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#include "util.h"
+#include "pixmap.h"
+#include "polygon.h"
+#include "draw_style.h"
+#include "picture.h"
+#include "picture_internal.h"
+
+IMPLEMENT_OBJECT_METHODS(picture_t, picture, _picture_destroy)
+
+picture_t *
+picture_create(
+  void)
+{
+  picture_t *pic = picture_alloc();
+  if (pic == NULL) {
+    return NULL;
+  }
+
+  pic->items = NULL;
+  pic->nb_items = 0;
+  pic->max_items = 0;
+  pic->has_clip = false;
+
+  return pic;
+}
+
+static void
+_picture_destroy(
+  picture_t *pic)
+{
+  assert(pic != NULL);
+
+  for (int32_t i = 0; i < pic->nb_items; ++i) {
+    picture_item_t *item = &pic->items[i];
+    if (item->poly != NULL) {
+      polygon_destroy(item->poly);
+    }
+    if (item->type == PICTURE_ITEM_POLY) {
+      if (item->draw_style.type == DRAW_STYLE_PIXMAP) {
+        pixmap_destroy(item->image);
+      } else {
+        draw_style_destroy(&item->draw_style);
+      }
+    }
+  }
+
+  if (pic->items != NULL) {
+    free(pic->items);
+  }
+
+  free(pic);
+}
+
+/* Returns a zeroed item at the end of the list, or NULL */
+static picture_item_t *
+_picture_push_item(
+  picture_t *pic,
+  picture_item_type_t type)
+{
+  assert(pic != NULL);
+
+  if (pic->nb_items == pic->max_items) {
+    int32_t max_items = max(16, pic->max_items * 2);
+    picture_item_t *items = (picture_item_t *)
+      realloc(pic->items, max_items * sizeof(picture_item_t));
+    if (items == NULL) {
+      return NULL;
+    }
+    pic->items = items;
+    pic->max_items = max_items;
+  }
+
+  picture_item_t *item = &pic->items[pic->nb_items++];
+  *item = (picture_item_t){ 0 };
+  item->type = type;
+
+  return item;
+}
+
+bool
+picture_add_poly(
+  picture_t *pic,
+  const polygon_t *p,
+  const rect_t *bbox,
+  draw_style_t draw_style,
+  double global_alpha,
+  color_t_ shadow_color,
+  double shadow_blur,
+  double shadow_offset_x,
+  double shadow_offset_y,
+  composite_operation_t op,
+  bool non_zero,
+  const transform_t *transform)
+{
+  assert(pic != NULL);
+  assert(p != NULL);
+  assert(bbox != NULL);
+  assert(transform != NULL);
+
+  pixmap_t image = pixmap_null();
+  if (draw_style.type == DRAW_STYLE_PIXMAP) {
+    assert(draw_style.content.pixmap != NULL);
+    image = pixmap_copy(draw_style.content.pixmap);
+    if (pixmap_valid(image) == false) {
+      return false;
+    }
+  }
+
+  polygon_t *poly = polygon_copy(p);
+  if (poly == NULL) {
+    pixmap_destroy(image);
+    return false;
+  }
+
+  picture_item_t *item = _picture_push_item(pic, PICTURE_ITEM_POLY);
+  if (item == NULL) {
+    polygon_destroy(poly);
+    pixmap_destroy(image);
+    return false;
+  }
+
+  item->poly = poly;
+  item->bbox = *bbox;
+  if (draw_style.type == DRAW_STYLE_PIXMAP) {
+    item->image = image;
+    item->draw_style = draw_style;
+    item->draw_style.content.pixmap = NULL; // points to image on replay
+  } else {
+    item->draw_style = draw_style_copy(&draw_style);
+  }
+  item->transform = *transform;
+  item->global_alpha = global_alpha;
+  item->shadow_color = shadow_color;
+  item->shadow_blur = shadow_blur;
+  item->shadow_offset_x = shadow_offset_x;
+  item->shadow_offset_y = shadow_offset_y;
+  item->op = op;
+  item->non_zero = non_zero;
+
+  return true;
+}
+
+bool
+picture_add_clip(
+  picture_t *pic,
+  const polygon_t *p,
+  bool non_zero)
+{
+  assert(pic != NULL);
+  assert(p != NULL);
+
+  polygon_t *poly = polygon_copy(p);
+  if (poly == NULL) {
+    return false;
+  }
+
+  picture_item_t *item = _picture_push_item(pic, PICTURE_ITEM_CLIP);
+  if (item == NULL) {
+    polygon_destroy(poly);
+    return false;
+  }
+
+  item->poly = poly;
+  item->non_zero = non_zero;
+  pic->has_clip = true;
+
+  return true;
+}
+
+bool
+picture_add_save(
+  picture_t *pic)
+{
+  assert(pic != NULL);
+
+  return _picture_push_item(pic, PICTURE_ITEM_SAVE) != NULL;
+}
+
+bool
+picture_add_restore(
+  picture_t *pic)
+{
+  assert(pic != NULL);
+
+  return _picture_push_item(pic, PICTURE_ITEM_RESTORE) != NULL;
+}
+
+int32_t
+picture_get_item_count(
+  const picture_t *pic)
+{
+  assert(pic != NULL);
+
+  return pic->nb_items;
+}
@@ -0,0 +1,75 @@
+/**************************************************************************/
+/*                                                                        */
+/*    Copyright 2022 OCamlPro                                             */
+/*                                                                        */
+/*  All rights reserved. This file is distributed under the terms of the  */
+/*  GNU Lesser General Public License version 2.1, with the special       */
+/*  exception on linking described in the file LICENSE.                   */
+/*                                                                        */
+/**************************************************************************/
+
+
+#ifndef __PICTURE_H
+#define __PICTURE_H
+
+#include <stdbool.h>
+
+#include "object.h"
+#include "color.h"
+#include "rect.h"
+#include "transform.h"
+#include "polygon.h"
+#include "draw_style.h"
+#include "color_composition.h"
+
+// A picture is a display list of ready-to-rasterize polygons, along
+// with everything needed to render them (style, alpha, shadow and
+// composite operation), recorded by a canvas in recording mode.
+// Polygons are stored in the device space of the recording canvas.
+typedef struct picture_t picture_t;
+
+DECLARE_OBJECT_METHODS(picture_t, picture)
+
+picture_t *
+picture_create(
+  void);
+
+// Appends a polygon to render with the given parameters; transform
+// maps the style (gradient or pattern) coordinates to device space.
+// Pixmap draw styles are copied, other styles are retained.
+bool
+picture_add_poly(
+  picture_t *pic,
+  const polygon_t *p,
+  const rect_t *bbox,
+  draw_style_t draw_style,
+  double global_alpha,
+  color_t_ shadow_color,
+  double shadow_blur,
+  double shadow_offset_x,
+  double shadow_offset_y,
+  composite_operation_t op,
+  bool non_zero,
+  const transform_t *transform);
+
+// Appends a clipping polygon, which lasts until the next unmatched
+// restore (or until the end of the picture)
+bool
+picture_add_clip(
+  picture_t *pic,
+  const polygon_t *p,
+  bool non_zero);
+
+bool
+picture_add_save(
+  picture_t *pic);
+
+bool
+picture_add_restore(
+  picture_t *pic);
+
+int32_t
+picture_get_item_count(
+  const picture_t *pic);
+
+#endif /* __PICTURE_H */
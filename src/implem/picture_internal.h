@@ -0,0 +1,59 @@
+/**************************************************************************/
+/*                                                                        */
+/*    Copyright 2022 OCamlPro                                             */
+/*                                                                        */
+/*  All rights reserved. This file is distributed under the terms of the  */
+/*  GNU Lesser General Public License version 2.1, with the special       */
+/*  exception on linking described in the file LICENSE.                   */
+/*                                                                        */
+/**************************************************************************/
+
+
+#ifndef __PICTURE_INTERNAL_H
+#define __PICTURE_INTERNAL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "object.h"
+#include "color.h"
+#include "rect.h"
+#include "pixmap.h"
+#include "transform.h"
+#include "polygon.h"
+#include "draw_style.h"
+#include "color_composition.h"
+#include "picture.h"
+
+typedef enum picture_item_type_t {
+  PICTURE_ITEM_POLY    = 0,
+  PICTURE_ITEM_CLIP    = 1,
+  PICTURE_ITEM_SAVE    = 2,
+  PICTURE_ITEM_RESTORE = 3
+} picture_item_type_t;
+
+typedef struct picture_item_t {
+  picture_item_type_t type;
+  polygon_t *poly; // NULL for save/restore
+  rect_t bbox;
+  draw_style_t draw_style;
+  pixmap_t image; // owned by the item, for pixmap draw styles
+  transform_t transform;
+  double global_alpha;
+  color_t_ shadow_color;
+  double shadow_blur;
+  double shadow_offset_x;
+  double shadow_offset_y;
+  composite_operation_t op;
+  bool non_zero;
+} picture_item_t;
+
+typedef struct picture_t {
+  INHERITS_OBJECT;
+  picture_item_t *items;
+  int32_t nb_items;
+  int32_t max_items;
+  bool has_clip; // whether replaying needs to save the canvas state
+} picture_t;
+
+#endif /* __PICTURE_INTERNAL_H */
@@ -10,6 +10,7 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <stdbool.h>
 #include <memory.h>
 #include <assert.h>
 
@@ -47,3 +48,49 @@ pixmap_blit(
     }
   }
 }
+
+pixmap_t
+pixmap_copy(
+  const pixmap_t *p)
+{
+  assert(p != NULL);
+
+  if (pixmap_valid(*p) == false) {
+    return pixmap_null();
+  }
+
+  if (pixmap_is_compact(*p) == true) {
+    color_t_ *data =
+      (color_t_ *)memdup(p->data, p->width * p->height * COLOR_SIZE);
+    if (data == NULL) {
+      return pixmap_null();
+    }
+    return pixmap(p->width, p->height, data);
+  }
+
+  pixmap_t dp = pixmap(p->width, p->height, NULL);
+  if (pixmap_valid(dp) == true) {
+    pixmap_blit(&dp, 0, 0, p, 0, 0, p->width, p->height);
+  }
+
+  return dp;
+}
+
+pixmap_t
+pixmap_sub(
+  const pixmap_t *p,
+  int32_t x,
+  int32_t y,
+  int32_t width,
+  int32_t height)
+{
+  assert(p != NULL);
+  assert(pixmap_valid(*p));
+
+  if ((x < 0) || (y < 0) || (width <= 0) || (height <= 0) ||
+      (x > p->width - width) || (y > p->height - height)) {
+    return pixmap_null();
+  }
+
+  return pixmap_strided(width, height, p->stride, &pixmap_at(*p, y, x));
+}
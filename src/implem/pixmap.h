@@ -20,21 +20,19 @@ typedef struct pixmap_t {
   color_t_ *data;
   int32_t width;
   int32_t height;
+  int32_t stride; // Distance between two rows, in pixels
 } pixmap_t;
 
 #define pixmap_null() \
-  ((pixmap_t){ .data = NULL, .width = 0, .height = 0 })
+  ((pixmap_t){ .data = NULL, .width = 0, .height = 0, .stride = 0 })
 
 #define pixmap(w,h,d) \
   ((pixmap_t){ .data = ((d) != NULL) ? (d) : \
                         (color_t_ *)calloc((w) * (h), COLOR_SIZE), \
-               .width = (w), .height = (h) })
+               .width = (w), .height = (h), .stride = (w) })
 
-#define pixmap_copy(p) \
-  ((pixmap_t){ .data = ((p).data == NULL) ? NULL : \
-                        (color_t_ *)memdup((p).data, (p).width * \
-                                           (p).height * COLOR_SIZE), \
-               .width = (p).width, .height = (p).height })
+#define pixmap_strided(w,h,s,d) \
+  ((pixmap_t){ .data = (d), .width = (w), .height = (h), .stride = (s) })
 
 #define pixmap_destroy(p) \
   do { \
@@ -44,13 +42,33 @@ typedef struct pixmap_t {
     } \
     (p).width = 0; \
     (p).height = 0; \
+    (p).stride = 0; \
   } while (0)
 
 #define pixmap_valid(p) \
-  (((p).data != NULL) && ((p).width > 0) && ((p).height > 0))
+  (((p).data != NULL) && ((p).width > 0) && ((p).height > 0) && \
+   ((p).stride >= (p).width))
+
+#define pixmap_is_compact(p) \
+  ((p).stride == (p).width)
 
 #define pixmap_at(p,i,j) \
-  ((p).data[(i) * (p).width + (j)])
+  ((p).data[(i) * (p).stride + (j)])
+
+// Returns a compact copy of p
+pixmap_t
+pixmap_copy(
+  const pixmap_t *p);
+
+// Returns a view on the given area of p, sharing its data
+// Views must never be destroyed, only their parent pixmap
+pixmap_t
+pixmap_sub(
+  const pixmap_t *p,
+  int32_t x,
+  int32_t y,
+  int32_t width,
+  int32_t height);
 
 void
 pixmap_blit(
@@ -29,6 +29,8 @@
 #include "polygon_internal.h"
 #include "pixmap.h"
 #include "filters.h"
+#include "stats.h"
+#include "poly_render.h"
 
 // Mask array
 static uint64_t _masks[(9 * 9) * (9 * 9)] = { 0 };
@@ -36,11 +38,19 @@ static uint64_t _masks[(9 * 9) * (9 * 9)] = { 0 };
 // Initial counter map
 static uint64_t map[256] = { 0 };
 
+// Both tables are only written once, before any rendering takes
+// place; afterwards they are read-only and can be shared by threads
+static bool _poly_render_initialized = false;
+
 // TODO: use symmetries to reduce memory usage / cache misses
 void
 poly_render_init(
   void)
 {
+  if (_poly_render_initialized == true) {
+    return;
+  }
+
   // Initialize mask array
   uint64_t *mask = _masks;
   for (int x1 = 0; x1 <= 8; ++x1) {
@@ -78,6 +88,8 @@ poly_render_init(
       (i & 0x40) * (0x0001000000000000 / 0x40) |
       (i & 0x80) * (0x0100000000000000 / 0x80);
   }
+
+  _poly_render_initialized = true;
 }
 
 static void
@@ -204,8 +216,9 @@ _clip_vertical(
   }
 }
 
-static int
-_calculate_coverage_even_odd(
+// Returns the 8x8 samples of pixel (x, y) lying inside p
+static uint64_t
+_calculate_samples_even_odd(
   float y,
   float x,
   const polygon_t *p)
@@ -239,9 +252,34 @@ _calculate_coverage_even_odd(
 
   }
 
-  return (numbits(mask) * 255) / 64;
+  return mask;
 }
 
+static int
+_calculate_coverage_even_odd(
+  float y,
+  float x,
+  const polygon_t *p)
+{
+  return (numbits(_calculate_samples_even_odd(y, x, p)) * 255) / 64;
+}
+
+// Accumulate the packed 8-bit winding counters into wide counters
+static void
+_spill_counters(
+  uint64_t *lcnt,
+  int32_t *wind)
+{
+  assert(lcnt != NULL);
+  assert(wind != NULL);
+
+  for (int l = 0; l < 8; ++l) {
+    for (int k = 0; k < 8; ++k) {
+      wind[l * 8 + k] += (int32_t)((lcnt[l] >> (k * 8)) & 0xFF) - 0x80;
+    }
+    lcnt[l] = 0x8080808080808080;
+  }
+}
 
 static int
 _calculate_coverage_non_zero(
@@ -253,11 +291,6 @@ _calculate_coverage_non_zero(
   assert(x >= 0.0f);
   assert(y >= 0.0f);
 
-  // When too many points, fall back to even_odd
-  if (p->nb_points >= 128) {
-    return _calculate_coverage_even_odd(y, x, p);
-  }
-
   // 8-bit winding counters packed as 64-bit integers
   uint64_t lcnt[8] = {
     0x8080808080808080, 0x8080808080808080,
@@ -266,6 +299,11 @@ _calculate_coverage_non_zero(
     0x8080808080808080, 0x8080808080808080,
   };
 
+  // Wide winding counters, only used when the packed ones may overflow
+  int32_t wind[64] = { 0 };
+  bool spilled = false;
+  int32_t nb_edges = 0;
+
   int i = 0;
   for (int ip = 0; ip < p->nb_subpolys; ++ip) {
 
@@ -281,7 +319,16 @@ _calculate_coverage_non_zero(
       int x2 = fastround(((float)previous.x - x) * 8.0f);
       int y2 = fastround(((float)previous.y - y) * 8.0f);
 
-//      if (y1 == y2) continue;
+      if (y1 == y2) continue;
+
+      // Each edge moves the packed counters by at most one, so spill
+      // them before they can overflow into the neighbouring lanes
+      if (nb_edges == 127) {
+        _spill_counters(lcnt, wind);
+        spilled = true;
+        nb_edges = 0;
+      }
+      nb_edges++;
 
       uint64_t m = _masks[((x1 * 9 + y1) * 9 + x2) * 9 + y2];
       if (y2 > y1) {
@@ -309,6 +356,14 @@ _calculate_coverage_non_zero(
 
   int bits = 0;
 
+  if (spilled) {
+    _spill_counters(lcnt, wind);
+    for (int l = 0; l < 64; ++l) {
+      bits += (wind[l] != 0);
+    }
+    return bits * 255 / 64;
+  }
+
   for (int l = 0; l < 8; ++l) {
     bits += (lcnt[l] & 0x00000000000000FF) != 0x0000000000000080;
     bits += (lcnt[l] & 0x000000000000FF00) != 0x0000000000008000;
@@ -408,7 +463,8 @@ _poly_render_pixmap(
   const rect_t *bbox,
   const draw_style_t draw_style,
   const transform_t *transform,
-  bool non_zero)
+  bool non_zero,
+  int64_t *covered)
 {
   assert(p != NULL);
   assert(bbox != NULL);
@@ -428,8 +484,9 @@ _poly_render_pixmap(
   transform_t *inverse = transform_copy(transform);
   transform_inverse(inverse);
 
-  int32_t w = (int32_t)(bbox->p2.x - bbox->p1.x) + 1;
-  int32_t h = (int32_t)(bbox->p2.y - bbox->p1.y) + 1;
+  /* Must cover every pixel index the bounding box is composed onto */
+  int32_t w = (int32_t)bbox->p2.x - (int32_t)bbox->p1.x + 1;
+  int32_t h = (int32_t)bbox->p2.y - (int32_t)bbox->p1.y + 1;
 
   pixmap_t pm = pixmap(w, h, NULL);
 
@@ -471,6 +528,7 @@ _poly_render_pixmap(
 
       int draw_alpha = (alpha * color.a) / 255;
       pixmap_at(pm, i, j) = color(draw_alpha, color.r, color.g, color.b);
+      *covered += (alpha > 0);
     }
 
     free(complex);
@@ -499,7 +557,8 @@ _poly_render_layered(
   double global_alpha,
   const pixmap_t *clip_region,
   bool non_zero,
-  const transform_t *transform)
+  const transform_t *transform,
+  stats_t *stats)
 {
   assert(pm != NULL);
   assert(pixmap_valid(*pm) == true);
@@ -511,13 +570,19 @@ _poly_render_layered(
          (draw_style.content.pattern != NULL));
   assert(transform != NULL);
 
+  int64_t covered = 0;
+  int64_t t = stats_start(stats);
   pixmap_t rendered_poly =
-    _poly_render_pixmap(p, bbox, draw_style, transform, non_zero);
+    _poly_render_pixmap(p, bbox, draw_style, transform, non_zero, &covered);
+  stats_stop(stats, STATS_TIME_RASTERIZE, t);
+  stats_add(stats, STATS_PIXELS_COVERED, covered);
 
   // Compose shadows if any
   if ((shadow_blur > 0.0 || shadow_offset_x != 0.0 || shadow_offset_y != 0.0) &&
       composite_operation != COPY && shadow_color.a != 0) {
 
+    t = stats_start(stats);
+
     int shadow_size_offset = (int)(sqrt(3.0 * shadow_blur * shadow_blur));
 
     pixmap_t shadow_poly =
@@ -541,6 +606,8 @@ _poly_render_layered(
       pixmap_destroy(shadow_poly);
     }
 
+    stats_stop(stats, STATS_TIME_BLUR, t);
+
     rect_t sbbox =
       rect(point(bbox->p1.x - shadow_size_offset + shadow_offset_x,
                  bbox->p1.y - shadow_size_offset + shadow_offset_y),
@@ -557,11 +624,18 @@ _poly_render_layered(
       upper_bound_j = min((int32_t)(sbbox.p2.x + 1.0), pm->width);
     }
 
+    t = stats_start(stats);
+
     for (int32_t i = lower_bound_i; i < upper_bound_i; ++i) {
       for (int32_t j = lower_bound_j; j < upper_bound_j; ++j) {
 
+        int32_t si = i - (int32_t)sbbox.p1.y;
+        int32_t sj = j - (int32_t)sbbox.p1.x;
+
         if (j < sbbox.p1.x || j > sbbox.p2.x ||
-            i < sbbox.p1.y || i > sbbox.p2.y) {
+            i < sbbox.p1.y || i > sbbox.p2.y ||
+            si >= blurred_shadow_poly.height ||
+            sj >= blurred_shadow_poly.width) {
           pixmap_at(*pm, i, j) =
             comp_compose(color_transparent_black,
                          pixmap_at(*pm, i, j), 0,
@@ -569,10 +643,7 @@ _poly_render_layered(
           continue;
         }
 
-        color_t_ fill_color =
-          pixmap_at(blurred_shadow_poly,
-                    i - (int32_t)sbbox.p1.y,
-                    j - (int32_t)sbbox.p1.x);
+        color_t_ fill_color = pixmap_at(blurred_shadow_poly, si, sj);
 
         fill_color.r = shadow_color.r;
         fill_color.g = shadow_color.g;
@@ -592,6 +663,11 @@ _poly_render_layered(
       }
     }
 
+    stats_stop(stats, STATS_TIME_COMPOSITE, t);
+    stats_add(stats, STATS_PIXELS_COMPOSITED,
+              (int64_t)max(0, upper_bound_i - lower_bound_i) *
+              max(0, upper_bound_j - lower_bound_j));
+
     pixmap_destroy(blurred_shadow_poly);
   }
 
@@ -606,6 +682,8 @@ _poly_render_layered(
     upper_bound_j = min((int32_t)(bbox->p2.x + 1.0), pm->width);
   }
 
+  t = stats_start(stats);
+
   for (int32_t i = lower_bound_i; i < upper_bound_i; ++i) {
     for (int32_t j = lower_bound_j; j < upper_bound_j; ++j) {
 
@@ -637,6 +715,11 @@ _poly_render_layered(
     }
   }
 
+  stats_stop(stats, STATS_TIME_COMPOSITE, t);
+  stats_add(stats, STATS_PIXELS_COMPOSITED,
+            (int64_t)max(0, upper_bound_i - lower_bound_i) *
+            max(0, upper_bound_j - lower_bound_j));
+
   pixmap_destroy(rendered_poly);
 }
 
@@ -650,7 +733,8 @@ _poly_render_direct(
   double global_alpha,
   const pixmap_t *clip_region,
   bool non_zero,
-  const transform_t *transform)
+  const transform_t *transform,
+  stats_t *stats)
 {
   assert(pm != NULL);
   assert(pixmap_valid(*pm) == true);
@@ -662,6 +746,11 @@ _poly_render_direct(
          (draw_style.content.pattern != NULL));
   assert(transform != NULL);
 
+  /* Coverage and composition are interleaved here, so the
+     time spent composing counts as rasterization time */
+  int64_t t = stats_start(stats);
+  int64_t covered = 0;
+
   int alpha = 0;
 
   polygon_t *line_poly = polygon_create(1024, 16);
@@ -746,11 +835,18 @@ _poly_render_direct(
       // Only do this logic if there's something to apply
       pixmap_at(*pm, i, j) = comp_compose(color, pixmap_at(*pm, i, j),
                                           draw_alpha, composite_operation);
+      covered += (alpha > 0);
     }
 
     free(complex);
   }
 
+  stats_stop(stats, STATS_TIME_RASTERIZE, t);
+  stats_add(stats, STATS_PIXELS_COVERED, covered);
+  stats_add(stats, STATS_PIXELS_COMPOSITED,
+            (int64_t)max(0, upper_bound_i - lower_bound_i) *
+            max(0, upper_bound_j - lower_bound_j));
+
   transform_destroy(inverse);
 
   polygon_destroy(tmp_poly);
@@ -773,17 +869,487 @@ poly_render(
   composite_operation_t compose_op,
   const pixmap_t *clip_region,
   bool non_zero,
-  const transform_t *transform)
+  const transform_t *transform,
+  stats_t *stats)
 {
+  stats_add(stats, STATS_POLY_RENDERS, 1);
+  stats_add(stats, STATS_VERTICES, p->nb_points);
+
   if ((shadow_blur > 0.0 || shadow_offset_x != 0.0 || shadow_offset_y != 0.0) &&
       compose_op != COPY && shadow_color.a != 0) {
     _poly_render_layered(s, p, bbox, draw_style, compose_op,
                          shadow_color, shadow_blur,
                          shadow_offset_x, shadow_offset_y,
-                         global_alpha, clip_region, non_zero, transform);
+                         global_alpha, clip_region, non_zero, transform,
+                         stats);
   }
   else {
     _poly_render_direct(s, p, bbox, draw_style, compose_op,
-                        global_alpha, clip_region, non_zero, transform);
+                        global_alpha, clip_region, non_zero, transform,
+                        stats);
+  }
+}
+
+// Coverage is kept in square tiles, allocated on first use, so
+// that a stroke costs according to its area, not to the area of
+// its bounding box
+#define POLY_TILE_SHIFT 4
+#define POLY_TILE_SIZE (1 << POLY_TILE_SHIFT)
+#define POLY_TILE_MASK (POLY_TILE_SIZE - 1)
+
+// Index of a pixel of the visible area in its tile
+#define poly_tile_index(i,j) \
+  ((((i) & POLY_TILE_MASK) << POLY_TILE_SHIFT) + ((j) & POLY_TILE_MASK))
+
+typedef struct poly_coverage_tile_t {
+  uint64_t samples[POLY_TILE_SIZE * POLY_TILE_SIZE]; // Covered by pieces
+  uint8_t alpha[POLY_TILE_SIZE * POLY_TILE_SIZE];    // Line coverage
+} poly_coverage_tile_t;
+
+typedef struct poly_coverage_t {
+  int32_t x;            // Visible area, in the target pixmap
+  int32_t y;
+  int32_t width;
+  int32_t height;
+  int32_t nb_tiles_x;   // Tiles covering the visible area
+  int32_t nb_tiles_y;
+  poly_coverage_tile_t **tiles;
+  polygon_t *line_poly; // Scratch polygons, reused for every piece
+  polygon_t *pixel_poly;
+  polygon_t *tmp_poly;
+} poly_coverage_t;
+
+poly_coverage_t *
+poly_coverage_create(
+  const pixmap_t *pm,
+  const rect_t *bbox)
+{
+  assert(pm != NULL);
+  assert(pixmap_valid(*pm) == true);
+  assert(bbox != NULL);
+
+  poly_coverage_t *cov = (poly_coverage_t *)calloc(1, sizeof(poly_coverage_t));
+  if (cov == NULL) {
+    return NULL;
+  }
+
+  // Only the visible part of the bounding box is of interest
+  int32_t x1 = max(0, (int32_t)floor(bbox->p1.x));
+  int32_t y1 = max(0, (int32_t)floor(bbox->p1.y));
+  int32_t x2 = min(pm->width, (int32_t)floor(bbox->p2.x) + 1);
+  int32_t y2 = min(pm->height, (int32_t)floor(bbox->p2.y) + 1);
+
+  // Tiles are allocated on first use
+  cov->x = x1;
+  cov->y = y1;
+  cov->width = max(0, x2 - x1);
+  cov->height = max(0, y2 - y1);
+  cov->nb_tiles_x = (cov->width + POLY_TILE_MASK) >> POLY_TILE_SHIFT;
+  cov->nb_tiles_y = (cov->height + POLY_TILE_MASK) >> POLY_TILE_SHIFT;
+  cov->tiles = (poly_coverage_tile_t **)
+    calloc(max(1, (size_t)cov->nb_tiles_x * cov->nb_tiles_y),
+           sizeof(poly_coverage_tile_t *));
+  if (cov->tiles == NULL) {
+    goto error;
   }
+
+  cov->line_poly = polygon_create(64, 4);
+  cov->pixel_poly = polygon_create(64, 4);
+  cov->tmp_poly = polygon_create(64, 4);
+  if ((cov->line_poly == NULL) || (cov->pixel_poly == NULL) ||
+      (cov->tmp_poly == NULL)) {
+    goto error;
+  }
+
+  return cov;
+
+error:
+  poly_coverage_destroy(cov);
+  return NULL;
+}
+
+void
+poly_coverage_destroy(
+  poly_coverage_t *cov)
+{
+  assert(cov != NULL);
+
+  if (cov->tmp_poly != NULL) {
+    polygon_destroy(cov->tmp_poly);
+  }
+  if (cov->pixel_poly != NULL) {
+    polygon_destroy(cov->pixel_poly);
+  }
+  if (cov->line_poly != NULL) {
+    polygon_destroy(cov->line_poly);
+  }
+  if (cov->tiles != NULL) {
+    for (size_t k = 0; k < (size_t)cov->nb_tiles_x * cov->nb_tiles_y; ++k) {
+      if (cov->tiles[k] != NULL) {
+        free(cov->tiles[k]);
+      }
+    }
+    free(cov->tiles);
+  }
+  free(cov);
+}
+
+// Tile holding pixel (i, j) of the visible area, if any
+static poly_coverage_tile_t *
+_poly_coverage_find_tile(
+  const poly_coverage_t *cov,
+  int32_t i,
+  int32_t j)
+{
+  assert(cov != NULL);
+  assert((i >= 0) && (i < cov->height));
+  assert((j >= 0) && (j < cov->width));
+
+  return cov->tiles[(size_t)(i >> POLY_TILE_SHIFT) * cov->nb_tiles_x +
+                    (j >> POLY_TILE_SHIFT)];
+}
+
+// Same, creating the tile if needed
+static poly_coverage_tile_t *
+_poly_coverage_get_tile(
+  poly_coverage_t *cov,
+  int32_t i,
+  int32_t j)
+{
+  assert(cov != NULL);
+  assert((i >= 0) && (i < cov->height));
+  assert((j >= 0) && (j < cov->width));
+
+  poly_coverage_tile_t **tile =
+    &cov->tiles[(size_t)(i >> POLY_TILE_SHIFT) * cov->nb_tiles_x +
+                (j >> POLY_TILE_SHIFT)];
+  if (*tile == NULL) {
+    *tile = (poly_coverage_tile_t *)calloc(1, sizeof(poly_coverage_tile_t));
+  }
+  return *tile;
+}
+
+void
+poly_coverage_add(
+  poly_coverage_t *cov,
+  const polygon_t *p)
+{
+  assert(cov != NULL);
+  assert(p != NULL);
+
+  if ((cov->width == 0) || (cov->height == 0) || (p->nb_points == 0)) {
+    return;
+  }
+
+  rect_t bbox = rect(p->points[0], p->points[0]);
+  for (int32_t k = 1; k < p->nb_points; ++k) {
+    rect_expand(&bbox, p->points[k]);
+  }
+
+  // Restrict to the mask
+  int32_t x1 = max(cov->x, (int32_t)floor(bbox.p1.x));
+  int32_t y1 = max(cov->y, (int32_t)floor(bbox.p1.y));
+  int32_t x2 = min(cov->x + cov->width, (int32_t)floor(bbox.p2.x) + 1);
+  int32_t y2 = min(cov->y + cov->height, (int32_t)floor(bbox.p2.y) + 1);
+  if ((x2 <= x1) || (y2 <= y1)) {
+    return;
+  }
+
+  polygon_t *line_poly = cov->line_poly;
+  polygon_t *pixel_poly = cov->pixel_poly;
+  polygon_t *tmp_poly = cov->tmp_poly;
+
+  int32_t w = x2 - x1;
+  uint64_t samples = 0;
+
+  for (int32_t i = 0; i < y2 - y1; ++i) {
+
+    _clip_horizontal((float)i, -1.0, p, tmp_poly, -x1, -y1);
+    _clip_horizontal((float)(i + 1), 1.0, tmp_poly, line_poly, 0.0, 0.0);
+
+    if (line_poly->nb_points == 0) {
+      continue;
+    }
+
+    bool *complex = _build_complex(w, line_poly);
+    if (complex == NULL) {
+      break;
+    }
+    bool calculate = true;
+
+    for (int32_t j = 0; j < w; ++j) {
+
+      bool is_complex = complex[j];
+
+      calculate |= is_complex;
+
+      if (calculate) {
+        _clip_vertical((float)j, -1.0, line_poly, tmp_poly, 0.0, 0.0);
+        _clip_vertical((float)(j + 1), 1.0, tmp_poly, pixel_poly, 0.0, 0.0);
+
+        swap(polygon_t *, line_poly, tmp_poly);
+
+        // Pieces are convex, so even-odd is enough
+        samples = _calculate_samples_even_odd((float)i, (float)j, pixel_poly);
+
+        calculate = is_complex;
+      }
+
+      // Pieces are merged sample by sample: adjacent pieces add up to
+      // full coverage along their shared edges, and overlapping ones
+      // are not counted twice, so this matches filling the outline
+      if (samples != 0) {
+        int32_t ti = y1 - cov->y + i;
+        int32_t tj = x1 - cov->x + j;
+        poly_coverage_tile_t *tile = _poly_coverage_get_tile(cov, ti, tj);
+        if (tile != NULL) {
+          tile->samples[poly_tile_index(ti, tj)] |= samples;
+        }
+      }
+    }
+
+    free(complex);
+  }
+
+  // Pointers may have been swapped
+  cov->line_poly = line_poly;
+  cov->tmp_poly = tmp_poly;
+}
+
+// Plot a pixel given in (major, minor) coordinates. Lines only add
+// up in pixels where one of them ends: this is where consecutive
+// segments meet, each holding part of the pixel. Elsewhere, the
+// highest coverage is kept, so that lines crossing or going back
+// over one another do not get darker than a single line.
+static void
+_poly_coverage_plot(
+  poly_coverage_t *cov,
+  bool steep,
+  int32_t u,
+  int32_t v,
+  double alpha,
+  bool partial)
+{
+  assert(cov != NULL);
+
+  int32_t j = steep ? v : u;
+  int32_t i = steep ? u : v;
+  if ((alpha <= 0.0) ||
+      (i < cov->y) || (i >= cov->y + cov->height) ||
+      (j < cov->x) || (j >= cov->x + cov->width)) {
+    return;
+  }
+
+  poly_coverage_tile_t *tile =
+    _poly_coverage_get_tile(cov, i - cov->y, j - cov->x);
+  if (tile == NULL) {
+    return;
+  }
+
+  uint8_t *a = &tile->alpha[poly_tile_index(i - cov->y, j - cov->x)];
+  int b = fastround(alpha * 255.0);
+  *a = (uint8_t)(partial ? min(255, (int)*a + b) : max((int)*a, b));
+}
+
+// Antialiased line of width w <= 1, in the spirit of Wu's algorithm:
+// each column along the major axis receives the part of the line it
+// contains, split between the two nearest pixels on the minor axis
+void
+poly_coverage_add_line(
+  poly_coverage_t *cov,
+  point_t p1,
+  point_t p2,
+  double w)
+{
+  assert(cov != NULL);
+
+  if ((cov->width == 0) || (cov->height == 0)) {
+    return;
+  }
+
+  // Work with pixel centers on integer coordinates
+  double x1 = p1.x - 0.5, y1 = p1.y - 0.5;
+  double x2 = p2.x - 0.5, y2 = p2.y - 0.5;
+
+  bool steep = fabs(y2 - y1) > fabs(x2 - x1);
+  if (steep) {
+    swap(double, x1, y1);
+    swap(double, x2, y2);
+  }
+  if (x1 > x2) {
+    swap(double, x1, x2);
+    swap(double, y1, y2);
+  }
+
+  if (x2 - x1 <= 0.0) {
+    return;
+  }
+
+  double gradient = (y2 - y1) / (x2 - x1);
+
+  // Height of the line cross section in a column
+  double k = w * sqrt(1.0 + gradient * gradient);
+
+  int32_t lo = steep ? cov->y : cov->x;
+  int32_t hi = lo + (steep ? cov->height : cov->width) - 1;
+  int32_t us = max(lo, (int32_t)floor(x1 + 0.5));
+  int32_t ue = min(hi, (int32_t)floor(x2 + 0.5));
+
+  for (int32_t u = us; u <= ue; ++u) {
+    double c1 = max(x1, (double)u - 0.5);
+    double c2 = min(x2, (double)u + 0.5);
+    if (c2 <= c1) {
+      continue;
+    }
+    double y = y1 + gradient * ((c1 + c2) * 0.5 - x1);
+    double fy = floor(y);
+    double f = y - fy;
+    double a = k * (c2 - c1);
+    bool partial = (c2 - c1 < 1.0);
+    _poly_coverage_plot(cov, steep, u, (int32_t)fy, a * (1.0 - f), partial);
+    _poly_coverage_plot(cov, steep, u, (int32_t)fy + 1, a * f, partial);
+  }
+}
+
+// Coverage of pixel (i, j) of the visible area, out of 255
+static int
+_poly_coverage_alpha(
+  const poly_coverage_tile_t *tile,
+  int32_t i,
+  int32_t j)
+{
+  assert(tile != NULL);
+
+  int32_t k = poly_tile_index(i, j);
+  return min(255, (numbits(tile->samples[k]) * 255) / 64 + tile->alpha[k]);
+}
+
+// Returns true if the pixel was composited
+static bool
+_poly_coverage_compose(
+  pixmap_t *pm,
+  int32_t i,
+  int32_t j,
+  int alpha,
+  const draw_style_t *draw_style,
+  double global_alpha,
+  composite_operation_t compose_op,
+  bool full_screen,
+  const pixmap_t *clip_region,
+  const transform_t *inverse)
+{
+  assert(pm != NULL);
+  assert(draw_style != NULL);
+  assert(inverse != NULL);
+
+  // Nothing to do for uncovered pixels, unless the
+  // composition operation affects the whole surface
+  if (alpha == 0) {
+    if (full_screen == true) {
+      pixmap_at(*pm, i, j) = comp_compose(color_transparent_black,
+                                          pixmap_at(*pm, i, j), 0,
+                                          compose_op);
+    }
+    return false;
+  }
+
+  color_t_ color =
+    _determine_base_color(draw_style, (float)j, (float)i, inverse);
+
+  int draw_alpha =
+    (alpha * fastround(global_alpha * 256.0) * color.a) / (256 * 255);
+  if ((clip_region != NULL) && (pixmap_valid(*clip_region) == true)) {
+    draw_alpha *= 255 - pixmap_at(*clip_region, i, j).a;
+    draw_alpha /= 255;
+  }
+
+  pixmap_at(*pm, i, j) = comp_compose(color, pixmap_at(*pm, i, j),
+                                      draw_alpha, compose_op);
+  return true;
+}
+
+void
+poly_coverage_render(
+  pixmap_t *pm,
+  const poly_coverage_t *cov,
+  draw_style_t draw_style,
+  double global_alpha,
+  composite_operation_t compose_op,
+  const pixmap_t *clip_region,
+  const transform_t *transform,
+  stats_t *stats)
+{
+  assert(pm != NULL);
+  assert(pixmap_valid(*pm) == true);
+  assert(cov != NULL);
+  assert((draw_style.type != DRAW_STYLE_GRADIENT) ||
+         (draw_style.content.gradient != NULL));
+  assert((draw_style.type != DRAW_STYLE_PATTERN) ||
+         (draw_style.content.pattern != NULL));
+  assert(transform != NULL);
+
+  bool full_screen = comp_is_full_screen(compose_op);
+
+  transform_t *inverse = transform_copy(transform);
+  transform_inverse(inverse);
+
+  int64_t t = stats_start(stats);
+  int64_t composited = 0;
+
+  if (full_screen == true) {
+
+    // Every pixel is composited, covered or not
+    for (int32_t i = 0; i < pm->height; ++i) {
+      for (int32_t j = 0; j < pm->width; ++j) {
+        int alpha = 0;
+        if ((i >= cov->y) && (i < cov->y + cov->height) &&
+            (j >= cov->x) && (j < cov->x + cov->width)) {
+          const poly_coverage_tile_t *tile =
+            _poly_coverage_find_tile(cov, i - cov->y, j - cov->x);
+          if (tile != NULL) {
+            alpha = _poly_coverage_alpha(tile, i - cov->y, j - cov->x);
+          }
+        }
+        composited +=
+          _poly_coverage_compose(pm, i, j, alpha, &draw_style, global_alpha,
+                                 compose_op, true, clip_region, inverse);
+      }
+    }
+
+  } else {
+
+    // Only the tiles that were touched need to be visited
+    for (int32_t ty = 0; ty < cov->nb_tiles_y; ++ty) {
+      for (int32_t tx = 0; tx < cov->nb_tiles_x; ++tx) {
+        const poly_coverage_tile_t *tile =
+          cov->tiles[(size_t)ty * cov->nb_tiles_x + tx];
+        if (tile == NULL) {
+          continue;
+        }
+        int32_t i1 = ty << POLY_TILE_SHIFT;
+        int32_t j1 = tx << POLY_TILE_SHIFT;
+        int32_t i2 = min(cov->height, i1 + POLY_TILE_SIZE);
+        int32_t j2 = min(cov->width, j1 + POLY_TILE_SIZE);
+        for (int32_t i = i1; i < i2; ++i) {
+          for (int32_t j = j1; j < j2; ++j) {
+            int alpha = _poly_coverage_alpha(tile, i, j);
+            composited +=
+              _poly_coverage_compose(pm, cov->y + i, cov->x + j, alpha,
+                                     &draw_style, global_alpha, compose_op,
+                                     false, clip_region, inverse);
+          }
+        }
+      }
+    }
+
+  }
+
+  /* Pieces were rasterized as they were added */
+  stats_stop(stats, STATS_TIME_COMPOSITE, t);
+  stats_add(stats, STATS_POLY_RENDERS, 1);
+  stats_add(stats, STATS_PIXELS_COVERED, composited);
+  stats_add(stats, STATS_PIXELS_COMPOSITED,
+            full_screen ? (int64_t)pm->width * pm->height : composited);
+
+  transform_destroy(inverse);
 }
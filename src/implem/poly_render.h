@@ -14,6 +14,7 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#include "point.h"
 #include "rect.h"
 #include "color.h"
 #include "transform.h"
@@ -21,6 +22,7 @@
 #include "color_composition.h"
 #include "polygon.h"
 #include "surface.h"
+#include "stats.h"
 
 void
 poly_render_init(
@@ -40,6 +42,43 @@ poly_render(
   composite_operation_t compose_op,
   const pixmap_t *clip_region,
   bool non_zero,
-  const transform_t *transform);
+  const transform_t *transform,
+  stats_t *stats);
+
+// Coverage accumulator, used to rasterize a shape given
+// as many small convex pieces (e.g. stroke pieces)
+typedef struct poly_coverage_t poly_coverage_t;
+
+poly_coverage_t *
+poly_coverage_create(
+  const pixmap_t *pm,
+  const rect_t *bbox);
+
+void
+poly_coverage_destroy(
+  poly_coverage_t *cov);
+
+void
+poly_coverage_add(
+  poly_coverage_t *cov,
+  const polygon_t *p);
+
+void
+poly_coverage_add_line(
+  poly_coverage_t *cov,
+  point_t p1,
+  point_t p2,
+  double w);
+
+void
+poly_coverage_render(
+  pixmap_t *pm,
+  const poly_coverage_t *cov,
+  draw_style_t draw_style,
+  double global_alpha,
+  composite_operation_t compose_op,
+  const pixmap_t *clip_region,
+  const transform_t *transform,
+  stats_t *stats);
 
 #endif /* __POLY_RENDER_H */
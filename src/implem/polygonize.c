@@ -23,6 +23,7 @@
 #include "path_internal.h"
 #include "polygon.h"
 #include "polygon_internal.h"
+#include "stroke.h"
 #include "polygonize.h"
 
 
@@ -98,132 +99,88 @@ bezier_to_poly(
   }
 }
 
-// Assuming the points are on opposite major sides of an ellipse
-// (image of a circle by the transform), fill the semi ellipse
-static void
-_arc_to_poly_transform(
-  point_t p1,
-  point_t p2,
-  polygon_t *p,
-  int precision,
-  const transform_t *linear,
-  const transform_t *inv_linear)
+// Cut the subpolygons of p according to the dash pattern
+static polygon_t *
+_polygon_dash(
+  const polygon_t *p,
+  const double *dash,
+  int32_t dash_array_size,
+  double dash_offset)
 {
   assert(p != NULL);
-  assert(linear != NULL);
-  assert(inv_linear != NULL);
-
-  point_t dp = point((p1.x - p2.x) / 2.0, (p1.y - p2.y) / 2.0);
-  point_t center = point((p1.x + p2.x) / 2.0, (p1.y + p2.y) / 2.0);
-  transform_apply(inv_linear, &dp);
-  for (int i = 1; i < precision; i++) {
-    double cs = cos(((double)(-i)) * M_PI / precision);
-    double ss = sin(((double)(-i)) * M_PI / precision);
-    point_t newPt = point((cs * dp.x + ss * dp.y), (-ss * dp.x + cs * dp.y));
-    transform_apply(linear, &newPt);
-    point_t output = point(newPt.x + center.x, newPt.y + center.y);
-    polygon_add_point(p, output);
+  assert(dash != NULL);
+  assert(dash_array_size > 0);
+
+  polygon_t *dashed_poly =
+    polygon_create(p->max_points * 2, p->max_subpolys * 2);
+  if (dashed_poly == NULL) {
+    return NULL;
   }
-}
 
-// Same as previous, but now we don't assume the points are on opposite ends.
-static void
-_arc_to_poly_transform_center(
-  point_t center,
-  point_t p1,
-  point_t p2,
-  polygon_t *p,
-  int precision,
-  const transform_t *linear,
-  const transform_t *inv_linear)
-{
-  assert(p != NULL);
-  assert(linear != NULL);
-  assert(inv_linear != NULL);
-
-  point_t dp1 = point((p1.x - center.x), (p1.y - center.y));
-  point_t dp2 = point((p2.x - center.x), (p2.y - center.y));
-  transform_apply(inv_linear, &dp1);
-  transform_apply(inv_linear, &dp2);
-
-  double angle = atan2((dp2.y), (dp2.x)) - atan2((dp1.y), dp1.x);
-  angle = angle - 2.0 * M_PI * floor(angle / (2.0 * M_PI));
-
-  for (int i = 0; i <= precision; i++) {
-    double cs = cos(((double)(-1)) * i * angle / precision);
-    double ss = sin(((double)(-1)) * i * angle / precision);
-    double x = dp1.x;
-    double y = dp1.y;
-    point_t new_pt = point((cs * x + ss * y), (-ss * x + cs * y));
-    transform_apply(linear, &new_pt);
-    point_t output = point(new_pt.x + center.x, new_pt.y + center.y);
-    polygon_add_point(p, output);
+  double dash_length = 0.0;
+  for (int32_t i = 0; i < dash_array_size; ++i) {
+    dash_length += dash[i];
   }
-}
 
-static void
-_miter_to_poly(
-  point_t p11,
-  point_t p12,
-  point_t p21,
-  point_t p22,
-  polygon_t *p,
-  double miter_limit,
-  point_t po,
-  double line_width,
-  const transform_t *inverse_linear)
-{
-  assert(p != NULL);
-  assert(inverse_linear != NULL);
-
-  // Compute intersection and add point
-  double a11 = p12.x - p11.x;
-  double a21 = p12.y - p11.y;
-  double a12 = p21.x - p22.x;
-  double a22 = p21.y - p22.y;
-  double det = a11 * a22 - a21 * a12;
-  double c1 = p21.x - p11.x;
-  double c2 = p21.y - p11.y;
-  double topdet = c1 * a22 - c2 * a12;
-  double ans = topdet / det;
-  point_t intersection =
-    point(p11.x + ans * (p12.x - p11.x), p11.y + ans * (p12.y - p11.y));
-  point_t dp = point(intersection.x - po.x, intersection.y - po.y);
-  transform_apply(inverse_linear, &dp);
-  double dist_to_intersection = point_dist_2(dp, point(0.0, 0.0));
-  double miter_cut = (line_width * miter_limit / 2.0);
-  if (dist_to_intersection < miter_cut * miter_cut) {
-    polygon_add_point(p, intersection);
+  int32_t init_indx = 0;
+  dash_offset -= dash_length * floor(dash_offset / dash_length);
+  while (dash_offset >= dash[init_indx]) {
+    dash_offset -= dash[init_indx];
+    init_indx++;
   }
-}
 
-static void
-_line_offset(
-  point_t p1,
-  point_t p2,
-  double o,
-  point_t *out_p1,
-  point_t *out_p2,
-  const transform_t *lin,
-  const transform_t *inv_lin)
-{
-  assert(out_p1 != NULL);
-  assert(out_p2 != NULL);
-  assert(lin != NULL);
-  assert(inv_lin != NULL);
+  for (int32_t i = 0; i < p->nb_subpolys; ++i) {
+    int32_t indx = init_indx;
+    double l = dash_offset;
+    int32_t fst = (i == 0) ? 0 : p->subpolys[i - 1];
+    if (init_indx % 2 == 0) {
+      polygon_add_point(dashed_poly, p->points[fst]);
+    }
 
-  *out_p1 = point_offset_ortho_transform(p1, p2, o, lin, inv_lin);
-  *out_p2 = point_offset_ortho_transform(p2, p1, -o, lin, inv_lin);
+    for (int j = fst; j < p->subpolys[i]; ++j) {
+      if (j == p->subpolys[i] && !p->subpoly_closed[i]) {
+        break;
+      }
+
+      point_t current_point = p->points[j];
+      point_t final_point = p->points[j == p->subpolys[i] ? fst : j + 1];
+      double dst = point_dist(current_point, final_point);
+      double line_x = (p->points[j+1].x - p->points[j].x) / dst;
+      double line_y = (p->points[j+1].y - p->points[j].y) / dst;
+
+      while (l + dst >= dash[indx]) {
+        double dst_to_cut = dash[indx] - l;
+        point_t cut_point = point(current_point.x + dst_to_cut * line_x,
+                                  current_point.y + dst_to_cut * line_y);
+        polygon_add_point(dashed_poly, cut_point);
+        if (indx % 2 == 0) {
+          polygon_end_subpoly(dashed_poly, false);
+        }
+        dst -= dash[indx] - l;
+        indx++;
+        indx %= dash_array_size;
+        l = 0;
+        current_point = cut_point;
+      }
+
+      if (l + dst < dash[indx]) {
+        l = l + dst;
+        if (indx % 2 == 0) {
+          polygon_add_point(dashed_poly, final_point);
+        }
+      }
+    }
+    polygon_end_subpoly(dashed_poly, false);
+  }
+
+  return dashed_poly;
 }
 
-void
-polygon_offset(
+// Transform (if needed) and dash the polygon to stroke; returns
+// the polygon to actually stroke, which must be freed if != p
+static const polygon_t *
+_polygon_prepare_stroke(
   const polygon_t *p,
-  polygon_t *np,
-  double w,
-  join_type_t join_type,
-  cap_type_t cap_type,
-  double miter_limit,
   const transform_t *transform,
   bool only_linear,
   const double *dash,
@@ -231,7 +188,6 @@ polygon_offset(
   double dash_offset)
 {
   assert(p != NULL);
-  assert(np != NULL);
   assert(transform != NULL);
   assert(dash_array_size == 0 || dash != NULL);
 
@@ -243,283 +199,110 @@ polygon_offset(
   }
 
   // Make dashed
-  polygon_t *dashed_poly = NULL;
   if (dash_array_size > 0) {
-    dashed_poly = polygon_create(p->max_points * 2, p->max_subpolys * 2);
-
-    double dash_length = 0.0;
-    for (int32_t i = 0; i < dash_array_size; ++i) {
-      dash_length += dash[i];
-    }
-
-    int32_t init_indx = 0;
-    dash_offset -= dash_length * floor(dash_offset / dash_length);
-    while (dash_offset >= dash[init_indx]) {
-      dash_offset -= dash[init_indx];
-      init_indx++;
-    }
-
-    for (int32_t i = 0; i < p->nb_subpolys; ++i) {
-      int32_t indx = init_indx;
-      double l = dash_offset;
-      int32_t fst = (i == 0) ? 0 : p->subpolys[i - 1];
-      if (init_indx % 2 == 0) {
-        polygon_add_point(dashed_poly, p->points[fst]);
-      }
-
-      for (int j = fst; j < p->subpolys[i]; ++j) {
-        if (j == p->subpolys[i] && !p->subpoly_closed[i]) {
-          break;
-        }
-
-        point_t current_point = p->points[j];
-        point_t final_point = p->points[j == p->subpolys[i] ? fst : j + 1];
-        double dst = point_dist(current_point, final_point);
-        double line_x = (p->points[j+1].x - p->points[j].x) / dst;
-        double line_y = (p->points[j+1].y - p->points[j].y) / dst;
-
-        while (l + dst >= dash[indx]) {
-          double dst_to_cut = dash[indx] - l;
-          point_t cut_point = point(current_point.x + dst_to_cut * line_x,
-                                    current_point.y + dst_to_cut * line_y);
-          polygon_add_point(dashed_poly, cut_point);
-          if (indx % 2 == 0) {
-            polygon_end_subpoly(dashed_poly, false);
-          }
-          dst -= dash[indx] - l;
-          indx++;
-          indx %= dash_array_size;
-          l = 0;
-          current_point = cut_point;
-        }
-
-        if (l + dst < dash[indx]) {
-          l = l + dst;
-          if (indx % 2 == 0) {
-            polygon_add_point(dashed_poly, final_point);
-          }
-        }
-      }
-      polygon_end_subpoly(dashed_poly, false);
-    }
-
-    p = dashed_poly;
+    return _polygon_dash(p, dash, dash_array_size, dash_offset);
   }
 
-  transform_t *lin = transform_extract_linear(transform);
-  transform_t *inv_lin = transform_copy(lin);
-  transform_inverse(inv_lin);
-
-  point_t p1o, p2o, p1n, p2n;
-  double o = w / 2.0;
-  int iter = 5;
-
-  for (int ip = 0; ip < p->nb_subpolys; ++ip) {
-
-    int ifp = (ip == 0) ? 0 : p->subpolys[ip - 1] + 1;
-
-    // Skip polygons with a single point
-    if (ifp == p->subpolys[ip]) {
-      continue;
-    }
+  return p;
+}
 
-    // Draw the "left" part
-
-    _line_offset(p->points[ifp], p->points[ifp + 1],
-                 -o, &p1o, &p2o, lin, inv_lin);
-    polygon_add_point(np, p1o);
-    polygon_add_point(np, p2o);
-
-    for (int i = ifp + 1; i < p->subpolys[ip]; ++i) {
-      _line_offset(p->points[i], p->points[i + 1],
-                   -o, &p1n, &p2n, lin, inv_lin);
-
-      // Add join if turning "right"
-      // TODO: don't bother if distance too small
-      if (point_position(p->points[i-1], p->points[i + 1], p->points[i]) > 0) {
-        switch (join_type) {
-          case JOIN_ROUND:
-            _arc_to_poly_transform_center(p->points[i], p2o, p1n, np,
-                                          iter, lin, inv_lin);
-            break;
-          case JOIN_MITER:
-            _miter_to_poly(p1o, p2o, p1n, p2n, np, miter_limit,
-                           p->points[i], w, inv_lin);
-            break;
-          case JOIN_BEVEL:
-            break;
-        }
-      }
+void
+polygon_offset(
+  const polygon_t *p,
+  polygon_t *np,
+  double w,
+  join_type_t join_type,
+  cap_type_t cap_type,
+  double miter_limit,
+  const transform_t *transform,
+  bool only_linear,
+  const double *dash,
+  int32_t dash_array_size,
+  double dash_offset)
+{
+  assert(p != NULL);
+  assert(np != NULL);
+  assert(transform != NULL);
+  assert(dash_array_size == 0 || dash != NULL);
 
-      polygon_add_point(np, p1n);
-      polygon_add_point(np, p2n);
+  const polygon_t *sp =
+    _polygon_prepare_stroke(p, transform, only_linear,
+                            dash, dash_array_size, dash_offset);
+  if (sp == NULL) {
+    return;
+  }
 
-      p1o = p1n;
-      p2o = p2n;
-    }
+  stroke_outline(sp, np, w, join_type, cap_type, miter_limit, transform);
 
-    // If closed, add a join
-    if (p->subpoly_closed[ip]) {
-      // Add join if turning "right"
-      // TODO: don't bother if distance too small
-      // Assume end and start point are equal
-      assert(point_equal(p->points[p->subpolys[ip]], p->points[ifp]));
-      _line_offset(p->points[ifp], p->points[ifp + 1],
-                   -o, &p1n, &p2n, lin, inv_lin);
-      if (point_position(p->points[p->subpolys[ip] - 1],
-                         p->points[ifp+1],
-                         p->points[ifp]) > 0) {
-        switch (join_type) {
-          case JOIN_ROUND:
-            _arc_to_poly_transform_center(p->points[ifp], p2o, p1n, np,
-                                          iter, lin, inv_lin);
-            break;
-          case JOIN_MITER:
-            _miter_to_poly(p1o, p2o, p1n, p2n, np, miter_limit,
-                           p->points[ifp], w, inv_lin);
-            break;
-          case JOIN_BEVEL:
-            break;
-        }
-      } else {
-        polygon_add_point(np, p1n);
-      }
+  if (sp != p) {
+    polygon_destroy((polygon_t *)sp);
+  }
+}
 
-      polygon_end_subpoly(np, true);
-
-    // If not closed, add a line cap
-    } else {
-      switch (cap_type) {
-        case CAP_BUTT:
-          break;
-        case CAP_SQUARE: {
-          double dist = point_dist(p->points[p->subpolys[ip] - 1],
-                                   p->points[p->subpolys[ip]]);
-          point_t new_p1 =
-            point(p2o.x + (p2o.x - p1o.x) / dist * o,
-                  p2o.y + (p2o.y - p1o.y) / dist * o);
-          p1o = p->points[p->subpolys[ip] - 1];
-          p2o = p->points[p->subpolys[ip]];
-          _line_offset(p1o, p2o, o, &p1n, &p2n, lin, inv_lin);
-          point_t new_p2 =
-            point(p2n.x + ((p2n.x - p1n.x) / dist) * o,
-                  p2n.y + ((p2n.y - p1n.y) / dist) * o);
-          polygon_add_point(np, new_p1);
-          polygon_add_point(np, new_p2);
-          break;
-        }
-        case CAP_ROUND: {
-          point_t new_p1 = point(p2o.x, p2o.y);
-          p1o = p->points[p->subpolys[ip] - 1];
-          p2o = p->points[p->subpolys[ip]];
-          _line_offset(p1o, p2o, o, &p1n, &p2n, lin, inv_lin);
-          _arc_to_poly_transform(new_p1, p2n, np, iter, lin, inv_lin);
-          break;
-        }
-      }
-    }
+void
+polygon_offset_pieces(
+  const polygon_t *p,
+  double w,
+  join_type_t join_type,
+  cap_type_t cap_type,
+  double miter_limit,
+  const transform_t *transform,
+  bool only_linear,
+  const double *dash,
+  int32_t dash_array_size,
+  double dash_offset,
+  stroke_piece_fun_t *fun,
+  void *data)
+{
+  assert(p != NULL);
+  assert(transform != NULL);
+  assert(dash_array_size == 0 || dash != NULL);
+  assert(fun != NULL);
 
-    // Draw the "right" part
-
-    _line_offset(p->points[p->subpolys[ip]], p->points[p->subpolys[ip] - 1],
-                 -o, &p1o, &p2o, lin, inv_lin);
-    polygon_add_point(np, p1o);
-    polygon_add_point(np, p2o);
-
-    for (int i = p->subpolys[ip] - 1; i > ifp; --i) {
-      _line_offset(p->points[i], p->points[i - 1],
-                   -o, &p1n, &p2n, lin, inv_lin);
-
-      // Add round join if turning "right"
-      // TODO: don't bother if distance too small
-      if (point_position(p->points[i+1], p->points[i - 1], p->points[i]) > 0) {
-        switch(join_type) {
-          case JOIN_ROUND:
-            _arc_to_poly_transform_center(p->points[i], p2o, p1n, np,
-                                          iter, lin, inv_lin);
-            break;
-          case JOIN_MITER:
-            _miter_to_poly(p1o, p2o, p1n, p2n, np, miter_limit,
-                           p->points[i], w, inv_lin);
-            break;
-          case JOIN_BEVEL:
-            break;
-        }
-      }
-      polygon_add_point(np, p1n);
-      polygon_add_point(np, p2n);
+  const polygon_t *sp =
+    _polygon_prepare_stroke(p, transform, only_linear,
+                            dash, dash_array_size, dash_offset);
+  if (sp == NULL) {
+    return;
+  }
 
-      p1o = p1n;
-      p2o = p2n;
-    }
+  stroke_pieces(sp, w, join_type, cap_type, miter_limit,
+                transform, fun, data);
 
-    // If closed, add a join
-    if (p->subpoly_closed[ip]) {
-      // Add join if turning "right"
-      // TODO: don't bother if distance too small
-      // Assume end and start point are equal
-      assert(point_equal(p->points[p->subpolys[ip]], p->points[ifp]));
-      _line_offset(p->points[p->subpolys[ip]], p->points[p->subpolys[ip] - 1],
-                   -o, &p1n, &p2n, lin, inv_lin);
-      if (point_position(p->points[ifp+1],
-                         p->points[p->subpolys[ip]-1],
-                         p->points[ifp]) > 0) {
-        switch (join_type) {
-          case JOIN_ROUND:
-            _arc_to_poly_transform_center(p->points[ifp], p2o, p1n, np,
-                                          iter, lin, inv_lin);
-            break;
-          case JOIN_MITER:
-            _miter_to_poly(p1o, p2o, p1n, p2n, np, miter_limit,
-                           p->points[ifp], w, inv_lin);
-            break;
-          case JOIN_BEVEL:
-            break;
-        }
-      } else {
-        polygon_add_point(np, p1n);
-      }
+  if (sp != p) {
+    polygon_destroy((polygon_t *)sp);
+  }
+}
 
-    // If not closed, add a line cap
-    } else {
-      switch (cap_type) {
-        case CAP_BUTT:
-          break;
-        case CAP_SQUARE: {
-          double dist = point_dist(p1o,p2o);
-          point_t new_p1 =
-            point(p2o.x + (p2o.x - p1o.x) / dist * o,
-                  p2o.y + (p2o.y - p1o.y) / dist * o);
-          p1o = p->points[ifp + 1];
-          p2o = p->points[ifp];
-          _line_offset(p1o, p2o, o, &p1n, &p2n, lin, inv_lin);
-          point_t new_p2 =
-            point(p2n.x + (p2n.x - p1n.x) / dist * o,
-                  p2n.y + (p2n.y - p1n.y) / dist * o);
-          polygon_add_point(np,new_p1);
-          polygon_add_point(np,new_p2);
-          break;
-        }
-        case CAP_ROUND: {
-          point_t new_p1 = point(p2o.x, p2o.y);
-          p1o = p->points[ifp + 1];
-          p2o = p->points[ifp];
-          _line_offset(p1o, p2o, o, &p1n, &p2n, lin, inv_lin);
-          _arc_to_poly_transform(new_p1, p2n, np, iter, lin, inv_lin);
-          break;
-        }
-      }
-    }
+void
+polygon_offset_hairline(
+  const polygon_t *p,
+  double w,
+  const transform_t *transform,
+  bool only_linear,
+  const double *dash,
+  int32_t dash_array_size,
+  double dash_offset,
+  stroke_line_fun_t *fun,
+  void *data)
+{
+  assert(p != NULL);
+  assert(transform != NULL);
+  assert(dash_array_size == 0 || dash != NULL);
+  assert(fun != NULL);
 
-    polygon_end_subpoly(np, true);
+  const polygon_t *sp =
+    _polygon_prepare_stroke(p, transform, only_linear,
+                            dash, dash_array_size, dash_offset);
+  if (sp == NULL) {
+    return;
   }
 
-  if (dashed_poly != NULL) {
-    polygon_destroy(dashed_poly);
-  }
+  stroke_hairline(sp, w, transform, fun, data);
 
-  transform_destroy(lin);
-  transform_destroy(inv_lin);
+  if (sp != p) {
+    polygon_destroy((polygon_t *)sp);
+  }
 }
 
 bool
@@ -593,45 +376,28 @@ polygonize(
 }
 
 bool
-polygonize_outline(
+polygonize_stroke(
   path_t *path, // in
   double w,
   polygon_t *p, // out
   rect_t *bbox, // out
-  join_type_t join_type,
-  cap_type_t cap_type,
-  double miter_limit,
   const transform_t *transform,
-  bool only_linear,
-  const double *dash,
-  int32_t dash_array_size,
-  double dash_offset)
+  bool only_linear)
 {
   assert(path != NULL);
   assert(w > 0.0);
   assert(p != NULL);
   assert(bbox != NULL);
   assert(transform != NULL);
-  assert(dash_array_size == 0 || dash != NULL);
-
-  // TODO: initial size according to number of primitive
-  polygon_t *tp = polygon_create(1024, 16);
-  if (tp == NULL) {
-    return false;
-  }
 
-  bool res = polygonize(path, tp, bbox);
-  if (res == false) {
-    polygon_destroy(tp);
+  if (polygonize(path, p, bbox) == false) {
     return false;
   }
 
-  polygon_offset(tp, p, w, join_type, cap_type, miter_limit, transform,
-                 only_linear, dash, dash_array_size, dash_offset);
-
-  polygon_destroy(tp);
-
   if (!only_linear) {
+    for (int i = 0; i < p->nb_points; i++) {
+      transform_apply(transform, &(p->points[i]));
+    }
     point_t pt1 = transform_apply_new(transform, &bbox->p1);
     point_t pt2 = transform_apply_new(transform, &bbox->p2);
     point_t bp3 = point(bbox->p2.x, bbox->p1.y);
@@ -656,5 +422,41 @@ polygonize_outline(
   return true;
 }
 
+bool
+polygonize_outline(
+  path_t *path, // in
+  double w,
+  polygon_t *p, // out
+  rect_t *bbox, // out
+  join_type_t join_type,
+  cap_type_t cap_type,
+  double miter_limit,
+  const transform_t *transform,
+  bool only_linear,
+  const double *dash,
+  int32_t dash_array_size,
+  double dash_offset)
+{
+  assert(path != NULL);
+  assert(w > 0.0);
+  assert(p != NULL);
+  assert(bbox != NULL);
+  assert(transform != NULL);
+  assert(dash_array_size == 0 || dash != NULL);
+
+  // TODO: initial size according to number of primitive
+  polygon_t *tp = polygon_create(1024, 16);
+  if (tp == NULL) {
+    return false;
+  }
 
+  bool res = polygonize_stroke(path, w, tp, bbox, transform, only_linear);
+  if (res == true) {
+    polygon_offset(tp, p, w, join_type, cap_type, miter_limit, transform,
+                   true, dash, dash_array_size, dash_offset);
+  }
 
+  polygon_destroy(tp);
+
+  return res;
+}
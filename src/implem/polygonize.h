@@ -18,19 +18,7 @@
 #include "path.h"
 #include "polygon.h"
 #include "transform.h"
-
-typedef enum join_type_t {
-  JOIN_ROUND = 0,
-  JOIN_MITER = 1,
-  JOIN_BEVEL = 2,
-} join_type_t;
-
-typedef enum cap_type_t {
-  CAP_BUTT = 0,
-  CAP_SQUARE = 1,
-  CAP_ROUND = 2
-} cap_type_t;
-
+#include "stroke.h"
 
 void
 quadratic_to_poly(
@@ -55,6 +43,17 @@ polygonize(
   polygon_t *p,
   rect_t *bbox);
 
+// Polygonizes a path to be stroked: the points of p are in device space,
+// and bbox covers the whole stroke of width w
+bool
+polygonize_stroke(
+  path_t *path,
+  double w,
+  polygon_t *p,
+  rect_t *bbox,
+  const transform_t *transform,
+  bool only_linear);
+
 bool
 polygonize_outline(
   path_t *path,
@@ -84,4 +83,31 @@ polygon_offset(
   int32_t dash_array_size,
   double dash_offset);
 
+void
+polygon_offset_pieces(
+  const polygon_t *p,
+  double w,
+  join_type_t join_type,
+  cap_type_t cap_type,
+  double miter_limit,
+  const transform_t *transform,
+  bool only_linear,
+  const double *dash,
+  int32_t dash_array_size,
+  double dash_offset,
+  stroke_piece_fun_t *fun,
+  void *data);
+
+void
+polygon_offset_hairline(
+  const polygon_t *p,
+  double w,
+  const transform_t *transform,
+  bool only_linear,
+  const double *dash,
+  int32_t dash_array_size,
+  double dash_offset,
+  stroke_line_fun_t *fun,
+  void *data);
+
 #endif /* __POLYGONIZE_H */
@@ -25,6 +25,9 @@
 #ifdef HAS_WAYLAND
 #include "wayland/wl_present_data.h"
 #endif
+#ifdef HAS_HEADLESS
+#include "headless/hdl_present_data.h"
+#endif
 
 typedef union present_data_t {
 #ifdef HAS_GDI
@@ -39,6 +42,9 @@ typedef union present_data_t {
 #ifdef HAS_WAYLAND
   wl_present_data_t wl;
 #endif
+#ifdef HAS_HEADLESS
+  hdl_present_data_t hdl;
+#endif
 } present_data_t;
 
 #endif /* __PRESENT_DATA_H */
@@ -23,6 +23,8 @@
 
 #include "../hashtable.h"
 #include "../event.h"
+#include "../defer.h"
+#include "../frame.h"
 #include "qtz_keyboard.h"
 #include "qtz_window_internal.h"
 #include "qtz_backend.h"
@@ -208,22 +210,20 @@ static void
 _qtz_render_all_windows(
   void)
 {
+  defer_process();
+
   event_t evt;
   qtz_window_t *w = NULL;
-  hashtable_iterator_t *i = NULL;
   evt.type = EVENT_FRAME;
   evt.time = qtz_get_time();
-  i = ht_get_iterator(qtz_back->nswin_to_win);
-  if (i != NULL) {
-    while ((w = (qtz_window_t *)ht_iterator_next(i)) != NULL) {
-      if (w->base.visible == true) {
-        evt.target = (void *)w;
-        if (event_notify(qtz_back->listener, &evt)) {
-          [w->nsview setNeedsDisplay:YES];
-        }
+  hashtable_iterator_t i = ht_get_iterator(qtz_back->nswin_to_win);
+  while ((w = (qtz_window_t *)ht_iterator_next(&i)) != NULL) {
+    if (w->base.visible == true) {
+      evt.target = (void *)w;
+      if (event_notify(qtz_back->listener, &evt)) {
+        [w->nsview setNeedsDisplay:YES];
       }
     }
-    ht_free_iterator(i);
   }
 }
 
@@ -406,8 +406,10 @@ qtz_backend_run(
   CFRunLoopRef runloop = CFRunLoopGetMain();
   CFRetain(runloop);
 
+  CFTimeInterval interval = (CFTimeInterval)frame_get_interval() / 1000000.0;
+
   CFRunLoopTimerRef runloopTimer = CFRunLoopTimerCreateWithHandler(
-    kCFAllocatorDefault, CFAbsoluteTimeGetCurrent() + 0.0166667, 0.0166667, 0, 0,
+    kCFAllocatorDefault, CFAbsoluteTimeGetCurrent() + interval, interval, 0, 0,
     ^(CFRunLoopTimerRef timer) { _qtz_render_all_windows(); });
 
   CFRunLoopAddTimer(runloop, runloopTimer, kCFRunLoopCommonModes);
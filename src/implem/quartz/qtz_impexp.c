@@ -14,6 +14,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
 
 #include <Cocoa/Cocoa.h>
@@ -36,37 +37,17 @@ qtz_impexp_terminate(
   return;
 }
 
-bool
-qtz_impexp_export_png(
+static bool
+_qtz_impexp_write_png(
   const pixmap_t *pixmap,
-  const char *filename)
+  CGImageDestinationRef image_dest)
 {
   assert(pixmap != NULL);
   assert(pixmap_valid(*pixmap));
-  assert(filename != NULL);
+  assert(image_dest != NULL);
 
   bool res = false;
 
-  CFStringRef str_filename =
-    CFStringCreateWithCString(kCFAllocatorDefault, filename,
-                              kCFStringEncodingUTF8);
-  if (str_filename == NULL) {
-    goto error_string;
-  }
-
-  CFURLRef url =
-    CFURLCreateWithFileSystemPath(kCFAllocatorDefault, str_filename,
-                                  kCFURLPOSIXPathStyle, false);
-  if (url == NULL) {
-    goto error_url;
-  }
-
-  CGImageDestinationRef image_dest =
-    CGImageDestinationCreateWithURL(url, kUTTypePNG, 1, NULL);
-  if (image_dest == NULL) {
-    goto error_image_dest;
-  }
-
   CGColorSpaceRef color_space =
     CGColorSpaceCreateWithName(kCGColorSpaceGenericRGB);
   if (color_space == NULL) {
@@ -75,7 +56,7 @@ qtz_impexp_export_png(
 
   CGDataProviderRef provider =
     CGDataProviderCreateWithData(NULL, (void *)pixmap->data,
-                                 pixmap->width * pixmap->height * COLOR_SIZE,
+                                 pixmap->stride * pixmap->height * COLOR_SIZE,
                                  NULL);
   if (provider == NULL) {
     goto error_provider;
@@ -83,7 +64,7 @@ qtz_impexp_export_png(
 
   CGImageRef image =
     CGImageCreate(pixmap->width, pixmap->height, 8, 8 * COLOR_SIZE,
-                  pixmap->width * COLOR_SIZE, color_space,
+                  pixmap->stride * COLOR_SIZE, color_space,
                   kCGImageAlphaPremultipliedFirst |
                   kCGBitmapByteOrder32Little,
                   provider, NULL, false,
@@ -106,6 +87,42 @@ error_image:
 error_provider:
   CGColorSpaceRelease(color_space);
 error_color_space:
+  return res;
+}
+
+bool
+qtz_impexp_export_png(
+  const pixmap_t *pixmap,
+  const char *filename)
+{
+  assert(pixmap != NULL);
+  assert(pixmap_valid(*pixmap));
+  assert(filename != NULL);
+
+  bool res = false;
+
+  CFStringRef str_filename =
+    CFStringCreateWithCString(kCFAllocatorDefault, filename,
+                              kCFStringEncodingUTF8);
+  if (str_filename == NULL) {
+    goto error_string;
+  }
+
+  CFURLRef url =
+    CFURLCreateWithFileSystemPath(kCFAllocatorDefault, str_filename,
+                                  kCFURLPOSIXPathStyle, false);
+  if (url == NULL) {
+    goto error_url;
+  }
+
+  CGImageDestinationRef image_dest =
+    CGImageDestinationCreateWithURL(url, kUTTypePNG, 1, NULL);
+  if (image_dest == NULL) {
+    goto error_image_dest;
+  }
+
+  res = _qtz_impexp_write_png(pixmap, image_dest);
+
   CFRelease(image_dest);
 error_image_dest:
   CFRelease(url);
@@ -115,6 +132,54 @@ error_string:
   return res;
 }
 
+bool
+qtz_impexp_export_png_to_memory(
+  const pixmap_t *pixmap,
+  uint8_t **data,
+  size_t *size)
+{
+  assert(pixmap != NULL);
+  assert(pixmap_valid(*pixmap));
+  assert(data != NULL);
+  assert(size != NULL);
+
+  bool res = false;
+
+  CFMutableDataRef cf_data = CFDataCreateMutable(kCFAllocatorDefault, 0);
+  if (cf_data == NULL) {
+    goto error_data;
+  }
+
+  CGImageDestinationRef image_dest =
+    CGImageDestinationCreateWithData(cf_data, kUTTypePNG, 1, NULL);
+  if (image_dest == NULL) {
+    goto error_image_dest;
+  }
+
+  if (_qtz_impexp_write_png(pixmap, image_dest) == false) {
+    goto error_write;
+  }
+
+  size_t length = (size_t)CFDataGetLength(cf_data);
+  uint8_t *buffer = (uint8_t *)malloc(max(length, 1));
+  if (buffer == NULL) {
+    goto error_write;
+  }
+  memcpy(buffer, CFDataGetBytePtr(cf_data), length);
+
+  *data = buffer;
+  *size = length;
+
+  res = true;
+
+error_write:
+  CFRelease(image_dest);
+error_image_dest:
+  CFRelease(cf_data);
+error_data:
+  return res;
+}
+
 bool
 qtz_impexp_import_png(
   pixmap_t *pixmap,
@@ -155,13 +220,15 @@ qtz_impexp_import_png(
   int32_t swidth = CGImageGetWidth(image);
   int32_t sheight = CGImageGetHeight(image);
 
-  int32_t dwidth = 0, dheight = 0;
+  int32_t dwidth = 0, dheight = 0, dstride = 0;
   if (alloc == true) {
     dwidth = swidth;
     dheight = sheight;
+    dstride = swidth;
   } else {
     dwidth = pixmap->width;
     dheight = pixmap->height;
+    dstride = pixmap->stride;
   }
 
   int32_t sx = 0, sy = 0;
@@ -181,8 +248,8 @@ qtz_impexp_import_png(
   }
 
   CGContextRef ctxt =
-    CGBitmapContextCreate((void *)data + (dy * dwidth + dx) * COLOR_SIZE,
-                          width, height, 8, dwidth * COLOR_SIZE, color_space,
+    CGBitmapContextCreate((void *)data + (dy * dstride + dx) * COLOR_SIZE,
+                          width, height, 8, dstride * COLOR_SIZE, color_space,
                           kCGImageAlphaPremultipliedFirst |
                           kCGBitmapByteOrder32Little);
   if (ctxt == NULL) {
@@ -196,6 +263,7 @@ qtz_impexp_import_png(
     pixmap->data = data;
     pixmap->width = dwidth;
     pixmap->height = dheight;
+    pixmap->stride = dstride;
   }
 
   res = true;
@@ -12,6 +12,7 @@
 #define __QTZ_IMPEXP_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include "../pixmap.h"
@@ -29,6 +30,12 @@ qtz_impexp_export_png(
   const pixmap_t *pixmap,
   const char *filename);
 
+bool
+qtz_impexp_export_png_to_memory(
+  const pixmap_t *pixmap,
+  uint8_t **data,
+  size_t *size);
+
 bool
 qtz_impexp_import_png(
   pixmap_t *pixmap,
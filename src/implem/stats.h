@@ -0,0 +1,57 @@
+/**************************************************************************/
+/*                                                                        */
+/*    Copyright 2022 OCamlPro                                             */
+/*                                                                        */
+/*  All rights reserved. This file is distributed under the terms of the  */
+/*  GNU Lesser General Public License version 2.1, with the special       */
+/*  exception on linking described in the file LICENSE.                   */
+/*                                                                        */
+/**************************************************************************/
+
+#ifndef __STATS_H
+#define __STATS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Times are in nanoseconds
+typedef enum stats_counter_t {
+  STATS_POLY_RENDERS       = 0,
+  STATS_VERTICES           = 1,
+  STATS_PIXELS_COVERED     = 2,
+  STATS_PIXELS_COMPOSITED  = 3,
+  STATS_GLYPHS             = 4,
+  STATS_PRESENTS           = 5,
+  STATS_BYTES_UPLOADED     = 6,
+  STATS_TIME_POLYGONIZE    = 7,
+  STATS_TIME_OFFSET        = 8,
+  STATS_TIME_RASTERIZE     = 9,
+  STATS_TIME_COMPOSITE     = 10,
+  STATS_TIME_BLUR          = 11,
+  STATS_TIME_PRESENT       = 12,
+  STATS_COUNT              = 13
+} stats_counter_t;
+
+typedef struct stats_t {
+  int64_t counters[STATS_COUNT];
+} stats_t;
+
+// Nanoseconds from an arbitrary starting point
+int64_t
+stats_now(
+  void);
+
+// Statistics are disabled when the stats_t pointer is NULL,
+// in which case these only cost a test (the clock is not read)
+
+#define stats_start(s) (((s) != NULL) ? stats_now() : 0)
+
+#define stats_stop(s,c,t) do { \
+  if ((s) != NULL) { (s)->counters[c] += stats_now() - (t); } \
+} while (0)
+
+#define stats_add(s,c,n) do { \
+  if ((s) != NULL) { (s)->counters[c] += (n); } \
+} while (0)
+
+#endif /* __STATS_H */
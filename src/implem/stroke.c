@@ -0,0 +1,614 @@
+/**************************************************************************/
+/*                                                                        */
+/*    Copyright 2022 OCamlPro                                             */
+/*                                                                        */
+/*  All rights reserved. This file is distributed under the terms of the  */
+/*  GNU Lesser General Public License version 2.1, with the special       */
+/*  exception on linking described in the file LICENSE.                   */
+/*                                                                        */
+/**************************************************************************/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h> // Note: on Win32, add #define _USE_MATH_DEFINES for M_PI
+#include <float.h>
+#include <assert.h>
+
+#include "util.h"
+#include "point.h"
+#include "transform.h"
+#include "polygon.h"
+#include "polygon_internal.h"
+#include "stroke.h"
+
+/*
+  The stroker works in "pen space", i.e. the space obtained by applying
+  the inverse of the linear part of the transform to the (already
+  transformed) points. In this space the pen is a circle of radius w/2,
+  so offsets, joins and caps can be computed with plain vector math.
+  Every emitted point is then mapped back to device space.
+*/
+typedef struct stroker_t {
+  double r;           // Half the line width (pen space)
+  double step;        // Maximum angle step when flattening arcs
+  join_type_t join_type;
+  cap_type_t cap_type;
+  double miter_limit;
+  double a, b, c, d;  // Linear part of the transform
+  double ia, ib, ic, id; // Its inverse
+} stroker_t;
+
+#define _offset(p,v,k) \
+  (point((p).x + (v).x * (k), (p).y + (v).y * (k)))
+
+// Largest singular value of the linear part of the transform
+static double
+_stroke_max_scale(
+  const transform_t *transform)
+{
+  assert(transform != NULL);
+
+  double a, b, c, d;
+  transform_extract_ft(transform, &a, &b, &c, &d);
+
+  double det = a * d - b * c;
+  double s2 = a * a + b * b + c * c + d * d;
+  return sqrt(0.5 * (s2 + sqrt(max(0.0, s2 * s2 - 4.0 * det * det))));
+}
+
+static bool
+_stroker_init(
+  stroker_t *s,
+  double w,
+  join_type_t join_type,
+  cap_type_t cap_type,
+  double miter_limit,
+  const transform_t *transform)
+{
+  assert(s != NULL);
+  assert(w > 0.0);
+  assert(transform != NULL);
+
+  double a, b, c, d;
+  transform_extract_ft(transform, &a, &b, &c, &d);
+
+  double det = a * d - b * c;
+  if (fabs(det) < DBL_EPSILON) {
+    return false;
+  }
+
+  s->r = w / 2.0;
+  s->join_type = join_type;
+  s->cap_type = cap_type;
+  s->miter_limit = miter_limit;
+  s->a = a; s->b = b; s->c = c; s->d = d;
+  s->ia = d / det; s->ib = -b / det;
+  s->ic = -c / det; s->id = a / det;
+
+  // The tolerance is given in device space: divide it by the largest
+  // scale factor of the transform to express it in pen space
+  double tol = STROKE_TOLERANCE / _stroke_max_scale(transform);
+  s->step = (tol >= s->r) ? M_PI / 2.0 :
+    min(M_PI / 2.0, 2.0 * acos(1.0 - tol / s->r));
+
+  return true;
+}
+
+static void
+_stroker_emit(
+  const stroker_t *s,
+  polygon_t *np,
+  point_t q)
+{
+  assert(s != NULL);
+  assert(np != NULL);
+
+  polygon_add_point(np, point(q.x * s->a + q.y * s->c,
+                              q.x * s->b + q.y * s->d));
+}
+
+// Load subpolygon [first, last] in pen space, skipping repeated points
+static int32_t
+_stroker_load(
+  const stroker_t *s,
+  const polygon_t *p,
+  int32_t first,
+  int32_t last,
+  bool closed,
+  point_t *q)
+{
+  assert(s != NULL);
+  assert(p != NULL);
+  assert(q != NULL);
+
+  int32_t n = 0;
+  for (int32_t i = first; i <= last; ++i) {
+    point_t pt = p->points[i];
+    point_t u = point(pt.x * s->ia + pt.y * s->ic, pt.x * s->ib + pt.y * s->id);
+    if ((n == 0) || (point_equal(q[n - 1], u) == false)) {
+      q[n++] = u;
+    }
+  }
+
+  if (closed && (n > 1) && point_equal(q[0], q[n - 1])) {
+    n--;
+  }
+
+  return n;
+}
+
+// Emits the points strictly between p + r.v and p + r.v rotated by sweep
+static void
+_stroker_arc(
+  const stroker_t *s,
+  polygon_t *np,
+  point_t p,
+  point_t v,
+  double sweep)
+{
+  assert(s != NULL);
+  assert(np != NULL);
+
+  int32_t n = (int32_t)ceil(fabs(sweep) / s->step);
+  if (n <= 1) {
+    return;
+  }
+
+  double da = sweep / (double)n;
+  double cs = cos(da);
+  double sn = sin(da);
+  point_t u = v;
+  for (int32_t i = 1; i < n; ++i) {
+    u = point(u.x * cs - u.y * sn, u.x * sn + u.y * cs);
+    _stroker_emit(s, np, _offset(p, u, s->r));
+  }
+}
+
+// Emits an outer join from p + r.a0 to p + r.a1; cusp_sweep gives the
+// direction of a round join when a0 and a1 are exactly opposite
+static void
+_stroker_outer_join(
+  const stroker_t *s,
+  polygon_t *np,
+  point_t p,
+  point_t a0,
+  point_t a1,
+  double cusp_sweep)
+{
+  assert(s != NULL);
+  assert(np != NULL);
+
+  double dot = a0.x * a1.x + a0.y * a1.y;
+  double cross = a0.x * a1.y - a0.y * a1.x;
+
+  _stroker_emit(s, np, _offset(p, a0, s->r));
+
+  switch (s->join_type) {
+    case JOIN_ROUND:
+      _stroker_arc(s, np, p, a0,
+                   ((cross == 0.0) && (dot < 0.0)) ?
+                   cusp_sweep : atan2(cross, dot));
+      break;
+    case JOIN_MITER:
+      // The miter length ratio is 1 / cos(theta / 2), i.e. the norm of m
+      if (1.0 + dot > DBL_EPSILON) {
+        point_t m = point((a0.x + a1.x) / (1.0 + dot),
+                          (a0.y + a1.y) / (1.0 + dot));
+        if (m.x * m.x + m.y * m.y <= s->miter_limit * s->miter_limit) {
+          _stroker_emit(s, np, _offset(p, m, s->r));
+        }
+      }
+      break;
+    case JOIN_BEVEL:
+      break;
+  }
+
+  _stroker_emit(s, np, _offset(p, a1, s->r));
+}
+
+// Emits the points of the cap strictly between p + r.n and p - r.n,
+// where n is the left normal of the outward direction d
+static void
+_stroker_cap(
+  const stroker_t *s,
+  polygon_t *np,
+  point_t p,
+  point_t d)
+{
+  assert(s != NULL);
+  assert(np != NULL);
+
+  point_t n = point(-d.y, d.x);
+
+  switch (s->cap_type) {
+    case CAP_BUTT:
+      break;
+    case CAP_SQUARE:
+      _stroker_emit(s, np, _offset(_offset(p, n, s->r), d, s->r));
+      _stroker_emit(s, np, _offset(_offset(p, n, -s->r), d, s->r));
+      break;
+    case CAP_ROUND:
+      _stroker_arc(s, np, p, n, -M_PI);
+      break;
+  }
+}
+
+static point_t
+_stroker_dir(
+  point_t p1,
+  point_t p2,
+  double *len)
+{
+  assert(len != NULL);
+
+  point_t d = point(p2.x - p1.x, p2.y - p1.y);
+  *len = sqrt(d.x * d.x + d.y * d.y);
+  return point(d.x / *len, d.y / *len);
+}
+
+// Emits the left side of the join at p1
+static void
+_stroker_join(
+  const stroker_t *s,
+  polygon_t *np,
+  point_t p0,
+  point_t p1,
+  point_t p2)
+{
+  assert(s != NULL);
+  assert(np != NULL);
+
+  double l0, l1;
+  point_t d0 = _stroker_dir(p0, p1, &l0);
+  point_t d1 = _stroker_dir(p1, p2, &l1);
+  point_t n0 = point(-d0.y, d0.x);
+  point_t n1 = point(-d1.y, d1.x);
+  double cross = d0.x * d1.y - d0.y * d1.x;
+  double dot = d0.x * d1.x + d0.y * d1.y;
+
+  if ((cross == 0.0) && (dot > 0.0)) {
+
+    // Collinear: a single offset point is enough
+    _stroker_emit(s, np, _offset(p1, n0, s->r));
+
+  } else if (cross > 0.0) {
+
+    // Turning left, the left side is the inner side: cut the corner at
+    // the intersection of both offset lines, unless it lies beyond one
+    // of the segments, in which case go through the center
+    if (1.0 + dot > DBL_EPSILON) {
+      point_t m = point((n0.x + n1.x) / (1.0 + dot),
+                        (n0.y + n1.y) / (1.0 + dot));
+      double t = s->r * fabs(m.x * d0.x + m.y * d0.y);
+      if ((t <= l0) && (t <= l1)) {
+        _stroker_emit(s, np, _offset(p1, m, s->r));
+        return;
+      }
+    }
+    _stroker_emit(s, np, _offset(p1, n0, s->r));
+    _stroker_emit(s, np, p1);
+    _stroker_emit(s, np, _offset(p1, n1, s->r));
+
+  } else {
+
+    _stroker_outer_join(s, np, p1, n0, n1, -M_PI);
+
+  }
+}
+
+// Emits the left side of q[0..n-1]
+static void
+_stroker_side(
+  const stroker_t *s,
+  polygon_t *np,
+  const point_t *q,
+  int32_t n,
+  bool closed)
+{
+  assert(s != NULL);
+  assert(np != NULL);
+  assert(q != NULL);
+  assert(n >= 2);
+
+  double l;
+
+  if (closed) {
+    for (int32_t i = 0; i < n; ++i) {
+      _stroker_join(s, np, q[(i + n - 1) % n], q[i], q[(i + 1) % n]);
+    }
+  } else {
+    point_t d = _stroker_dir(q[0], q[1], &l);
+    _stroker_emit(s, np, _offset(q[0], point(-d.y, d.x), s->r));
+    for (int32_t i = 1; i < n - 1; ++i) {
+      _stroker_join(s, np, q[i - 1], q[i], q[i + 1]);
+    }
+    d = _stroker_dir(q[n - 2], q[n - 1], &l);
+    _stroker_emit(s, np, _offset(q[n - 1], point(-d.y, d.x), s->r));
+  }
+}
+
+bool
+stroke_outline(
+  const polygon_t *p,
+  polygon_t *np,
+  double w,
+  join_type_t join_type,
+  cap_type_t cap_type,
+  double miter_limit,
+  const transform_t *transform)
+{
+  assert(p != NULL);
+  assert(np != NULL);
+  assert(w > 0.0);
+  assert(transform != NULL);
+
+  stroker_t s;
+  if (_stroker_init(&s, w, join_type, cap_type,
+                    miter_limit, transform) == false) {
+    return true;
+  }
+
+  point_t *q = (point_t *)calloc(2 * max(1, p->nb_points), sizeof(point_t));
+  if (q == NULL) {
+    return false;
+  }
+  point_t *rq = q + max(1, p->nb_points);
+
+  double l;
+
+  for (int32_t ip = 0; ip < p->nb_subpolys; ++ip) {
+
+    int32_t first = (ip == 0) ? 0 : p->subpolys[ip - 1] + 1;
+    bool closed = p->subpoly_closed[ip];
+    int32_t n = _stroker_load(&s, p, first, p->subpolys[ip], closed, q);
+
+    // Skip subpolygons reduced to a single point
+    if (n < 2) {
+      continue;
+    }
+
+    for (int32_t i = 0; i < n; ++i) {
+      rq[i] = q[n - 1 - i];
+    }
+
+    if (closed) {
+      _stroker_side(&s, np, q, n, true);
+      polygon_end_subpoly(np, true);
+      _stroker_side(&s, np, rq, n, true);
+      polygon_end_subpoly(np, true);
+    } else {
+      _stroker_side(&s, np, q, n, false);
+      _stroker_cap(&s, np, q[n - 1], _stroker_dir(q[n - 2], q[n - 1], &l));
+      _stroker_side(&s, np, rq, n, false);
+      _stroker_cap(&s, np, q[0], _stroker_dir(q[1], q[0], &l));
+      polygon_end_subpoly(np, true);
+    }
+  }
+
+  free(q);
+
+  return true;
+}
+
+static void
+_stroker_piece_segment(
+  const stroker_t *s,
+  polygon_t *piece,
+  point_t p1,
+  point_t p2,
+  stroke_piece_fun_t *fun,
+  void *data)
+{
+  assert(s != NULL);
+  assert(piece != NULL);
+  assert(fun != NULL);
+
+  double l;
+  point_t d = _stroker_dir(p1, p2, &l);
+  point_t n = point(-d.y, d.x);
+
+  polygon_reset(piece);
+  _stroker_emit(s, piece, _offset(p1, n, s->r));
+  _stroker_emit(s, piece, _offset(p2, n, s->r));
+  _stroker_emit(s, piece, _offset(p2, n, -s->r));
+  _stroker_emit(s, piece, _offset(p1, n, -s->r));
+  polygon_end_subpoly(piece, true);
+  fun(piece, data);
+}
+
+static void
+_stroker_piece_join(
+  const stroker_t *s,
+  polygon_t *piece,
+  point_t p0,
+  point_t p1,
+  point_t p2,
+  stroke_piece_fun_t *fun,
+  void *data)
+{
+  assert(s != NULL);
+  assert(piece != NULL);
+  assert(fun != NULL);
+
+  double l0, l1;
+  point_t d0 = _stroker_dir(p0, p1, &l0);
+  point_t d1 = _stroker_dir(p1, p2, &l1);
+  point_t n0 = point(-d0.y, d0.x);
+  point_t n1 = point(-d1.y, d1.x);
+  double cross = d0.x * d1.y - d0.y * d1.x;
+  double dot = d0.x * d1.x + d0.y * d1.y;
+
+  // Nothing to fill between collinear segments
+  if ((cross == 0.0) && (dot > 0.0)) {
+    return;
+  }
+
+  // The inner side is covered by the segments themselves
+  polygon_reset(piece);
+  _stroker_emit(s, piece, p1);
+  if (cross > 0.0) {
+    _stroker_outer_join(s, piece, p1, point(-n0.x, -n0.y),
+                        point(-n1.x, -n1.y), M_PI);
+  } else {
+    _stroker_outer_join(s, piece, p1, n0, n1, -M_PI);
+  }
+  polygon_end_subpoly(piece, true);
+  fun(piece, data);
+}
+
+static void
+_stroker_piece_cap(
+  const stroker_t *s,
+  polygon_t *piece,
+  point_t p,
+  point_t d,
+  stroke_piece_fun_t *fun,
+  void *data)
+{
+  assert(s != NULL);
+  assert(piece != NULL);
+  assert(fun != NULL);
+
+  if (s->cap_type == CAP_BUTT) {
+    return;
+  }
+
+  point_t n = point(-d.y, d.x);
+
+  polygon_reset(piece);
+  _stroker_emit(s, piece, _offset(p, n, s->r));
+  _stroker_cap(s, piece, p, d);
+  _stroker_emit(s, piece, _offset(p, n, -s->r));
+  polygon_end_subpoly(piece, true);
+  fun(piece, data);
+}
+
+bool
+stroke_pieces(
+  const polygon_t *p,
+  double w,
+  join_type_t join_type,
+  cap_type_t cap_type,
+  double miter_limit,
+  const transform_t *transform,
+  stroke_piece_fun_t *fun,
+  void *data)
+{
+  assert(p != NULL);
+  assert(w > 0.0);
+  assert(transform != NULL);
+  assert(fun != NULL);
+
+  stroker_t s;
+  if (_stroker_init(&s, w, join_type, cap_type,
+                    miter_limit, transform) == false) {
+    return true;
+  }
+
+  point_t *q = (point_t *)calloc(max(1, p->nb_points), sizeof(point_t));
+  if (q == NULL) {
+    return false;
+  }
+
+  polygon_t *piece = polygon_create(64, 1);
+  if (piece == NULL) {
+    free(q);
+    return false;
+  }
+
+  double l;
+
+  for (int32_t ip = 0; ip < p->nb_subpolys; ++ip) {
+
+    int32_t first = (ip == 0) ? 0 : p->subpolys[ip - 1] + 1;
+    bool closed = p->subpoly_closed[ip];
+    int32_t n = _stroker_load(&s, p, first, p->subpolys[ip], closed, q);
+
+    // Skip subpolygons reduced to a single point
+    if (n < 2) {
+      continue;
+    }
+
+    if (closed) {
+      for (int32_t i = 0; i < n; ++i) {
+        _stroker_piece_segment(&s, piece, q[i], q[(i + 1) % n], fun, data);
+        _stroker_piece_join(&s, piece, q[(i + n - 1) % n], q[i],
+                            q[(i + 1) % n], fun, data);
+      }
+    } else {
+      for (int32_t i = 0; i < n - 1; ++i) {
+        _stroker_piece_segment(&s, piece, q[i], q[i + 1], fun, data);
+        if (i > 0) {
+          _stroker_piece_join(&s, piece, q[i - 1], q[i], q[i + 1],
+                              fun, data);
+        }
+      }
+      _stroker_piece_cap(&s, piece, q[n - 1],
+                         _stroker_dir(q[n - 2], q[n - 1], &l), fun, data);
+      _stroker_piece_cap(&s, piece, q[0],
+                         _stroker_dir(q[1], q[0], &l), fun, data);
+    }
+  }
+
+  polygon_destroy(piece);
+  free(q);
+
+  return true;
+}
+
+bool
+stroke_is_hairline(
+  double w,
+  const transform_t *transform)
+{
+  assert(transform != NULL);
+
+  return w * _stroke_max_scale(transform) <= 1.0;
+}
+
+bool
+stroke_hairline(
+  const polygon_t *p,
+  double w,
+  const transform_t *transform,
+  stroke_line_fun_t *fun,
+  void *data)
+{
+  assert(p != NULL);
+  assert(w > 0.0);
+  assert(transform != NULL);
+  assert(fun != NULL);
+
+  double a, b, c, d;
+  transform_extract_ft(transform, &a, &b, &c, &d);
+
+  double det = a * d - b * c;
+  if (fabs(det) < DBL_EPSILON) {
+    return true;
+  }
+
+  for (int32_t ip = 0; ip < p->nb_subpolys; ++ip) {
+
+    int32_t first = (ip == 0) ? 0 : p->subpolys[ip - 1] + 1;
+
+    // Closed subpolygons already end with their first point
+    for (int32_t i = first; i < p->subpolys[ip]; ++i) {
+
+      point_t p1 = p->points[i];
+      point_t p2 = p->points[i + 1];
+      double l = point_dist(p1, p2);
+      if (l == 0.0) {
+        continue;
+      }
+
+      // A pen-space rectangle of width w maps to a parallelogram whose
+      // device width, across the device direction u, is w.|det|.|L^-1 u|
+      point_t u = point((p2.x - p1.x) / l, (p2.y - p1.y) / l);
+      point_t v = point((u.x * d - u.y * c) / det, (u.y * a - u.x * b) / det);
+      fun(p1, p2, w * fabs(det) * sqrt(v.x * v.x + v.y * v.y), data);
+    }
+  }
+
+  return true;
+}
@@ -0,0 +1,92 @@
+/**************************************************************************/
+/*                                                                        */
+/*    Copyright 2022 OCamlPro                                             */
+/*                                                                        */
+/*  All rights reserved. This file is distributed under the terms of the  */
+/*  GNU Lesser General Public License version 2.1, with the special       */
+/*  exception on linking described in the file LICENSE.                   */
+/*                                                                        */
+/**************************************************************************/
+
+#ifndef __STROKE_H
+#define __STROKE_H
+
+#include <stdbool.h>
+
+#include "point.h"
+#include "polygon.h"
+#include "transform.h"
+
+typedef enum join_type_t {
+  JOIN_ROUND = 0,
+  JOIN_MITER = 1,
+  JOIN_BEVEL = 2,
+} join_type_t;
+
+typedef enum cap_type_t {
+  CAP_BUTT = 0,
+  CAP_SQUARE = 1,
+  CAP_ROUND = 2
+} cap_type_t;
+
+// Maximum distance (in device pixels) between a round join or cap
+// and its polygonal approximation
+#define STROKE_TOLERANCE 0.25
+
+// Number of points above which a stroke is better rasterized
+// piece by piece rather than as a whole outline
+#define STROKE_PIECES_THRESHOLD 128
+
+// Receives each convex piece of a stroke in pieces mode
+typedef void stroke_piece_fun_t(const polygon_t *piece, void *data);
+
+// Receives each segment of a hairline stroke, along with its device width
+typedef void stroke_line_fun_t(point_t p1, point_t p2, double w, void *data);
+
+// Outlines the (already transformed) polygon p into np. Each open
+// subpolygon yields a single contour (left side, end cap, right side,
+// start cap), each closed one yields an outer and an inner contour.
+// Inner joins are cut at the offset lines intersection whenever
+// possible, so that the outline does not overlap itself.
+// The transform is only used for its linear part.
+bool
+stroke_outline(
+  const polygon_t *p,
+  polygon_t *np,
+  double w,
+  join_type_t join_type,
+  cap_type_t cap_type,
+  double miter_limit,
+  const transform_t *transform);
+
+// Same as stroke_outline, but instead of building an outline, emits
+// every segment, outer join and cap as an individual convex polygon,
+// so that they can be rasterized without building the whole outline
+bool
+stroke_pieces(
+  const polygon_t *p,
+  double w,
+  join_type_t join_type,
+  cap_type_t cap_type,
+  double miter_limit,
+  const transform_t *transform,
+  stroke_piece_fun_t *fun,
+  void *data);
+
+// Tells whether a stroke of width w is at most one device pixel wide
+bool
+stroke_is_hairline(
+  double w,
+  const transform_t *transform);
+
+// Emits every segment of p, so that it can be drawn as a thin line
+// instead of being outlined; joins and caps are ignored
+bool
+stroke_hairline(
+  const polygon_t *p,
+  double w,
+  const transform_t *transform,
+  stroke_line_fun_t *fun,
+  void *data);
+
+#endif /* __STROKE_H */
@@ -22,6 +22,7 @@
 #include "pixmap.h"
 #include "surface.h"
 #include "surface_internal.h"
+#include "trace.h"
 
 #ifdef HAS_GDI
 #include "gdi/gdi_surface.h"
@@ -35,15 +36,25 @@
 #ifdef HAS_WAYLAND
 #include "wayland/wl_surface.h"
 #endif
+#ifdef HAS_HEADLESS
+#include "headless/hdl_surface.h"
+#endif
+
+// Over-allocation granted to a surface that has to grow, so that
+// successive resizes (such as those that occur while interactively
+// resizing a window) do not reallocate and copy it every time
+#define SURFACE_SLACK(n) ((int32_t)min((int64_t)(n) + (n) / 4, INT32_MAX))
 
 static surface_t *
 _surface_create_internal(
   int32_t width,
   int32_t height,
+  int32_t stride,
   color_t_ *data) // May be NULL
 {
   assert(width > 0);
   assert(height > 0);
+  assert(stride >= width);
 
   surface_t *s = (surface_t *)calloc(1, sizeof(surface_t));
   if (s == NULL) {
@@ -54,6 +65,9 @@ _surface_create_internal(
   s->data = data;
   s->width = width;
   s->height = height;
+  s->stride = stride;
+  s->rows = height;
+  s->compact = false;
 
   return s;
 }
@@ -71,7 +85,7 @@ surface_create(
     return NULL;
   }
 
-  surface_t *s = _surface_create_internal(width, height, data);
+  surface_t *s = _surface_create_internal(width, height, width, data);
   if (s == NULL) {
     free(data);
     return NULL;
@@ -88,11 +102,13 @@ surface_create_from_pixmap(
   assert(pixmap_valid(*pixmap) == true);
 
   surface_t *s =
-    _surface_create_internal(pixmap->width, pixmap->height, pixmap->data);
+    _surface_create_internal(pixmap->width, pixmap->height,
+                             pixmap->stride, pixmap->data);
   if (s != NULL) {
     pixmap->data = NULL;
     pixmap->width = 0;
     pixmap->height = 0;
+    pixmap->stride = 0;
   }
 
   return s;
@@ -108,7 +124,7 @@ surface_create_onscreen(
   assert(width > 0);
   assert(height > 0);
 
-  surface_t *s = _surface_create_internal(width, height, NULL);
+  surface_t *s = _surface_create_internal(width, height, width, NULL);
   if (s == NULL) {
     return NULL;
   }
@@ -126,6 +142,9 @@ surface_create_onscreen(
     case_WAYLAND(s->impl = (surface_impl_t *)
                  surface_create_wl_impl((wl_target_t *)target,
                                         width, height, &s->data));
+    case_HEADLESS(s->impl = (surface_impl_t *)
+                  surface_create_hdl_impl((hdl_target_t *)target,
+                                          width, height, &s->data));
     default_fail();
   }
   if (s->impl == NULL) {
@@ -151,6 +170,7 @@ surface_destroy(
                   /* s->data = NULL; // if not done already -- check */);
       case_X11(surface_destroy_x11_impl((surface_impl_x11_t *)s->impl));
       case_WAYLAND(surface_destroy_wl_impl((surface_impl_wl_t *)s->impl));
+      case_HEADLESS(surface_destroy_hdl_impl((surface_impl_hdl_t *)s->impl));
       default_fail();
     }
     free(s->impl);
@@ -168,23 +188,61 @@ _surface_copy_to_buffer(
   surface_t *s,
   color_t_ *data,
   int32_t width,
-  int32_t height)
+  int32_t height,
+  int32_t stride)
 {
   assert(s != NULL);
   assert(s->data != NULL);
   assert(data != NULL);
   assert(width > 0);
   assert(height > 0);
+  assert(stride >= width);
+
+  pixmap_t dp = pixmap_strided(width, height, stride, data);
+  pixmap_t sp = surface_get_raw_pixmap(s);
+  pixmap_blit(&dp, 0, 0, &sp, 0, 0, width, height);
+}
 
-  uint32_t min_width = width < s->width ? width : s->width;
-  uint32_t min_height = height < s->height ? height : s->height;
-  for (size_t i = 0; i < min_height; ++i) {
-    for (size_t j = 0; j < min_width; ++j) {
-      data[i * width + j] = s->data[i * s->width + j];
+static void
+_surface_clear_exposed(
+  surface_t *s,
+  int32_t width,
+  int32_t height)
+{
+  assert(s != NULL);
+  assert(s->data != NULL);
+  assert(width <= s->stride);
+  assert(height <= s->rows);
+
+  /* Pixels beyond the current size may be left
+     over from a previous, larger size */
+  for (int32_t i = 0; i < height; ++i) {
+    int32_t j = (i < s->height) ? s->width : 0;
+    if (j < width) {
+      memset(&s->data[i * s->stride + j], 0, (width - j) * COLOR_SIZE);
     }
   }
 }
 
+static bool
+_surface_is_strided(
+  const surface_t *s)
+{
+  assert(s != NULL);
+
+  if (s->impl == NULL) {
+    return true;
+  }
+
+  bool result = false;
+  switch_IMPL() {
+    case_X11(result = true);
+    case_HEADLESS(result = true);
+    default_ignore();
+  }
+  return result;
+}
+
 bool
 surface_resize(
   surface_t *s,
@@ -198,18 +256,40 @@ surface_resize(
     return false;
   }
 
+  bool strided = _surface_is_strided(s);
+
+  /* Reuse the current buffer if it is large enough,
+     unless most of it would be wasted */
+  if ((strided == true) &&
+      ((s->compact == false) || (width == s->stride)) &&
+      (width <= s->stride) && (height <= s->rows) &&
+      ((int64_t)width * height * 4 >= (int64_t)s->stride * s->rows)) {
+    _surface_clear_exposed(s, width, height);
+    s->width = width;
+    s->height = height;
+    return true;
+  }
+
+  int32_t stride = width;
+  int32_t rows = height;
+  if ((strided == true) && (s->compact == false) &&
+      ((width > s->stride) || (height > s->rows))) {
+    stride = SURFACE_SLACK(width);
+    rows = SURFACE_SLACK(height);
+  }
+
   color_t_ *data = NULL;
 
 // TODO: fill extra data with background color
 
   if (s->impl == NULL) {
 
-    data = (color_t_ *)calloc(width * height, sizeof(color_t_));
+    data = (color_t_ *)calloc((size_t)stride * rows, sizeof(color_t_));
     if (data == NULL) {
       return false;
     }
 
-    _surface_copy_to_buffer(s, data, width, height);
+    _surface_copy_to_buffer(s, data, width, height, stride);
 
     free(s->data);
 
@@ -227,12 +307,20 @@ surface_resize(
                                           width, height, &data));
       case_X11(result =
                surface_resize_x11_impl((surface_impl_x11_t *)s->impl,
-                                       s->width, s->height, &s->data,
-                                       width, height, &data));
+                                       s->width, s->height, s->stride,
+                                       &s->data,
+                                       width, height, stride, rows,
+                                       &data));
       case_WAYLAND(result =
                    surface_resize_wl_impl((surface_impl_wl_t *)s->impl,
                                           s->width, s->height, &s->data,
                                           width, height, &data));
+      case_HEADLESS(result =
+                    surface_resize_hdl_impl((surface_impl_hdl_t *)s->impl,
+                                            s->width, s->height, s->stride,
+                                            &s->data,
+                                            width, height, stride, rows,
+                                            &data));
       default_fail();
     }
     if (result == false) {
@@ -244,6 +332,8 @@ surface_resize(
   s->data = data;
   s->width = width;
   s->height = height;
+  s->stride = stride;
+  s->rows = rows;
 
   return true;
 }
@@ -257,6 +347,8 @@ surface_present(
   assert(s->impl != NULL);
   assert(present_data != NULL);
 
+  int64_t trace_t = trace_begin();
+
   switch_IMPL() {
     case_GDI(surface_present_gdi_impl((surface_impl_gdi_t *)s->impl,
                                       s->width, s->height,
@@ -270,8 +362,13 @@ surface_present(
     case_WAYLAND(surface_present_wl_impl((surface_impl_wl_t *)s->impl,
                                          s->width, s->height,
                                          &present_data->wl));
+    case_HEADLESS(surface_present_hdl_impl((surface_impl_hdl_t *)s->impl,
+                                           s->width, s->height,
+                                           &present_data->hdl));
     default_fail();
   }
+
+  trace_end("surface_present", trace_t);
 }
 
 pixmap_t
@@ -281,5 +378,28 @@ surface_get_raw_pixmap(
   assert(s != NULL);
   assert(s->data != NULL);
 
-  return pixmap(s->width, s->height, s->data);
+  return pixmap_strided(s->width, s->height, s->stride, s->data);
+}
+
+bool
+surface_set_compact(
+  surface_t *s)
+{
+  assert(s != NULL);
+  assert(s->data != NULL);
+
+  s->compact = true;
+  if (s->stride == s->width) {
+    return true;
+  }
+  return surface_resize(s, s->width, s->height);
+}
+
+size_t
+surface_get_memory_size(
+  const surface_t *s)
+{
+  assert(s != NULL);
+
+  return (size_t)s->stride * s->rows * COLOR_SIZE;
 }
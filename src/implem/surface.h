@@ -11,6 +11,7 @@
 #ifndef __SURFACE_H
 #define __SURFACE_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -61,4 +62,17 @@ pixmap_t
 surface_get_raw_pixmap(
   surface_t *s);
 
+// Makes the rows of the surface contiguous (its stride equal to its
+// width), reallocating it if needed; resizes then keep them so,
+// instead of reserving room to grow. Returns false on failure.
+bool
+surface_set_compact(
+  surface_t *s);
+
+// Size of the pixel buffer, including the rows and
+// columns reserved for growth, in bytes
+size_t
+surface_get_memory_size(
+  const surface_t *s);
+
 #endif /* __SURFACE_H */
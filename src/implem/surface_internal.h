@@ -12,6 +12,7 @@
 #define __SURFACE_INTERNAL_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 #include "color.h"
 
@@ -22,6 +23,9 @@ typedef struct surface_t {
   color_t_ *data;
   int32_t width;
   int32_t height;
+  int32_t stride; // Allocated width, in pixels
+  int32_t rows;   // Allocated height, in pixels
+  bool compact;   // Whether stride must remain equal to width
 } surface_t;
 
 #endif /* __SURFACE_INTERNAL_H */
@@ -0,0 +1,251 @@
+/**************************************************************************/
+/*                                                                        */
+/*    Copyright 2022 OCamlPro                                             */
+/*                                                                        */
+/*  All rights reserved. This file is distributed under the terms of the  */
+/*  GNU Lesser General Public License version 2.1, with the special       */
+/*  exception on linking described in the file LICENSE.                   */
+/*                                                                        */
+/**************************************************************************/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <assert.h>
+
+#include "util.h"
+#include "lock.h"
+#include "stats.h"
+#include "trace.h"
+
+#if !defined(_WIN32) && !defined(_WIN64)
+#include <pthread.h>
+#define TRACE_HAS_THREAD_EXIT
+#endif
+
+#if defined(_MSC_VER)
+#define TRACE_THREAD_LOCAL __declspec(thread)
+#else
+#define TRACE_THREAD_LOCAL _Thread_local
+#endif
+
+/* Spans are stored in chunks, allocated as the ring fills up, so
+   that threads recording few spans only hold a few of them */
+#define TRACE_CHUNK_SIZE 1024
+#define TRACE_NB_CHUNKS (TRACE_BUFFER_SIZE / TRACE_CHUNK_SIZE)
+
+typedef struct trace_span_t {
+  const char *name;
+  int64_t start;
+  int64_t duration;
+} trace_span_t;
+
+/* Only ever written by the thread owning it; buffers are never
+   freed, as their thread may still be recording into them, but
+   those of exited threads are handed over to new threads (when
+   thread exit can be caught), along with the spans they hold */
+typedef struct trace_buffer_t {
+  struct trace_buffer_t *next;
+  struct trace_buffer_t *next_free; // under the lock
+  int32_t tid;
+  atomic_int generation; // the trace the spans belong to
+  atomic_int_fast64_t count; // total number of spans recorded
+  int64_t snapshot; // count when tracing stopped, under the lock
+  trace_span_t *chunks[TRACE_NB_CHUNKS]; // published through count
+} trace_buffer_t;
+
+atomic_bool trace_enabled = false;
+
+static atomic_int _trace_generation = 0;
+static int32_t _trace_next_tid = 1;
+static char *_trace_filename = NULL;
+
+/* Only taken when a thread records its first span, and when
+   writing the trace out */
+static lock_t _trace_lock = LOCK_INITIALIZER;
+static trace_buffer_t *_trace_buffers = NULL;
+static trace_buffer_t *_trace_free_buffers = NULL;
+
+static TRACE_THREAD_LOCAL trace_buffer_t *_trace_buffer = NULL;
+
+#ifdef TRACE_HAS_THREAD_EXIT
+
+static pthread_key_t _trace_key;
+static pthread_once_t _trace_key_once = PTHREAD_ONCE_INIT;
+
+static void
+_trace_thread_exit(
+  void *data)
+{
+  trace_buffer_t *buffer = (trace_buffer_t *)data;
+  assert(buffer != NULL);
+
+  lock_acquire(&_trace_lock);
+  buffer->next_free = _trace_free_buffers;
+  _trace_free_buffers = buffer;
+  lock_release(&_trace_lock);
+}
+
+static void
+_trace_key_create(
+  void)
+{
+  pthread_key_create(&_trace_key, _trace_thread_exit);
+}
+
+#endif /* TRACE_HAS_THREAD_EXIT */
+
+static trace_buffer_t *
+_trace_get_buffer(
+  void)
+{
+  if (_trace_buffer == NULL) {
+    lock_acquire(&_trace_lock);
+    trace_buffer_t *buffer = _trace_free_buffers;
+    if (buffer != NULL) {
+      _trace_free_buffers = buffer->next_free;
+    } else {
+      buffer = (trace_buffer_t *)calloc(1, sizeof(trace_buffer_t));
+      if (buffer == NULL) {
+        lock_release(&_trace_lock);
+        return NULL;
+      }
+      buffer->tid = _trace_next_tid++;
+      buffer->next = _trace_buffers;
+      _trace_buffers = buffer;
+    }
+    lock_release(&_trace_lock);
+#ifdef TRACE_HAS_THREAD_EXIT
+    pthread_once(&_trace_key_once, _trace_key_create);
+    pthread_setspecific(_trace_key, buffer);
+#endif
+    _trace_buffer = buffer;
+  }
+  return _trace_buffer;
+}
+
+void
+trace_record(
+  const char *name,
+  int64_t start)
+{
+  assert(name != NULL);
+
+  if (atomic_load_explicit(&trace_enabled, memory_order_relaxed) == false) {
+    return;
+  }
+
+  trace_buffer_t *buffer = _trace_get_buffer();
+  if (buffer == NULL) {
+    return;
+  }
+
+  /* Spans left from a previous trace are dropped */
+  int32_t generation = atomic_load(&_trace_generation);
+  if (atomic_load_explicit(&buffer->generation,
+                           memory_order_relaxed) != generation) {
+    atomic_store(&buffer->count, 0);
+    atomic_store(&buffer->generation, generation);
+  }
+
+  int64_t count = atomic_load_explicit(&buffer->count, memory_order_relaxed);
+  int64_t index = count % TRACE_BUFFER_SIZE;
+  trace_span_t **chunk = &buffer->chunks[index / TRACE_CHUNK_SIZE];
+  if (*chunk == NULL) {
+    *chunk = (trace_span_t *)calloc(TRACE_CHUNK_SIZE, sizeof(trace_span_t));
+    if (*chunk == NULL) {
+      return;
+    }
+  }
+  trace_span_t *span = &(*chunk)[index % TRACE_CHUNK_SIZE];
+  span->name = name;
+  span->start = start;
+  span->duration = stats_now() - start;
+  atomic_store_explicit(&buffer->count, count + 1, memory_order_release);
+}
+
+bool
+trace_start(
+  const char *filename)
+{
+  assert(filename != NULL);
+
+  char *filename_copy = strdup(filename);
+  if (filename_copy == NULL) {
+    return false;
+  }
+
+  lock_acquire(&_trace_lock);
+  if (_trace_filename != NULL) {
+    free(_trace_filename);
+  }
+  _trace_filename = filename_copy;
+  atomic_fetch_add(&_trace_generation, 1);
+  lock_release(&_trace_lock);
+
+  atomic_store(&trace_enabled, true);
+
+  return true;
+}
+
+bool
+trace_stop(
+  void)
+{
+  if (atomic_exchange(&trace_enabled, false) == false) {
+    return true;
+  }
+
+  lock_acquire(&_trace_lock);
+
+  /* Take the counts first, so that the spans written are those
+     recorded by now, however long writing them takes */
+  int32_t generation = atomic_load(&_trace_generation);
+  for (trace_buffer_t *buffer = _trace_buffers; buffer != NULL;
+       buffer = buffer->next) {
+    buffer->snapshot =
+      (atomic_load(&buffer->generation) == generation) ?
+      atomic_load_explicit(&buffer->count, memory_order_acquire) : 0;
+  }
+
+  FILE *f = fopen(_trace_filename, "w");
+  free(_trace_filename);
+  _trace_filename = NULL;
+  if (f == NULL) {
+    lock_release(&_trace_lock);
+    return false;
+  }
+
+  /* Times are in microseconds */
+  fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+  bool first = true;
+  for (trace_buffer_t *buffer = _trace_buffers; buffer != NULL;
+       buffer = buffer->next) {
+    int64_t count = buffer->snapshot;
+    if (count == 0) {
+      continue;
+    }
+    fprintf(f, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+            "\"tid\":%d,\"args\":{\"name\":\"Thread %d\"}}",
+            first ? "" : ",", buffer->tid, buffer->tid);
+    first = false;
+    for (int64_t i = max(0, count - TRACE_BUFFER_SIZE); i < count; ++i) {
+      int64_t index = i % TRACE_BUFFER_SIZE;
+      const trace_span_t *span =
+        &buffer->chunks[index / TRACE_CHUNK_SIZE][index % TRACE_CHUNK_SIZE];
+      fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,"
+              "\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+              span->name, buffer->tid,
+              (double)span->start / 1000.0,
+              (double)span->duration / 1000.0);
+    }
+  }
+  fprintf(f, "\n]}\n");
+
+  lock_release(&_trace_lock);
+
+  return fclose(f) == 0;
+}
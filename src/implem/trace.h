@@ -0,0 +1,63 @@
+/**************************************************************************/
+/*                                                                        */
+/*    Copyright 2022 OCamlPro                                             */
+/*                                                                        */
+/*  All rights reserved. This file is distributed under the terms of the  */
+/*  GNU Lesser General Public License version 2.1, with the special       */
+/*  exception on linking described in the file LICENSE.                   */
+/*                                                                        */
+/**************************************************************************/
+
+#ifndef __TRACE_H
+#define __TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "stats.h"
+
+// Number of spans kept per thread; older ones are overwritten.
+// Room for them is only allocated as they are recorded.
+#define TRACE_BUFFER_SIZE 65536
+
+// Tracing records spans (a name, a start time and a duration) in
+// per-thread ring buffers, without taking any lock. Span names must
+// be string literals, as only their address is recorded.
+
+// Read by every thread drawing, hence atomic; a relaxed load is
+// enough, as spans are handed over through the buffer counts
+extern atomic_bool trace_enabled;
+
+// Starts recording spans, to be written to filename (as a Chrome
+// trace-event JSON file, also readable by Perfetto) by trace_stop
+bool
+trace_start(
+  const char *filename);
+
+// Stops recording spans and writes them out; does nothing
+// (and succeeds) if tracing was not started. The spans written
+// are those recorded when tracing stopped, but a thread that was
+// recording a span at that time may still overwrite the oldest
+// ones (or, in a full buffer, any) while they are written out.
+bool
+trace_stop(
+  void);
+
+void
+trace_record(
+  const char *name,
+  int64_t start);
+
+// Spans are delimited by trace_begin and trace_end; when tracing is
+// disabled, these only cost a test (the clock is not read)
+
+#define trace_begin() \
+  (atomic_load_explicit(&trace_enabled, memory_order_relaxed) ? \
+   stats_now() : 0)
+
+#define trace_end(name,t) do { \
+  if ((t) != 0) { trace_record((name), (t)); } \
+} while (0)
+
+#endif /* __TRACE_H */
@@ -8,7 +8,7 @@
 /*                                                                        */
 /**************************************************************************/
 
-#if defined HAS_X11 || defined HAS_WAYLAND
+#if defined HAS_X11 || defined HAS_WAYLAND || defined HAS_HEADLESS
 
 #include <stdlib.h>
 #include <stdbool.h>
@@ -19,6 +19,7 @@
 #include FT_FREETYPE_H
 
 #include "../util.h"
+#include "../lock.h"
 #include "../point.h"
 #include "../rect.h"
 #include "../polygon.h"
@@ -31,6 +32,12 @@ static bool _ft_initialized = false;
 static FcConfig *_fc_config = NULL;
 static FT_Library _ft_library = NULL;
 
+/* The FreeType library object and the FontConfig configuration
+   are shared; faces are created and destroyed under this lock,
+   while glyph loading only touches the face owned by the caller */
+static lock_t _ft_lock = LOCK_INITIALIZER;
+
+// Must be called with _ft_lock held
 static void
 _unx_font_ensure_init(
   void)
@@ -111,6 +118,8 @@ unx_font_create(
     size = 8.3;
   }
 
+  lock_acquire(&_ft_lock);
+
   // TODO: this should be part of backend init
   _unx_font_ensure_init();
 
@@ -186,6 +195,8 @@ unx_font_create(
 
   f->ft_face = face;
 
+  lock_release(&_ft_lock);
+
   return f;
 
 error:
@@ -198,6 +209,7 @@ error:
   if (fp != NULL) {
     FcPatternDestroy(fp);
   }
+  lock_release(&_ft_lock);
   return NULL;
 }
 
@@ -208,7 +220,9 @@ unx_font_destroy(
   assert(f != NULL);
   assert(f->ft_face != NULL);
 
+  lock_acquire(&_ft_lock);
   FT_Done_Face(f->ft_face);
+  lock_release(&_ft_lock);
   free(f);
 }
 
@@ -367,4 +381,4 @@ it is itself used for the start point.
 
 const int unx_font = 0;
 
-#endif /* HAS_X11 || HAS_WAYLAND */
+#endif /* HAS_X11 || HAS_WAYLAND || HAS_HEADLESS */
@@ -8,21 +8,26 @@
 /*                                                                        */
 /**************************************************************************/
 
-#if defined HAS_X11 || defined HAS_WAYLAND
+#if defined HAS_X11 || defined HAS_WAYLAND || defined HAS_HEADLESS
 
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <memory.h>
+#include <string.h>
 #include <setjmp.h>
 #include <assert.h>
 
 #include <png.h>
+#include <zlib.h>
 
 #include "../util.h"
 #include "../pixmap.h"
 #include "../color.h"
+#include "../impexp.h"
+#include "unx_pool.h"
+#include "unx_png_parallel.h"
 
 bool
 unx_impexp_init(
@@ -35,36 +40,64 @@ void
 unx_impexp_terminate(
   void)
 {
-  return;
+  unx_pool_terminate();
 }
 
-bool
-unx_impexp_export_png(
-  const pixmap_t *pixmap,
-  const char *filename)
+static void
+_unx_impexp_set_png_options(
+  png_struct *png,
+  const impexp_png_options_t *options)
 {
-  assert(pixmap != NULL);
-  assert(pixmap_valid(*pixmap));
-  assert(filename != NULL);
+  assert(png != NULL);
+  assert(options != NULL);
 
-  FILE *fp = fopen(filename, "wb");
-  if (fp == NULL) {
-    return false;
+  if (options->level >= 0) {
+    png_set_compression_level(png, min(options->level, 9));
   }
 
-  png_struct *png =
-    png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-  if (png == NULL) {
-    fclose(fp);
-    return false;
+  switch (options->filter) {
+    case IMPEXP_FILTER_ADAPTIVE: break;
+    case IMPEXP_FILTER_NONE:
+      png_set_filter(png, PNG_FILTER_TYPE_BASE, PNG_FILTER_NONE); break;
+    case IMPEXP_FILTER_SUB:
+      png_set_filter(png, PNG_FILTER_TYPE_BASE, PNG_FILTER_SUB); break;
+    case IMPEXP_FILTER_UP:
+      png_set_filter(png, PNG_FILTER_TYPE_BASE, PNG_FILTER_UP); break;
+    case IMPEXP_FILTER_AVERAGE:
+      png_set_filter(png, PNG_FILTER_TYPE_BASE, PNG_FILTER_AVG); break;
+    case IMPEXP_FILTER_PAETH:
+      png_set_filter(png, PNG_FILTER_TYPE_BASE, PNG_FILTER_PAETH); break;
+    default: assert(!"Invalid PNG filter"); break;
   }
 
-  png_info *info = png_create_info_struct(png);
-  if (info == NULL) {
-    png_destroy_write_struct(&png, NULL);
-    fclose(fp);
-    return false;
+  switch (options->strategy) {
+    case IMPEXP_STRATEGY_DEFAULT: break;
+    case IMPEXP_STRATEGY_FILTERED:
+      png_set_compression_strategy(png, Z_FILTERED); break;
+    case IMPEXP_STRATEGY_HUFFMAN_ONLY:
+      png_set_compression_strategy(png, Z_HUFFMAN_ONLY); break;
+    case IMPEXP_STRATEGY_RLE:
+      png_set_compression_strategy(png, Z_RLE); break;
+    case IMPEXP_STRATEGY_FIXED:
+      png_set_compression_strategy(png, Z_FIXED); break;
+    default: assert(!"Invalid PNG strategy"); break;
   }
+}
+
+// The destination is set up by the caller (either with
+// png_init_io or png_set_write_fn) before calling this function
+static bool
+_unx_impexp_write_png(
+  png_struct *png,
+  png_info *info,
+  const pixmap_t *pixmap,
+  const impexp_png_options_t *options)
+{
+  assert(png != NULL);
+  assert(info != NULL);
+  assert(pixmap != NULL);
+  assert(pixmap_valid(*pixmap));
+  assert(options != NULL);
 
   png_byte **row_pointers = NULL;
 
@@ -72,14 +105,12 @@ unx_impexp_export_png(
     if (row_pointers != NULL) {
       png_free(png, row_pointers);
     }
-    png_destroy_write_struct(&png, &info);
-    fclose(fp);
     return false;
   }
 
   png_set_check_for_invalid_index(png, 0);
 
-  png_init_io(png, fp);
+  _unx_impexp_set_png_options(png, options);
 
   png_set_IHDR(png, info, pixmap->width, pixmap->height, 8,
                PNG_COLOR_TYPE_RGB_ALPHA, PNG_INTERLACE_NONE,
@@ -92,8 +123,6 @@ unx_impexp_export_png(
   row_pointers =
     (png_byte **)png_malloc(png, pixmap->height * sizeof(png_byte *));
   if (row_pointers == NULL) {
-    png_destroy_write_struct(&png, &info);
-    fclose(fp);
     return false;
   }
 
@@ -105,9 +134,184 @@ unx_impexp_export_png(
   png_write_end(png, NULL);
 
   png_free(png, row_pointers);
+
+  return true;
+}
+
+static bool
+_unx_impexp_file_write(
+  const uint8_t *data,
+  size_t size,
+  void *user_data)
+{
+  assert(data != NULL);
+  assert(user_data != NULL);
+
+  return fwrite(data, 1, size, (FILE *)user_data) == size;
+}
+
+bool
+unx_impexp_export_png(
+  const pixmap_t *pixmap,
+  const char *filename,
+  const impexp_png_options_t *options)
+{
+  assert(pixmap != NULL);
+  assert(pixmap_valid(*pixmap));
+  assert(filename != NULL);
+  assert(options != NULL);
+
+  FILE *fp = fopen(filename, "wb");
+  if (fp == NULL) {
+    return false;
+  }
+
+  if ((options->parallel == true) && (unx_pool_size() > 1)) {
+    bool res = unx_png_parallel_write(pixmap, options,
+                                      _unx_impexp_file_write, fp);
+    return (fclose(fp) == 0) && res;
+  }
+
+  png_struct *png =
+    png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+  if (png == NULL) {
+    fclose(fp);
+    return false;
+  }
+
+  png_info *info = png_create_info_struct(png);
+  if (info == NULL) {
+    png_destroy_write_struct(&png, NULL);
+    fclose(fp);
+    return false;
+  }
+
+  png_init_io(png, fp);
+
+  bool res = _unx_impexp_write_png(png, info, pixmap, options);
+
   png_destroy_write_struct(&png, &info);
   fclose(fp);
 
+  return res;
+}
+
+typedef struct unx_impexp_buffer_t {
+  uint8_t *data;
+  size_t size;
+  size_t capacity;
+} unx_impexp_buffer_t;
+
+static bool
+_unx_impexp_buffer_append(
+  const uint8_t *data,
+  size_t length,
+  void *user_data)
+{
+  assert(data != NULL);
+  assert(user_data != NULL);
+
+  unx_impexp_buffer_t *buffer = (unx_impexp_buffer_t *)user_data;
+
+  if (buffer->size + length > buffer->capacity) {
+    size_t capacity = max(buffer->capacity * 2, buffer->size + length);
+    uint8_t *new_data = (uint8_t *)realloc(buffer->data, capacity);
+    if (new_data == NULL) {
+      return false;
+    }
+    buffer->data = new_data;
+    buffer->capacity = capacity;
+  }
+
+  memcpy(buffer->data + buffer->size, data, length);
+  buffer->size += length;
+
+  return true;
+}
+
+static void
+_unx_impexp_buffer_write(
+  png_struct *png,
+  png_byte *data,
+  size_t length)
+{
+  assert(png != NULL);
+  assert(data != NULL);
+
+  if (_unx_impexp_buffer_append(data, length, png_get_io_ptr(png)) == false) {
+    png_error(png, "out of memory");
+  }
+}
+
+static void
+_unx_impexp_buffer_flush(
+  png_struct *png)
+{
+  return;
+}
+
+bool
+unx_impexp_export_png_to_memory(
+  const pixmap_t *pixmap,
+  const impexp_png_options_t *options,
+  uint8_t **data,
+  size_t *size)
+{
+  assert(pixmap != NULL);
+  assert(pixmap_valid(*pixmap));
+  assert(options != NULL);
+  assert(data != NULL);
+  assert(size != NULL);
+
+  // Start with a fourth of the raw size, which is a fair
+  // estimate of the compressed size of most rendered images
+  unx_impexp_buffer_t buffer = { 0 };
+  buffer.capacity = max(4096, (size_t)pixmap->width * pixmap->height);
+  buffer.data = (uint8_t *)malloc(buffer.capacity);
+  if (buffer.data == NULL) {
+    return false;
+  }
+
+  if ((options->parallel == true) && (unx_pool_size() > 1)) {
+    if (unx_png_parallel_write(pixmap, options,
+                               _unx_impexp_buffer_append, &buffer) == false) {
+      free(buffer.data);
+      return false;
+    }
+    *data = buffer.data;
+    *size = buffer.size;
+    return true;
+  }
+
+  png_struct *png =
+    png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+  if (png == NULL) {
+    free(buffer.data);
+    return false;
+  }
+
+  png_info *info = png_create_info_struct(png);
+  if (info == NULL) {
+    png_destroy_write_struct(&png, NULL);
+    free(buffer.data);
+    return false;
+  }
+
+  png_set_write_fn(png, &buffer,
+                   _unx_impexp_buffer_write, _unx_impexp_buffer_flush);
+
+  bool res = _unx_impexp_write_png(png, info, pixmap, options);
+
+  png_destroy_write_struct(&png, &info);
+
+  if (res == false) {
+    free(buffer.data);
+    return false;
+  }
+
+  *data = buffer.data;
+  *size = buffer.size;
+
   return true;
 }
 
@@ -199,13 +403,15 @@ unx_impexp_import_png(
   int32_t swidth = png_get_image_width(png, info);
   int32_t sheight = png_get_image_height(png, info);
 
-  int32_t dwidth = 0, dheight = 0;
+  int32_t dwidth = 0, dheight = 0, dstride = 0;
   if (alloc == true) {
     dwidth = swidth;
     dheight = sheight;
+    dstride = swidth;
   } else {
     dwidth = pixmap->width;
     dheight = pixmap->height;
+    dstride = pixmap->stride;
   }
 
   int32_t sx = 0, sy = 0;
@@ -238,11 +444,11 @@ unx_impexp_import_png(
     for (int32_t i = 0; i < height; ++i) {
       if (p > 0) {
         memcpy(row + sx * COLOR_SIZE,
-               (void *)&data[(dy + i) * dwidth + dx],
+               (void *)&data[(dy + i) * dstride + dx],
                width * COLOR_SIZE);
       }
       png_read_row(png, row, NULL);
-      memcpy((void *)&data[(dy + i) * dwidth + dx],
+      memcpy((void *)&data[(dy + i) * dstride + dx],
              row + sx * COLOR_SIZE,
              width * COLOR_SIZE);
     }
@@ -257,6 +463,7 @@ unx_impexp_import_png(
     pixmap->data = data;
     pixmap->width = dwidth;
     pixmap->height = dheight;
+    pixmap->stride = dstride;
   }
 
   res = true;
@@ -277,8 +484,65 @@ error:
   return res;
 }
 
+typedef struct unx_impexp_import_job_t {
+  char *filename;
+  impexp_import_done_fun_t *fun;
+  void *data;
+} unx_impexp_import_job_t;
+
+static void
+_unx_impexp_import_job(
+  void *data)
+{
+  unx_impexp_import_job_t *job = (unx_impexp_import_job_t *)data;
+  assert(job != NULL);
+
+  pixmap_t pixmap = pixmap_null();
+  if (unx_impexp_import_png(&pixmap, 0, 0, job->filename) == false) {
+    pixmap = pixmap_null();
+  }
+
+  job->fun(pixmap, job->data);
+
+  free(job->filename);
+  free(job);
+}
+
+bool
+unx_impexp_import_png_async(
+  const char *filename,
+  impexp_import_done_fun_t *fun,
+  void *data)
+{
+  assert(filename != NULL);
+  assert(fun != NULL);
+
+  unx_impexp_import_job_t *job =
+    (unx_impexp_import_job_t *)calloc(1, sizeof(unx_impexp_import_job_t));
+  if (job == NULL) {
+    return false;
+  }
+
+  job->filename = strdup(filename);
+  if (job->filename == NULL) {
+    free(job);
+    return false;
+  }
+
+  job->fun = fun;
+  job->data = data;
+
+  /* Decode right away if no worker could be started */
+  if ((unx_pool_size() == 0) ||
+      (unx_pool_submit(_unx_impexp_import_job, job) == false)) {
+    _unx_impexp_import_job(job);
+  }
+
+  return true;
+}
+
 #else
 
 const int unx_impexp = 0;
 
-#endif /* HAS_X11 || HAS_WAYLAND */
+#endif /* HAS_X11 || HAS_WAYLAND || HAS_HEADLESS */
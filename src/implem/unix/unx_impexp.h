@@ -15,6 +15,7 @@
 #include <stdint.h>
 
 #include "../pixmap.h"
+#include "../impexp.h"
 
 bool
 unx_impexp_init(
@@ -27,7 +28,15 @@ unx_impexp_terminate(
 bool
 unx_impexp_export_png(
   const pixmap_t *pixmap,
-  const char *filename);
+  const char *filename,
+  const impexp_png_options_t *options);
+
+bool
+unx_impexp_export_png_to_memory(
+  const pixmap_t *pixmap,
+  const impexp_png_options_t *options,
+  uint8_t **data,
+  size_t *size);
 
 bool
 unx_impexp_import_png(
@@ -36,4 +45,10 @@ unx_impexp_import_png(
   int32_t dy,
   const char *filename);
 
+bool
+unx_impexp_import_png_async(
+  const char *filename,
+  impexp_import_done_fun_t *fun,
+  void *data);
+
 #endif /* __UNX_IMPEXP_H */
@@ -0,0 +1,503 @@
+/**************************************************************************/
+/*                                                                        */
+/*    Copyright 2022 OCamlPro                                             */
+/*                                                                        */
+/*  All rights reserved. This file is distributed under the terms of the  */
+/*  GNU Lesser General Public License version 2.1, with the special       */
+/*  exception on linking described in the file LICENSE.                   */
+/*                                                                        */
+/**************************************************************************/
+
+#if defined HAS_X11 || defined HAS_WAYLAND || defined HAS_HEADLESS
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include <zlib.h>
+
+#include "../util.h"
+#include "../color.h"
+#include "../pixmap.h"
+#include "../impexp.h"
+#include "unx_pool.h"
+#include "unx_png_parallel.h"
+
+// Approximate amount of filtered data per strip
+#define UNX_PNG_STRIP_SIZE (256 * 1024)
+
+// Size of the deflate window, used to prime each strip
+#define UNX_PNG_WINDOW_SIZE 32768
+
+enum {
+  UNX_PNG_FILTER_NONE    = 0,
+  UNX_PNG_FILTER_SUB     = 1,
+  UNX_PNG_FILTER_UP      = 2,
+  UNX_PNG_FILTER_AVERAGE = 3,
+  UNX_PNG_FILTER_PAETH   = 4,
+  UNX_PNG_NB_FILTERS     = 5
+};
+
+typedef struct unx_png_strip_t {
+  const pixmap_t *pixmap;
+  const impexp_png_options_t *options;
+  const struct unx_png_strip_t *prev; // to prime the dictionary
+  int32_t y;
+  int32_t height;
+  bool last;
+  uint8_t *filtered;
+  size_t filtered_size;
+  uint8_t *compressed;
+  size_t compressed_size;
+  uint32_t adler;
+  bool ok;
+} unx_png_strip_t;
+
+static void
+_unx_png_strip_destroy(
+  unx_png_strip_t *strip)
+{
+  assert(strip != NULL);
+
+  if (strip->filtered != NULL) {
+    free(strip->filtered);
+    strip->filtered = NULL;
+  }
+  if (strip->compressed != NULL) {
+    free(strip->compressed);
+    strip->compressed = NULL;
+  }
+}
+
+// Converts a row from BGRA to RGBA
+static void
+_unx_png_convert_row(
+  const pixmap_t *pixmap,
+  int32_t y,
+  uint8_t *row)
+{
+  assert(pixmap != NULL);
+  assert(row != NULL);
+
+  const color_t_ *src = &pixmap_at(*pixmap, y, 0);
+  for (int32_t x = 0; x < pixmap->width; ++x) {
+    row[4 * x + 0] = src[x].r;
+    row[4 * x + 1] = src[x].g;
+    row[4 * x + 2] = src[x].b;
+    row[4 * x + 3] = src[x].a;
+  }
+}
+
+static uint8_t
+_unx_png_paeth(
+  int a,
+  int b,
+  int c)
+{
+  int p = a + b - c;
+  int pa = abs(p - a);
+  int pb = abs(p - b);
+  int pc = abs(p - c);
+  if ((pa <= pb) && (pa <= pc)) {
+    return (uint8_t)a;
+  } else if (pb <= pc) {
+    return (uint8_t)b;
+  } else {
+    return (uint8_t)c;
+  }
+}
+
+// Filters a row of n bytes; prev is the (unfiltered) row above
+static void
+_unx_png_filter_row(
+  int filter,
+  const uint8_t *cur,
+  const uint8_t *prev,
+  uint8_t *out,
+  size_t n)
+{
+  assert(cur != NULL);
+  assert(prev != NULL);
+  assert(out != NULL);
+
+  switch (filter) {
+    case UNX_PNG_FILTER_NONE:
+      memcpy(out, cur, n);
+      break;
+    case UNX_PNG_FILTER_SUB:
+      for (size_t i = 0; i < n; ++i) {
+        out[i] = cur[i] - ((i < 4) ? 0 : cur[i - 4]);
+      }
+      break;
+    case UNX_PNG_FILTER_UP:
+      for (size_t i = 0; i < n; ++i) {
+        out[i] = cur[i] - prev[i];
+      }
+      break;
+    case UNX_PNG_FILTER_AVERAGE:
+      for (size_t i = 0; i < n; ++i) {
+        int left = (i < 4) ? 0 : cur[i - 4];
+        out[i] = cur[i] - (uint8_t)((left + prev[i]) >> 1);
+      }
+      break;
+    case UNX_PNG_FILTER_PAETH:
+      for (size_t i = 0; i < n; ++i) {
+        int left = (i < 4) ? 0 : cur[i - 4];
+        int up_left = (i < 4) ? 0 : prev[i - 4];
+        out[i] = cur[i] - _unx_png_paeth(left, prev[i], up_left);
+      }
+      break;
+    default:
+      assert(!"Invalid PNG filter");
+      break;
+  }
+}
+
+// Same heuristic as libpng: minimum sum of absolute (signed) values
+static size_t
+_unx_png_filter_cost(
+  const uint8_t *out,
+  size_t n)
+{
+  assert(out != NULL);
+
+  size_t sum = 0;
+  for (size_t i = 0; i < n; ++i) {
+    sum += (out[i] < 128) ? out[i] : 256 - out[i];
+  }
+  return sum;
+}
+
+static void
+_unx_png_strip_filter(
+  void *data)
+{
+  unx_png_strip_t *strip = (unx_png_strip_t *)data;
+  assert(strip != NULL);
+
+  const pixmap_t *pixmap = strip->pixmap;
+  size_t n = (size_t)pixmap->width * 4;
+
+  strip->filtered_size = (size_t)strip->height * (n + 1);
+  strip->filtered = (uint8_t *)malloc(strip->filtered_size);
+
+  // Previous row, current row, and candidate rows for each filter
+  uint8_t *rows = (uint8_t *)calloc(2 + UNX_PNG_NB_FILTERS, n);
+
+  if ((strip->filtered == NULL) || (rows == NULL)) {
+    free(rows);
+    strip->ok = false;
+    return;
+  }
+
+  uint8_t *prev = rows;
+  uint8_t *cur = rows + n;
+  uint8_t *candidates = rows + 2 * n;
+
+  if (strip->y > 0) {
+    _unx_png_convert_row(pixmap, strip->y - 1, prev);
+  }
+
+  int filter = -1;
+  switch (strip->options->filter) {
+    case IMPEXP_FILTER_ADAPTIVE: filter = -1; break;
+    case IMPEXP_FILTER_NONE: filter = UNX_PNG_FILTER_NONE; break;
+    case IMPEXP_FILTER_SUB: filter = UNX_PNG_FILTER_SUB; break;
+    case IMPEXP_FILTER_UP: filter = UNX_PNG_FILTER_UP; break;
+    case IMPEXP_FILTER_AVERAGE: filter = UNX_PNG_FILTER_AVERAGE; break;
+    case IMPEXP_FILTER_PAETH: filter = UNX_PNG_FILTER_PAETH; break;
+    default: assert(!"Invalid PNG filter"); break;
+  }
+
+  uint8_t *out = strip->filtered;
+  for (int32_t i = 0; i < strip->height; ++i) {
+
+    _unx_png_convert_row(pixmap, strip->y + i, cur);
+
+    if (filter >= 0) {
+      out[0] = (uint8_t)filter;
+      _unx_png_filter_row(filter, cur, prev, out + 1, n);
+    } else {
+      int best = 0;
+      size_t best_cost = SIZE_MAX;
+      for (int f = 0; f < UNX_PNG_NB_FILTERS; ++f) {
+        uint8_t *candidate = candidates + f * n;
+        _unx_png_filter_row(f, cur, prev, candidate, n);
+        size_t cost = _unx_png_filter_cost(candidate, n);
+        if (cost < best_cost) {
+          best = f;
+          best_cost = cost;
+        }
+      }
+      out[0] = (uint8_t)best;
+      memcpy(out + 1, candidates + best * n, n);
+    }
+
+    swap(uint8_t *, prev, cur);
+    out += n + 1;
+  }
+
+  free(rows);
+
+  strip->ok = true;
+}
+
+static int
+_unx_png_zlib_level(
+  const impexp_png_options_t *options)
+{
+  assert(options != NULL);
+
+  if (options->level < 0) {
+    return Z_DEFAULT_COMPRESSION;
+  }
+  return min(options->level, 9);
+}
+
+static int
+_unx_png_zlib_strategy(
+  const impexp_png_options_t *options)
+{
+  assert(options != NULL);
+
+  switch (options->strategy) {
+    // As libpng, favor Z_FILTERED when rows are filtered
+    case IMPEXP_STRATEGY_DEFAULT:
+      return (options->filter == IMPEXP_FILTER_NONE) ?
+        Z_DEFAULT_STRATEGY : Z_FILTERED;
+    case IMPEXP_STRATEGY_FILTERED: return Z_FILTERED;
+    case IMPEXP_STRATEGY_HUFFMAN_ONLY: return Z_HUFFMAN_ONLY;
+    case IMPEXP_STRATEGY_RLE: return Z_RLE;
+    case IMPEXP_STRATEGY_FIXED: return Z_FIXED;
+    default: assert(!"Invalid PNG strategy"); return Z_DEFAULT_STRATEGY;
+  }
+}
+
+static void
+_unx_png_strip_deflate(
+  void *data)
+{
+  unx_png_strip_t *strip = (unx_png_strip_t *)data;
+  assert(strip != NULL);
+
+  if (strip->ok == false) {
+    return;
+  }
+
+  strip->ok = false;
+
+  strip->adler = adler32(adler32(0, NULL, 0),
+                         strip->filtered, (uInt)strip->filtered_size);
+
+  z_stream z = { 0 };
+  int res = deflateInit2(&z, _unx_png_zlib_level(strip->options),
+                         Z_DEFLATED, -15, 8,
+                         _unx_png_zlib_strategy(strip->options));
+  if (res != Z_OK) {
+    return;
+  }
+
+  if ((strip->prev != NULL) && (strip->prev->filtered != NULL)) {
+    size_t dict_size = min(strip->prev->filtered_size, UNX_PNG_WINDOW_SIZE);
+    deflateSetDictionary(&z, strip->prev->filtered +
+                             strip->prev->filtered_size - dict_size,
+                         (uInt)dict_size);
+  }
+
+  // Leave room for the empty stored block emitted by Z_SYNC_FLUSH
+  size_t capacity = deflateBound(&z, (uLong)strip->filtered_size) + 64;
+  strip->compressed = (uint8_t *)malloc(capacity);
+  if (strip->compressed == NULL) {
+    deflateEnd(&z);
+    return;
+  }
+
+  z.next_in = strip->filtered;
+  z.avail_in = (uInt)strip->filtered_size;
+  z.next_out = strip->compressed;
+  z.avail_out = (uInt)capacity;
+
+  // All strips but the last end on a byte boundary without the
+  // final block bit, so that they can simply be concatenated
+  res = deflate(&z, strip->last ? Z_FINISH : Z_SYNC_FLUSH);
+  bool ok = strip->last ?
+    (res == Z_STREAM_END) :
+    ((res == Z_OK) && (z.avail_in == 0) && (z.avail_out > 0));
+
+  strip->compressed_size = capacity - z.avail_out;
+  deflateEnd(&z);
+
+  strip->ok = ok;
+}
+
+static void
+_unx_png_store_u32(
+  uint8_t *p,
+  uint32_t v)
+{
+  p[0] = (uint8_t)(v >> 24);
+  p[1] = (uint8_t)(v >> 16);
+  p[2] = (uint8_t)(v >> 8);
+  p[3] = (uint8_t)v;
+}
+
+// Writes a chunk whose data is the concatenation of up to three parts
+static bool
+_unx_png_write_chunk(
+  unx_png_write_fun_t *write,
+  void *user_data,
+  const char *type,
+  const uint8_t *d1, size_t s1,
+  const uint8_t *d2, size_t s2,
+  const uint8_t *d3, size_t s3)
+{
+  assert(write != NULL);
+  assert(type != NULL);
+
+  uint8_t header[8];
+  _unx_png_store_u32(header, (uint32_t)(s1 + s2 + s3));
+  memcpy(header + 4, type, 4);
+
+  uLong crc = crc32(0, NULL, 0);
+  crc = crc32(crc, header + 4, 4);
+  if (s1 > 0) crc = crc32(crc, d1, (uInt)s1);
+  if (s2 > 0) crc = crc32(crc, d2, (uInt)s2);
+  if (s3 > 0) crc = crc32(crc, d3, (uInt)s3);
+
+  uint8_t trailer[4];
+  _unx_png_store_u32(trailer, (uint32_t)crc);
+
+  return write(header, 8, user_data) &&
+    ((s1 == 0) || write(d1, s1, user_data)) &&
+    ((s2 == 0) || write(d2, s2, user_data)) &&
+    ((s3 == 0) || write(d3, s3, user_data)) &&
+    write(trailer, 4, user_data);
+}
+
+bool
+unx_png_parallel_write(
+  const pixmap_t *pixmap,
+  const impexp_png_options_t *options,
+  unx_png_write_fun_t *write,
+  void *user_data)
+{
+  assert(pixmap != NULL);
+  assert(pixmap_valid(*pixmap));
+  assert(options != NULL);
+  assert(write != NULL);
+
+  static const uint8_t signature[8] =
+    { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+  uint8_t ihdr[13];
+  _unx_png_store_u32(ihdr, (uint32_t)pixmap->width);
+  _unx_png_store_u32(ihdr + 4, (uint32_t)pixmap->height);
+  ihdr[8] = 8;  // bit depth
+  ihdr[9] = 6;  // RGBA
+  ihdr[10] = 0; // deflate
+  ihdr[11] = 0; // adaptive filtering
+  ihdr[12] = 0; // no interlace
+
+  if ((write(signature, 8, user_data) == false) ||
+      (_unx_png_write_chunk(write, user_data, "IHDR", ihdr, 13,
+                            NULL, 0, NULL, 0) == false)) {
+    return false;
+  }
+
+  // The FLEVEL field is only informative
+  int level = _unx_png_zlib_level(options);
+  uint8_t zlib_header[2] = { 0x78, 0x9C };
+  if ((level >= 0) && (level <= 1)) {
+    zlib_header[1] = 0x01;
+  } else if ((level >= 2) && (level <= 5)) {
+    zlib_header[1] = 0x5E;
+  } else if (level >= 7) {
+    zlib_header[1] = 0xDA;
+  }
+
+  size_t row_size = (size_t)pixmap->width * 4 + 1;
+  int32_t rows_per_strip =
+    (int32_t)max(1, UNX_PNG_STRIP_SIZE / row_size);
+  int32_t nb_strips = (pixmap->height + rows_per_strip - 1) / rows_per_strip;
+
+  // Strips are processed in groups, to bound memory usage
+  int32_t group_size = max(2, 2 * unx_pool_size());
+
+  unx_png_strip_t *strips =
+    (unx_png_strip_t *)calloc(group_size, sizeof(unx_png_strip_t));
+  if (strips == NULL) {
+    return false;
+  }
+
+  bool res = true;
+  unx_png_strip_t prev = { 0 };
+  uLong adler = adler32(0, NULL, 0);
+
+  for (int32_t first = 0; (first < nb_strips) && (res == true);
+       first += group_size) {
+
+    int32_t count = min(group_size, nb_strips - first);
+
+    for (int32_t i = 0; i < count; ++i) {
+      unx_png_strip_t *strip = &strips[i];
+      strip->pixmap = pixmap;
+      strip->options = options;
+      strip->prev = (i == 0) ? &prev : &strips[i - 1];
+      strip->y = (first + i) * rows_per_strip;
+      strip->height = min(rows_per_strip, pixmap->height - strip->y);
+      strip->last = (first + i == nb_strips - 1);
+      strip->filtered = NULL;
+      strip->compressed = NULL;
+      strip->ok = false;
+    }
+
+    res = unx_pool_parallel_for(_unx_png_strip_filter, strips,
+                                sizeof(unx_png_strip_t), count) &&
+          unx_pool_parallel_for(_unx_png_strip_deflate, strips,
+                                sizeof(unx_png_strip_t), count);
+
+    for (int32_t i = 0; (i < count) && (res == true); ++i) {
+      unx_png_strip_t *strip = &strips[i];
+      if (strip->ok == false) {
+        res = false;
+        break;
+      }
+      adler = adler32_combine(adler, strip->adler,
+                              (z_off_t)strip->filtered_size);
+      uint8_t zlib_trailer[4];
+      _unx_png_store_u32(zlib_trailer, (uint32_t)adler);
+      res = _unx_png_write_chunk(write, user_data, "IDAT",
+                                 zlib_header, (first + i == 0) ? 2 : 0,
+                                 strip->compressed, strip->compressed_size,
+                                 zlib_trailer, strip->last ? 4 : 0);
+    }
+
+    // Keep the last strip of the group to prime the next one
+    _unx_png_strip_destroy(&prev);
+    prev = strips[count - 1];
+    prev.compressed_size = 0;
+    free(prev.compressed);
+    prev.compressed = NULL;
+    for (int32_t i = 0; i < count - 1; ++i) {
+      _unx_png_strip_destroy(&strips[i]);
+    }
+  }
+
+  _unx_png_strip_destroy(&prev);
+  free(strips);
+
+  if (res == true) {
+    res = _unx_png_write_chunk(write, user_data, "IEND",
+                               NULL, 0, NULL, 0, NULL, 0);
+  }
+
+  return res;
+}
+
+#else
+
+const int unx_png_parallel = 0;
+
+#endif /* HAS_X11 || HAS_WAYLAND || HAS_HEADLESS */
@@ -0,0 +1,37 @@
+/**************************************************************************/
+/*                                                                        */
+/*    Copyright 2022 OCamlPro                                             */
+/*                                                                        */
+/*  All rights reserved. This file is distributed under the terms of the  */
+/*  GNU Lesser General Public License version 2.1, with the special       */
+/*  exception on linking described in the file LICENSE.                   */
+/*                                                                        */
+/**************************************************************************/
+
+#ifndef __UNX_PNG_PARALLEL_H
+#define __UNX_PNG_PARALLEL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../pixmap.h"
+#include "../impexp.h"
+
+// Receives consecutive pieces of the encoded PNG stream
+typedef bool unx_png_write_fun_t(const uint8_t *data, size_t size,
+                                 void *user_data);
+
+// Encodes the pixmap as PNG by filtering and deflating independent
+// strips of rows on the worker pool. Strips are deflated as separate
+// raw deflate streams ending on a byte boundary (each one primed with
+// the end of the previous strip as dictionary), so their concatenation
+// forms a single valid zlib stream, emitted as one IDAT per strip.
+bool
+unx_png_parallel_write(
+  const pixmap_t *pixmap,
+  const impexp_png_options_t *options,
+  unx_png_write_fun_t *write,
+  void *user_data);
+
+#endif /* __UNX_PNG_PARALLEL_H */
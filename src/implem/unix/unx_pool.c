@@ -0,0 +1,362 @@
+/**************************************************************************/
+/*                                                                        */
+/*    Copyright 2022 OCamlPro                                             */
+/*                                                                        */
+/*  All rights reserved. This file is distributed under the terms of the  */
+/*  GNU Lesser General Public License version 2.1, with the special       */
+/*  exception on linking described in the file LICENSE.                   */
+/*                                                                        */
+/**************************************************************************/
+
+#if defined HAS_X11 || defined HAS_WAYLAND || defined HAS_HEADLESS
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include <unistd.h>
+#include <pthread.h>
+
+#include "../util.h"
+#include "unx_pool.h"
+
+#define UNX_POOL_MAX_THREADS 64
+
+typedef struct unx_pool_task_t {
+  unx_pool_task_fun_t *fun;
+  void *data;
+  struct unx_pool_task_t *next;
+} unx_pool_task_t;
+
+typedef struct unx_pool_t {
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  pthread_t threads[UNX_POOL_MAX_THREADS];
+  int32_t nb_threads;
+  unx_pool_task_t *first;
+  unx_pool_task_t *last;
+  bool stopping;
+  int32_t users; /* Protected by _unx_pool_mutex */
+} unx_pool_t;
+
+/* Callers hold the pool as users while they access it, so that
+   unx_pool_terminate only frees it once they are all done */
+static unx_pool_t *_unx_pool = NULL;
+static pthread_mutex_t _unx_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t _unx_pool_cond = PTHREAD_COND_INITIALIZER;
+
+static void *
+_unx_pool_worker(
+  void *arg)
+{
+  unx_pool_t *pool = (unx_pool_t *)arg;
+  assert(pool != NULL);
+
+  pthread_mutex_lock(&pool->mutex);
+
+  while (true) {
+
+    while ((pool->first == NULL) && (pool->stopping == false)) {
+      pthread_cond_wait(&pool->cond, &pool->mutex);
+    }
+
+    unx_pool_task_t *task = pool->first;
+    if (task == NULL) {
+      break;
+    }
+
+    pool->first = task->next;
+    if (pool->first == NULL) {
+      pool->last = NULL;
+    }
+
+    pthread_mutex_unlock(&pool->mutex);
+    task->fun(task->data);
+    free(task);
+    pthread_mutex_lock(&pool->mutex);
+  }
+
+  pthread_mutex_unlock(&pool->mutex);
+
+  return NULL;
+}
+
+/* Starts the pool if needed; the result must
+   be handed back with _unx_pool_release */
+static unx_pool_t *
+_unx_pool_acquire(
+  void)
+{
+  pthread_mutex_lock(&_unx_pool_mutex);
+
+  if (_unx_pool != NULL) {
+    unx_pool_t *pool = _unx_pool;
+    pool->users++;
+    pthread_mutex_unlock(&_unx_pool_mutex);
+    return pool;
+  }
+
+  unx_pool_t *pool = (unx_pool_t *)calloc(1, sizeof(unx_pool_t));
+  if (pool == NULL) {
+    pthread_mutex_unlock(&_unx_pool_mutex);
+    return NULL;
+  }
+
+  pthread_mutex_init(&pool->mutex, NULL);
+  pthread_cond_init(&pool->cond, NULL);
+
+  long nb_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  int32_t nb_threads = (int32_t)min(max(nb_cpus, 1), UNX_POOL_MAX_THREADS);
+
+  for (int32_t i = 0; i < nb_threads; ++i) {
+    if (pthread_create(&pool->threads[i], NULL,
+                       _unx_pool_worker, pool) != 0) {
+      break;
+    }
+    pool->nb_threads++;
+  }
+
+  if (pool->nb_threads == 0) {
+    pthread_cond_destroy(&pool->cond);
+    pthread_mutex_destroy(&pool->mutex);
+    free(pool);
+    pthread_mutex_unlock(&_unx_pool_mutex);
+    return NULL;
+  }
+
+  pool->users = 1;
+  _unx_pool = pool;
+
+  pthread_mutex_unlock(&_unx_pool_mutex);
+
+  return pool;
+}
+
+static void
+_unx_pool_release(
+  unx_pool_t *pool)
+{
+  assert(pool != NULL);
+
+  pthread_mutex_lock(&_unx_pool_mutex);
+  assert(pool->users > 0);
+  if (--pool->users == 0) {
+    pthread_cond_broadcast(&_unx_pool_cond);
+  }
+  pthread_mutex_unlock(&_unx_pool_mutex);
+}
+
+void
+unx_pool_terminate(
+  void)
+{
+  pthread_mutex_lock(&_unx_pool_mutex);
+
+  unx_pool_t *pool = _unx_pool;
+  _unx_pool = NULL;
+
+  // Wait for the callers still using the pool
+  while ((pool != NULL) && (pool->users > 0)) {
+    pthread_cond_wait(&_unx_pool_cond, &_unx_pool_mutex);
+  }
+
+  pthread_mutex_unlock(&_unx_pool_mutex);
+
+  if (pool == NULL) {
+    return;
+  }
+
+  // Pending tasks are still run before the workers exit
+  pthread_mutex_lock(&pool->mutex);
+  pool->stopping = true;
+  pthread_cond_broadcast(&pool->cond);
+  pthread_mutex_unlock(&pool->mutex);
+
+  for (int32_t i = 0; i < pool->nb_threads; ++i) {
+    pthread_join(pool->threads[i], NULL);
+  }
+
+  pthread_cond_destroy(&pool->cond);
+  pthread_mutex_destroy(&pool->mutex);
+  free(pool);
+}
+
+int32_t
+unx_pool_size(
+  void)
+{
+  unx_pool_t *pool = _unx_pool_acquire();
+  if (pool == NULL) {
+    return 0;
+  }
+  int32_t nb_threads = pool->nb_threads;
+  _unx_pool_release(pool);
+  return nb_threads;
+}
+
+bool
+unx_pool_submit(
+  unx_pool_task_fun_t *fun,
+  void *data)
+{
+  assert(fun != NULL);
+
+  unx_pool_t *pool = _unx_pool_acquire();
+  if (pool == NULL) {
+    return false;
+  }
+
+  unx_pool_task_t *task =
+    (unx_pool_task_t *)calloc(1, sizeof(unx_pool_task_t));
+  if (task == NULL) {
+    _unx_pool_release(pool);
+    return false;
+  }
+
+  task->fun = fun;
+  task->data = data;
+  task->next = NULL;
+
+  pthread_mutex_lock(&pool->mutex);
+
+  if (pool->last == NULL) {
+    pool->first = task;
+  } else {
+    pool->last->next = task;
+  }
+  pool->last = task;
+
+  pthread_cond_signal(&pool->cond);
+
+  pthread_mutex_unlock(&pool->mutex);
+
+  _unx_pool_release(pool);
+
+  return true;
+}
+
+/* A batch is shared by the caller of unx_pool_parallel_for and the
+   helper tasks it submits; helpers that are only scheduled after the
+   work is done still access it, hence the reference counter */
+typedef struct unx_pool_batch_t {
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  unx_pool_task_fun_t *fun;
+  uint8_t *data;
+  size_t size;
+  int32_t count;
+  int32_t next;
+  int32_t done;
+  int32_t refs;
+} unx_pool_batch_t;
+
+static void
+_unx_pool_batch_release(
+  unx_pool_batch_t *batch)
+{
+  assert(batch != NULL);
+
+  pthread_mutex_lock(&batch->mutex);
+  bool last = (--batch->refs == 0);
+  pthread_mutex_unlock(&batch->mutex);
+
+  if (last == true) {
+    pthread_cond_destroy(&batch->cond);
+    pthread_mutex_destroy(&batch->mutex);
+    free(batch);
+  }
+}
+
+static void
+_unx_pool_batch_run(
+  unx_pool_batch_t *batch)
+{
+  assert(batch != NULL);
+
+  pthread_mutex_lock(&batch->mutex);
+
+  while (batch->next < batch->count) {
+    int32_t i = batch->next++;
+    pthread_mutex_unlock(&batch->mutex);
+    batch->fun((void *)(batch->data + (size_t)i * batch->size));
+    pthread_mutex_lock(&batch->mutex);
+    if (++batch->done == batch->count) {
+      pthread_cond_broadcast(&batch->cond);
+    }
+  }
+
+  pthread_mutex_unlock(&batch->mutex);
+}
+
+static void
+_unx_pool_batch_helper(
+  void *data)
+{
+  unx_pool_batch_t *batch = (unx_pool_batch_t *)data;
+  assert(batch != NULL);
+
+  _unx_pool_batch_run(batch);
+  _unx_pool_batch_release(batch);
+}
+
+bool
+unx_pool_parallel_for(
+  unx_pool_task_fun_t *fun,
+  void *data,
+  size_t size,
+  int32_t count)
+{
+  assert(fun != NULL);
+  assert(data != NULL);
+  assert(count >= 0);
+
+  if (count == 0) {
+    return true;
+  }
+
+  unx_pool_batch_t *batch =
+    (unx_pool_batch_t *)calloc(1, sizeof(unx_pool_batch_t));
+  if (batch == NULL) {
+    return false;
+  }
+
+  pthread_mutex_init(&batch->mutex, NULL);
+  pthread_cond_init(&batch->cond, NULL);
+  batch->fun = fun;
+  batch->data = (uint8_t *)data;
+  batch->size = size;
+  batch->count = count;
+  batch->next = 0;
+  batch->done = 0;
+  batch->refs = 1;
+
+  int32_t nb_helpers = min(count - 1, unx_pool_size());
+  for (int32_t i = 0; i < nb_helpers; ++i) {
+    pthread_mutex_lock(&batch->mutex);
+    batch->refs++;
+    pthread_mutex_unlock(&batch->mutex);
+    if (unx_pool_submit(_unx_pool_batch_helper, batch) == false) {
+      _unx_pool_batch_release(batch);
+      break;
+    }
+  }
+
+  _unx_pool_batch_run(batch);
+
+  pthread_mutex_lock(&batch->mutex);
+  while (batch->done < batch->count) {
+    pthread_cond_wait(&batch->cond, &batch->mutex);
+  }
+  pthread_mutex_unlock(&batch->mutex);
+
+  _unx_pool_batch_release(batch);
+
+  return true;
+}
+
+#else
+
+const int unx_pool = 0;
+
+#endif /* HAS_X11 || HAS_WAYLAND || HAS_HEADLESS */
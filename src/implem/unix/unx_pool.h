@@ -0,0 +1,47 @@
+/**************************************************************************/
+/*                                                                        */
+/*    Copyright 2022 OCamlPro                                             */
+/*                                                                        */
+/*  All rights reserved. This file is distributed under the terms of the  */
+/*  GNU Lesser General Public License version 2.1, with the special       */
+/*  exception on linking described in the file LICENSE.                   */
+/*                                                                        */
+/**************************************************************************/
+
+#ifndef __UNX_POOL_H
+#define __UNX_POOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef void unx_pool_task_fun_t(void *data);
+
+// The pool is started lazily, with one worker per online processor
+
+void
+unx_pool_terminate(
+  void);
+
+int32_t
+unx_pool_size(
+  void);
+
+// Queues fun(data) for execution on a worker
+bool
+unx_pool_submit(
+  unx_pool_task_fun_t *fun,
+  void *data);
+
+// Runs fun on each of the count elements of the data array
+// (each one being size bytes long), and waits for completion.
+// The calling thread takes part in the work, so this may
+// safely be used from within a worker.
+bool
+unx_pool_parallel_for(
+  unx_pool_task_fun_t *fun,
+  void *data,
+  size_t size,
+  int32_t count);
+
+#endif /* __UNX_POOL_H */
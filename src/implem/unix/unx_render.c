@@ -0,0 +1,232 @@
+/**************************************************************************/
+/*                                                                        */
+/*    Copyright 2022 OCamlPro                                             */
+/*                                                                        */
+/*  All rights reserved. This file is distributed under the terms of the  */
+/*  GNU Lesser General Public License version 2.1, with the special       */
+/*  exception on linking described in the file LICENSE.                   */
+/*                                                                        */
+/**************************************************************************/
+
+
+#if defined HAS_X11 || defined HAS_WAYLAND || defined HAS_HEADLESS
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include <pthread.h>
+
+#include "../canvas.h"
+#include "../command.h"
+#include "unx_render.h"
+
+typedef struct unx_render_buffer_t {
+  struct unx_render_buffer_t *next;
+  int64_t frame;
+  size_t len;
+  double data[];
+} unx_render_buffer_t;
+
+typedef struct unx_render_t {
+  canvas_t *canvas;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond; // signaled on any change
+  pthread_t thread;
+  unx_render_buffer_t *first;
+  unx_render_buffer_t *last;
+  int64_t frame; // frame buffers are being submitted in
+  int64_t released; // last frame whose buffers may run
+  bool busy; // a buffer is being run
+  bool stopping;
+} unx_render_t;
+
+static bool
+_unx_render_runnable(
+  const unx_render_t *render)
+{
+  assert(render != NULL);
+
+  return (render->first != NULL) &&
+         (render->first->frame <= render->released);
+}
+
+static void *
+_unx_render_thread(
+  void *arg)
+{
+  unx_render_t *render = (unx_render_t *)arg;
+  assert(render != NULL);
+
+  pthread_mutex_lock(&render->mutex);
+
+  while (true) {
+
+    while ((_unx_render_runnable(render) == false) &&
+           (render->stopping == false)) {
+      pthread_cond_wait(&render->cond, &render->mutex);
+    }
+
+    if (render->stopping == true) {
+      break;
+    }
+
+    unx_render_buffer_t *buffer = render->first;
+    render->first = buffer->next;
+    if (render->first == NULL) {
+      render->last = NULL;
+    }
+    render->busy = true;
+
+    pthread_mutex_unlock(&render->mutex);
+    command_execute(render->canvas, buffer->data, buffer->len);
+    free(buffer);
+    pthread_mutex_lock(&render->mutex);
+
+    render->busy = false;
+    pthread_cond_broadcast(&render->cond);
+  }
+
+  pthread_mutex_unlock(&render->mutex);
+
+  return NULL;
+}
+
+unx_render_t *
+unx_render_create(
+  canvas_t *canvas)
+{
+  assert(canvas != NULL);
+
+  unx_render_t *render = (unx_render_t *)calloc(1, sizeof(unx_render_t));
+  if (render == NULL) {
+    return NULL;
+  }
+
+  render->canvas = canvas;
+  pthread_mutex_init(&render->mutex, NULL);
+  pthread_cond_init(&render->cond, NULL);
+
+  if (pthread_create(&render->thread, NULL,
+                     _unx_render_thread, render) != 0) {
+    pthread_cond_destroy(&render->cond);
+    pthread_mutex_destroy(&render->mutex);
+    free(render);
+    return NULL;
+  }
+
+  return render;
+}
+
+void
+unx_render_destroy(
+  unx_render_t *render)
+{
+  assert(render != NULL);
+
+  pthread_mutex_lock(&render->mutex);
+  render->stopping = true;
+  pthread_cond_broadcast(&render->cond);
+  pthread_mutex_unlock(&render->mutex);
+
+  pthread_join(render->thread, NULL);
+
+  while (render->first != NULL) {
+    unx_render_buffer_t *buffer = render->first;
+    render->first = buffer->next;
+    free(buffer);
+  }
+
+  pthread_cond_destroy(&render->cond);
+  pthread_mutex_destroy(&render->mutex);
+  free(render);
+}
+
+bool
+unx_render_submit(
+  unx_render_t *render,
+  const double *data,
+  size_t len)
+{
+  assert(render != NULL);
+  assert((data != NULL) || (len == 0));
+
+  if (len == 0) {
+    return true;
+  }
+
+  unx_render_buffer_t *buffer = (unx_render_buffer_t *)
+    malloc(sizeof(unx_render_buffer_t) + len * sizeof(double));
+  if (buffer == NULL) {
+    return false;
+  }
+
+  memcpy(buffer->data, data, len * sizeof(double));
+  buffer->len = len;
+  buffer->next = NULL;
+
+  pthread_mutex_lock(&render->mutex);
+
+  buffer->frame = render->frame;
+  if (render->last == NULL) {
+    render->first = buffer;
+  } else {
+    render->last->next = buffer;
+  }
+  render->last = buffer;
+
+  pthread_cond_broadcast(&render->cond);
+  pthread_mutex_unlock(&render->mutex);
+
+  return true;
+}
+
+void
+unx_render_begin_frame(
+  unx_render_t *render,
+  bool hold)
+{
+  assert(render != NULL);
+
+  pthread_mutex_lock(&render->mutex);
+  render->frame++;
+  if (hold == false) {
+    render->released = render->frame;
+    pthread_cond_broadcast(&render->cond);
+  }
+  pthread_mutex_unlock(&render->mutex);
+}
+
+void
+unx_render_release(
+  unx_render_t *render)
+{
+  assert(render != NULL);
+
+  pthread_mutex_lock(&render->mutex);
+  render->released = render->frame;
+  pthread_cond_broadcast(&render->cond);
+  pthread_mutex_unlock(&render->mutex);
+}
+
+void
+unx_render_wait(
+  unx_render_t *render)
+{
+  assert(render != NULL);
+
+  pthread_mutex_lock(&render->mutex);
+  while ((_unx_render_runnable(render) == true) ||
+         (render->busy == true)) {
+    pthread_cond_wait(&render->cond, &render->mutex);
+  }
+  pthread_mutex_unlock(&render->mutex);
+}
+
+#else
+
+const int unx_render = 0;
+
+#endif /* HAS_X11 || HAS_WAYLAND || HAS_HEADLESS */
@@ -0,0 +1,60 @@
+/**************************************************************************/
+/*                                                                        */
+/*    Copyright 2022 OCamlPro                                             */
+/*                                                                        */
+/*  All rights reserved. This file is distributed under the terms of the  */
+/*  GNU Lesser General Public License version 2.1, with the special       */
+/*  exception on linking described in the file LICENSE.                   */
+/*                                                                        */
+/**************************************************************************/
+
+#ifndef __UNX_RENDER_H
+#define __UNX_RENDER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "../canvas.h"
+
+// A render thread runs the command buffers submitted to a canvas,
+// in order. Buffers are tagged with the frame they were submitted
+// in, and only run once that frame has been let through.
+
+typedef struct unx_render_t unx_render_t;
+
+// Starts a render thread for the canvas
+unx_render_t *
+unx_render_create(
+  canvas_t *canvas);
+
+// Waits for the buffer being run (if any), drops the
+// others and stops the thread
+void
+unx_render_destroy(
+  unx_render_t *render);
+
+// Copies and queues a command buffer, which must be valid
+bool
+unx_render_submit(
+  unx_render_t *render,
+  const double *data,
+  size_t len);
+
+// Starts a new frame; if hold is true, the buffers submitted
+// from now on wait for unx_render_release to be called
+void
+unx_render_begin_frame(
+  unx_render_t *render,
+  bool hold);
+
+// Lets all the queued buffers run
+void
+unx_render_release(
+  unx_render_t *render);
+
+// Waits until all the buffers that were let through have run
+void
+unx_render_wait(
+  unx_render_t *render);
+
+#endif /* __UNX_RENDER_H */
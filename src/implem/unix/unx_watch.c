@@ -0,0 +1,288 @@
+/**************************************************************************/
+/*                                                                        */
+/*    Copyright 2022 OCamlPro                                             */
+/*                                                                        */
+/*  All rights reserved. This file is distributed under the terms of the  */
+/*  GNU Lesser General Public License version 2.1, with the special       */
+/*  exception on linking described in the file LICENSE.                   */
+/*                                                                        */
+/**************************************************************************/
+
+#if defined HAS_X11 || defined HAS_WAYLAND || defined HAS_HEADLESS
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include <time.h>
+#include <errno.h>
+#include <poll.h>
+
+#include "../util.h"
+#include "../watch.h"
+#include "unx_watch.h"
+
+typedef struct unx_watch_t {
+  int32_t id;
+  int fd; // -1 for timers
+  int32_t flags;
+  int64_t deadline; // timers only
+  int64_t period; // timers only, 0 if one-shot
+  watch_fun_t *fun; // NULL once removed
+  void *data;
+} unx_watch_t;
+
+static unx_watch_t *_unx_watches = NULL;
+static int32_t _unx_watch_count = 0;
+static int32_t _unx_watch_capacity = 0;
+static int32_t _unx_watch_next_id = 1;
+
+/* Kept from one wait to the next, to avoid reallocating */
+static struct pollfd *_unx_watch_pollfds = NULL;
+static int32_t _unx_watch_pollfds_capacity = 0;
+
+static int64_t
+_unx_watch_now(
+  void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int32_t
+_unx_watch_add(
+  int fd,
+  int32_t flags,
+  int64_t deadline,
+  int64_t period,
+  watch_fun_t *fun,
+  void *data)
+{
+  assert(fun != NULL);
+
+  if (_unx_watch_count == _unx_watch_capacity) {
+    int32_t capacity = max(8, _unx_watch_capacity * 2);
+    unx_watch_t *watches =
+      (unx_watch_t *)realloc(_unx_watches, capacity * sizeof(unx_watch_t));
+    if (watches == NULL) {
+      return 0;
+    }
+    _unx_watches = watches;
+    _unx_watch_capacity = capacity;
+  }
+
+  unx_watch_t *w = &_unx_watches[_unx_watch_count++];
+  w->id = _unx_watch_next_id;
+  w->fd = fd;
+  w->flags = flags;
+  w->deadline = deadline;
+  w->period = period;
+  w->fun = fun;
+  w->data = data;
+
+  _unx_watch_next_id = (_unx_watch_next_id == INT32_MAX) ?
+                         1 : _unx_watch_next_id + 1;
+
+  return w->id;
+}
+
+/* Watches are only marked when removed, as this may happen
+   from a callback; they are actually dropped here */
+static void
+_unx_watch_compact(
+  void)
+{
+  int32_t j = 0;
+  for (int32_t i = 0; i < _unx_watch_count; ++i) {
+    if (_unx_watches[i].fun != NULL) {
+      _unx_watches[j++] = _unx_watches[i];
+    }
+  }
+  _unx_watch_count = j;
+}
+
+int32_t
+unx_watch_fd(
+  int fd,
+  int32_t flags,
+  watch_fun_t *fun,
+  void *data)
+{
+  assert(fd >= 0);
+  assert((flags & (WATCH_READ | WATCH_WRITE)) != 0);
+  assert(fun != NULL);
+
+  return _unx_watch_add(fd, flags & (WATCH_READ | WATCH_WRITE),
+                        0, 0, fun, data);
+}
+
+int32_t
+unx_watch_timer(
+  int64_t delay,
+  int64_t period,
+  watch_fun_t *fun,
+  void *data)
+{
+  assert(delay >= 0);
+  assert(period >= 0);
+  assert(fun != NULL);
+
+  return _unx_watch_add(-1, WATCH_TIMEOUT, _unx_watch_now() + delay,
+                        period, fun, data);
+}
+
+void
+unx_watch_remove(
+  int32_t id)
+{
+  for (int32_t i = 0; i < _unx_watch_count; ++i) {
+    if (_unx_watches[i].id == id) {
+      _unx_watches[i].fun = NULL;
+      _unx_watches[i].data = NULL;
+      return;
+    }
+  }
+}
+
+bool
+unx_watch_active(
+  void)
+{
+  _unx_watch_compact();
+  return _unx_watch_count > 0;
+}
+
+void
+unx_watch_terminate(
+  void)
+{
+  free(_unx_watches);
+  _unx_watches = NULL;
+  _unx_watch_count = 0;
+  _unx_watch_capacity = 0;
+
+  free(_unx_watch_pollfds);
+  _unx_watch_pollfds = NULL;
+  _unx_watch_pollfds_capacity = 0;
+}
+
+bool
+unx_watch_wait(
+  int fd,
+  int64_t timeout,
+  bool *fd_ready)
+{
+  assert(timeout >= 0);
+
+  if (fd_ready != NULL) {
+    *fd_ready = false;
+  }
+
+  _unx_watch_compact();
+
+  /* Wake up for the earliest timer */
+  int64_t now = _unx_watch_now();
+  int32_t nb_fds = (fd >= 0) ? 1 : 0;
+  for (int32_t i = 0; i < _unx_watch_count; ++i) {
+    if (_unx_watches[i].fd >= 0) {
+      nb_fds++;
+    } else {
+      timeout = min(timeout, max(0, _unx_watches[i].deadline - now));
+    }
+  }
+
+  if (nb_fds > _unx_watch_pollfds_capacity) {
+    struct pollfd *pollfds =
+      (struct pollfd *)realloc(_unx_watch_pollfds,
+                               nb_fds * sizeof(struct pollfd));
+    if (pollfds == NULL) {
+      return false;
+    }
+    _unx_watch_pollfds = pollfds;
+    _unx_watch_pollfds_capacity = nb_fds;
+  }
+
+  int32_t n = 0;
+  if (fd >= 0) {
+    _unx_watch_pollfds[n].fd = fd;
+    _unx_watch_pollfds[n].events = POLLIN;
+    _unx_watch_pollfds[n++].revents = 0;
+  }
+  for (int32_t i = 0; i < _unx_watch_count; ++i) {
+    unx_watch_t *w = &_unx_watches[i];
+    if (w->fd >= 0) {
+      _unx_watch_pollfds[n].fd = w->fd;
+      _unx_watch_pollfds[n].events =
+        ((w->flags & WATCH_READ) ? POLLIN : 0) |
+        ((w->flags & WATCH_WRITE) ? POLLOUT : 0);
+      _unx_watch_pollfds[n++].revents = 0;
+    }
+  }
+
+  /* Round up, so as not to wake up early and spin */
+  int res = poll(_unx_watch_pollfds, nb_fds, (int)((timeout + 999) / 1000));
+  if (res < 0) {
+    /* Interrupted by a signal: let the caller check its deadlines */
+    return errno == EINTR;
+  }
+
+  bool activity = false;
+
+  n = 0;
+  if (fd >= 0) {
+    if (_unx_watch_pollfds[n++].revents != 0) {
+      if (fd_ready != NULL) {
+        *fd_ready = true;
+      }
+      activity = true;
+    }
+  }
+
+  /* Callbacks may add watches (possibly reallocating the array),
+     those are left for the next wait */
+  int32_t count = _unx_watch_count;
+  now = _unx_watch_now();
+  for (int32_t i = 0; i < count; ++i) {
+    unx_watch_t *w = &_unx_watches[i];
+    int32_t id = w->id;
+    watch_fun_t *fun = w->fun;
+    void *data = w->data;
+    if (w->fd >= 0) {
+      short revents = _unx_watch_pollfds[n++].revents;
+      if ((fun == NULL) || (revents == 0)) {
+        continue;
+      }
+      if (revents & POLLNVAL) {
+        /* The descriptor was closed without being unwatched */
+        w->fun = NULL;
+        continue;
+      }
+      /* On error or hang up, let the reader or writer find out */
+      int32_t flags = (revents & (POLLERR | POLLHUP)) ? w->flags : 0;
+      flags |= ((revents & POLLIN) ? WATCH_READ : 0) |
+               ((revents & POLLOUT) ? WATCH_WRITE : 0);
+      fun(id, flags & w->flags, data);
+      activity = true;
+    } else if ((fun != NULL) && (w->deadline <= now)) {
+      if (w->period > 0) {
+        do {
+          w->deadline += w->period;
+        } while (w->deadline <= now);
+      } else {
+        w->fun = NULL;
+      }
+      fun(id, WATCH_TIMEOUT, data);
+      activity = true;
+    }
+  }
+
+  return activity;
+}
+
+#else
+
+const int unx_watch = 0;
+
+#endif /* HAS_X11 || HAS_WAYLAND || HAS_HEADLESS */
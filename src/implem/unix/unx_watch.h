@@ -0,0 +1,60 @@
+/**************************************************************************/
+/*                                                                        */
+/*    Copyright 2022 OCamlPro                                             */
+/*                                                                        */
+/*  All rights reserved. This file is distributed under the terms of the  */
+/*  GNU Lesser General Public License version 2.1, with the special       */
+/*  exception on linking described in the file LICENSE.                   */
+/*                                                                        */
+/**************************************************************************/
+
+#ifndef __UNX_WATCH_H
+#define __UNX_WATCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../watch.h"
+
+// Ids are positive; 0 is returned on failure
+
+int32_t
+unx_watch_fd(
+  int fd,
+  int32_t flags,
+  watch_fun_t *fun,
+  void *data);
+
+// Delay and period are in microseconds; a period of 0 makes
+// the timer fire only once, after which it is removed
+int32_t
+unx_watch_timer(
+  int64_t delay,
+  int64_t period,
+  watch_fun_t *fun,
+  void *data);
+
+void
+unx_watch_remove(
+  int32_t id);
+
+bool
+unx_watch_active(
+  void);
+
+void
+unx_watch_terminate(
+  void);
+
+// Waits at most timeout microseconds (possibly less if a timer
+// expires earlier) for fd (if not negative) to become readable
+// or for a watch to fire, and runs the callbacks of fired watches.
+// Sets fd_ready (if not NULL) to whether fd is readable.
+// Returns false if the whole time elapsed with nothing happening.
+bool
+unx_watch_wait(
+  int fd,
+  int64_t timeout,
+  bool *fd_ready);
+
+#endif /* __UNX_WATCH_H */
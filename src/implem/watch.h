@@ -0,0 +1,26 @@
+/**************************************************************************/
+/*                                                                        */
+/*    Copyright 2022 OCamlPro                                             */
+/*                                                                        */
+/*  All rights reserved. This file is distributed under the terms of the  */
+/*  GNU Lesser General Public License version 2.1, with the special       */
+/*  exception on linking described in the file LICENSE.                   */
+/*                                                                        */
+/**************************************************************************/
+
+#ifndef __WATCH_H
+#define __WATCH_H
+
+#include <stdint.h>
+
+typedef enum watch_flag_t {
+  WATCH_READ    = 1,
+  WATCH_WRITE   = 2,
+  WATCH_TIMEOUT = 4
+} watch_flag_t;
+
+// Called from the event loop when a watched file descriptor becomes
+// ready (flags tells how) or when a timer expires (flags is WATCH_TIMEOUT)
+typedef void watch_fun_t(int32_t id, int32_t flags, void *data);
+
+#endif /* __WATCH_H */
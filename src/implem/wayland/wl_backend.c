@@ -15,6 +15,7 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 #include <assert.h>
 
 #include <wayland-client.h>
@@ -23,28 +24,38 @@
 
 #include "../hashtable.h"
 #include "../event.h"
+#include "../defer.h"
+#include "../frame.h"
+#include "../unix/unx_watch.h"
 #include "wl_backend.h"
 #include "wl_backend_internal.h"
 #include "wl_window_internal.h"
 
 wl_backend_t *wl_back = NULL;
 
-/*
 static hash_t
-_x11_wid_hash(
-  const xcb_window_t *wid)
+_wl_surf_hash(
+  struct wl_surface * const *surf)
 {
-  return (hash_t)(uintptr_t)*wid;
+  return (hash_t)(uintptr_t)*surf;
 }
 
 static bool
-_x11_wid_equal(
-  const xcb_window_t *wid1,
-  const xcb_window_t *wid2)
+_wl_surf_equal(
+  struct wl_surface * const *surf1,
+  struct wl_surface * const *surf2)
 {
-  return (*wid1) == (*wid2);
+  return (*surf1) == (*surf2);
+}
+
+int64_t
+wl_get_time(
+  void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
 }
-*/
 
 
 static void
@@ -230,16 +241,14 @@ wl_backend_init(
     return false;
   }
 
-  /* Map from WL windows IDs to window objects */
-/*
-  wl_back->wid_to_win = ht_new((key_hash_fun_t *)_wl_wid_hash,
-                                (key_equal_fun_t *)_wl_wid_equal,
+  /* Map from surfaces to window objects */
+  wl_back->surf_to_win = ht_new((key_hash_fun_t *)_wl_surf_hash,
+                                (key_equal_fun_t *)_wl_surf_equal,
                                 32);
-  if (wl_back->wid_to_win == NULL) {
+  if (wl_back->surf_to_win == NULL) {
     wl_backend_terminate();
     return false;
   }
-*/
 
 
   /* Connect to Wayland server */
@@ -312,11 +321,9 @@ wl_backend_terminate(
   wl_display_roundtrip(wl_back->display);
   wl_display_disconnect(wl_back->display);
 
-/*
-  if (wl_back->wid_to_win != NULL) {
-    ht_delete(wl_back->wid_to_win);
+  if (wl_back->surf_to_win != NULL) {
+    ht_delete(wl_back->surf_to_win);
   }
-*/
 
   free(wl_back);
 
@@ -327,32 +334,32 @@ void
 wl_backend_add_window(
   wl_window_t *w)
 {
+  assert(wl_back != NULL);
   assert(w != NULL);
-/*
-  assert(w->wid != XCB_WINDOW_NONE);
-  ht_add(wl_back->wid_to_win, (void *)&(w->wid), (void *)w);
-*/
+  assert(w->wl_surface != NULL);
+
+  ht_add(wl_back->surf_to_win, (void *)&(w->wl_surface), (void *)w);
 }
 
 void
 wl_backend_remove_window(
   const wl_window_t *w)
 {
+  assert(wl_back != NULL);
   assert(w != NULL);
-/*
-  assert(w->wid != XCB_WINDOW_NONE);
-  ht_remove(wl_back->wid_to_win, (void *)&(w->wid));
-*/
+  assert(w->wl_surface != NULL);
+
+  ht_remove(wl_back->surf_to_win, (void *)&(w->wl_surface));
 }
 
 wl_window_t *
 wl_backend_get_window(
-  int wid)
+  const struct wl_surface *wl_surface)
 {
-  assert(wid != 0);
+  assert(wl_back != NULL);
+  assert(wl_surface != NULL);
 
-//  return (wl_window_t *)ht_find(wl_back->wid_to_win, (void *)&wid);
-  return NULL;
+  return (wl_window_t *)ht_find(wl_back->surf_to_win, (void *)&wl_surface);
 }
 
 void
@@ -372,18 +379,120 @@ wl_backend_get_listener(
   return wl_back->listener;
 }
 
+static void
+_wl_frame_done(
+  void *data,
+  struct wl_callback *callback,
+  uint32_t time)
+{
+  wl_window_t *w = (wl_window_t *)data;
+  assert(w != NULL);
+  assert(w->frame_callback == callback);
+
+  wl_callback_destroy(callback);
+  w->frame_callback = NULL;
+}
+
+static const struct wl_callback_listener
+_wl_frame_listener =
+{
+  .done = _wl_frame_done,
+};
+
+static void
+_wl_present_window(
+  wl_window_t *w)
+{
+  assert(wl_back != NULL);
+  assert(w != NULL);
+
+  /* Must be requested before the surface is committed */
+  w->frame_callback = wl_surface_frame(w->wl_surface);
+  if (w->frame_callback != NULL) {
+    wl_callback_add_listener(w->frame_callback, &_wl_frame_listener, w);
+  }
+
+  event_t evt;
+  evt.type = EVENT_PRESENT;
+  evt.time = wl_get_time();
+  evt.target = (void *)w;
+  evt.desc.present.data.wl.dummy = NULL;
+  event_notify(wl_back->listener, &evt);
+}
+
+/* Windows whose last frame the compositor has not shown yet are
+   skipped: frames then follow the display, up to the frame rate */
+static void
+_wl_render_all_windows(
+  void)
+{
+  assert(wl_back != NULL);
+
+  defer_process();
+
+  event_t evt;
+  wl_window_t *w = NULL;
+
+  evt.type = EVENT_FRAME;
+  evt.time = wl_get_time();
+  hashtable_iterator_t i = ht_get_iterator(wl_back->surf_to_win);
+  while ((w = (wl_window_t *)ht_iterator_next(&i)) != NULL) {
+    if ((w->base.visible == true) && (w->frame_callback == NULL)) {
+      evt.target = (void *)w;
+      if (event_notify(wl_back->listener, &evt)) {
+        _wl_present_window(w);
+      }
+    }
+  }
+}
+
 void
 wl_backend_run(
   void)
 {
-//  wl_window_t *w = NULL;
-//  xcb_event_t e;
-//  event_t evt;
+  assert(wl_back != NULL);
+
+  int64_t next_frame = wl_get_time();
 
   wl_back->running = true;
 
-  while (wl_display_dispatch(wl_back->display) >= 0) {
-    /* Handle events */
+  while (wl_back->running) {
+
+    defer_process();
+
+    /* Handle events, while also waiting for watched
+       descriptors, timers and the next frame */
+    while (wl_display_prepare_read(wl_back->display) != 0) {
+      wl_display_dispatch_pending(wl_back->display);
+    }
+    wl_display_flush(wl_back->display);
+
+    bool ready = false;
+    int64_t frame_timeout = next_frame - wl_get_time();
+    if (frame_timeout > 0) {
+      unx_watch_wait(wl_display_get_fd(wl_back->display),
+                     frame_timeout, &ready);
+    }
+    if (ready == true) {
+      if (wl_display_read_events(wl_back->display) < 0) {
+        break;
+      }
+    } else {
+      wl_display_cancel_read(wl_back->display);
+    }
+
+    wl_display_dispatch_pending(wl_back->display);
+
+    int64_t now = wl_get_time();
+    if (now >= next_frame) {
+      _wl_render_all_windows();
+      wl_display_flush(wl_back->display);
+
+      /* Compute time until next frame, skip frames if needed */
+      do {
+        next_frame += frame_get_interval();
+      } while (next_frame < now);
+    }
   }
 
 }
@@ -22,6 +22,10 @@
 
 typedef struct wl_backend_t wl_backend_t;
 
+int64_t
+wl_get_time(
+  void);
+
 bool
 wl_backend_init(
   void);
@@ -40,7 +44,7 @@ wl_backend_remove_window(
 
 wl_window_t *
 wl_backend_get_window(
-  int wid);
+  const struct wl_surface *wl_surface);
 
 void
 wl_backend_set_listener(
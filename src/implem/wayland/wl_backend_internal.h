@@ -25,6 +25,9 @@ typedef struct wl_backend_t {
   bool running;
   event_listener_t *listener;
 
+  /* Map from surfaces to window objects */
+  hashtable_t *surf_to_win;
+
   /* Globals */
   struct wl_display *display;
   struct wl_registry *registry;
@@ -129,6 +129,9 @@ wl_window_create(
 
   wl_display_roundtrip(wl_back->display);
 
+  // Add to managed windows
+  wl_backend_add_window(window);
+
 /*
   // Create the WL window
   window->wid = xcb_generate_id(wl_back->c);
@@ -234,9 +237,12 @@ wl_window_destroy(
   wl_window_t *window)
 {
   assert(window != NULL);
-/*
-  assert(window->wid != XCB_WINDOW_NONE);
+  assert(window->wl_surface != NULL);
   wl_backend_remove_window(window);
+  if (window->frame_callback != NULL) {
+    wl_callback_destroy(window->frame_callback);
+  }
+/*
   xcb_destroy_window(wl_back->c, window->wid);
 */
   free(window);
@@ -326,6 +332,11 @@ wl_window_hide(
   assert(window != NULL);
 //  assert(window->wid != XCB_WINDOW_NONE);
 //  xcb_unmap_window(wl_back->c, window->wid);
+  // Drop any pending frame: a hidden surface may never get it
+  if (window->frame_callback != NULL) {
+    wl_callback_destroy(window->frame_callback);
+    window->frame_callback = NULL;
+  }
 }
 
 #else
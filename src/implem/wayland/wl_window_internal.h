@@ -27,6 +27,10 @@ typedef struct wl_window_t {
   struct xdg_toplevel *xdg_toplevel;
 //  struct wl_buffer *wl_buffer;
 
+  /* Pending frame callback, if any: no frame is sent
+     to the window until the compositor signals it */
+  struct wl_callback *frame_callback;
+
 } wl_window_t;
 
 #endif /* __WL_WINDOW_INTERNAL_H */
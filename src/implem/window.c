@@ -29,6 +29,9 @@
 #ifdef HAS_WAYLAND
 #include "wayland/wl_window.h"
 #endif
+#ifdef HAS_HEADLESS
+#include "headless/hdl_window.h"
+#endif
 
 window_t *
 window_create(
@@ -54,6 +57,9 @@ window_create(
     case_WAYLAND(
       w = (window_t *)wl_window_create(decorated, title, x, y, width, height)
     );
+    case_HEADLESS(
+      w = (window_t *)hdl_window_create(decorated, title, x, y, width, height)
+    );
     default_fail();
   }
 
@@ -77,6 +83,9 @@ window_destroy(
     case_WAYLAND(
       wl_window_destroy((wl_window_t *)window)
     );
+    case_HEADLESS(
+      hdl_window_destroy((hdl_window_t *)window)
+    );
     default_fail();
   }
 }
@@ -119,6 +128,9 @@ window_get_target(
     case_WAYLAND(
       t = (target_t *)wl_window_get_target((wl_window_t *)window)
     );
+    case_HEADLESS(
+      t = (target_t *)hdl_window_get_target((hdl_window_t *)window)
+    );
     default_fail();
   }
 
@@ -143,6 +155,9 @@ window_set_title(
     case_WAYLAND(
       wl_window_set_title((wl_window_t *)window, title)
     );
+    case_HEADLESS(
+      hdl_window_set_title((hdl_window_t *)window, title)
+    );
     default_fail();
   }
 }
@@ -166,6 +181,9 @@ window_set_size(
     case_WAYLAND(
       wl_window_set_size((wl_window_t *)window, width, height)
     );
+    case_HEADLESS(
+      hdl_window_set_size((hdl_window_t *)window, width, height)
+    );
     default_fail();
   }
 }
@@ -198,6 +216,9 @@ window_set_position(
     case_WAYLAND(
       wl_window_set_position((wl_window_t *)window, x, y)
     );
+    case_HEADLESS(
+      hdl_window_set_position((hdl_window_t *)window, x, y)
+    );
     default_fail();
   }
 }
@@ -223,6 +244,9 @@ window_show(
     case_WAYLAND(
       wl_window_show((wl_window_t *)window)
     );
+    case_HEADLESS(
+      hdl_window_show((hdl_window_t *)window)
+    );
     default_fail();
   }
 }
@@ -248,6 +272,9 @@ window_hide(
     case_WAYLAND(
       wl_window_hide((wl_window_t *)window)
     );
+    case_HEADLESS(
+      hdl_window_hide((hdl_window_t *)window)
+    );
     default_fail();
   }
 }
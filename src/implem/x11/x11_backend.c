@@ -17,7 +17,6 @@
 #include <string.h>
 #include <assert.h>
 
-#include <sys/select.h>
 
 #include <xcb/xcb.h>
 #include <xcb/shm.h>
@@ -28,6 +27,9 @@
 #include "../util.h"
 #include "../hashtable.h"
 #include "../event.h"
+#include "../defer.h"
+#include "../frame.h"
+#include "../unix/unx_watch.h"
 #include "x11_keysym.h"
 #include "x11_keyboard.h"
 #include "x11_backend.h"
@@ -102,28 +104,6 @@ _x11_wid_equal(
   return (*wid1) == (*wid2);
 }
 
-static xcb_atom_t
-_x11_query_atom(
-  xcb_connection_t *c,
-  const char *atom_name)
-{
-  assert(c != NULL);
-  assert(atom_name != NULL);
-
-  xcb_intern_atom_cookie_t cookie =
-    xcb_intern_atom(c, 0, strlen(atom_name), atom_name);
-  xcb_intern_atom_reply_t *atom_reply =
-    xcb_intern_atom_reply(c, cookie, NULL);
-
-  xcb_atom_t atom = XCB_ATOM_NONE;
-  if (atom_reply) {
-    atom = atom_reply->atom;
-    free(atom_reply);
-  }
-
-  return atom;
-}
-
 int64_t
 x11_get_time(
   void)
@@ -176,39 +156,56 @@ x11_backend_init(
     }
   }
 
-  /* Setup the XKB extension */
+  /* Startup requests are all sent before waiting for any reply,
+     so that they share round-trips instead of taking one each */
+
+  /* Query the XKB and SHM extensions at once; requests
+     to an extension first need its (cached) opcode */
+  xcb_prefetch_extension_data(x11_back->c, &xcb_xkb_id);
+  xcb_prefetch_extension_data(x11_back->c, &xcb_shm_id);
+
+  /* Request atoms */
+  struct {
+    const char *name;
+    xcb_atom_t *atom;
+    xcb_intern_atom_cookie_t cookie;
+  } atoms[] = {
+    { "WM_PROTOCOLS", &x11_back->WM_PROTOCOLS },
+    { "WM_DELETE_WINDOW", &x11_back->WM_DELETE_WINDOW },
+    { "WM_TAKE_FOCUS", &x11_back->WM_TAKE_FOCUS },
+    { "WM_CLIENT_LEADER", &x11_back->WM_CLIENT_LEADER },
+    { "UTF8_STRING", &x11_back->UTF8_STRING },
+    { "_NET_WM_NAME", &x11_back->_NET_WM_NAME },
+    { "_NET_WM_ICON_NAME", &x11_back->_NET_WM_ICON_NAME },
+    { "_NET_WM_PID", &x11_back->_NET_WM_PID },
+    { "_NET_WM_PING", &x11_back->_NET_WM_PING },
+    { "_NET_WM_SYNC_REQUEST", &x11_back->_NET_WM_SYNC_REQUEST },
+    { "_NET_WM_USER_TIME_WINDOW", &x11_back->_NET_WM_USER_TIME_WINDOW },
+    { "_MOTIF_WM_HINTS", &x11_back->_MOTIF_WM_HINTS },
+    { "_NET_WM_WINDOW_TYPE", &x11_back->_NET_WM_WINDOW_TYPE },
+    { "_NET_WM_WINDOW_TYPE_SPLASH", &x11_back->_NET_WM_WINDOW_TYPE_SPLASH },
+  };
+  size_t nb_atoms = sizeof(atoms) / sizeof(atoms[0]);
+  for (size_t i = 0; i < nb_atoms; ++i) {
+    atoms[i].cookie = xcb_intern_atom(x11_back->c, 0,
+                                      strlen(atoms[i].name), atoms[i].name);
+  }
+
+  /* Setup the XKB extension; the server handles requests in
+     order, so the ones below may be sent right after this one */
   xcb_xkb_use_extension_cookie_t xkb_cookie =
     xcb_xkb_use_extension(x11_back->c,
                           XCB_XKB_MAJOR_VERSION, XCB_XKB_MINOR_VERSION);
-  xcb_xkb_use_extension_reply_t *xkb_reply =
-    xcb_xkb_use_extension_reply(x11_back->c, xkb_cookie, NULL);
-  if (xkb_reply == NULL) {
-    x11_backend_terminate();
-    return false;
-  }
-  free(xkb_reply);
-  x11_back->_XCB_XKB_EVENT =
-    xcb_get_extension_data(x11_back->c, &xcb_xkb_id)->first_event;
-
-  /* Retrieve the keysyms and mapping */
-  x11_keyboard_refresh();
-  if (x11_back->xkb_get_map_reply == NULL) {
-    x11_backend_terminate();
-    return false;
-  }
-
 
   xcb_xkb_per_client_flags_cookie_t xkb_cf_cookie =
     xcb_xkb_per_client_flags(x11_back->c, XCB_XKB_ID_USE_CORE_KBD,
                              XCB_XKB_PER_CLIENT_FLAG_DETECTABLE_AUTO_REPEAT,
                              XCB_XKB_PER_CLIENT_FLAG_DETECTABLE_AUTO_REPEAT,
                              0, 0, 0);
+  xcb_discard_reply(x11_back->c, xkb_cf_cookie.sequence);
 
-  xcb_xkb_per_client_flags_reply_t *xkb_cf_reply =
-    xcb_xkb_per_client_flags_reply (x11_back->c, xkb_cf_cookie, NULL);
-
-  free(xkb_cf_reply);
-
+  /* Request the keysyms and mapping */
+  x11_keyboard_cookies_t kb_cookies = x11_keyboard_request();
 
   /* Setup XKB events to listen */
 
@@ -249,14 +246,27 @@ x11_backend_init(
   xcb_xkb_select_events_aux(x11_back->c, XCB_XKB_ID_USE_CORE_KBD,
     which, 0 /* clear */, 0 /* select_all */, map_parts, map_parts, &ed);
 
-
-
   /* TODO: only if shm is available */
   /* Query SHM extension */
-  xcb_shm_query_version_cookie_t cookie =
+  xcb_shm_query_version_cookie_t shm_cookie =
     xcb_shm_query_version(x11_back->c);
+
+  /* Now collect the replies */
+
+  xcb_xkb_use_extension_reply_t *xkb_reply =
+    xcb_xkb_use_extension_reply(x11_back->c, xkb_cookie, NULL);
+  bool xkb_ok = (xkb_reply != NULL);
+  free(xkb_reply);
+  if ((xkb_ok == false) ||
+      (x11_keyboard_process(kb_cookies) == false)) {
+    x11_backend_terminate();
+    return false;
+  }
+  x11_back->_XCB_XKB_EVENT =
+    xcb_get_extension_data(x11_back->c, &xcb_xkb_id)->first_event;
+
   xcb_shm_query_version_reply_t *shm_reply =
-    xcb_shm_query_version_reply(x11_back->c, cookie, NULL);
+    xcb_shm_query_version_reply(x11_back->c, shm_cookie, NULL);
   if (!shm_reply || !shm_reply->shared_pixmaps) {
     x11_back->has_shm = 0;
   } else {
@@ -269,35 +279,15 @@ x11_backend_init(
     free(shm_reply);
   }
 
-  /* Query atoms */
-  x11_back->WM_PROTOCOLS =
-    _x11_query_atom(x11_back->c, "WM_PROTOCOLS");
-  x11_back->WM_DELETE_WINDOW =
-    _x11_query_atom(x11_back->c, "WM_DELETE_WINDOW");
-  x11_back->WM_TAKE_FOCUS =
-    _x11_query_atom(x11_back->c, "WM_TAKE_FOCUS");
-  x11_back->WM_CLIENT_LEADER =
-    _x11_query_atom(x11_back->c, "WM_CLIENT_LEADER");
-  x11_back->UTF8_STRING =
-    _x11_query_atom(x11_back->c, "UTF8_STRING");
-  x11_back->_NET_WM_NAME =
-    _x11_query_atom(x11_back->c, "_NET_WM_NAME");
-  x11_back->_NET_WM_ICON_NAME =
-    _x11_query_atom(x11_back->c, "_NET_WM_ICON_NAME");
-  x11_back->_NET_WM_PID =
-    _x11_query_atom(x11_back->c, "_NET_WM_PID");
-  x11_back->_NET_WM_PING =
-    _x11_query_atom(x11_back->c, "_NET_WM_PING");
-  x11_back->_NET_WM_SYNC_REQUEST =
-    _x11_query_atom(x11_back->c, "_NET_WM_SYNC_REQUEST");
-  x11_back->_NET_WM_USER_TIME_WINDOW =
-    _x11_query_atom(x11_back->c, "_NET_WM_USER_TIME_WINDOW");
-  x11_back->_MOTIF_WM_HINTS =
-    _x11_query_atom(x11_back->c, "_MOTIF_WM_HINTS");
-  x11_back->_NET_WM_WINDOW_TYPE =
-    _x11_query_atom(x11_back->c, "_NET_WM_WINDOW_TYPE");
-  x11_back->_NET_WM_WINDOW_TYPE_SPLASH =
-    _x11_query_atom(x11_back->c, "_NET_WM_WINDOW_TYPE_SPLASH");
+  for (size_t i = 0; i < nb_atoms; ++i) {
+    xcb_intern_atom_reply_t *atom_reply =
+      xcb_intern_atom_reply(x11_back->c, atoms[i].cookie, NULL);
+    *atoms[i].atom = XCB_ATOM_NONE;
+    if (atom_reply) {
+      *atoms[i].atom = atom_reply->atom;
+      free(atom_reply);
+    }
+  }
 
 /*
 _NET_WM_WINDOW_TYPE_DESKTOP       disappears
@@ -422,23 +412,21 @@ _x11_render_all_windows(
 {
   assert(x11_back != NULL);
 
+  defer_process();
+
   event_t evt;
   x11_window_t *w = NULL;
-  hashtable_iterator_t *i = NULL;
 
   evt.type = EVENT_FRAME;
   evt.time = x11_get_time();
-  i = ht_get_iterator(x11_back->wid_to_win);
-  if (i != NULL) {
-    while ((w = (x11_window_t *)ht_iterator_next(i)) != NULL) {
-      if (w->base.visible == true) {
-        evt.target = (void *)w;
-        if (event_notify(x11_back->listener, &evt)) {
-          _x11_present_window(w);
-        }
+  hashtable_iterator_t i = ht_get_iterator(x11_back->wid_to_win);
+  while ((w = (x11_window_t *)ht_iterator_next(&i)) != NULL) {
+    if (w->base.visible == true) {
+      evt.target = (void *)w;
+      if (event_notify(x11_back->listener, &evt)) {
+        _x11_present_window(w);
       }
     }
-    ht_free_iterator(i);
   }
 }
 
@@ -487,13 +475,10 @@ x11_backend_run(
   xcb_event_t e;
   uint8_t event_type;
   event_t evt;
-  fd_set fds;
 
   struct timespec ts_current = { .tv_sec = 0, .tv_nsec = 0 };
   struct timespec ts_next_frame = { .tv_sec = 0, .tv_nsec = 0 };
-  struct timeval tv_frame_timeout = { .tv_sec = 0, .tv_usec = 0 };
-
-  FD_ZERO(&fds);
+  int64_t frame_timeout = 0;
 
   clock_gettime(CLOCK_MONOTONIC, &ts_next_frame);
 
@@ -748,21 +733,18 @@ x11_backend_run(
     } else {
       /* Update remaining time to wait */
       clock_gettime(CLOCK_MONOTONIC, &ts_current);
-      tv_frame_timeout.tv_usec =
+      frame_timeout =
         (ts_next_frame.tv_sec - ts_current.tv_sec) * 1000000 +
         (ts_next_frame.tv_nsec - ts_current.tv_nsec) / 1000;
 
-      /* Wait for new events or frame */
-      if (tv_frame_timeout.tv_usec > 0) {
-        FD_SET(x11_back->fd, &fds);
-      };
-      if ((tv_frame_timeout.tv_usec <= 0) ||
-          (select(1, &fds, NULL, NULL, &tv_frame_timeout) == 0)) {
+      /* Wait for new events, watched descriptors, timers or frame */
+      if ((frame_timeout <= 0) ||
+          (unx_watch_wait(x11_back->fd, frame_timeout, NULL) == false)) {
         _x11_render_all_windows();
 
         /* Compute time until next frame, skip frames if needed */
         do {
-          ts_next_frame.tv_nsec += 1000000000 / 60;
+          ts_next_frame.tv_nsec += frame_get_interval() * 1000;
           if (ts_next_frame.tv_nsec >= 1000000000) {
             ts_next_frame.tv_nsec -= 1000000000;
             ts_next_frame.tv_sec += 1;
@@ -19,6 +19,7 @@
 #include <xcb/xcb.h>
 
 #include "../event.h"
+#include "x11_keyboard.h"
 #include "x11_backend_internal.h"
 
 /* keycode -> keyname -> universalkeycode */
@@ -310,30 +311,55 @@ _x11_keyname_to_keycode(
   return KEY_UNDEFINED;
 }
 
-void
-x11_keyboard_refresh(
+x11_keyboard_cookies_t
+x11_keyboard_request(
   void)
 {
   assert(x11_back != NULL);
   assert(x11_back->c != NULL);
 
+  x11_keyboard_cookies_t cookies;
+
   /* Request key map */
-  xcb_xkb_get_map_cookie_t xkb_gm_cookie =
+  cookies.get_map =
     xcb_xkb_get_map(x11_back->c, XCB_XKB_ID_USE_CORE_KBD,
       XCB_XKB_MAP_PART_KEY_SYMS | XCB_XKB_MAP_PART_KEY_TYPES, 0, 0, 0, 0,
       0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
 
   /* Request key names */
-  xcb_xkb_get_names_cookie_t xkb_gn_cookie =
+  cookies.get_names =
     xcb_xkb_get_names(x11_back->c,
                       XCB_XKB_ID_USE_CORE_KBD,
                       XCB_XKB_NAME_DETAIL_KEY_NAMES);
 
+  return cookies;
+}
 
-  /* Process key map */
+bool
+x11_keyboard_process(
+  x11_keyboard_cookies_t cookies)
+{
+  assert(x11_back != NULL);
+  assert(x11_back->c != NULL);
+
+  /* Fetch both replies before changing anything, so that
+     a failure leaves the current key map and names in place */
 
   xcb_xkb_get_map_reply_t *xkb_gm_rep =
-    xcb_xkb_get_map_reply(x11_back->c, xkb_gm_cookie, NULL);
+    xcb_xkb_get_map_reply(x11_back->c, cookies.get_map, NULL);
+  xcb_xkb_get_names_reply_t *xkb_gn_rep =
+    xcb_xkb_get_names_reply(x11_back->c, cookies.get_names, NULL);
+  if ((xkb_gm_rep == NULL) || (xkb_gn_rep == NULL)) {
+    if (xkb_gm_rep != NULL) {
+      free(xkb_gm_rep);
+    }
+    if (xkb_gn_rep != NULL) {
+      free(xkb_gn_rep);
+    }
+    return false;
+  }
+
+  /* Process key map */
 
   if (x11_back->xkb_get_map_reply != NULL) {
     free(x11_back->xkb_get_map_reply);
@@ -395,9 +421,6 @@ x11_keyboard_refresh(
 
   /* Process key names */
 
-  xcb_xkb_get_names_reply_t *xkb_gn_rep =
-    xcb_xkb_get_names_reply(x11_back->c, xkb_gn_cookie, NULL);
-
   xcb_xkb_get_names_value_list_t nvl;
 
   xcb_xkb_get_names_value_list_unpack(
@@ -420,6 +443,15 @@ x11_keyboard_refresh(
   }
 
   free(xkb_gn_rep);
+
+  return true;
+}
+
+bool
+x11_keyboard_refresh(
+  void)
+{
+  return x11_keyboard_process(x11_keyboard_request());
 }
 
 key_code_t
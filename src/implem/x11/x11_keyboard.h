@@ -11,11 +11,31 @@
 #ifndef __X11_KEYBOARD_H
 #define __X11_KEYBOARD_H
 
+#include <stdbool.h>
+
 #include <xcb/xcb.h>
+#include <xcb/xkb.h>
 
 #include "../event.h"
 
-void
+typedef struct x11_keyboard_cookies_t {
+  xcb_xkb_get_map_cookie_t get_map;
+  xcb_xkb_get_names_cookie_t get_names;
+} x11_keyboard_cookies_t;
+
+// Sends the key map and key names requests, so that other
+// requests can be issued before waiting for their replies
+x11_keyboard_cookies_t
+x11_keyboard_request(
+  void);
+
+// Waits for the replies and updates the keyboard mapping;
+// returns false (keeping the previous mapping) on failure
+bool
+x11_keyboard_process(
+  x11_keyboard_cookies_t cookies);
+
+bool
 x11_keyboard_refresh(
   void);
 
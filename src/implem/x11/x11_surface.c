@@ -21,6 +21,7 @@
 
 #include "../config.h"
 #include "../color.h"
+#include "../pixmap.h"
 #include "x11_backend_internal.h"
 #include "x11_window.h"
 #include "x11_target.h"
@@ -115,58 +116,44 @@ surface_destroy_x11_impl(
   }
 }
 
-static void
-_raw_surface_copy(
-  color_t_ *s_data,
-  int32_t s_width,
-  int32_t s_height,
-  color_t_ *d_data,
-  int32_t d_width,
-  int32_t d_height)
-{
-  assert(s_data != NULL);
-  assert(s_width > 0);
-  assert(s_height > 0);
-  assert(d_data != NULL);
-  assert(d_width > 0);
-  assert(d_height > 0);
-  uint32_t min_width = d_width < s_width ? d_width : s_width;
-  uint32_t min_height = d_height < s_height ? d_height : s_height;
-  for (size_t i = 0; i < min_height; ++i) {
-    for (size_t j = 0; j < min_width; ++j) {
-      d_data[i * d_width + j] = s_data[i * s_width + j];
-    }
-  }
-}
-
 bool
 surface_resize_x11_impl(
   surface_impl_x11_t *impl,
   int32_t s_width,
   int32_t s_height,
+  int32_t s_stride,
   color_t_ **s_data,
   int32_t d_width,
   int32_t d_height,
+  int32_t d_stride,
+  int32_t d_rows,
   color_t_ **d_data)
 {
   assert(impl != NULL);
   assert(s_width > 0);
   assert(s_height  > 0);
+  assert(s_stride >= s_width);
   assert(s_data != NULL);
   assert(*s_data != NULL);
   assert(d_width > 0);
   assert(d_height  > 0);
+  assert(d_stride >= d_width);
+  assert(d_rows >= d_height);
   assert(d_data != NULL);
   assert(*d_data == NULL);
 
+  /* The image is allocated at its full capacity,
+     but only the visible rows are ever sent */
   xcb_image_t *img = _surface_create_x11_image(x11_back->c,
                                                x11_back->screen->root_depth,
-                                               d_width, d_height, d_data);
+                                               d_stride, d_rows, d_data);
   if (img == NULL) {
     return false;
   }
 
-  _raw_surface_copy(*s_data, s_width, s_height, *d_data, d_width, d_height);
+  pixmap_t sp = pixmap_strided(s_width, s_height, s_stride, *s_data);
+  pixmap_t dp = pixmap_strided(d_width, d_height, d_stride, *d_data);
+  pixmap_blit(&dp, 0, 0, &sp, 0, 0, d_width, d_height);
 
   if (impl->img) {
     xcb_image_destroy(impl->img);
@@ -190,7 +177,12 @@ surface_present_x11_impl(
   assert(width > 0);
   assert(height  > 0);
 
-  xcb_image_put(x11_back->c, impl->wid, impl->cid, impl->img, 0, 0, 0);
+  assert(impl->img != NULL);
+  assert(height <= impl->img->height);
+
+  xcb_put_image(x11_back->c, impl->img->format, impl->wid, impl->cid,
+                impl->img->width, height, 0, 0, 0, impl->img->depth,
+                impl->img->stride * height, impl->img->data);
   xcb_flush(x11_back->c);
 }
 
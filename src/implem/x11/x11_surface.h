@@ -38,9 +38,12 @@ surface_resize_x11_impl(
   surface_impl_x11_t *impl,
   int32_t s_width,
   int32_t s_height,
+  int32_t s_stride,
   color_t_ **s_data,
   int32_t d_width,
   int32_t d_height,
+  int32_t d_stride,
+  int32_t d_rows,
   color_t_ **d_data);
 
 void
@@ -344,8 +344,85 @@ module V1 = struct
                       p''.status <- Alias p'
         ) cb
 
+    (* Promises in ps are watched concurrently, so that
+       the result is rejected as soon as one of them is *)
+    let all ps =
+      match ps with
+      | [] -> return []
+      | _ ->
+          let p = create () in
+          let values = Array.make (List.length ps) None in
+          let remaining = ref (List.length ps) in
+          let pending () =
+            match (resolve_alias p).status with
+            | Pending _ -> true
+            | _ -> false
+          in
+          let fulfill () =
+            resolve p (Fulfill (Array.fold_right (fun v l ->
+                match v with Some v -> v :: l | None -> assert false
+              ) values []))
+          in
+          List.iteri (fun i pi ->
+              ignore (bind pi (fun v ->
+                  values.(i) <- Some v;
+                  decr remaining;
+                  if !remaining = 0 && pending () then fulfill ();
+                  return ()));
+              ignore (catch (fun () -> pi) (fun e ->
+                  if pending () then resolve p (Reject e);
+                  return ()))
+            ) ps;
+          p
+
     let () = Callback.register "ml_canvas_promise_resolve" resolve
 
+    (* Lets the stubs reject promises with Failure *)
+    let () = Callback.register_exception "ml_canvas_failure" (Failure "")
+
+  end
+
+  module PNG = struct
+
+    type filter =
+      | Adaptive
+      | NoFilter
+      | Sub
+      | Up
+      | Average
+      | Paeth
+
+    type strategy =
+      | Default
+      | Filtered
+      | HuffmanOnly
+      | RLE
+      | Fixed
+
+    type options = {
+      level: int;
+      filter: filter;
+      strategy: strategy;
+      parallel: bool;
+    }
+
+    let default_options = {
+      level = -1;
+      filter = Adaptive;
+      strategy = Default;
+      parallel = false;
+    }
+
+    let fast_options = {
+      level = 1;
+      filter = Sub;
+      strategy = RLE;
+      parallel = false;
+    }
+
+    type buffer =
+      (int, Bigarray.int8_unsigned_elt, Bigarray.c_layout) Bigarray.Array1.t
+
   end
 
   module ImageData = struct
@@ -362,15 +439,24 @@ module V1 = struct
     external createFromPNG : string -> t Promise.t
       = "ml_canvas_image_data_create_from_png"
 
+    let createFromPNGs filenames =
+      Promise.all (List.map createFromPNG filenames)
+
     external getSize : t -> (int * int)
       = "ml_canvas_image_data_get_size"
 
+    external release : t -> unit
+      = "ml_canvas_image_data_release"
+
     external fill : t -> Color.t -> unit
       = "ml_canvas_image_data_fill"
 
     external sub : t -> pos:(int * int) -> size:(int * int) -> t
       = "ml_canvas_image_data_sub"
 
+    let subRows id ~y ~height =
+      Bigarray.Array3.sub_left id y height
+
     external blit :
       dst:t -> dpos:(int * int) ->
       src:t -> spos:(int * int) -> size:(int * int) -> unit
@@ -385,9 +471,35 @@ module V1 = struct
     external importPNG : t -> pos:(int * int) -> string -> unit Promise.t
       = "ml_canvas_image_data_import_png"
 
-    external exportPNG : t -> string -> unit
+    external exportPNGRaw : t -> string -> PNG.options -> unit
       = "ml_canvas_image_data_export_png"
 
+    let exportPNG ?(options = PNG.default_options) id filename =
+      exportPNGRaw id filename options
+
+    external exportPNGToBytesRaw : t -> PNG.options -> Bytes.t
+      = "ml_canvas_image_data_export_png_to_bytes"
+
+    let exportPNGToBytes ?(options = PNG.default_options) id =
+      exportPNGToBytesRaw id options
+
+    external exportPNGToBufferRaw : t -> PNG.options -> PNG.buffer
+      = "ml_canvas_image_data_export_png_to_buffer"
+
+    let exportPNGToBuffer ?(options = PNG.default_options) id =
+      exportPNGToBufferRaw id options
+
+    let snapshotHeaderSize = 16
+
+    external createFromSnapshot : string -> t
+      = "ml_canvas_image_data_create_from_snapshot"
+
+    external importSnapshot : t -> pos:(int * int) -> string -> unit
+      = "ml_canvas_image_data_import_snapshot"
+
+    external exportSnapshot : t -> string -> unit
+      = "ml_canvas_image_data_export_snapshot"
+
   end
 
   module Gradient = struct
@@ -427,6 +539,19 @@ module V1 = struct
     external lineTo : t -> Point.t -> unit
       = "ml_canvas_path_line_to"
 
+    external addPointsGen :
+      t -> (int, Bigarray.int8_unsigned_elt, Bigarray.c_layout)
+             Bigarray.Array1.t option ->
+      (float, Bigarray.float64_elt, Bigarray.c_layout) Bigarray.Genarray.t ->
+      unit
+      = "ml_canvas_path_add_points"
+
+    let addPoints p ?moves points =
+      addPointsGen p moves (Bigarray.genarray_of_array1 points)
+
+    let addPoints2 p ?moves points =
+      addPointsGen p moves (Bigarray.genarray_of_array2 points)
+
     external arc :
       t -> center:Point.t -> radius:float ->
       theta1:float -> theta2:float -> ccw:bool -> unit
@@ -517,6 +642,218 @@ module V1 = struct
 
   end
 
+  module CommandBuffer = struct
+
+    type data =
+      (float, Bigarray.float64_elt, Bigarray.c_layout) Bigarray.Array1.t
+
+    type t = {
+      mutable data : data;
+      mutable length : int;
+    }
+
+    let create ?(capacity = 1024) () =
+      let data = Bigarray.Array1.create Bigarray.float64
+                   Bigarray.c_layout (max capacity 16) in
+      { data; length = 0 }
+
+    let clear b =
+      b.length <- 0
+
+    let length b =
+      b.length
+
+    let reserve b n =
+      let capacity = Bigarray.Array1.dim b.data in
+      if b.length + n > capacity then begin
+        let data = Bigarray.Array1.create Bigarray.float64
+                     Bigarray.c_layout (max (2 * capacity) (b.length + n)) in
+        Bigarray.Array1.blit (Bigarray.Array1.sub b.data 0 b.length)
+          (Bigarray.Array1.sub data 0 b.length);
+        b.data <- data
+      end
+
+    (* Must be preceded by a reserve covering the whole command *)
+    let push b x =
+      Bigarray.Array1.unsafe_set b.data b.length x;
+      b.length <- b.length + 1
+
+    (* Opcodes, see implem/command.h *)
+
+    let op0 b op =
+      reserve b 1; push b op
+
+    let op1 b op x =
+      reserve b 2; push b op; push b x
+
+    let op2 b op (x, y) =
+      reserve b 3; push b op; push b x; push b y
+
+    let op4 b op (x1, y1) (x2, y2) =
+      reserve b 5; push b op; push b x1; push b y1; push b x2; push b y2
+
+    let op_transform b op { Transform.a; b = tb; c; d; e; f } =
+      reserve b 7; push b op;
+      push b a; push b tb; push b c; push b d; push b e; push b f
+
+    let of_bool x =
+      if x then 1.0 else 0.0
+
+    let of_color c =
+      Int32.to_float (Color.to_int32 c)
+
+    let save b =
+      op0 b 0.0
+
+    let restore b =
+      op0 b 1.0
+
+    let setTransform b t =
+      op_transform b 2.0 t
+
+    let transform b t =
+      op_transform b 3.0 t
+
+    let translate b v =
+      op2 b 4.0 v
+
+    let scale b v =
+      op2 b 5.0 v
+
+    let shear b v =
+      op2 b 6.0 v
+
+    let rotate b a =
+      op1 b 7.0 a
+
+    let setLineWidth b w =
+      op1 b 8.0 w
+
+    let setLineJoin b j =
+      op1 b 9.0 (match j with
+                 | Join.Round -> 0.0
+                 | Join.Miter -> 1.0
+                 | Join.Bevel -> 2.0)
+
+    let setLineCap b c =
+      op1 b 10.0 (match c with
+                  | Cap.Butt -> 0.0
+                  | Cap.Square -> 1.0
+                  | Cap.Round -> 2.0)
+
+    let setMiterLimit b l =
+      op1 b 11.0 l
+
+    let setLineDashOffset b o =
+      op1 b 12.0 o
+
+    let setStrokeColor b c =
+      op1 b 13.0 (of_color c)
+
+    let setFillColor b c =
+      op1 b 14.0 (of_color c)
+
+    let setGlobalAlpha b a =
+      op1 b 15.0 a
+
+    let setGlobalCompositeOperation b o =
+      op1 b 16.0 (match o with
+                  | CompositeOp.SourceOver -> 0.0
+                  | CompositeOp.SourceIn -> 1.0
+                  | CompositeOp.SourceOut -> 2.0
+                  | CompositeOp.SourceAtop -> 3.0
+                  | CompositeOp.DestinationOver -> 4.0
+                  | CompositeOp.DestinationIn -> 5.0
+                  | CompositeOp.DestinationOut -> 6.0
+                  | CompositeOp.DestinationAtop -> 7.0
+                  | CompositeOp.Lighter -> 8.0
+                  | CompositeOp.Copy -> 9.0
+                  | CompositeOp.XOR -> 10.0
+                  | CompositeOp.Multiply -> 11.0
+                  | CompositeOp.Screen -> 12.0
+                  | CompositeOp.Overlay -> 13.0
+                  | CompositeOp.Darken -> 14.0
+                  | CompositeOp.Lighten -> 15.0
+                  | CompositeOp.ColorDodge -> 16.0
+                  | CompositeOp.ColorBurn -> 17.0
+                  | CompositeOp.HardLight -> 18.0
+                  | CompositeOp.SoftLight -> 19.0
+                  | CompositeOp.Difference -> 20.0
+                  | CompositeOp.Exclusion -> 21.0
+                  | CompositeOp.Hue -> 22.0
+                  | CompositeOp.Saturation -> 23.0
+                  | CompositeOp.Color -> 24.0
+                  | CompositeOp.Luminosity -> 25.0)
+
+    let setShadowColor b c =
+      op1 b 17.0 (of_color c)
+
+    let setShadowBlur b s =
+      op1 b 18.0 s
+
+    let setShadowOffset b o =
+      op2 b 19.0 o
+
+    let clearPath b =
+      op0 b 20.0
+
+    let closePath b =
+      op0 b 21.0
+
+    let moveTo b p =
+      op2 b 22.0 p
+
+    let lineTo b p =
+      op2 b 23.0 p
+
+    let arc b ~center:(x, y) ~radius ~theta1 ~theta2 ~ccw =
+      reserve b 7; push b 24.0;
+      push b x; push b y; push b radius;
+      push b theta1; push b theta2; push b (of_bool ccw)
+
+    let arcTo b ~p1:(x1, y1) ~p2:(x2, y2) ~radius =
+      reserve b 6; push b 25.0;
+      push b x1; push b y1; push b x2; push b y2; push b radius
+
+    let quadraticCurveTo b ~cp ~p =
+      op4 b 26.0 cp p
+
+    let bezierCurveTo b ~cp1:(x1, y1) ~cp2:(x2, y2) ~p:(x, y) =
+      reserve b 7; push b 27.0;
+      push b x1; push b y1; push b x2; push b y2; push b x; push b y
+
+    let rect b ~pos ~size =
+      op4 b 28.0 pos size
+
+    let ellipse b ~center:(x, y) ~radius:(rx, ry)
+          ~rotation ~theta1 ~theta2 ~ccw =
+      reserve b 9; push b 29.0;
+      push b x; push b y; push b rx; push b ry; push b rotation;
+      push b theta1; push b theta2; push b (of_bool ccw)
+
+    let fill b ~nonzero =
+      op1 b 30.0 (of_bool nonzero)
+
+    let stroke b =
+      op0 b 31.0
+
+    let clip b ~nonzero =
+      op1 b 32.0 (of_bool nonzero)
+
+    let fillRect b ~pos ~size =
+      op4 b 33.0 pos size
+
+    let strokeRect b ~pos ~size =
+      op4 b 34.0 pos size
+
+  end
+
+  module Picture = struct
+
+    type t
+
+  end
+
   module Canvas = struct
 
     type 'kind t
@@ -581,6 +918,9 @@ module V1 = struct
     external createOffscreenFromPNG : string -> [> `Offscreen] t Promise.t
       = "ml_canvas_create_offscreen_from_png"
 
+    external createOffscreenFromSnapshot : string -> [> `Offscreen] t
+      = "ml_canvas_create_offscreen_from_snapshot"
+
     (* Visibility *)
 
     external show : [< `Onscreen] t -> unit
@@ -592,11 +932,51 @@ module V1 = struct
     external close : [> `Onscreen] t -> unit
       = "ml_canvas_close"
 
+    external destroy : 'kind t -> unit
+      = "ml_canvas_destroy"
+
     (* Configuration *)
 
     external getId : 'kind t -> int
       = "ml_canvas_get_id"
 
+    external getFrameOnDemand : 'kind t -> bool
+      = "ml_canvas_get_frame_on_demand"
+
+    external setFrameOnDemand : 'kind t -> bool -> unit
+      = "ml_canvas_set_frame_on_demand"
+
+    external requestFrame : 'kind t -> unit
+      = "ml_canvas_request_frame"
+
+    type stats = {
+      poly_renders: int;
+      vertices: int;
+      pixels_covered: int;
+      pixels_composited: int;
+      glyphs: int;
+      presents: int;
+      bytes_uploaded: int;
+      polygonize_time: float;
+      offset_time: float;
+      rasterize_time: float;
+      composite_time: float;
+      blur_time: float;
+      present_time: float;
+    }
+
+    external setStatsEnabled : 'kind t -> bool -> unit
+      = "ml_canvas_set_stats_enabled"
+
+    external getStatsEnabled : 'kind t -> bool
+      = "ml_canvas_get_stats_enabled"
+
+    external getStats : 'kind t -> stats
+      = "ml_canvas_get_stats"
+
+    external resetStats : 'kind t -> unit
+      = "ml_canvas_reset_stats"
+
     external getSize : 'kind t -> (int * int)
       = "ml_canvas_get_size"
 
@@ -759,6 +1139,19 @@ module V1 = struct
     external lineTo : 'kind t -> Point.t -> unit
       = "ml_canvas_line_to"
 
+    external polylineGen :
+      'kind t -> (int, Bigarray.int8_unsigned_elt, Bigarray.c_layout)
+                   Bigarray.Array1.t option ->
+      (float, Bigarray.float64_elt, Bigarray.c_layout) Bigarray.Genarray.t ->
+      unit
+      = "ml_canvas_polyline"
+
+    let polyline c ?moves points =
+      polylineGen c moves (Bigarray.genarray_of_array1 points)
+
+    let polyline2 c ?moves points =
+      polylineGen c moves (Bigarray.genarray_of_array2 points)
+
     external arc :
       'kind t -> center:Point.t -> radius:float ->
       theta1:float -> theta2:float -> ccw:bool -> unit
@@ -819,6 +1212,50 @@ module V1 = struct
       src:'kind2 t -> spos:(int * int) -> size:(int * int) -> unit
       = "ml_canvas_blit"
 
+    type sprites =
+      (float, Bigarray.float64_elt, Bigarray.c_layout) Bigarray.Array2.t
+
+    external blitBatchRaw :
+      'kind1 t -> 'kind2 t -> sprites -> bool -> unit
+      = "ml_canvas_blit_batch"
+
+    let blitBatch ?(reorder = false) ~dst ~src sprites =
+      blitBatchRaw dst src sprites reorder
+
+    (* Batched drawing *)
+
+    external executeRaw : 'kind t -> CommandBuffer.data -> int -> unit
+      = "ml_canvas_execute"
+
+    let execute c b =
+      executeRaw c b.CommandBuffer.data b.CommandBuffer.length
+
+    external setThreaded : 'kind t -> bool -> unit
+      = "ml_canvas_set_threaded"
+
+    external getThreaded : 'kind t -> bool
+      = "ml_canvas_get_threaded"
+
+    external submitRaw : 'kind t -> CommandBuffer.data -> int -> unit
+      = "ml_canvas_submit"
+
+    let submit c b =
+      submitRaw c b.CommandBuffer.data b.CommandBuffer.length
+
+    (* Pictures *)
+
+    external beginPicture : 'kind t -> unit
+      = "ml_canvas_begin_picture"
+
+    external endPicture : 'kind t -> Picture.t
+      = "ml_canvas_end_picture"
+
+    external drawPictureRaw : 'kind t -> Transform.t option -> Picture.t -> unit
+      = "ml_canvas_draw_picture"
+
+    let drawPicture ?transform c pic =
+      drawPictureRaw c transform pic
+
     (* Direct pixel access *)
 
     external getPixel : 'kind t -> (int * int) -> Color.t
@@ -831,6 +1268,15 @@ module V1 = struct
       'kind t -> pos:(int * int) -> size:(int * int) -> ImageData.t
       = "ml_canvas_get_image_data"
 
+    external getImageDataViewRaw : 'kind t -> ImageData.t * bool
+      = "ml_canvas_get_image_data_view"
+
+    let getImageDataView c =
+      let view, fresh = getImageDataViewRaw c in
+      (* The view does not own its data, so keep the canvas alive *)
+      if fresh then Gc.finalise (fun _ -> ignore (Sys.opaque_identity c)) view;
+      view
+
     external putImageData :
       'kind t -> dpos:(int * int) -> ImageData.t ->
       spos:(int * int) -> size:(int * int) -> unit
@@ -839,9 +1285,30 @@ module V1 = struct
     external importPNG : 'kind t -> pos:(int * int) -> string -> unit Promise.t
       = "ml_canvas_import_png"
 
-    external exportPNG : 'kind t -> string -> unit
+    external exportPNGRaw : 'kind t -> string -> PNG.options -> unit
       = "ml_canvas_export_png"
 
+    let exportPNG ?(options = PNG.default_options) c filename =
+      exportPNGRaw c filename options
+
+    external exportPNGToBytesRaw : 'kind t -> PNG.options -> Bytes.t
+      = "ml_canvas_export_png_to_bytes"
+
+    let exportPNGToBytes ?(options = PNG.default_options) c =
+      exportPNGToBytesRaw c options
+
+    external exportPNGToBufferRaw : 'kind t -> PNG.options -> PNG.buffer
+      = "ml_canvas_export_png_to_buffer"
+
+    let exportPNGToBuffer ?(options = PNG.default_options) c =
+      exportPNGToBufferRaw c options
+
+    external importSnapshot : 'kind t -> pos:(int * int) -> string -> unit
+      = "ml_canvas_import_snapshot"
+
+    external exportSnapshot : 'kind t -> string -> unit
+      = "ml_canvas_export_snapshot"
+
   end
 
   module Event = struct
@@ -1123,6 +1590,7 @@ module V1 = struct
       | Quartz : [`OSX] backend_type
       | X11 : [<`Unix | `OSX | `Win32] backend_type
       | Wayland : [`Unix] backend_type
+      | Headless : [<`Unix | `OSX | `Win32] backend_type
 
     type options = {
       js_backends: [`JS] backend_type list;
@@ -1146,15 +1614,74 @@ module V1 = struct
       ('state -> 'dummy1) -> 'state -> 'dummy2
       = "ml_canvas_run"
 
+    external runBatched :
+      ('state -> Event.t list -> 'state * bool) ->
+      ('state -> 'dummy1) -> 'state -> 'dummy2
+      = "ml_canvas_run_batched"
+
     external stop : unit -> unit
       = "ml_canvas_stop"
 
     external getCurrentTimestamp : unit -> Event.timestamp
       = "ml_canvas_get_current_timestamp"
 
+    external setFrameRate : int -> unit
+      = "ml_canvas_set_frame_rate"
+
+    external getFrameRate : unit -> int
+      = "ml_canvas_get_frame_rate"
+
+    external setEventCoalescing : bool -> unit
+      = "ml_canvas_set_event_coalescing"
+
+    external getEventCoalescing : unit -> bool
+      = "ml_canvas_get_event_coalescing"
+
+    external startTrace : string -> unit
+      = "ml_canvas_start_trace"
+
+    external stopTrace : unit -> unit
+      = "ml_canvas_stop_trace"
+
     external getCanvas : int -> 'kind Canvas.t option
       = "ml_canvas_get_canvas"
 
+    type watch = int
+
+    type fd_ready = {
+      watch: watch;
+      readable: bool;
+      writable: bool;
+    }
+
+    type Event.payload +=
+      | FdReady of fd_ready
+      | TimerExpired of watch
+
+    external watchFd : int -> bool -> bool -> watch
+      = "ml_canvas_watch_fd"
+
+    let watchFd ?(read = true) ?(write = false) fd =
+      watchFd fd read write
+
+    external startTimer : Int64.t -> Int64.t -> watch
+      = "ml_canvas_watch_timer"
+
+    let startTimer ?(period = 0L) delay =
+      startTimer delay period
+
+    external unwatch : watch -> unit
+      = "ml_canvas_unwatch"
+
+    let () =
+      Callback.register "ml_canvas_watch_event" (fun watch flags ->
+          let payload =
+            if flags land 4 <> 0 then TimerExpired watch
+            else FdReady { watch; readable = flags land 1 <> 0;
+                           writable = flags land 2 <> 0 }
+          in
+          Event.Custom { timestamp = getCurrentTimestamp (); payload })
+
     let pending_custom = ref []
 
     let sendCustomEvent payload =
@@ -1176,6 +1703,24 @@ module V1 = struct
       let k s = k s in
       run h k s
 
+    let runBatched h k s =
+      let h s el =
+        let s, b = h s el in
+        let pc = List.rev !pending_custom in
+        pending_custom := [];
+        let s =
+          match pc with
+          | [] -> s
+          | pc ->
+              let timestamp = getCurrentTimestamp () in
+              fst (h s (List.map (fun p ->
+                           Event.Custom { timestamp; payload = p }) pc))
+        in
+        s, b
+      in
+      let k s = k s in
+      runBatched h k s
+
   end
 
 end
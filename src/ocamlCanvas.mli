@@ -54,6 +54,14 @@
     styling elements can be saved and restored to/from a state stack
     using the functions {!Canvas.save} and {!Canvas.restore}.
 
+    Rendering onto offscreen canvases ({!Canvas.fill}, {!Canvas.stroke},
+    {!Canvas.fillText}, {!Canvas.blit}, {!Canvas.exportPNG}, ...) releases
+    the OCaml runtime while the actual work is performed, so that several
+    threads or domains may each draw onto their own offscreen canvases in
+    parallel. A given canvas must however not be used by several threads
+    at once, and onscreen canvases should only be drawn from the thread
+    running the event loop.
+
     Once the canvases are ready, we may start handling events for these canvases.
     To do so, we use the {!Backend.run} function, which runs an event loop.
     This function MUST be the last instruction of the program. It takes three
@@ -440,12 +448,66 @@ module V1 : sig
     val bind : 'a t -> ('a -> 'b t) -> 'b t
     (** [bind p f] attaches the callback [f] to promise [p]  *)
 
+    val all : 'a t list -> 'a list t
+    (** [all ps] returns a promise fulfilled with the values of all
+        promises in [ps], in order, or rejected as soon as one is *)
+
     val catch : (unit -> 'a t) -> (exn -> 'a t) -> 'a t
     (** [catch f h] calls [f], returning a promise, and sets [h]
         to be called if that promise becomes rejected *)
 
   end
 
+  module PNG : sig
+  (** PNG encoding options *)
+
+    type filter =
+      | Adaptive
+      | NoFilter
+      | Sub
+      | Up
+      | Average
+      | Paeth (**)
+    (** Row filters applied before compression. [Adaptive] lets the
+        encoder pick the best filter for each row, while [NoFilter]
+        is the fastest choice, at the expense of a larger output *)
+
+    type strategy =
+      | Default
+      | Filtered
+      | HuffmanOnly
+      | RLE
+      | Fixed (**)
+    (** Deflate compression strategies *)
+
+    type options = {
+      level: int;
+      filter: filter;
+      strategy: strategy;
+      parallel: bool;
+    }
+    (** PNG encoding options. The compression [level] ranges from
+        0 (no compression) to 9 (best compression), -1 selecting the
+        encoder default. When [parallel] is set, strips of rows are
+        filtered and compressed on all available processors, which
+        greatly speeds up the export of large images, for a slightly
+        larger output. These options are only honored by backends
+        that encode PNG files themselves (X11, Wayland and Headless):
+        the others rely on the system image codecs and ignore them. *)
+
+    val default_options : options
+    (** The encoder defaults *)
+
+    val fast_options : options
+    (** Options trading size for speed (level 1, [Sub] filter,
+        [RLE] strategy), suitable for transient snapshots *)
+
+    type buffer =
+      (int, Bigarray.int8_unsigned_elt, Bigarray.c_layout) Bigarray.Array1.t
+    (** Encoded PNG data *)
+
+  end
+
   module ImageData : sig
   (** Image data manipulation functions *)
 
@@ -459,11 +521,29 @@ module V1 : sig
 
     val createFromPNG : string -> t Promise.t
     (** [createFromPNG filename] creates an image data
-        with the contents of PNG file [filename] *)
+        with the contents of PNG file [filename].
+        The file is decoded on a background thread, and the
+        promise is resolved from the event loop once done:
+        it only makes progress while {!Backend.run} runs, and
+        a decoding that completes after the loop has stopped is
+        only resolved the next time it is started.
+        It is rejected with [Failure] if decoding fails. *)
+
+    val createFromPNGs : string list -> t list Promise.t
+    (** [createFromPNGs filenames] creates an image data for each
+        of the PNG files in [filenames], decoding them concurrently *)
 
     val getSize : t -> (int * int)
     (** [getSize id] returns the size of image data [id] *)
 
+    val release : t -> unit
+    (** [release id] frees the pixels of image data [id] right away,
+        instead of waiting for the garbage collector to reclaim them;
+        [id] is then empty (its size is 0x0). Pixels shared with other
+        image data (e.g. through [Bigarray] slices) are only freed once
+        all of them are released or collected.
+        @raise Invalid_argument if [id] is a memory-mapped file *)
+
     val fill : t -> Color.t -> unit
     (** [fill id c] fills the image data [id] with the given color [c] *)
 
@@ -471,6 +551,11 @@ module V1 : sig
     (** [sub c ~pos ~size] returns a copy of the pixel data
         at position [pos] of size [size] in image data [id] *)
 
+    val subRows : t -> y:int -> height:int -> t
+    (** [subRows id ~y ~height] returns the [height] rows of image
+        data [id] starting at row [y], without copying them: the
+        result shares its storage with [id] *)
+
     val blit :
       dst:t -> dpos:(int * int) ->
       src:t -> spos:(int * int) -> size:(int * int) -> unit
@@ -488,12 +573,45 @@ module V1 : sig
 
     val importPNG : t -> pos:(int * int) -> string -> unit Promise.t
     (** [importPNG id ~pos filename] loads the file [filename]
-        into image data [id] at position [pos] *)
+        into image data [id] at position [pos]. As with
+        {!createFromPNG}, decoding happens in the background,
+        and the pixels are copied when the promise is resolved. *)
 
-    val exportPNG : t -> string -> unit
-    (** [exportPNG id filename] saves the contents of image
+    val exportPNG : ?options:PNG.options -> t -> string -> unit
+    (** [exportPNG ?options id filename] saves the contents of image
         data [id] to a file with name [filename] *)
 
+    val exportPNGToBytes : ?options:PNG.options -> t -> Bytes.t
+    (** [exportPNGToBytes ?options id] encodes the contents
+        of image data [id] as PNG, in memory *)
+
+    val exportPNGToBuffer : ?options:PNG.options -> t -> PNG.buffer
+    (** [exportPNGToBuffer ?options id] encodes the contents of image
+        data [id] as PNG, in memory. Unlike {!exportPNGToBytes}, the
+        encoded data is not copied into the OCaml heap. *)
+
+    val snapshotHeaderSize : int
+    (** Size of the header of snapshot files. Snapshots are meant
+        to be fast to write and read, rather than small: the header
+        (the ["OCNVBGRA"] signature, then the width and height as
+        little-endian 32-bit integers) is followed by the raw pixels,
+        laid out as in image data. They can thus also be mapped into
+        memory, e.g. with [Unix.map_file fd ~pos:(Int64.of_int
+        snapshotHeaderSize) Bigarray.int8_unsigned Bigarray.c_layout
+        false [| height; width; 4 |]]. *)
+
+    val createFromSnapshot : string -> t
+    (** [createFromSnapshot filename] creates an image data
+        with the contents of snapshot file [filename] *)
+
+    val importSnapshot : t -> pos:(int * int) -> string -> unit
+    (** [importSnapshot id ~pos filename] loads the snapshot file
+        [filename] into image data [id] at position [pos] *)
+
+    val exportSnapshot : t -> string -> unit
+    (** [exportSnapshot id filename] saves the contents of image
+        data [id] to a snapshot file with name [filename] *)
+
   end
 
   module Gradient : sig
@@ -542,6 +660,26 @@ module V1 : sig
     (** [lineTo p pos] adds a straight line from
         the path [p]'s brush position to [pos]. *)
 
+    val addPoints :
+      t -> ?moves:(int, Bigarray.int8_unsigned_elt, Bigarray.c_layout)
+                    Bigarray.Array1.t ->
+      (float, Bigarray.float64_elt, Bigarray.c_layout) Bigarray.Array1.t ->
+      unit
+    (** [addPoints p ?moves points] adds all the points in [points],
+        given as consecutive x and y coordinates, to the path [p].
+        The first point starts a new subpath and the other ones are
+        joined by straight lines. If [moves] is given, a point starts
+        a new subpath if and only if its flag in [moves] is non-zero.
+        This is much faster than calling {!lineTo} for each point. *)
+
+    val addPoints2 :
+      t -> ?moves:(int, Bigarray.int8_unsigned_elt, Bigarray.c_layout)
+                    Bigarray.Array1.t ->
+      (float, Bigarray.float64_elt, Bigarray.c_layout) Bigarray.Array2.t ->
+      unit
+    (** [addPoints2 p ?moves points] is the same as {!addPoints},
+        with [points] given as an N×2 array *)
+
     val arc :
       t -> center:Point.t -> radius:float ->
       theta1:float -> theta2:float -> ccw:bool -> unit
@@ -651,6 +789,82 @@ module V1 : sig
 
   end
 
+  module CommandBuffer : sig
+  (** Drawing commands recorded in bulk, to be run by {!Canvas.execute}.
+
+      Each drawing function of {!Canvas} goes through a separate call
+      into the C library, which costs about as much as a cheap drawing
+      operation. A command buffer instead stores the commands as
+      floats in a bigarray, so that they can all be run in one call.
+      The functions below record the same command as their
+      counterpart in {!Canvas}. *)
+
+    type t
+    (** A growable buffer of drawing commands *)
+
+    val create : ?capacity:int -> unit -> t
+    (** [create ?capacity ()] creates an empty command buffer, initially
+        able to hold [capacity] floats (an opcode and its arguments each
+        take one float) without growing. *)
+
+    val clear : t -> unit
+    (** [clear b] removes all commands from [b], keeping its storage *)
+
+    val length : t -> int
+    (** [length b] returns the number of floats used by [b]'s commands *)
+
+    val save : t -> unit
+    val restore : t -> unit
+    val setTransform : t -> Transform.t -> unit
+    val transform : t -> Transform.t -> unit
+    val translate : t -> (float * float) -> unit
+    val scale : t -> (float * float) -> unit
+    val shear : t -> (float * float) -> unit
+    val rotate : t -> float -> unit
+    val setLineWidth : t -> float -> unit
+    val setLineJoin : t -> Join.t -> unit
+    val setLineCap : t -> Cap.t -> unit
+    val setMiterLimit : t -> float -> unit
+    val setLineDashOffset : t -> float -> unit
+    val setStrokeColor : t -> Color.t -> unit
+    val setFillColor : t -> Color.t -> unit
+    val setGlobalAlpha : t -> float -> unit
+    val setGlobalCompositeOperation : t -> CompositeOp.t -> unit
+    val setShadowColor : t -> Color.t -> unit
+    val setShadowBlur : t -> float -> unit
+    val setShadowOffset : t -> (float * float) -> unit
+    val clearPath : t -> unit
+    val closePath : t -> unit
+    val moveTo : t -> Point.t -> unit
+    val lineTo : t -> Point.t -> unit
+    val arc :
+      t -> center:Point.t -> radius:float ->
+      theta1:float -> theta2:float -> ccw:bool -> unit
+    val arcTo : t -> p1:Point.t -> p2:Point.t -> radius:float -> unit
+    val quadraticCurveTo : t -> cp:Point.t -> p:Point.t -> unit
+    val bezierCurveTo : t -> cp1:Point.t -> cp2:Point.t -> p:Point.t -> unit
+    val rect : t -> pos:Point.t -> size:(float * float) -> unit
+    val ellipse :
+      t -> center:Point.t -> radius:(float * float) ->
+      rotation:float -> theta1:float -> theta2:float -> ccw:bool -> unit
+    val fill : t -> nonzero:bool -> unit
+    val stroke : t -> unit
+    val clip : t -> nonzero:bool -> unit
+    val fillRect : t -> pos:Point.t -> size:(float * float) -> unit
+    val strokeRect : t -> pos:Point.t -> size:(float * float) -> unit
+
+  end
+
+  module Picture : sig
+  (** Recorded drawing operations *)
+
+    type t
+    (** An abstract type representing a picture, i.e. a list of shapes
+        ready to be rasterized, as recorded by {!Canvas.beginPicture}
+        and {!Canvas.endPicture}, and replayed by {!Canvas.drawPicture} *)
+
+  end
+
   module Canvas : sig
   (** Canvas manipulation functions *)
 
@@ -748,7 +962,14 @@ module V1 : sig
 
     val createOffscreenFromPNG : string -> [> `Offscreen] t Promise.t
     (** [createOffscreen filename] creates an offscreen
-        canvas with the contents of PNG file [filename] *)
+        canvas with the contents of PNG file [filename].
+        Decoding happens in the background, see
+        {!ImageData.createFromPNG}. *)
+
+    val createOffscreenFromSnapshot : string -> [> `Offscreen] t
+    (** [createOffscreenFromSnapshot filename] creates an offscreen
+        canvas with the contents of snapshot file [filename],
+        see {!ImageData.snapshotHeaderSize} *)
 
 
     (** {1 Visibility} *)
@@ -766,12 +987,77 @@ module V1 : sig
         it from the screen and prevents it to receive events ;
         however it can still be used as an offscreen canvas. *)
 
+    val destroy : 'kind t -> unit
+    (** [destroy c] closes the canvas [c] and releases its pixels right
+        away, instead of waiting for the garbage collector to reclaim it.
+        The canvas must not be used afterwards (doing so raises [Failure],
+        except with the Javascript backend), and its image data view, if
+        any, becomes empty. When called from a handler of an event of [c],
+        the pixels are released once the handler returns. *)
+
 
     (** {1 Configuration} *)
 
     val getId : 'kind t -> int
     (** [getId c] returns the unique id of canvas [c] *)
 
+    val getFrameOnDemand : 'kind t -> bool
+    (** [getFrameOnDemand c] returns [true] if canvas [c] only receives
+        frame events when requested with {!requestFrame} *)
+
+    val setFrameOnDemand : 'kind t -> bool -> unit
+    (** [setFrameOnDemand c b] sets whether canvas [c] only receives
+        frame events when requested with {!requestFrame}. This avoids
+        redrawing and presenting static content on every frame.
+        Canvases are not on-demand by default. *)
+
+    val requestFrame : 'kind t -> unit
+    (** [requestFrame c] requests that the next frame event be sent
+        to canvas [c], if it is on-demand. Multiple requests issued
+        before the next frame result in a single frame event.
+        A frame is requested automatically when the canvas is resized. *)
+
+    type stats = {
+      poly_renders: int; (** Number of shapes rasterized *)
+      vertices: int; (** Number of polygon vertices processed *)
+      pixels_covered: int; (** Number of pixels covered by shapes *)
+      pixels_composited: int; (** Number of pixels composited *)
+      glyphs: int; (** Number of glyphs rendered *)
+      presents: int; (** Number of times the canvas was presented *)
+      bytes_uploaded: int; (** Number of bytes sent to the display *)
+      polygonize_time: float; (** Time spent turning paths into polygons *)
+      offset_time: float; (** Time spent outlining strokes *)
+      rasterize_time: float; (** Time spent computing shape coverage *)
+      composite_time: float; (** Time spent compositing shapes *)
+      blur_time: float; (** Time spent blurring shadows *)
+      present_time: float; (** Time spent presenting the canvas *)
+    }
+    (** Rendering statistics of a canvas. Times are in microseconds.
+        Shapes without shadows are composited while being rasterized,
+        in which case compositing time counts as rasterization time ;
+        likewise, long or thin strokes are rasterized while being
+        outlined. Presentation is only measured with the X11 and
+        GDI backends. *)
+
+    val setStatsEnabled : 'kind t -> bool -> unit
+    (** [setStatsEnabled c b] sets whether rendering statistics are
+        gathered for canvas [c]. They are disabled by default, in which
+        case gathering them costs close to nothing. Disabling them
+        discards the statistics gathered so far. *)
+
+    val getStatsEnabled : 'kind t -> bool
+    (** [getStatsEnabled c] returns whether rendering statistics
+        are gathered for canvas [c] *)
+
+    val getStats : 'kind t -> stats
+    (** [getStats c] returns the rendering statistics gathered for
+        canvas [c] since they were last reset (all zero if disabled,
+        or with the Javascript backend) *)
+
+    val resetStats : 'kind t -> unit
+    (** [resetStats c] resets the rendering statistics of canvas [c],
+        e.g. at the start of each frame *)
+
     val getSize : 'kind t -> (int * int)
     (** [getSize c] returns the size of canvas [c] *)
 
@@ -969,6 +1255,26 @@ module V1 : sig
     (** [lineTo c p] adds the point [p] to the current subpath of canvas [c].
         If the current subpath is empty, this behaves just like [moveTo c ~p].*)
 
+    val polyline :
+      'kind t -> ?moves:(int, Bigarray.int8_unsigned_elt, Bigarray.c_layout)
+                         Bigarray.Array1.t ->
+      (float, Bigarray.float64_elt, Bigarray.c_layout) Bigarray.Array1.t ->
+      unit
+    (** [polyline c ?moves points] adds all the points in [points], given
+        as consecutive x and y coordinates, to the path of canvas [c].
+        The first point starts a new subpath and the other ones are
+        joined by straight lines. If [moves] is given, a point starts
+        a new subpath if and only if its flag in [moves] is non-zero.
+        This is much faster than calling {!lineTo} for each point. *)
+
+    val polyline2 :
+      'kind t -> ?moves:(int, Bigarray.int8_unsigned_elt, Bigarray.c_layout)
+                         Bigarray.Array1.t ->
+      (float, Bigarray.float64_elt, Bigarray.c_layout) Bigarray.Array2.t ->
+      unit
+    (** [polyline2 c ?moves points] is the same as {!polyline},
+        with [points] given as an N×2 array *)
+
     val arc :
       'kind t -> center:Point.t -> radius:float ->
       theta1:float -> theta2:float -> ccw:bool -> unit
@@ -1060,6 +1366,93 @@ module V1 : sig
     (** [blit ~dst ~dpos ~src ~spos ~size] copies the area specified by [spos]
         and [size] from canvas [src] to canvas [dst] at position [dpos] *)
 
+    type sprites =
+      (float, Bigarray.float64_elt, Bigarray.c_layout) Bigarray.Array2.t
+    (** Sprites to draw in one go, one per row. Each row holds the
+        source area ([sx], [sy], [sw], [sh]), the destination area
+        ([dx], [dy], [dw], [dh]) and an opacity factor ([alpha]).
+        It may optionally be followed by a transform ([a], [b], [c],
+        [d], [e], [f]) applied before the canvas one: the matrix
+        thus has either 9 or 15 columns. *)
+
+    val blitBatch :
+      ?reorder:bool -> dst:'kind1 t -> src:'kind2 t -> sprites -> unit
+    (** [blitBatch ?reorder ~dst ~src sprites] draws all the [sprites]
+        from canvas [src] onto canvas [dst], scaling them if source
+        and destination sizes differ. This is much faster than
+        calling {!blit} for each sprite: sprites drawn at whole pixel
+        positions, with neither scaling nor rotation, are simply
+        composited. If [reorder] is [true] (the default is [false]),
+        sprites may be drawn in any order, which helps when there are
+        many of them and drawing order does not matter (e.g. when
+        they do not overlap). *)
+
+
+    (** {1 Batched drawing} *)
+
+    val execute : 'kind t -> CommandBuffer.t -> unit
+    (** [execute c b] runs all the commands recorded in [b] onto
+        the canvas [c], in order. The buffer is left untouched, so
+        that it may be executed again or cleared and refilled. *)
+
+    val setThreaded : 'kind t -> bool -> unit
+    (** [setThreaded c b] sets whether canvas [c] has its own render
+        thread (the default is [false]), which runs the commands given
+        to {!submit}. The commands submitted while handling a frame
+        event are rasterized while the next frame is being built: they
+        only start once the previous frame has been presented, and the
+        frame is itself presented at the next frame event. Any operation
+        on the state, path, pixels or statistics of [c] first waits for
+        the submitted commands to be run, and presents the frame awaiting
+        presentation, if any. The following do not wait: {!getSize},
+        {!getPosition}, {!setPosition}, {!getId}, {!show}, {!hide},
+        {!getFrameOnDemand}, {!setFrameOnDemand}, {!requestFrame},
+        {!getStatsEnabled}, {!getThreaded}, and pixel accesses through
+        an image data view.
+        Only available with the X11, Wayland and headless backends.
+        @raise Failure otherwise, or if the thread cannot be started *)
+
+    val getThreaded : 'kind t -> bool
+    (** [getThreaded c] returns whether canvas [c] has its own
+        render thread *)
+
+    val submit : 'kind t -> CommandBuffer.t -> unit
+    (** [submit c b] queues the commands recorded in [b] to be run by
+        the render thread of canvas [c], and returns right away: the
+        commands are copied, so [b] may be cleared and refilled at once.
+        If [c] has no render thread, this is the same as {!execute}. *)
+
+
+    (** {1 Pictures} *)
+
+    val beginPicture : 'kind t -> unit
+    (** [beginPicture c] starts recording a picture on canvas [c]: until
+        {!endPicture} is called, filling, stroking, text drawing, clipping
+        and blitting operations on [c] are recorded instead of being
+        drawn. Paths are flattened, stroked and outlined, and glyphs are
+        turned into outlines at record time, using the state of [c] at
+        that time. Direct pixel access is not recorded, nor are clips set
+        before recording started. Hairlines are recorded as outlines,
+        which may slightly differ from drawing them directly.
+
+        @raise Failure if [c] is already recording a picture *)
+
+    val endPicture : 'kind t -> Picture.t
+    (** [endPicture c] stops recording a picture on canvas [c] and returns
+        the recorded picture.
+
+        @raise Failure if [c] is not recording a picture *)
+
+    val drawPicture : ?transform:Transform.t -> 'kind t -> Picture.t -> unit
+    (** [drawPicture ?transform c pic] draws the picture [pic] on canvas
+        [c], through the current transform of [c] composed with
+        [transform] (if given). This is much faster than drawing the
+        same shapes again, as only rasterization remains to be done:
+        it is well suited for static backgrounds, legends or icons.
+        The picture keeps its own styles, and its opacity is multiplied
+        by the current global alpha. Shapes are those of the original
+        drawing, so scaling a picture up may reveal their flattening. *)
+
 
     (** {1 Direct pixel access} *)
 
@@ -1080,6 +1473,17 @@ module V1 : sig
     (** [getImageData c ~pos ~size] returns a copy of the pixel
         data at position [pos] of size [size] in canvas [c] *)
 
+    val getImageDataView : 'kind t -> ImageData.t
+    (** [getImageDataView c] returns the pixel data of canvas [c]
+        itself, without copying it: writing to the returned image
+        data draws directly on the canvas. The view has the size of
+        the canvas; once it has been taken, the canvas no longer
+        reserves room to grow when resized. The canvas is kept alive
+        as long as its view is. When the canvas is resized, the view
+        is updated to match the new surface, but sub-arrays or slices
+        taken from it are not and must not be used anymore. On the
+        JavaScript backend, this returns a copy instead. *)
+
     val putImageData :
       'kind t -> dpos:(int * int) -> ImageData.t ->
       spos:(int * int) -> size:(int * int) -> unit
@@ -1089,11 +1493,31 @@ module V1 : sig
 
     val importPNG : 'kind t -> pos:(int * int) -> string -> unit Promise.t
     (** [importPNG c ~pos filename] loads the file
+        [filename] into canvas [c] at position [pos].
+        Decoding happens in the background, see
+        {!ImageData.importPNG}. *)
+
+    val exportPNG : ?options:PNG.options -> 'kind t -> string -> unit
+    (** [exportPNG ?options c filename] saves the contents
+        of canvas [c] to a file with name [filename] *)
+
+    val exportPNGToBytes : ?options:PNG.options -> 'kind t -> Bytes.t
+    (** [exportPNGToBytes ?options c] encodes the contents
+        of canvas [c] as PNG, in memory *)
+
+    val exportPNGToBuffer : ?options:PNG.options -> 'kind t -> PNG.buffer
+    (** [exportPNGToBuffer ?options c] encodes the contents of canvas
+        [c] as PNG, in memory, without copying the encoded data into
+        the OCaml heap *)
+
+    val importSnapshot : 'kind t -> pos:(int * int) -> string -> unit
+    (** [importSnapshot c ~pos filename] loads the snapshot file
         [filename] into canvas [c] at position [pos] *)
 
-    val exportPNG : 'kind t -> string -> unit
-    (** [exportPNG c filename] saves the contents of
-        canvas [c] to a file with name [filename] *)
+    val exportSnapshot : 'kind t -> string -> unit
+    (** [exportSnapshot c filename] saves the contents of canvas [c]
+        to a snapshot file with name [filename]. This is much faster
+        than {!exportPNG}, e.g. to capture frames or cache layers. *)
 
   end
 
@@ -1425,8 +1849,14 @@ module V1 : sig
       | GDI : [`Win32] backend_type
       | Quartz : [`OSX] backend_type
       | X11 : [<`Unix | `OSX | `Win32] backend_type
-      | Wayland : [`Unix] backend_type (**)
-    (** The different kind of supported backends *)
+      | Wayland : [`Unix] backend_type
+      | Headless : [<`Unix | `OSX | `Win32] backend_type (**)
+    (** The different kind of supported backends. The [Headless] backend
+        does not connect to any display server: windowed canvases are
+        only simulated (they are sent frame events at a fixed rate, but
+        are never shown), and its event loop terminates by itself once
+        no such canvas remains. It is meant for batch rendering, and is
+        only available when FreeType, Fontconfig and libpng are found. *)
 
     type options = {
       js_backends: [`JS] backend_type list;
@@ -1464,6 +1894,17 @@ module V1 : sig
         just be ignored (though this should not be done). However, [run]
         may be called from the [k] function, if needed. *)
 
+    val runBatched :
+      ('state -> Event.t list -> 'state * bool) ->
+      ('state -> 'dummy1) -> 'state -> 'dummy2
+    (** [runBatched h k s] is similar to [run h k s], except that
+        events are accumulated and passed to [h] in a single call,
+        in the order they occurred, right before the next frame.
+        Frame and close events are always passed alone, so that the
+        boolean returned by [h] applies to them ; it is ignored
+        for other batches. Events that have not been delivered
+        when the event loop terminates are dropped. *)
+
     val stop : unit -> unit
     (** [stop ()] requests termination of the currently running event
         loop, if any. It should be called from an event handler function.
@@ -1474,10 +1915,89 @@ module V1 : sig
     val getCanvas : int -> 'a Canvas.t option
     (** [getCanvas i] returns the canvas that has id [i], if it exists *)
 
+    type watch
+    (** An abstract type identifying a watched file descriptor or a timer *)
+
+    type fd_ready = {
+      watch: watch;
+      readable: bool;
+      writable: bool;
+    }
+    (** Describes which operations a watched file descriptor is ready for *)
+
+    type Event.payload +=
+      | FdReady of fd_ready
+      (** Occurs when a file descriptor watched with {!watchFd} is ready *)
+      | TimerExpired of watch
+      (** Occurs when a timer started with {!startTimer} expires *)
+    (** Payloads of the custom events sent for watches *)
+
+    val watchFd : ?read:bool -> ?write:bool -> int -> watch
+    (** [watchFd ?read ?write fd] makes the event loop wait for the Unix
+        file descriptor [fd] (as an integer) to be ready for reading
+        (if [read], the default) and/or writing (if [write]), in which
+        case a custom event with an {!FdReady} payload is sent, until
+        {!unwatch} is called. This avoids polling on every frame.
+        Only available with the X11, Wayland and headless backends.
+        @raise Failure otherwise *)
+
+    val startTimer : ?period:Int64.t -> Int64.t -> watch
+    (** [startTimer ?period d] makes the event loop send a custom event
+        with a {!TimerExpired} payload after [d] microseconds, and then
+        every [period] microseconds if given, until {!unwatch} is called.
+        Not available with the GDI and Quartz backends.
+        @raise Failure in that case *)
+
+    val unwatch : watch -> unit
+    (** [unwatch w] stops watching the file descriptor
+        or timer identified by [w] *)
+
     val getCurrentTimestamp : unit -> Event.timestamp
     (** [getCurrentTimestamp ()] returns the current timestamp
         in microseconds, from an arbitrary starting point *)
 
+    val setFrameRate : int -> unit
+    (** [setFrameRate r] sets the number of frame events sent
+        per second to [r], clipped to the range 1-1000 (default 60).
+        With the Quartz backend, the change takes effect the next
+        time the event loop is started. With the Javascript and
+        Wayland backends, frames are also paced by the browser or
+        the compositor, so [r] is an upper bound. Frames are not
+        synchronized with the display on other backends. *)
+
+    val getFrameRate : unit -> int
+    (** [getFrameRate ()] returns the number of frame events
+        sent per second *)
+
+    val setEventCoalescing : bool -> unit
+    (** [setEventCoalescing b] sets whether consecutive mouse move
+        and canvas resize events of a canvas are merged, in which case
+        only the latest ones are sent, right before the next frame or
+        any other event of that canvas. This is disabled by default, as
+        intermediate mouse positions are then lost (e.g. when drawing),
+        and as a canvas that gets no frames (e.g. a hidden one) only
+        receives them along with its next other event.
+        With the Javascript backend, the browser decides. *)
+
+    val getEventCoalescing : unit -> bool
+    (** [getEventCoalescing ()] returns whether mouse move and
+        canvas resize events are merged *)
+
+    val startTrace : string -> unit
+    (** [startTrace f] starts recording the time spent in drawing
+        primitives, frame and event handlers, presentation, font
+        loading and PNG encoding/decoding. The recording is written to
+        file [f] by {!stopTrace}, in the Chrome trace-event format
+        (viewable in chrome://tracing or Perfetto). Only the most recent
+        spans of each thread are kept. Does nothing with the
+        Javascript backend.
+        @raise Failure if tracing could not be started *)
+
+    val stopTrace : unit -> unit
+    (** [stopTrace ()] stops recording and writes the trace file.
+        Does nothing if tracing was not started.
+        @raise Failure if the trace file could not be written *)
+
     val sendCustomEvent : Event.payload -> unit
     (** [sendCustomEvent p] requests the backend to send a custom event
         with payload [p] ; if called within an event handler, this event
@@ -11,6 +11,7 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
 #include <assert.h>
 
 #define CAML_NAME_SPACE
@@ -20,6 +21,7 @@
 #include "caml/bigarray.h"
 #include "caml/fail.h"
 #include "caml/callback.h"
+#include "caml/signals.h"
 
 #include "../implem/config.h"
 #include "../implem/tuples.h"
@@ -33,7 +35,11 @@
 #include "../implem/impexp.h"
 #include "../implem/event.h"
 #include "../implem/canvas.h"
+#include "../implem/command.h"
 #include "../implem/backend.h"
+#include "../implem/defer.h"
+#include "../implem/lock.h"
+#include "../implem/trace.h"
 
 #include "ml_tags.h"
 #include "ml_convert.h"
@@ -62,13 +68,14 @@ CAMLprim value name(value *a, int n) \
 
 /* Promises */
 static CAMLprim value
-_ml_canvas_promise_return(
-  value mlValue)
+_ml_canvas_promise_create(
+  void)
 {
-  CAMLparam1(mlValue);
+  CAMLparam0();
   CAMLlocal2(mlStatus,mlPromise);
-  mlStatus = caml_alloc(1, TAG_PROMISE_FULFILLED);
-  Store_field(mlStatus, 0, mlValue);
+  mlStatus = caml_alloc(2, TAG_PROMISE_PENDING);
+  Store_field(mlStatus, 0, Val_emptylist);
+  Store_field(mlStatus, 1, Val_emptylist);
   mlPromise = caml_alloc_tuple(1);
   Store_field(mlPromise, 0, mlStatus);
   CAMLreturn(mlPromise);
@@ -76,6 +83,378 @@ _ml_canvas_promise_return(
 
 
 
+/* Runtime release */
+
+/* Offscreen canvases are not reachable from the event loop, so their
+   rendering only touches memory owned by the canvas: the runtime can
+   be released meanwhile, letting other threads (or domains) run, and
+   possibly draw onto other canvases. Onscreen canvases must keep the
+   runtime, as their surface may be resized under their feet. The
+   canvases are retained meanwhile, as another thread may destroy
+   them; they are released once the runtime is held again, since
+   freeing a canvas calls back into it. */
+static bool
+_ml_canvas_enter_blocking_section(
+  canvas_t *c1,
+  canvas_t *c2)
+{
+  if ((c1 != NULL) && (canvas_get_type(c1) != CANVAS_OFFSCREEN)) {
+    return false;
+  }
+  if ((c2 != NULL) && (canvas_get_type(c2) != CANVAS_OFFSCREEN)) {
+    return false;
+  }
+  if (c1 != NULL) {
+    canvas_retain(c1);
+  }
+  if (c2 != NULL) {
+    canvas_retain(c2);
+  }
+  caml_enter_blocking_section();
+  return true;
+}
+
+static void
+_ml_canvas_leave_blocking_section(
+  bool released,
+  canvas_t *c1,
+  canvas_t *c2)
+{
+  if (released == false) {
+    return;
+  }
+  caml_leave_blocking_section();
+  if (c1 != NULL) {
+    canvas_release(c1);
+  }
+  if (c2 != NULL) {
+    canvas_release(c2);
+  }
+}
+
+/* Image data is handled the same way, except that it has no
+   reference count: the data in use while the runtime is released
+   is recorded here, and releasing it meanwhile defers freeing it
+   to its last user. When too many are in use, the runtime is kept. */
+
+#define ML_CANVAS_BUSY_DATA_MAX 64
+
+typedef struct ml_canvas_busy_data_t {
+  void *data;
+  int32_t users;
+  bool released;
+} ml_canvas_busy_data_t;
+
+static ml_canvas_busy_data_t _ml_canvas_busy_data[ML_CANVAS_BUSY_DATA_MAX];
+static lock_t _ml_canvas_busy_lock = LOCK_INITIALIZER;
+
+static ml_canvas_busy_data_t *
+_ml_canvas_busy_data_find(
+  const void *data)
+{
+  for (size_t i = 0; i < ML_CANVAS_BUSY_DATA_MAX; ++i) {
+    if (_ml_canvas_busy_data[i].data == data) {
+      return &_ml_canvas_busy_data[i];
+    }
+  }
+  return NULL;
+}
+
+static bool
+_ml_canvas_enter_blocking_section_data(
+  void *data)
+{
+  if (data != NULL) {
+    lock_acquire(&_ml_canvas_busy_lock);
+    ml_canvas_busy_data_t *busy = _ml_canvas_busy_data_find(data);
+    if (busy == NULL) {
+      busy = _ml_canvas_busy_data_find(NULL);
+      if (busy == NULL) {
+        lock_release(&_ml_canvas_busy_lock);
+        return false;
+      }
+      busy->data = data;
+      busy->users = 0;
+      busy->released = false;
+    }
+    busy->users++;
+    lock_release(&_ml_canvas_busy_lock);
+  }
+  caml_enter_blocking_section();
+  return true;
+}
+
+static void
+_ml_canvas_leave_blocking_section_data(
+  bool released,
+  void *data)
+{
+  if (released == false) {
+    return;
+  }
+  caml_leave_blocking_section();
+  if (data == NULL) {
+    return;
+  }
+  lock_acquire(&_ml_canvas_busy_lock);
+  ml_canvas_busy_data_t *busy = _ml_canvas_busy_data_find(data);
+  assert(busy != NULL);
+  assert(busy->users > 0);
+  if (--busy->users == 0) {
+    if (busy->released == true) {
+      free(busy->data);
+    }
+    busy->data = NULL;
+  }
+  lock_release(&_ml_canvas_busy_lock);
+}
+
+/* Returns false if the data is in use, in which
+   case its last user will free it instead */
+static bool
+_ml_canvas_busy_data_release(
+  void *data)
+{
+  assert(data != NULL);
+
+  lock_acquire(&_ml_canvas_busy_lock);
+  ml_canvas_busy_data_t *busy = _ml_canvas_busy_data_find(data);
+  if (busy != NULL) {
+    busy->released = true;
+  }
+  lock_release(&_ml_canvas_busy_lock);
+  return (busy == NULL);
+}
+
+/* OCaml strings may move while the runtime is released */
+static char *
+_ml_canvas_string_dup(
+  value mlString)
+{
+  size_t len = caml_string_length(mlString);
+  char *str = (char *)malloc(len + 1);
+  if (str == NULL) {
+    caml_raise_out_of_memory();
+  }
+  memcpy(str, String_val(mlString), len + 1);
+  return str;
+}
+
+
+
+/* Encoded data */
+
+/* Both functions take ownership of the data, which must have been
+   allocated with malloc */
+
+static value
+_ml_canvas_bytes_of_data(
+  uint8_t *data,
+  size_t size)
+{
+  CAMLparam0();
+  CAMLlocal1(mlBytes);
+  mlBytes = caml_alloc_string(size);
+  memcpy(Bytes_val(mlBytes), data, size);
+  free(data);
+  CAMLreturn(mlBytes);
+}
+
+static value
+_ml_canvas_buffer_of_data(
+  uint8_t *data,
+  size_t size)
+{
+  CAMLparam0();
+  intnat dims[CAML_BA_MAX_NUM_DIMS] = { (intnat)size };
+  CAMLreturn(caml_ba_alloc(CAML_BA_UINT8 | CAML_BA_C_LAYOUT |
+                           CAML_BA_MANAGED, 1, (void *)data, dims));
+}
+
+
+
+/* Asynchronous PNG import */
+
+/* Exception raised by an event handler or a promise callback,
+   to be re-raised once the event loop has stopped */
+static value _ml_canvas_mlException = Val_unit;
+
+typedef enum ml_canvas_png_target_t {
+  ML_CANVAS_PNG_NEW_IMAGE_DATA,
+  ML_CANVAS_PNG_NEW_CANVAS,
+  ML_CANVAS_PNG_INTO_IMAGE_DATA,
+  ML_CANVAS_PNG_INTO_CANVAS
+} ml_canvas_png_target_t;
+
+typedef struct ml_canvas_png_request_t {
+  ml_canvas_png_target_t target;
+  value mlPromise;
+  value mlTarget; /* Destination of imports */
+  int32_t x;
+  int32_t y;
+  pixmap_t pixmap; /* Decoded image */
+} ml_canvas_png_request_t;
+
+/* Runs on the event loop thread, with the runtime held */
+static void
+_ml_canvas_png_complete(
+  void *data)
+{
+  CAMLparam0();
+  CAMLlocal5(mlPromise, mlValue, mlMessage, mlResolution, mlResult);
+
+  ml_canvas_png_request_t *request = (ml_canvas_png_request_t *)data;
+  assert(request != NULL);
+
+  bool res = pixmap_valid(request->pixmap);
+  const char *error = "unable to decode PNG file";
+  mlValue = Val_unit;
+
+  if (res == true) {
+    switch (request->target) {
+      case ML_CANVAS_PNG_NEW_IMAGE_DATA:
+        mlValue = Val_pixmap(&request->pixmap);
+        break;
+      case ML_CANVAS_PNG_NEW_CANVAS: {
+        canvas_t *canvas =
+          canvas_create_offscreen_from_pixmap(&request->pixmap);
+        if (canvas == NULL) {
+          error = "unable to create a canvas from the given PNG";
+          res = false;
+        } else {
+          mlValue = Val_canvas(canvas);
+          canvas_release(canvas); /* Because Val_canvas retains it */
+        }
+        pixmap_destroy(request->pixmap);
+        break;
+      }
+      case ML_CANVAS_PNG_INTO_IMAGE_DATA: {
+        pixmap_t pixmap = Pixmap_val(request->mlTarget);
+        pixmap_blit(&pixmap, request->x, request->y, &request->pixmap,
+                    0, 0, request->pixmap.width, request->pixmap.height);
+        pixmap_destroy(request->pixmap);
+        break;
+      }
+      case ML_CANVAS_PNG_INTO_CANVAS: {
+        /* The canvas may have been destroyed meanwhile; raising
+           here would escape from the event loop */
+        canvas_t *canvas =
+          *((canvas_t **)Data_custom_val(request->mlTarget));
+        if (canvas == NULL) {
+          error = "invalid canvas object";
+          res = false;
+        } else {
+          canvas_sync(canvas);
+          canvas_put_pixmap(canvas, request->x, request->y, &request->pixmap,
+                            0, 0, request->pixmap.width,
+                            request->pixmap.height);
+        }
+        pixmap_destroy(request->pixmap);
+        break;
+      }
+      default:
+        assert(!"Invalid PNG import target");
+        break;
+    }
+  }
+
+  if (res == true) {
+    mlResolution = caml_alloc(1, TAG_RESOLUTION_FULFILL);
+    Store_field(mlResolution, 0, mlValue);
+  } else {
+    /* Same as the exception raised by caml_failwith */
+    mlMessage = caml_copy_string(error);
+    mlValue = caml_alloc_tuple(2);
+    Store_field(mlValue, 0, *caml_named_value("ml_canvas_failure"));
+    Store_field(mlValue, 1, mlMessage);
+    mlResolution = caml_alloc(1, TAG_RESOLUTION_REJECT);
+    Store_field(mlResolution, 0, mlValue);
+  }
+
+  mlPromise = request->mlPromise;
+  caml_remove_generational_global_root(&request->mlPromise);
+  caml_remove_generational_global_root(&request->mlTarget);
+  free(request);
+
+  mlResult = caml_callback2_exn(*caml_named_value("ml_canvas_promise_resolve"),
+                                mlPromise, mlResolution);
+
+  /* Promise callbacks are run from the event loop, so their
+     exceptions are handled just like those of event handlers */
+  if (Is_exception_result(mlResult)) {
+    mlResult = Extract_exception(mlResult);
+    if (_ml_canvas_mlException == Val_unit) {
+      caml_modify_generational_global_root(&_ml_canvas_mlException, mlResult);
+    }
+    backend_stop();
+  }
+
+  CAMLreturn0;
+}
+
+/* Runs on a worker thread, without the runtime */
+static void
+_ml_canvas_png_decoded(
+  pixmap_t pixmap,
+  void *data)
+{
+  ml_canvas_png_request_t *request = (ml_canvas_png_request_t *)data;
+  assert(request != NULL);
+
+  request->pixmap = pixmap;
+  if (defer_post(_ml_canvas_png_complete, request) == false) {
+    /* The promise can't be resolved without the runtime,
+       so it will stay pending forever */
+    pixmap_destroy(request->pixmap);
+    defer_cancel();
+  }
+}
+
+/* Decoding happens on a worker thread; the returned promise is
+   resolved from the event loop once the pixmap is ready */
+static value
+_ml_canvas_import_png_async(
+  ml_canvas_png_target_t target,
+  value mlTarget,
+  int32_t x,
+  int32_t y,
+  value mlFilename)
+{
+  CAMLparam2(mlTarget, mlFilename);
+  CAMLlocal1(mlPromise);
+
+  mlPromise = _ml_canvas_promise_create();
+
+  ml_canvas_png_request_t *request =
+    (ml_canvas_png_request_t *)calloc(1, sizeof(ml_canvas_png_request_t));
+  if (request == NULL) {
+    caml_raise_out_of_memory();
+  }
+
+  request->target = target;
+  request->mlPromise = mlPromise;
+  caml_register_generational_global_root(&request->mlPromise);
+  request->mlTarget = mlTarget;
+  caml_register_generational_global_root(&request->mlTarget);
+  request->x = x;
+  request->y = y;
+  request->pixmap = pixmap_null();
+
+  defer_expect();
+  if (impexp_import_png_async(String_val(mlFilename),
+                              _ml_canvas_png_decoded, request) == false) {
+    defer_cancel();
+    caml_remove_generational_global_root(&request->mlPromise);
+    caml_remove_generational_global_root(&request->mlTarget);
+    free(request);
+    caml_failwith("unable to start PNG decoding");
+  }
+
+  CAMLreturn(mlPromise);
+}
+
+
+
 /* Image Data (aka Pixmaps) */
 
 CAMLprim value
@@ -83,12 +462,8 @@ ml_canvas_image_data_create_from_png(
   value mlFilename)
 {
   CAMLparam1(mlFilename);
-  pixmap_t pixmap = { 0 };
-  bool res = impexp_import_png(&pixmap, 0, 0, String_val(mlFilename));
-  if ((res == false) || (pixmap_valid(pixmap) == false)) {
-    caml_failwith("unable to create pixmap from PNG file");
-  }
-  CAMLreturn(_ml_canvas_promise_return(Val_pixmap(&pixmap)));
+  CAMLreturn(_ml_canvas_import_png_async(ML_CANVAS_PNG_NEW_IMAGE_DATA,
+                                         Val_unit, 0, 0, mlFilename));
 }
 
 CAMLprim value
@@ -104,6 +479,29 @@ ml_canvas_image_data_get_size(
   CAMLreturn(mlResult);
 }
 
+CAMLprim value
+ml_canvas_image_data_release(
+  value mlPixmap)
+{
+  CAMLparam1(mlPixmap);
+  struct caml_ba_array *ba = Caml_ba_array_val(mlPixmap);
+  /* Unmapping needs the actual size, leave that to the GC */
+  if ((ba->flags & CAML_BA_MANAGED_MASK) == CAML_BA_MAPPED_FILE) {
+    caml_invalid_argument("Image data is a mapped file");
+  }
+  /* Shared data (when proxied) is freed along with its last user */
+  if (((ba->flags & CAML_BA_MANAGED_MASK) == CAML_BA_MANAGED) &&
+      (ba->proxy == NULL) && (ba->data != NULL) &&
+      (_ml_canvas_busy_data_release(ba->data) == true)) {
+    free(ba->data);
+  }
+  ba->data = NULL;
+  for (int i = 0; i < ba->num_dims; ++i) {
+    ba->dim[i] = 0;
+  }
+  CAMLreturn(Val_unit);
+}
+
 CAMLprim value
 ml_canvas_image_data_fill(
   value mlPixmap,
@@ -193,27 +591,138 @@ ml_canvas_image_data_import_png(
   value mlFilename)
 {
   CAMLparam3(mlPixmap, mlDPos, mlFilename);
+  /* Fail early on invalid image data */
   pixmap_t pixmap = Pixmap_val(mlPixmap);
-  bool res = impexp_import_png(&pixmap,
-                               Int32_val_clip(Field(mlDPos, 0)),
-                               Int32_val_clip(Field(mlDPos, 1)),
-                               String_val(mlFilename));
-  if ((res == false) || (pixmap_valid(pixmap) == false)) {
+  if (pixmap_valid(pixmap) == false) {
     caml_failwith("unable to import PNG file into pixmap");
   }
-  CAMLreturn(_ml_canvas_promise_return(Val_unit));
+  CAMLreturn(_ml_canvas_import_png_async(ML_CANVAS_PNG_INTO_IMAGE_DATA,
+                                         mlPixmap,
+                                         Int32_val_clip(Field(mlDPos, 0)),
+                                         Int32_val_clip(Field(mlDPos, 1)),
+                                         mlFilename));
 }
 
 CAMLprim value
 ml_canvas_image_data_export_png(
+  value mlPixmap,
+  value mlFilename,
+  value mlOptions)
+{
+  CAMLparam3(mlPixmap, mlFilename, mlOptions);
+  pixmap_t pixmap = Pixmap_val(mlPixmap);
+  impexp_png_options_t options = Png_options_val(mlOptions);
+  char *filename = _ml_canvas_string_dup(mlFilename);
+  bool released = _ml_canvas_enter_blocking_section_data(pixmap.data);
+  bool res = impexp_export_png(&pixmap, filename, &options);
+  _ml_canvas_leave_blocking_section_data(released, pixmap.data);
+  free(filename);
+  if (res == false) {
+    caml_failwith("unable to export pixmap to PNG file");
+  }
+  CAMLreturn(Val_unit);
+}
+
+static bool
+_ml_canvas_image_data_export_png_to_memory(
+  value mlPixmap,
+  value mlOptions,
+  uint8_t **data,
+  size_t *size)
+{
+  pixmap_t pixmap = Pixmap_val(mlPixmap);
+  impexp_png_options_t options = Png_options_val(mlOptions);
+  bool released = _ml_canvas_enter_blocking_section_data(pixmap.data);
+  bool res = impexp_export_png_to_memory(&pixmap, &options, data, size);
+  _ml_canvas_leave_blocking_section_data(released, pixmap.data);
+  return res;
+}
+
+CAMLprim value
+ml_canvas_image_data_export_png_to_bytes(
+  value mlPixmap,
+  value mlOptions)
+{
+  CAMLparam2(mlPixmap, mlOptions);
+  uint8_t *data = NULL;
+  size_t size = 0;
+  if (_ml_canvas_image_data_export_png_to_memory(mlPixmap, mlOptions,
+                                                 &data, &size) == false) {
+    caml_failwith("unable to export pixmap to PNG data");
+  }
+  CAMLreturn(_ml_canvas_bytes_of_data(data, size));
+}
+
+CAMLprim value
+ml_canvas_image_data_export_png_to_buffer(
+  value mlPixmap,
+  value mlOptions)
+{
+  CAMLparam2(mlPixmap, mlOptions);
+  uint8_t *data = NULL;
+  size_t size = 0;
+  if (_ml_canvas_image_data_export_png_to_memory(mlPixmap, mlOptions,
+                                                 &data, &size) == false) {
+    caml_failwith("unable to export pixmap to PNG data");
+  }
+  CAMLreturn(_ml_canvas_buffer_of_data(data, size));
+}
+
+CAMLprim value
+ml_canvas_image_data_create_from_snapshot(
+  value mlFilename)
+{
+  CAMLparam1(mlFilename);
+  pixmap_t pixmap = pixmap_null();
+  char *filename = _ml_canvas_string_dup(mlFilename);
+  caml_enter_blocking_section();
+  bool res = impexp_import_snapshot(&pixmap, 0, 0, filename);
+  caml_leave_blocking_section();
+  free(filename);
+  if ((res == false) || (pixmap_valid(pixmap) == false)) {
+    caml_failwith("unable to create pixmap from snapshot file");
+  }
+  CAMLreturn(Val_pixmap(&pixmap));
+}
+
+CAMLprim value
+ml_canvas_image_data_import_snapshot(
+  value mlPixmap,
+  value mlDPos,
+  value mlFilename)
+{
+  CAMLparam3(mlPixmap, mlDPos, mlFilename);
+  pixmap_t pixmap = Pixmap_val(mlPixmap);
+  if (pixmap_valid(pixmap) == false) {
+    caml_failwith("unable to import snapshot file into pixmap");
+  }
+  int32_t x = Int32_val_clip(Field(mlDPos, 0));
+  int32_t y = Int32_val_clip(Field(mlDPos, 1));
+  char *filename = _ml_canvas_string_dup(mlFilename);
+  bool released = _ml_canvas_enter_blocking_section_data(pixmap.data);
+  bool res = impexp_import_snapshot(&pixmap, x, y, filename);
+  _ml_canvas_leave_blocking_section_data(released, pixmap.data);
+  free(filename);
+  if (res == false) {
+    caml_failwith("unable to import snapshot file into pixmap");
+  }
+  CAMLreturn(Val_unit);
+}
+
+CAMLprim value
+ml_canvas_image_data_export_snapshot(
   value mlPixmap,
   value mlFilename)
 {
   CAMLparam2(mlPixmap, mlFilename);
   pixmap_t pixmap = Pixmap_val(mlPixmap);
-  bool res = impexp_export_png(&pixmap, String_val(mlFilename));
+  char *filename = _ml_canvas_string_dup(mlFilename);
+  bool released = _ml_canvas_enter_blocking_section_data(pixmap.data);
+  bool res = impexp_export_snapshot(&pixmap, filename);
+  _ml_canvas_leave_blocking_section_data(released, pixmap.data);
+  free(filename);
   if (res == false) {
-    caml_failwith("unable to export pixmap to PNG file");
+    caml_failwith("unable to export pixmap to snapshot file");
   }
   CAMLreturn(Val_unit);
 }
@@ -402,6 +911,24 @@ ml_canvas_path_line_to(
   CAMLreturn(Val_unit);
 }
 
+CAMLprim value
+ml_canvas_path_add_points(
+  value mlPath2d,
+  value mlMoves,
+  value mlPoints)
+{
+  CAMLparam3(mlPath2d, mlMoves, mlPoints);
+  int32_t nb_points = 0;
+  const double *coords = Point_array_val(mlPoints, &nb_points);
+  const uint8_t *moves =
+    Is_block(mlMoves) ? Move_flags_val(Field(mlMoves, 0), nb_points) : NULL;
+  if (path2d_add_points(Path2d_val(mlPath2d), coords, moves,
+                        nb_points, NULL) == false) {
+    caml_failwith("unable to add points to path");
+  }
+  CAMLreturn(Val_unit);
+}
+
 CAMLprim value
 ml_canvas_path_arc_n(
   value mlPath2d,
@@ -695,7 +1222,7 @@ ml_canvas_create_offscreen_from_image_data(
   pixmap_t pixmap = Pixmap_val(mlPixmap);
   /* We need to duplicate the pixmap, as canvas_create_offscreen_from_pixmap
      steals the data pointer */
-  pixmap = pixmap_copy(pixmap);
+  pixmap = pixmap_copy(&pixmap);
   if (pixmap_valid(pixmap) == false) {
     caml_failwith("unable to create a canvas from the given image data");
   }
@@ -715,16 +1242,29 @@ ml_canvas_create_offscreen_from_image_data(
 CAMLprim value
 ml_canvas_create_offscreen_from_png(
   value mlFilename)
+{
+  CAMLparam1(mlFilename);
+  CAMLreturn(_ml_canvas_import_png_async(ML_CANVAS_PNG_NEW_CANVAS,
+                                         Val_unit, 0, 0, mlFilename));
+}
+
+CAMLprim value
+ml_canvas_create_offscreen_from_snapshot(
+  value mlFilename)
 {
   CAMLparam1(mlFilename);
   CAMLlocal1(mlCanvas);
-  canvas_t *canvas = canvas_create_offscreen_from_png(String_val(mlFilename));
+  char *filename = _ml_canvas_string_dup(mlFilename);
+  caml_enter_blocking_section();
+  canvas_t *canvas = canvas_create_offscreen_from_snapshot(filename);
+  caml_leave_blocking_section();
+  free(filename);
   if (canvas == NULL) {
-    caml_failwith("unable to create a canvas from the given PNG");
+    caml_failwith("unable to create a canvas from the given snapshot");
   }
   mlCanvas = Val_canvas(canvas);
   canvas_release(canvas); /* Because Val_canvas retains it */
-  CAMLreturn(_ml_canvas_promise_return(mlCanvas));
+  CAMLreturn(mlCanvas);
 }
 
 
@@ -736,7 +1276,7 @@ ml_canvas_show(
   value mlCanvas)
 {
   CAMLparam1(mlCanvas);
-  canvas_show(Canvas_val(mlCanvas));
+  canvas_show(Canvas_val_unsynced(mlCanvas));
   CAMLreturn(Val_unit);
 }
 
@@ -745,7 +1285,7 @@ ml_canvas_hide(
   value mlCanvas)
 {
   CAMLparam1(mlCanvas);
-  canvas_hide(Canvas_val(mlCanvas));
+  canvas_hide(Canvas_val_unsynced(mlCanvas));
   CAMLreturn(Val_unit);
 }
 
@@ -758,6 +1298,15 @@ ml_canvas_close(
   CAMLreturn(Val_unit);
 }
 
+CAMLprim value
+ml_canvas_destroy(
+  value mlCanvas)
+{
+  CAMLparam1(mlCanvas);
+  Canvas_destroy(mlCanvas);
+  CAMLreturn(Val_unit);
+}
+
 
 
 /* Configuration */
@@ -770,13 +1319,94 @@ ml_canvas_get_id(
   CAMLreturn(Val_long(_ml_canvas_get_id_raw(mlCanvas)));
 }
 
+CAMLprim value
+ml_canvas_get_frame_on_demand(
+  value mlCanvas)
+{
+  CAMLparam1(mlCanvas);
+  CAMLreturn(Val_bool(canvas_get_frame_on_demand(
+                        Canvas_val_unsynced(mlCanvas))));
+}
+
+CAMLprim value
+ml_canvas_set_frame_on_demand(
+  value mlCanvas,
+  value mlOnDemand)
+{
+  CAMLparam2(mlCanvas, mlOnDemand);
+  canvas_set_frame_on_demand(Canvas_val_unsynced(mlCanvas),
+                             Bool_val(mlOnDemand));
+  CAMLreturn(Val_unit);
+}
+
+CAMLprim value
+ml_canvas_request_frame(
+  value mlCanvas)
+{
+  CAMLparam1(mlCanvas);
+  canvas_request_frame(Canvas_val_unsynced(mlCanvas));
+  CAMLreturn(Val_unit);
+}
+
+CAMLprim value
+ml_canvas_set_stats_enabled(
+  value mlCanvas,
+  value mlEnabled)
+{
+  CAMLparam2(mlCanvas, mlEnabled);
+  if (canvas_set_stats_enabled(Canvas_val(mlCanvas),
+                               Bool_val(mlEnabled)) == false) {
+    caml_raise_out_of_memory();
+  }
+  CAMLreturn(Val_unit);
+}
+
+CAMLprim value
+ml_canvas_get_stats_enabled(
+  value mlCanvas)
+{
+  CAMLparam1(mlCanvas);
+  CAMLreturn(Val_bool(canvas_get_stats_enabled(
+                        Canvas_val_unsynced(mlCanvas))));
+}
+
+CAMLprim value
+ml_canvas_get_stats(
+  value mlCanvas)
+{
+  CAMLparam1(mlCanvas);
+  CAMLlocal2(mlStats, mlTime);
+  stats_t stats;
+  canvas_get_stats(Canvas_val(mlCanvas), &stats);
+  /* Same layout as the OCaml record: counters, then times (in us) */
+  mlStats = caml_alloc(STATS_COUNT, 0);
+  for (int32_t i = 0; i < STATS_TIME_POLYGONIZE; ++i) {
+    Store_field(mlStats, i, Val_long(stats.counters[i]));
+  }
+  for (int32_t i = STATS_TIME_POLYGONIZE; i < STATS_COUNT; ++i) {
+    mlTime = caml_copy_double((double)stats.counters[i] / 1000.0);
+    Store_field(mlStats, i, mlTime);
+  }
+  CAMLreturn(mlStats);
+}
+
+CAMLprim value
+ml_canvas_reset_stats(
+  value mlCanvas)
+{
+  CAMLparam1(mlCanvas);
+  canvas_reset_stats(Canvas_val(mlCanvas));
+  CAMLreturn(Val_unit);
+}
+
 CAMLprim value
 ml_canvas_get_size(
   value mlCanvas)
 {
   CAMLparam1(mlCanvas);
   CAMLlocal1(mlResult);
-  pair_t(int32_t) result = canvas_get_size(Canvas_val(mlCanvas));
+  pair_t(int32_t) result =
+    canvas_get_size(Canvas_val_unsynced(mlCanvas));
   mlResult = caml_alloc_tuple(2);
   Store_field(mlResult, 0, Val_int32_clip(fst(result)));
   Store_field(mlResult, 1, Val_int32_clip(snd(result)));
@@ -789,9 +1419,12 @@ ml_canvas_set_size(
   value mlSize)
 {
   CAMLparam2(mlCanvas, mlSize);
-  canvas_set_size(Canvas_val(mlCanvas),
+  canvas_t *canvas = Canvas_val(mlCanvas);
+  canvas_set_size(canvas,
                   Int32_val_clip(Field(mlSize, 0)),
                   Int32_val_clip(Field(mlSize, 1)));
+  Canvas_view_update(canvas);
+  Canvas_memory_update(canvas);
   CAMLreturn(Val_unit);
 }
 
@@ -801,7 +1434,8 @@ ml_canvas_get_position(
 {
   CAMLparam1(mlCanvas);
   CAMLlocal1(mlResult);
-  pair_t(int32_t) result = canvas_get_position(Canvas_val(mlCanvas));
+  pair_t(int32_t) result =
+    canvas_get_position(Canvas_val_unsynced(mlCanvas));
   mlResult = caml_alloc_tuple(2);
   Store_field(mlResult, 0, Val_int32_clip(fst(result)));
   Store_field(mlResult, 1, Val_int32_clip(snd(result)));
@@ -814,7 +1448,7 @@ ml_canvas_set_position(
   value mlPos)
 {
   CAMLparam2(mlCanvas, mlPos);
-  canvas_set_position(Canvas_val(mlCanvas),
+  canvas_set_position(Canvas_val_unsynced(mlCanvas),
                       Int32_val_clip(Field(mlPos, 0)),
                       Int32_val_clip(Field(mlPos, 1)));
   CAMLreturn(Val_unit);
@@ -1358,6 +1992,24 @@ ml_canvas_line_to(
   CAMLreturn(Val_unit);
 }
 
+CAMLprim value
+ml_canvas_polyline(
+  value mlCanvas,
+  value mlMoves,
+  value mlPoints)
+{
+  CAMLparam3(mlCanvas, mlMoves, mlPoints);
+  int32_t nb_points = 0;
+  const double *coords = Point_array_val(mlPoints, &nb_points);
+  const uint8_t *moves =
+    Is_block(mlMoves) ? Move_flags_val(Field(mlMoves, 0), nb_points) : NULL;
+  if (canvas_add_points(Canvas_val(mlCanvas), coords, moves,
+                        nb_points) == false) {
+    caml_failwith("unable to add points to path");
+  }
+  CAMLreturn(Val_unit);
+}
+
 CAMLprim value
 ml_canvas_arc_n(
   value mlCanvas,
@@ -1482,8 +2134,11 @@ ml_canvas_fill(
   value mlNonZero)
 {
   CAMLparam2(mlCanvas, mlNonZero);
-  canvas_fill(Canvas_val(mlCanvas),
-              Bool_val(mlNonZero));
+  canvas_t *canvas = Canvas_val(mlCanvas);
+  bool non_zero = Bool_val(mlNonZero);
+  bool released = _ml_canvas_enter_blocking_section(canvas, NULL);
+  canvas_fill(canvas, non_zero);
+  _ml_canvas_leave_blocking_section(released, canvas, NULL);
   CAMLreturn(Val_unit);
 }
 
@@ -1494,9 +2149,12 @@ ml_canvas_fill_path(
   value mlNonZero)
 {
   CAMLparam3(mlCanvas, mlPath2d, mlNonZero);
-  canvas_fill_path(Canvas_val(mlCanvas),
-                   Path2d_val(mlPath2d),
-                   Bool_val(mlNonZero));
+  canvas_t *canvas = Canvas_val(mlCanvas);
+  path2d_t *path2d = Path2d_val(mlPath2d);
+  bool non_zero = Bool_val(mlNonZero);
+  bool released = _ml_canvas_enter_blocking_section(canvas, NULL);
+  canvas_fill_path(canvas, path2d, non_zero);
+  _ml_canvas_leave_blocking_section(released, canvas, NULL);
   CAMLreturn(Val_unit);
 }
 
@@ -1505,7 +2163,10 @@ ml_canvas_stroke(
   value mlCanvas)
 {
   CAMLparam1(mlCanvas);
-  canvas_stroke(Canvas_val(mlCanvas));
+  canvas_t *canvas = Canvas_val(mlCanvas);
+  bool released = _ml_canvas_enter_blocking_section(canvas, NULL);
+  canvas_stroke(canvas);
+  _ml_canvas_leave_blocking_section(released, canvas, NULL);
   CAMLreturn(Val_unit);
 }
 
@@ -1515,8 +2176,11 @@ ml_canvas_stroke_path(
   value mlPath2d)
 {
   CAMLparam2(mlCanvas, mlPath2d);
-  canvas_stroke_path(Canvas_val(mlCanvas),
-                     Path2d_val(mlPath2d));
+  canvas_t *canvas = Canvas_val(mlCanvas);
+  path2d_t *path2d = Path2d_val(mlPath2d);
+  bool released = _ml_canvas_enter_blocking_section(canvas, NULL);
+  canvas_stroke_path(canvas, path2d);
+  _ml_canvas_leave_blocking_section(released, canvas, NULL);
   CAMLreturn(Val_unit);
 }
 
@@ -1584,11 +2248,14 @@ ml_canvas_fill_text(
   value mlP)
 {
   CAMLparam3(mlCanvas, mlText, mlP);
-  canvas_fill_text(Canvas_val(mlCanvas),
-                   String_val(mlText),
-                   Double_val(Field(mlP, 0)),
-                   Double_val(Field(mlP, 1)),
-                   0.0);
+  canvas_t *canvas = Canvas_val(mlCanvas);
+  double x = Double_val(Field(mlP, 0));
+  double y = Double_val(Field(mlP, 1));
+  char *text = _ml_canvas_string_dup(mlText);
+  bool released = _ml_canvas_enter_blocking_section(canvas, NULL);
+  canvas_fill_text(canvas, text, x, y, 0.0);
+  _ml_canvas_leave_blocking_section(released, canvas, NULL);
+  free(text);
   CAMLreturn(Val_unit);
 }
 
@@ -1599,11 +2266,14 @@ ml_canvas_stroke_text(
   value mlP)
 {
   CAMLparam3(mlCanvas, mlText, mlP);
-  canvas_stroke_text(Canvas_val(mlCanvas),
-                     String_val(mlText),
-                     Double_val(Field(mlP, 0)),
-                     Double_val(Field(mlP, 1)),
-                     0.0);
+  canvas_t *canvas = Canvas_val(mlCanvas);
+  double x = Double_val(Field(mlP, 0));
+  double y = Double_val(Field(mlP, 1));
+  char *text = _ml_canvas_string_dup(mlText);
+  bool released = _ml_canvas_enter_blocking_section(canvas, NULL);
+  canvas_stroke_text(canvas, text, x, y, 0.0);
+  _ml_canvas_leave_blocking_section(released, canvas, NULL);
+  free(text);
   CAMLreturn(Val_unit);
 }
 
@@ -1616,14 +2286,196 @@ ml_canvas_blit(
   value mlSize)
 {
   CAMLparam5(mlDstCanvas, mlDPos, mlSrcCanvas, mlSPos, mlSize);
-  canvas_blit(Canvas_val(mlDstCanvas),
-              Int32_val_clip(Field(mlDPos, 0)),
-              Int32_val_clip(Field(mlDPos, 1)),
-              Canvas_val(mlSrcCanvas),
-              Int32_val_clip(Field(mlSPos, 0)),
-              Int32_val_clip(Field(mlSPos, 1)),
-              Int32_val_clip(Field(mlSize, 0)),
-              Int32_val_clip(Field(mlSize, 1)));
+  canvas_t *dst_canvas = Canvas_val(mlDstCanvas);
+  canvas_t *src_canvas = Canvas_val(mlSrcCanvas);
+  int32_t dx = Int32_val_clip(Field(mlDPos, 0));
+  int32_t dy = Int32_val_clip(Field(mlDPos, 1));
+  int32_t sx = Int32_val_clip(Field(mlSPos, 0));
+  int32_t sy = Int32_val_clip(Field(mlSPos, 1));
+  int32_t width = Int32_val_clip(Field(mlSize, 0));
+  int32_t height = Int32_val_clip(Field(mlSize, 1));
+  bool released = _ml_canvas_enter_blocking_section(dst_canvas, src_canvas);
+  canvas_blit(dst_canvas, dx, dy, src_canvas, sx, sy, width, height);
+  _ml_canvas_leave_blocking_section(released, dst_canvas, src_canvas);
+  CAMLreturn(Val_unit);
+}
+
+CAMLprim value
+ml_canvas_blit_batch(
+  value mlDstCanvas,
+  value mlSrcCanvas,
+  value mlSprites,
+  value mlReorder)
+{
+  CAMLparam4(mlDstCanvas, mlSrcCanvas, mlSprites, mlReorder);
+  canvas_t *dst_canvas = Canvas_val(mlDstCanvas);
+  canvas_t *src_canvas = Canvas_val(mlSrcCanvas);
+  struct caml_ba_array *ba = Caml_ba_array_val(mlSprites);
+  if ((ba->num_dims != 2) ||
+      ((ba->flags & CAML_BA_KIND_MASK) != CAML_BA_FLOAT64) ||
+      ((ba->flags & CAML_BA_LAYOUT_MASK) != CAML_BA_C_LAYOUT) ||
+      ((ba->dim[1] != 9) && (ba->dim[1] != 15)) ||
+      (ba->dim[0] > INT32_MAX)) {
+    caml_invalid_argument("Sprites must be a float64 matrix "
+                          "with 9 or 15 columns");
+  }
+  int32_t count = (int32_t)ba->dim[0];
+  int32_t fields = (int32_t)ba->dim[1];
+  canvas_sprite_t *sprites = NULL;
+  if (count > 0) {
+    sprites = (canvas_sprite_t *)calloc(count, sizeof(canvas_sprite_t));
+    if (sprites == NULL) {
+      caml_raise_out_of_memory();
+    }
+  }
+  const double *data = (const double *)ba->data;
+  for (int32_t i = 0; i < count; ++i, data += fields) {
+    canvas_sprite_t *sprite = &sprites[i];
+    sprite->sx = data[0]; sprite->sy = data[1];
+    sprite->sw = data[2]; sprite->sh = data[3];
+    sprite->dx = data[4]; sprite->dy = data[5];
+    sprite->dw = data[6]; sprite->dh = data[7];
+    sprite->alpha = data[8];
+    if (fields == 15) {
+      transform_set(&sprite->transform, data[9], data[10], data[11],
+                                        data[12], data[13], data[14]);
+    } else {
+      transform_reset(&sprite->transform);
+    }
+  }
+  bool released = _ml_canvas_enter_blocking_section(dst_canvas, src_canvas);
+  canvas_blit_batch(dst_canvas, src_canvas, sprites, count,
+                    Bool_val(mlReorder));
+  _ml_canvas_leave_blocking_section(released, dst_canvas, src_canvas);
+  free(sprites);
+  CAMLreturn(Val_unit);
+}
+
+/* The buffer data lives outside the OCaml heap,
+   so it stays put while the runtime is released */
+CAMLprim value
+ml_canvas_execute(
+  value mlCanvas,
+  value mlData,
+  value mlLength)
+{
+  CAMLparam3(mlCanvas, mlData, mlLength);
+  canvas_t *canvas = Canvas_val(mlCanvas);
+  struct caml_ba_array *ba = Caml_ba_array_val(mlData);
+  intnat len = Long_val(mlLength);
+  if ((ba->num_dims != 1) ||
+      ((ba->flags & CAML_BA_KIND_MASK) != CAML_BA_FLOAT64) ||
+      (len < 0) || (len > ba->dim[0])) {
+    caml_invalid_argument("Invalid command buffer");
+  }
+  bool released = _ml_canvas_enter_blocking_section(canvas, NULL);
+  bool ok = command_execute(canvas, (const double *)ba->data, (size_t)len);
+  _ml_canvas_leave_blocking_section(released, canvas, NULL);
+  if (ok == false) {
+    caml_invalid_argument("Malformed command in command buffer");
+  }
+  CAMLreturn(Val_unit);
+}
+
+CAMLprim value
+ml_canvas_set_threaded(
+  value mlCanvas,
+  value mlThreaded)
+{
+  CAMLparam2(mlCanvas, mlThreaded);
+  if (canvas_set_threaded(Canvas_val(mlCanvas),
+                          Bool_val(mlThreaded)) == false) {
+    caml_failwith("unable to start a render thread");
+  }
+  CAMLreturn(Val_unit);
+}
+
+CAMLprim value
+ml_canvas_get_threaded(
+  value mlCanvas)
+{
+  CAMLparam1(mlCanvas);
+  CAMLreturn(Val_bool(canvas_get_threaded(Canvas_val_unsynced(mlCanvas))));
+}
+
+/* Commands are checked before being queued, so that a malformed
+   buffer is reported here rather than by the render thread */
+CAMLprim value
+ml_canvas_submit(
+  value mlCanvas,
+  value mlData,
+  value mlLength)
+{
+  CAMLparam3(mlCanvas, mlData, mlLength);
+  canvas_t *canvas = Canvas_val_unsynced(mlCanvas);
+  struct caml_ba_array *ba = Caml_ba_array_val(mlData);
+  intnat len = Long_val(mlLength);
+  if ((ba->num_dims != 1) ||
+      ((ba->flags & CAML_BA_KIND_MASK) != CAML_BA_FLOAT64) ||
+      (len < 0) || (len > ba->dim[0])) {
+    caml_invalid_argument("Invalid command buffer");
+  }
+  const double *data = (const double *)ba->data;
+  if (command_validate(data, (size_t)len) == false) {
+    caml_invalid_argument("Malformed command in command buffer");
+  }
+  bool released = _ml_canvas_enter_blocking_section(canvas, NULL);
+  bool ok = canvas_submit(canvas, data, (size_t)len);
+  _ml_canvas_leave_blocking_section(released, canvas, NULL);
+  if (ok == false) {
+    caml_raise_out_of_memory();
+  }
+  CAMLreturn(Val_unit);
+}
+
+
+
+/* Pictures */
+
+CAMLprim value
+ml_canvas_begin_picture(
+  value mlCanvas)
+{
+  CAMLparam1(mlCanvas);
+  if (canvas_begin_picture(Canvas_val(mlCanvas)) == false) {
+    caml_failwith("unable to start recording a picture");
+  }
+  CAMLreturn(Val_unit);
+}
+
+CAMLprim value
+ml_canvas_end_picture(
+  value mlCanvas)
+{
+  CAMLparam1(mlCanvas);
+  CAMLlocal1(mlPicture);
+  picture_t *picture = canvas_end_picture(Canvas_val(mlCanvas));
+  if (picture == NULL) {
+    caml_failwith("canvas is not recording a picture");
+  }
+  mlPicture = Val_picture(picture);
+  picture_release(picture); /* Because Val_picture retains it */
+  CAMLreturn(mlPicture);
+}
+
+CAMLprim value
+ml_canvas_draw_picture(
+  value mlCanvas,
+  value mlTransform,
+  value mlPicture)
+{
+  CAMLparam3(mlCanvas, mlTransform, mlPicture);
+  canvas_t *canvas = Canvas_val(mlCanvas);
+  picture_t *picture = Picture_val(mlPicture);
+  transform_t transform = { 0 };
+  bool transformed = Is_block(mlTransform);
+  if (transformed == true) {
+    transform = Transform_val(Field(mlTransform, 0));
+  }
+  bool released = _ml_canvas_enter_blocking_section(canvas, NULL);
+  canvas_draw_picture(canvas, picture,
+                      (transformed == true) ? &transform : NULL);
+  _ml_canvas_leave_blocking_section(released, canvas, NULL);
   CAMLreturn(Val_unit);
 }
 
@@ -1678,6 +2530,20 @@ ml_canvas_get_image_data(
   CAMLreturn(Val_pixmap(&pixmap));
 }
 
+CAMLprim value
+ml_canvas_get_image_data_view(
+  value mlCanvas)
+{
+  CAMLparam1(mlCanvas);
+  CAMLlocal2(mlView, mlResult);
+  bool fresh = false;
+  mlView = Val_canvas_view(Canvas_val(mlCanvas), &fresh);
+  mlResult = caml_alloc_tuple(2);
+  Store_field(mlResult, 0, mlView);
+  Store_field(mlResult, 1, Val_bool(fresh));
+  CAMLreturn(mlResult);
+}
+
 CAMLprim value
 ml_canvas_put_image_data(
   value mlCanvas,
@@ -1706,27 +2572,113 @@ ml_canvas_import_png(
   value mlFilename)
 {
   CAMLparam3(mlCanvas, mlDPos, mlFilename);
-  bool res =
-    canvas_import_png(Canvas_val(mlCanvas),
-                      Int32_val_clip(Field(mlDPos, 0)),
-                      Int32_val_clip(Field(mlDPos, 1)),
-                      String_val(mlFilename));
+  CAMLreturn(_ml_canvas_import_png_async(ML_CANVAS_PNG_INTO_CANVAS,
+                                         mlCanvas,
+                                         Int32_val_clip(Field(mlDPos, 0)),
+                                         Int32_val_clip(Field(mlDPos, 1)),
+                                         mlFilename));
+}
+
+CAMLprim value
+ml_canvas_export_png(
+  value mlCanvas,
+  value mlFilename,
+  value mlOptions)
+{
+  CAMLparam3(mlCanvas, mlFilename, mlOptions);
+  canvas_t *canvas = Canvas_val(mlCanvas);
+  impexp_png_options_t options = Png_options_val(mlOptions);
+  char *filename = _ml_canvas_string_dup(mlFilename);
+  bool released = _ml_canvas_enter_blocking_section(canvas, NULL);
+  bool res = canvas_export_png(canvas, filename, &options);
+  _ml_canvas_leave_blocking_section(released, canvas, NULL);
+  free(filename);
+  if (res == false) {
+    caml_failwith("unable to export to PNG");
+  }
+  CAMLreturn(Val_unit);
+}
+
+static bool
+_ml_canvas_export_png_to_memory(
+  value mlCanvas,
+  value mlOptions,
+  uint8_t **data,
+  size_t *size)
+{
+  canvas_t *canvas = Canvas_val(mlCanvas);
+  impexp_png_options_t options = Png_options_val(mlOptions);
+  bool released = _ml_canvas_enter_blocking_section(canvas, NULL);
+  bool res = canvas_export_png_to_memory(canvas, &options, data, size);
+  _ml_canvas_leave_blocking_section(released, canvas, NULL);
+  return res;
+}
+
+CAMLprim value
+ml_canvas_export_png_to_bytes(
+  value mlCanvas,
+  value mlOptions)
+{
+  CAMLparam2(mlCanvas, mlOptions);
+  uint8_t *data = NULL;
+  size_t size = 0;
+  if (_ml_canvas_export_png_to_memory(mlCanvas, mlOptions,
+                                      &data, &size) == false) {
+    caml_failwith("unable to export to PNG data");
+  }
+  CAMLreturn(_ml_canvas_bytes_of_data(data, size));
+}
+
+CAMLprim value
+ml_canvas_export_png_to_buffer(
+  value mlCanvas,
+  value mlOptions)
+{
+  CAMLparam2(mlCanvas, mlOptions);
+  uint8_t *data = NULL;
+  size_t size = 0;
+  if (_ml_canvas_export_png_to_memory(mlCanvas, mlOptions,
+                                      &data, &size) == false) {
+    caml_failwith("unable to export to PNG data");
+  }
+  CAMLreturn(_ml_canvas_buffer_of_data(data, size));
+}
+
+CAMLprim value
+ml_canvas_import_snapshot(
+  value mlCanvas,
+  value mlDPos,
+  value mlFilename)
+{
+  CAMLparam3(mlCanvas, mlDPos, mlFilename);
+  canvas_t *canvas = Canvas_val(mlCanvas);
+  int32_t x = Int32_val_clip(Field(mlDPos, 0));
+  int32_t y = Int32_val_clip(Field(mlDPos, 1));
+  char *filename = _ml_canvas_string_dup(mlFilename);
+  bool released = _ml_canvas_enter_blocking_section(canvas, NULL);
+  bool res = canvas_import_snapshot(canvas, x, y, filename);
+  _ml_canvas_leave_blocking_section(released, canvas, NULL);
+  free(filename);
   if (res == false) {
-    caml_failwith("unable to import PNG");
+    caml_failwith("unable to import snapshot");
   }
-  CAMLreturn(_ml_canvas_promise_return(Val_unit));
+  CAMLreturn(Val_unit);
 }
 
 CAMLprim value
-ml_canvas_export_png(
+ml_canvas_export_snapshot(
   value mlCanvas,
   value mlFilename)
 {
   CAMLparam2(mlCanvas, mlFilename);
-  bool res = canvas_export_png(Canvas_val(mlCanvas),
-                               String_val(mlFilename));
+  canvas_t *canvas = Canvas_val(mlCanvas);
+  char *filename = _ml_canvas_string_dup(mlFilename);
+  bool released = _ml_canvas_enter_blocking_section(canvas, NULL);
+  bool res = canvas_export_snapshot(canvas, filename);
+  _ml_canvas_leave_blocking_section(released, canvas, NULL);
+  free(filename);
   if (res == false) {
-    caml_failwith("unable to export to PNG");
+    caml_failwith("unable to export to snapshot");
   }
   CAMLreturn(Val_unit);
 }
@@ -1764,12 +2716,13 @@ _ml_canvas_impl_type(
   CAMLparam1(mlBackend);
   impl_type_t impl_type = IMPL_NONE;
   switch (Int_val(mlBackend)) {
-    case TAG_CANVAS:  assert(!"HTML5 Canvas not available from C"); break;
-    case TAG_GDI:     impl_type = IMPL_GDI;     break;
-    case TAG_QUARTZ:  impl_type = IMPL_QUARTZ;  break;
-    case TAG_X11:     impl_type = IMPL_X11;     break;
-    case TAG_WAYLAND: impl_type = IMPL_WAYLAND; break;
-    default:          assert(!"Invalid backend specified"); break;
+    case TAG_CANVAS:   assert(!"HTML5 Canvas not available from C"); break;
+    case TAG_GDI:      impl_type = IMPL_GDI;      break;
+    case TAG_QUARTZ:   impl_type = IMPL_QUARTZ;   break;
+    case TAG_X11:      impl_type = IMPL_X11;      break;
+    case TAG_WAYLAND:  impl_type = IMPL_WAYLAND;  break;
+    case TAG_HEADLESS: impl_type = IMPL_HEADLESS; break;
+    default:           assert(!"Invalid backend specified"); break;
   }
   CAMLreturnT(impl_type_t, impl_type);
 }
@@ -1808,25 +2761,27 @@ ml_canvas_init(
   CAMLreturn(Val_bool(_ml_canvas_initialized));
 }
 
-static value _ml_canvas_mlException = Val_unit;
 static value _ml_canvas_mlState = Val_unit;
 static value _ml_canvas_mlProcessEvent = Val_unit;
 
+/* In batched mode, events other than frame and close events
+   are accumulated here (most recent first) until the next frame */
+static bool _ml_canvas_batched = false;
+static value _ml_canvas_mlBatch = Val_emptylist;
+
+/* Calls the event handler with either an event or
+   a list of events, depending on the current mode */
 static bool
-_ml_canvas_process_event(
-  event_t *event,
-  event_listener_t *next_listener)
+_ml_canvas_call_handler(
+  value mlArg)
 {
-  CAMLparam0();
+  CAMLparam1(mlArg);
   CAMLlocal1(mlResult);
 
-  if (_ml_canvas_mlProcessEvent == Val_unit) {
-    CAMLreturnT(bool, false);
-  }
-
+  int64_t trace_t = trace_begin();
   mlResult = caml_callback2_exn(_ml_canvas_mlProcessEvent,
-                                _ml_canvas_mlState,
-                                Val_event(event));
+                                _ml_canvas_mlState, mlArg);
+  trace_end("process_event", trace_t);
 
   /* If an exception was raised, save for later */
   if (Is_exception_result(mlResult)) {
@@ -1845,18 +2800,98 @@ _ml_canvas_process_event(
   CAMLreturnT(bool, Bool_val(mlResult));
 }
 
-CAMLprim value
-ml_canvas_run(
+static void
+_ml_canvas_flush_batch(
+  void)
+{
+  CAMLparam0();
+  CAMLlocal3(mlEvents, mlCell, mlTmp);
+
+  if (_ml_canvas_mlBatch == Val_emptylist) {
+    CAMLreturn0;
+  }
+
+  /* Put the events back in order */
+  mlEvents = Val_emptylist;
+  for (mlCell = _ml_canvas_mlBatch; mlCell != Val_emptylist;
+       mlCell = Field(mlCell, 1)) {
+    mlTmp = caml_alloc(2, 0);
+    Store_field(mlTmp, 0, Field(mlCell, 0));
+    Store_field(mlTmp, 1, mlEvents);
+    mlEvents = mlTmp;
+  }
+  caml_modify_generational_global_root(&_ml_canvas_mlBatch, Val_emptylist);
+
+  _ml_canvas_call_handler(mlEvents);
+
+  CAMLreturn0;
+}
+
+static bool
+_ml_canvas_process_event(
+  event_t *event,
+  event_listener_t *next_listener)
+{
+  CAMLparam0();
+  CAMLlocal1(mlEvents);
+
+  /* The surface was reallocated, make sure no OCaml
+     code gets to see the old one through its view */
+  if (event->type == EVENT_RESIZE) {
+    Canvas_view_update((canvas_t *)event->target);
+    Canvas_memory_update((canvas_t *)event->target);
+  }
+
+  if (_ml_canvas_mlProcessEvent == Val_unit) {
+    CAMLreturnT(bool, false);
+  }
+
+  if (_ml_canvas_batched == false) {
+    if (event->type == EVENT_IDLE) {
+      CAMLreturnT(bool, false);
+    }
+    CAMLreturnT(bool, _ml_canvas_call_handler(Val_event(event)));
+  }
+
+  bool result = false;
+
+  switch (event->type) {
+    case EVENT_IDLE:
+      _ml_canvas_flush_batch();
+      break;
+    case EVENT_FRAME:
+    case EVENT_CLOSE:
+      /* Delivered alone, so that the handler result applies to them */
+      _ml_canvas_flush_batch();
+      mlEvents = caml_alloc(2, 0);
+      Store_field(mlEvents, 0, Val_event(event));
+      Store_field(mlEvents, 1, Val_emptylist);
+      result = _ml_canvas_call_handler(mlEvents);
+      break;
+    default:
+      mlEvents = caml_alloc(2, 0);
+      Store_field(mlEvents, 0, Val_event(event));
+      Store_field(mlEvents, 1, _ml_canvas_mlBatch);
+      caml_modify_generational_global_root(&_ml_canvas_mlBatch, mlEvents);
+      break;
+  }
+
+  CAMLreturnT(bool, result);
+}
+
+static void
+_ml_canvas_run(
   value mlProcessEvent,
   value mlContinuation,
-  value mlState)
+  value mlState,
+  bool batched)
 {
   CAMLparam3(mlProcessEvent, mlContinuation, mlState);
   CAMLlocal1(mlResult);
 
   /* If already running, ignore */
   if (_ml_canvas_mlProcessEvent != Val_unit) {
-    CAMLreturn(Val_unit);
+    CAMLreturn0;
   }
 
   _ml_canvas_mlProcessEvent = mlProcessEvent;
@@ -1868,12 +2903,21 @@ ml_canvas_run(
   _ml_canvas_mlException = Val_unit;
   caml_register_generational_global_root(&_ml_canvas_mlException);
 
+  _ml_canvas_batched = batched;
+  _ml_canvas_mlBatch = Val_emptylist;
+  caml_register_generational_global_root(&_ml_canvas_mlBatch);
+
   event_listener_t event_listener = {
     .process_event = _ml_canvas_process_event,
     .next_listener = NULL
   };
   backend_run(&event_listener);
 
+  /* Events received after the last frame are dropped */
+  caml_remove_generational_global_root(&_ml_canvas_mlBatch);
+  _ml_canvas_mlBatch = Val_emptylist;
+  _ml_canvas_batched = false;
+
   mlResult = _ml_canvas_mlException;
   caml_remove_generational_global_root(&_ml_canvas_mlException);
   _ml_canvas_mlException = Val_unit;
@@ -1896,6 +2940,28 @@ ml_canvas_run(
     caml_raise(mlResult);
   }
 
+  CAMLreturn0;
+}
+
+CAMLprim value
+ml_canvas_run(
+  value mlProcessEvent,
+  value mlContinuation,
+  value mlState)
+{
+  CAMLparam3(mlProcessEvent, mlContinuation, mlState);
+  _ml_canvas_run(mlProcessEvent, mlContinuation, mlState, false);
+  CAMLreturn(Val_unit);
+}
+
+CAMLprim value
+ml_canvas_run_batched(
+  value mlProcessEvent,
+  value mlContinuation,
+  value mlState)
+{
+  CAMLparam3(mlProcessEvent, mlContinuation, mlState);
+  _ml_canvas_run(mlProcessEvent, mlContinuation, mlState, true);
   CAMLreturn(Val_unit);
 }
 
@@ -1908,6 +2974,89 @@ ml_canvas_stop(
   CAMLreturn(Val_unit);
 }
 
+/* Watches are identified by their id on the OCaml side,
+   which builds the corresponding event from it */
+static void
+_ml_canvas_watch_fired(
+  int32_t id,
+  int32_t flags,
+  void *data)
+{
+  CAMLparam0();
+  CAMLlocal2(mlEvent, mlEvents);
+
+  if (_ml_canvas_mlProcessEvent == Val_unit) {
+    CAMLreturn0;
+  }
+
+  mlEvent = caml_callback2_exn(*caml_named_value("ml_canvas_watch_event"),
+                               Val_int(id), Val_int(flags));
+  if (Is_exception_result(mlEvent)) {
+    mlEvent = Extract_exception(mlEvent);
+    if (_ml_canvas_mlException == Val_unit) {
+      caml_modify_generational_global_root(&_ml_canvas_mlException, mlEvent);
+    }
+    backend_stop();
+    CAMLreturn0;
+  }
+
+  if (_ml_canvas_batched == false) {
+    _ml_canvas_call_handler(mlEvent);
+  } else {
+    /* Not held back, as these usually call for a quick reaction */
+    _ml_canvas_flush_batch();
+    mlEvents = caml_alloc(2, 0);
+    Store_field(mlEvents, 0, mlEvent);
+    Store_field(mlEvents, 1, Val_emptylist);
+    _ml_canvas_call_handler(mlEvents);
+  }
+
+  CAMLreturn0;
+}
+
+CAMLprim value
+ml_canvas_watch_fd(
+  value mlFd,
+  value mlRead,
+  value mlWrite)
+{
+  CAMLparam3(mlFd, mlRead, mlWrite);
+  int32_t flags = (Bool_val(mlRead) ? WATCH_READ : 0) |
+                  (Bool_val(mlWrite) ? WATCH_WRITE : 0);
+  if ((Int_val(mlFd) < 0) || (flags == 0)) {
+    caml_invalid_argument("Backend.watchFd");
+  }
+  int32_t id = backend_watch_fd(Int_val(mlFd), flags,
+                                _ml_canvas_watch_fired, NULL);
+  if (id == 0) {
+    caml_failwith("unable to watch file descriptor");
+  }
+  CAMLreturn(Val_int(id));
+}
+
+CAMLprim value
+ml_canvas_watch_timer(
+  value mlDelay,
+  value mlPeriod)
+{
+  CAMLparam2(mlDelay, mlPeriod);
+  int32_t id = backend_watch_timer(Int64_val(mlDelay), Int64_val(mlPeriod),
+                                   _ml_canvas_watch_fired, NULL);
+  if (id == 0) {
+    caml_failwith("unable to start timer");
+  }
+  CAMLreturn(Val_int(id));
+}
+
+CAMLprim value
+ml_canvas_unwatch(
+  value mlId)
+{
+  CAMLparam1(mlId);
+  backend_unwatch(Int_val(mlId));
+  CAMLreturn(Val_unit);
+}
+
 CAMLprim value
 ml_canvas_get_current_timestamp(
   void)
@@ -1916,6 +3065,62 @@ ml_canvas_get_current_timestamp(
   CAMLreturn(caml_copy_int64(backend_get_time()));
 }
 
+CAMLprim value
+ml_canvas_set_frame_rate(
+  value mlRate)
+{
+  CAMLparam1(mlRate);
+  backend_set_frame_rate(Int32_val_clip(mlRate));
+  CAMLreturn(Val_unit);
+}
+
+CAMLprim value
+ml_canvas_get_frame_rate(
+  void)
+{
+  CAMLparam0();
+  CAMLreturn(Val_int(backend_get_frame_rate()));
+}
+
+CAMLprim value
+ml_canvas_set_event_coalescing(
+  value mlCoalescing)
+{
+  CAMLparam1(mlCoalescing);
+  backend_set_event_coalescing(Bool_val(mlCoalescing));
+  CAMLreturn(Val_unit);
+}
+
+CAMLprim value
+ml_canvas_get_event_coalescing(
+  void)
+{
+  CAMLparam0();
+  CAMLreturn(Val_bool(backend_get_event_coalescing()));
+}
+
+CAMLprim value
+ml_canvas_start_trace(
+  value mlFilename)
+{
+  CAMLparam1(mlFilename);
+  if (trace_start(String_val(mlFilename)) == false) {
+    caml_failwith("unable to start trace");
+  }
+  CAMLreturn(Val_unit);
+}
+
+CAMLprim value
+ml_canvas_stop_trace(
+  value mlUnit)
+{
+  CAMLparam1(mlUnit);
+  if (trace_stop() == false) {
+    caml_failwith("unable to write trace");
+  }
+  CAMLreturn(Val_unit);
+}
+
 CAMLprim value
 ml_canvas_get_canvas(
   value mlId)
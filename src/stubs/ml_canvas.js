@@ -142,18 +142,43 @@ function _move_handler(e) {
   return false;
 }
 
+//Provides: _frame_rate
+var _frame_rate = 60;
+
+//Provides: _frame_interval
+var _frame_interval = 0.0;
+
+//Provides: _frame_last
+var _frame_last = 0.0;
+
 //Provides: _frame_handler
-//Requires: _ml_canvas_process_event,EVENT_TAG
-//Requires: caml_int64_of_float
+//Requires: _ml_canvas_process_event,EVENT_TAG,_frame_interval,_frame_last
+//Requires: _ml_canvas_flush_batch,caml_int64_of_float
 function _frame_handler(timestamp) {
 
-  var surfaces = document.getElementsByTagName("canvas");
+  // Skipped frames must not hold back batched events
+  _ml_canvas_flush_batch();
 
-  for (var i = 0; i < surfaces.length; ++i) {
-    var evt = [ EVENT_TAG.FRAME,
-                [ 0, surfaces[i].canvas,
-                  caml_int64_of_float(timestamp * 1000.0) ] ];
-    _ml_canvas_process_event(evt);
+  // Frames are paced by the browser; a lower rate skips some of them
+  if (timestamp - _frame_last >= _frame_interval) {
+
+    _frame_last = timestamp;
+
+    var surfaces = document.getElementsByTagName("canvas");
+
+    for (var i = 0; i < surfaces.length; ++i) {
+      var canvas = surfaces[i].canvas;
+      if (canvas.frameOnDemand) {
+        if (!canvas.frameRequested) {
+          continue;
+        }
+        canvas.frameRequested = false;
+      }
+      var evt = [ EVENT_TAG.FRAME,
+                  [ 0, canvas,
+                    caml_int64_of_float(timestamp * 1000.0) ] ];
+      _ml_canvas_process_event(evt);
+    }
   }
 
   window.requestAnimationFrame(_frame_handler);
@@ -252,6 +277,14 @@ function ml_canvas_image_data_get_size(data) {
   return [ 0, caml_ba_dim(data, 1), caml_ba_dim(data, 0) ];
 }
 
+//Provides: ml_canvas_image_data_release
+function ml_canvas_image_data_release(data) {
+  data.data = new data.data.constructor(0);
+  for (var i = 0; i < data.dims.length; i++) {
+    data.dims[i] = 0;
+  }
+}
+
 //Provides: ml_canvas_image_data_fill
 //Requires: caml_ba_to_typed_array
 function ml_canvas_image_data_fill(data, color) {
@@ -386,7 +419,7 @@ function ml_canvas_image_data_import_png(data, pos, filename) {
 //Provides: ml_canvas_image_data_export_png
 //Requires: _ml_canvas_surface_of_ba
 //Requires: caml_create_file
-function ml_canvas_image_data_export_png(data, filename) {
+function ml_canvas_image_data_export_png(data, filename, options) {
   var surface = _ml_canvas_surface_of_ba(data);
   if (surface !== null) {
     var data = surface.toDataURL("image/png").substring(22);
@@ -394,6 +427,127 @@ function ml_canvas_image_data_export_png(data, filename) {
   }
 }
 
+//Provides: _ml_canvas_png_of_surface
+function _ml_canvas_png_of_surface(surface) {
+  // Encoding options are not supported by the browser
+  var str = window.atob(surface.toDataURL("image/png").substring(22));
+  var ta = new window.Uint8Array(str.length);
+  for (var i = 0; i < str.length; i++) {
+    ta[i] = str.charCodeAt(i);
+  }
+  return ta;
+}
+
+//Provides: ml_canvas_image_data_export_png_to_bytes
+//Requires: _ml_canvas_surface_of_ba,_ml_canvas_png_of_surface
+//Requires: caml_bytes_of_array,caml_failwith
+function ml_canvas_image_data_export_png_to_bytes(data, options) {
+  var surface = _ml_canvas_surface_of_ba(data);
+  if (surface === null) {
+    caml_failwith("unable to export pixmap to PNG data");
+  }
+  return caml_bytes_of_array(_ml_canvas_png_of_surface(surface));
+}
+
+//Provides: ml_canvas_image_data_export_png_to_buffer
+//Requires: _ml_canvas_surface_of_ba,_ml_canvas_png_of_surface
+//Requires: caml_ba_create_unsafe,caml_failwith
+function ml_canvas_image_data_export_png_to_buffer(data, options) {
+  var surface = _ml_canvas_surface_of_ba(data);
+  if (surface === null) {
+    caml_failwith("unable to export pixmap to PNG data");
+  }
+  var ta = _ml_canvas_png_of_surface(surface);
+  return caml_ba_create_unsafe(3 /* Uint8Array */, 0 /* c_layout */,
+                               [ta.length], ta);
+}
+
+//Provides: _ml_canvas_snapshot_of_ba
+//Requires: caml_ba_dim,caml_ba_to_typed_array
+function _ml_canvas_snapshot_of_ba(data) {
+  // Same layout as the native snapshots: magic, width, height, BGRA rows
+  var width = caml_ba_dim(data, 1);
+  var height = caml_ba_dim(data, 0);
+  var ta = caml_ba_to_typed_array(data);
+  var header = "OCNVBGRA";
+  var dims = [ width, height ];
+  for (var d = 0; d < 2; d++) {
+    for (var i = 0; i < 4; i++) {
+      header += String.fromCharCode((dims[d] >>> (8 * i)) & 0xFF);
+    }
+  }
+  var chunks = [ header ];
+  for (var i = 0; i < ta.length; i += 0x8000) {
+    chunks.push(String.fromCharCode.apply(null, ta.subarray(i, i + 0x8000)));
+  }
+  return chunks.join("");
+}
+
+//Provides: _ml_canvas_ba_of_snapshot_file
+//Requires: caml_read_file_content,caml_ml_string_length,caml_string_unsafe_get
+//Requires: caml_ba_create_unsafe
+function _ml_canvas_ba_of_snapshot_file(filename) {
+  var fc = caml_read_file_content(filename);
+  var len = caml_ml_string_length(fc);
+  if (len < 16) {
+    return null;
+  }
+  var magic = "OCNVBGRA";
+  for (var i = 0; i < 8; i++) {
+    if (caml_string_unsafe_get(fc, i) !== magic.charCodeAt(i)) {
+      return null;
+    }
+  }
+  var dims = [ 0, 0 ];
+  for (var d = 0; d < 2; d++) {
+    for (var i = 3; i >= 0; i--) {
+      dims[d] = dims[d] * 256 + caml_string_unsafe_get(fc, 8 + 4 * d + i);
+    }
+  }
+  var width = dims[0];
+  var height = dims[1];
+  if ((width === 0) || (height === 0) || (len < 16 + width * height * 4)) {
+    return null;
+  }
+  var dta = new window.Uint8Array(width * height * 4);
+  for (var i = 0; i < dta.length; i++) {
+    dta[i] = caml_string_unsafe_get(fc, 16 + i);
+  }
+  return caml_ba_create_unsafe(3 /* Uint8Array */, 0 /* c_layout */,
+                               [height, width, 4], dta);
+}
+
+//Provides: ml_canvas_image_data_create_from_snapshot
+//Requires: _ml_canvas_ba_of_snapshot_file,caml_failwith
+function ml_canvas_image_data_create_from_snapshot(filename) {
+  var ba = _ml_canvas_ba_of_snapshot_file(filename);
+  if (ba === null) {
+    caml_failwith("unable to create pixmap from snapshot file");
+  }
+  return ba;
+}
+
+//Provides: ml_canvas_image_data_import_snapshot
+//Requires: _ml_canvas_ba_of_snapshot_file,ml_canvas_image_data_blit
+//Requires: caml_ba_dim,caml_failwith
+function ml_canvas_image_data_import_snapshot(data, pos, filename) {
+  var ba = _ml_canvas_ba_of_snapshot_file(filename);
+  if (ba === null) {
+    caml_failwith("unable to import snapshot file into pixmap");
+  }
+  ml_canvas_image_data_blit(data, pos, ba, [ 0, 0, 0 ],
+                            [ 0, caml_ba_dim(ba, 1), caml_ba_dim(ba, 0) ]);
+  return 0;
+}
+
+//Provides: ml_canvas_image_data_export_snapshot
+//Requires: _ml_canvas_snapshot_of_ba
+//Requires: caml_create_file
+function ml_canvas_image_data_export_snapshot(data, filename) {
+  caml_create_file(filename, _ml_canvas_snapshot_of_ba(data));
+  return 0;
+}
+
 
 
 /* Path2D */
@@ -418,6 +572,21 @@ function ml_canvas_path_line_to(path, p) {
   path.lineTo(p[1], p[2]);
 }
 
+//Provides: ml_canvas_path_add_points
+//Requires: caml_ba_to_typed_array
+function ml_canvas_path_add_points(path, moves, points) {
+  var pts = caml_ba_to_typed_array(points);
+  var mvs = (moves === 0) ? null : caml_ba_to_typed_array(moves[1]);
+  for (var i = 0; i < pts.length / 2; ++i) {
+    var is_move = (mvs === null) ? (i === 0) : (mvs[i] !== 0);
+    if (is_move) {
+      path.moveTo(pts[2 * i], pts[2 * i + 1]);
+    } else {
+      path.lineTo(pts[2 * i], pts[2 * i + 1]);
+    }
+  }
+}
+
 //Provides: ml_canvas_path_arc
 function ml_canvas_path_arc(path, p, radius, theta1, theta2, ccw) {
   path.arc(p[1], p[2], radius, theta1, theta2, ccw);
@@ -767,6 +936,17 @@ function ml_canvas_create_offscreen_from_png(filename) {
   return ml_promise;
 }
 
+//Provides: ml_canvas_create_offscreen_from_snapshot
+//Requires: ml_canvas_create_offscreen_from_image_data
+//Requires: _ml_canvas_ba_of_snapshot_file,caml_failwith
+function ml_canvas_create_offscreen_from_snapshot(filename) {
+  var ba = _ml_canvas_ba_of_snapshot_file(filename);
+  if (ba === null) {
+    caml_failwith("unable to create a canvas from the given snapshot");
+  }
+  return ml_canvas_create_offscreen_from_image_data(ba);
+}
+
 
 
 /* Visibility */
@@ -821,6 +1001,19 @@ function ml_canvas_close(canvas) {
 }
 
 
+// Provides: ml_canvas_destroy
+// Requires: ml_canvas_close
+function ml_canvas_destroy(canvas) {
+  ml_canvas_close(canvas);
+  // Browsers release the backing store of empty canvases
+  if (canvas.surface != null) {
+    canvas.surface.width = 0;
+    canvas.surface.height = 0;
+  }
+  canvas.width = 0;
+  canvas.height = 0;
+}
+
 
 /* Configuration */
 
@@ -829,6 +1022,41 @@ function ml_canvas_get_id(canvas) {
   return canvas.id;
 }
 
+// Provides: ml_canvas_get_frame_on_demand
+function ml_canvas_get_frame_on_demand(canvas) {
+  return canvas.frameOnDemand ? 1 : 0;
+}
+
+// Provides: ml_canvas_set_frame_on_demand
+function ml_canvas_set_frame_on_demand(canvas, on_demand) {
+  canvas.frameOnDemand = (on_demand !== 0);
+}
+
+// Provides: ml_canvas_request_frame
+function ml_canvas_request_frame(canvas) {
+  canvas.frameRequested = true;
+}
+
+// Provides: ml_canvas_set_stats_enabled
+function ml_canvas_set_stats_enabled(canvas, enabled) {
+  canvas.statsEnabled = (enabled !== 0);
+}
+
+// Provides: ml_canvas_get_stats_enabled
+function ml_canvas_get_stats_enabled(canvas) {
+  return canvas.statsEnabled ? 1 : 0;
+}
+
+// Provides: ml_canvas_get_stats
+function ml_canvas_get_stats(canvas) {
+  // Rendering is done by the browser, nothing can be measured
+  return [ 0, 0, 0, 0, 0, 0, 0, 0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 ];
+}
+
+// Provides: ml_canvas_reset_stats
+function ml_canvas_reset_stats(canvas) {
+}
+
 // Provides: ml_canvas_get_size
 function ml_canvas_get_size(canvas) {
   return [ 0, canvas.width, canvas.height ];
@@ -1179,6 +1407,12 @@ function ml_canvas_line_to(canvas, p) {
   canvas.ctxt.lineTo(p[1], p[2]);
 }
 
+//Provides: ml_canvas_polyline
+//Requires: ml_canvas_path_add_points
+function ml_canvas_polyline(canvas, moves, points) {
+  ml_canvas_path_add_points(canvas.ctxt, moves, points);
+}
+
 //Provides: ml_canvas_arc
 function ml_canvas_arc(canvas, p, radius, theta1, theta2, ccw) {
   canvas.ctxt.arc(p[1], p[2], radius, theta1, theta2, ccw);
@@ -1295,6 +1529,236 @@ function ml_canvas_blit(dst_canvas, dpos, src_canvas, spos, size) {
                             dpos[1], dpos[2], width, height);
 }
 
+//Provides: ml_canvas_blit_batch
+//Requires: caml_ba_dim,caml_ba_to_typed_array
+function ml_canvas_blit_batch(dst_canvas, src_canvas, sprites, reorder) {
+  // Order is always preserved, the browser does its own batching
+  var count = caml_ba_dim(sprites, 0);
+  var fields = caml_ba_dim(sprites, 1);
+  var data = caml_ba_to_typed_array(sprites);
+  var ctxt = dst_canvas.ctxt;
+  var alpha = ctxt.globalAlpha;
+  for (var i = 0, k = 0; i < count; i++, k += fields) {
+    if (fields === 15) {
+      ctxt.save();
+      ctxt.transform(data[k+9], data[k+10], data[k+11],
+                     data[k+12], data[k+13], data[k+14]);
+    }
+    ctxt.globalAlpha = alpha * Math.min(data[k+8], 1.0);
+    ctxt.drawImage(src_canvas.surface,
+                   data[k+0], data[k+1], data[k+2], data[k+3],
+                   data[k+4], data[k+5], data[k+6], data[k+7]);
+    if (fields === 15) {
+      ctxt.restore();
+    }
+  }
+  ctxt.globalAlpha = alpha;
+}
+
+//Provides: ml_canvas_execute
+//Requires: caml_ba_to_typed_array,caml_invalid_argument
+//Requires: Join_type_val,Cap_type_val,Compop_val,_color_of_int
+function ml_canvas_execute(canvas, data, length) {
+  // Same layout as in implem/command.h
+  var arity = [ 0, 0, 6, 6, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 2,
+                0, 0, 2, 2, 6, 5, 4, 6, 4, 8, 1, 0, 1, 4, 4 ];
+  var d = caml_ba_to_typed_array(data);
+  if (length < 0 || length > d.length) {
+    caml_invalid_argument("Invalid command buffer");
+  }
+  var ctxt = canvas.ctxt;
+  var i = 0;
+  while (i < length) {
+    var op = d[i];
+    if (!(op >= 0 && op < arity.length && op === Math.floor(op)) ||
+        (length - i - 1 < arity[op])) {
+      caml_invalid_argument("Malformed command in command buffer");
+    }
+    var k = i + 1;
+    i = k + arity[op];
+    switch (op) {
+      case 0: ctxt.save(); break;
+      case 1: ctxt.restore(); break;
+      case 2: ctxt.setTransform(d[k], d[k+1], d[k+2],
+                                d[k+3], d[k+4], d[k+5]); break;
+      case 3: ctxt.transform(d[k], d[k+1], d[k+2],
+                             d[k+3], d[k+4], d[k+5]); break;
+      case 4: ctxt.translate(d[k], d[k+1]); break;
+      case 5: ctxt.scale(d[k], d[k+1]); break;
+      case 6: ctxt.transform(1.0, d[k+1], d[k], 1.0, 0.0, 0.0); break;
+      case 7: ctxt.rotate(d[k]); break;
+      case 8: ctxt.lineWidth = d[k]; break;
+      case 9: ctxt.lineJoin = Join_type_val(d[k]); break;
+      case 10: ctxt.lineCap = Cap_type_val(d[k]); break;
+      case 11: ctxt.miterLimit = d[k]; break;
+      case 12: ctxt.lineDashOffset = d[k]; break;
+      case 13: ctxt.strokeStyle = _color_of_int(d[k] | 0); break;
+      case 14: ctxt.fillStyle = _color_of_int(d[k] | 0); break;
+      case 15: ctxt.globalAlpha = d[k]; break;
+      case 16: ctxt.globalCompositeOperation = Compop_val(d[k]); break;
+      case 17: ctxt.shadowColor = _color_of_int(d[k] | 0); break;
+      case 18: ctxt.shadowBlur = d[k]; break;
+      case 19: ctxt.shadowOffsetX = d[k];
+               ctxt.shadowOffsetY = d[k+1]; break;
+      case 20: ctxt.beginPath(); break;
+      case 21: ctxt.closePath(); break;
+      case 22: ctxt.moveTo(d[k], d[k+1]); break;
+      case 23: ctxt.lineTo(d[k], d[k+1]); break;
+      case 24: ctxt.arc(d[k], d[k+1], d[k+2], d[k+3], d[k+4],
+                        d[k+5] !== 0); break;
+      case 25: ctxt.arcTo(d[k], d[k+1], d[k+2], d[k+3], d[k+4]); break;
+      case 26: ctxt.quadraticCurveTo(d[k], d[k+1], d[k+2], d[k+3]); break;
+      case 27: ctxt.bezierCurveTo(d[k], d[k+1], d[k+2],
+                                  d[k+3], d[k+4], d[k+5]); break;
+      case 28: ctxt.rect(d[k], d[k+1], d[k+2], d[k+3]); break;
+      case 29: ctxt.ellipse(d[k], d[k+1], d[k+2], d[k+3], d[k+4],
+                            d[k+5], d[k+6], d[k+7] !== 0); break;
+      case 30: ctxt.fill(d[k] !== 0 ? "nonzero" : "evenodd"); break;
+      case 31: ctxt.stroke(); break;
+      case 32: ctxt.clip(d[k] !== 0 ? "nonzero" : "evenodd"); break;
+      case 33: ctxt.fillRect(d[k], d[k+1], d[k+2], d[k+3]); break;
+      case 34: ctxt.strokeRect(d[k], d[k+1], d[k+2], d[k+3]); break;
+    }
+  }
+}
+
+// There are no render threads in the browser: commands are run right away
+
+//Provides: ml_canvas_set_threaded
+//Requires: caml_failwith
+function ml_canvas_set_threaded(canvas, threaded) {
+  if (threaded !== 0) {
+    caml_failwith("unable to start a render thread");
+  }
+}
+
+//Provides: ml_canvas_get_threaded
+function ml_canvas_get_threaded(canvas) {
+  return 0;
+}
+
+//Provides: ml_canvas_submit
+//Requires: ml_canvas_execute
+function ml_canvas_submit(canvas, data, length) {
+  ml_canvas_execute(canvas, data, length);
+}
+
+
+
+/* Pictures */
+
+// While recording, the context is replaced by a proxy logging calls and
+// property changes. Drawing calls are only logged, other calls (e.g.
+// path building) also go through, so that getters keep working.
+
+//Provides: _picture_state
+var _picture_state = [ "fillStyle", "strokeStyle", "lineWidth", "lineJoin",
+                       "lineCap", "miterLimit", "lineDashOffset",
+                       "globalAlpha", "globalCompositeOperation",
+                       "shadowColor", "shadowBlur", "shadowOffsetX",
+                       "shadowOffsetY", "font" ];
+
+//Provides: ml_canvas_begin_picture
+//Requires: caml_failwith,_picture_state
+function ml_canvas_begin_picture(canvas) {
+  if (canvas.picture) {
+    caml_failwith("unable to start recording a picture");
+  }
+  var ctxt = canvas.ctxt;
+  var ops = [];
+  _picture_state.forEach(function(prop) {
+    ops.push({ set: prop, value: ctxt[prop] });
+  });
+  var m = ctxt.getTransform();
+  ops.push({ call: "setTransform", args: [ m.a, m.b, m.c, m.d, m.e, m.f ] });
+  ops.push({ call: "setLineDash", args: [ ctxt.getLineDash() ] });
+  var drawing = [ "fill", "stroke", "fillRect", "strokeRect", "fillText",
+                  "strokeText", "drawImage" ];
+  canvas.picture = { ctxt: ctxt, ops: ops };
+  canvas.ctxt = new Proxy(ctxt, {
+    get: function(target, prop) {
+      var v = target[prop];
+      if (typeof(v) !== "function") {
+        return v;
+      }
+      if (/^(get|is|create|measure)/.test(prop)) {
+        return v.bind(target);
+      }
+      return function() {
+        var args = Array.prototype.slice.call(arguments);
+        if (prop === "drawImage") {
+          // Sources may change afterwards, so keep a copy
+          var copy = document.createElement("canvas");
+          copy.width = args[0].width;
+          copy.height = args[0].height;
+          copy.getContext("2d").drawImage(args[0], 0, 0);
+          args[0] = copy;
+        }
+        ops.push({ call: prop, args: args });
+        if (drawing.indexOf(prop) < 0) {
+          return v.apply(target, arguments);
+        }
+      };
+    },
+    set: function(target, prop, value) {
+      ops.push({ set: prop, value: value });
+      target[prop] = value;
+      return true;
+    }
+  });
+}
+
+//Provides: ml_canvas_end_picture
+//Requires: caml_failwith
+function ml_canvas_end_picture(canvas) {
+  if (!canvas.picture) {
+    caml_failwith("canvas is not recording a picture");
+  }
+  var picture = canvas.picture;
+  canvas.ctxt = picture.ctxt;
+  canvas.picture = null;
+  return { ops: picture.ops };
+}
+
+//Provides: ml_canvas_draw_picture
+function ml_canvas_draw_picture(canvas, t, picture) {
+  var ctxt = canvas.ctxt;
+  ctxt.save();
+  if (t) {
+    t = t[1];
+    ctxt.transform(t[1], t[2], t[3], t[4], t[5], t[6]);
+  }
+  var base = ctxt.getTransform();
+  var alpha = ctxt.globalAlpha;
+  var depth = 0;
+  picture.ops.forEach(function(op) {
+    if (op.set === "globalAlpha") {
+      ctxt.globalAlpha = op.value * alpha;
+    } else if (op.set) {
+      ctxt[op.set] = op.value;
+    } else if (op.call === "setTransform") {
+      ctxt.setTransform(base);
+      ctxt.transform.apply(ctxt, op.args);
+    } else if (op.call === "resetTransform") {
+      ctxt.setTransform(base);
+    } else if (op.call === "save") {
+      ctxt.save();
+      depth++;
+    } else if (op.call === "restore") {
+      // Unmatched restores do not reach the caller's state
+      if (depth > 0) {
+        ctxt.restore();
+        depth--;
+      }
+    } else {
+      ctxt[op.call].apply(ctxt, op.args);
+    }
+  });
+  for (; depth >= 0; depth--) {
+    ctxt.restore();
+  }
+}
+
 
 /* Direct pixel access */
 
@@ -1337,6 +1801,15 @@ function ml_canvas_get_image_data(canvas, pos, size) {
                                [height, width, 4], dta);
 }
 
+//Provides: ml_canvas_get_image_data_view
+//Requires: ml_canvas_get_image_data
+function ml_canvas_get_image_data_view(canvas) {
+  // Browsers do not expose the canvas backing store, so this is a copy
+  var view = ml_canvas_get_image_data(canvas, [0, 0, 0],
+                                      [0, canvas.width, canvas.height]);
+  return [0, view, 1];
+}
+
 //Provides: ml_canvas_put_image_data
 //Requires: caml_ba_to_typed_array,caml_ba_dim
 function ml_canvas_put_image_data(canvas, dpos, data, spos, size) {
@@ -1383,11 +1856,48 @@ function ml_canvas_import_png(canvas, pos, filename) {
 
 //Provides: ml_canvas_export_png
 //Requires: caml_create_file
-function ml_canvas_export_png(canvas, filename) {
+function ml_canvas_export_png(canvas, filename, options) {
   var data = canvas.surface.toDataURL("image/png").substring(22);
   caml_create_file(filename, window.atob(data));
 }
 
+//Provides: ml_canvas_export_png_to_bytes
+//Requires: _ml_canvas_png_of_surface,caml_bytes_of_array
+function ml_canvas_export_png_to_bytes(canvas, options) {
+  return caml_bytes_of_array(_ml_canvas_png_of_surface(canvas.surface));
+}
+
+//Provides: ml_canvas_export_png_to_buffer
+//Requires: _ml_canvas_png_of_surface,caml_ba_create_unsafe
+function ml_canvas_export_png_to_buffer(canvas, options) {
+  var ta = _ml_canvas_png_of_surface(canvas.surface);
+  return caml_ba_create_unsafe(3 /* Uint8Array */, 0 /* c_layout */,
+                               [ta.length], ta);
+}
+
+//Provides: ml_canvas_import_snapshot
+//Requires: _ml_canvas_ba_of_snapshot_file,ml_canvas_put_image_data
+//Requires: caml_ba_dim,caml_failwith
+function ml_canvas_import_snapshot(canvas, pos, filename) {
+  var ba = _ml_canvas_ba_of_snapshot_file(filename);
+  if (ba === null) {
+    caml_failwith("unable to import snapshot");
+  }
+  ml_canvas_put_image_data(canvas, pos, ba, [ 0, 0, 0 ],
+                           [ 0, caml_ba_dim(ba, 1), caml_ba_dim(ba, 0) ]);
+  return 0;
+}
+
+//Provides: ml_canvas_export_snapshot
+//Requires: ml_canvas_get_image_data,_ml_canvas_snapshot_of_ba
+//Requires: caml_create_file
+function ml_canvas_export_snapshot(canvas, filename) {
+  var data = ml_canvas_get_image_data(canvas, [ 0, 0, 0 ],
+                                      [ 0, canvas.width, canvas.height ]);
+  caml_create_file(filename, _ml_canvas_snapshot_of_ba(data));
+  return 0;
+}
+
 
 
 /* Event */
@@ -1447,14 +1957,14 @@ var _ml_canvas_mlContinuation = null;
 //Provides: _ml_canvas_mlState
 var _ml_canvas_mlState = null;
 
-//Provides: _ml_canvas_process_event
-//Requires: _ml_canvas_mlProcessEvent,_ml_canvas_mlContinuation,_ml_canvas_mlState,ml_canvas_stop
-function _ml_canvas_process_event(mlEvent) {
-  if (_ml_canvas_mlProcessEvent === null) {
-    return false;
-  }
+//Provides: _ml_canvas_batch
+var _ml_canvas_batch = null;
+
+//Provides: _ml_canvas_call_handler
+//Requires: _ml_canvas_mlProcessEvent,_ml_canvas_mlState,ml_canvas_stop
+function _ml_canvas_call_handler(mlArg) {
   try {
-    var mlResult = _ml_canvas_mlProcessEvent(_ml_canvas_mlState, mlEvent);
+    var mlResult = _ml_canvas_mlProcessEvent(_ml_canvas_mlState, mlArg);
     _ml_canvas_mlState = mlResult[1];
     return mlResult[2];
   } catch (exn) {
@@ -1464,8 +1974,46 @@ function _ml_canvas_process_event(mlEvent) {
   }
 }
 
+//Provides: _ml_canvas_flush_batch
+//Requires: _ml_canvas_batch,_ml_canvas_call_handler,_ml_canvas_mlProcessEvent
+function _ml_canvas_flush_batch() {
+  if ((_ml_canvas_batch === null) || (_ml_canvas_batch.length === 0) ||
+      (_ml_canvas_mlProcessEvent === null)) {
+    return;
+  }
+  var mlEvents = 0;
+  for (var i = _ml_canvas_batch.length - 1; i >= 0; --i) {
+    mlEvents = [0, _ml_canvas_batch[i], mlEvents];
+  }
+  _ml_canvas_batch = [];
+  _ml_canvas_call_handler(mlEvents);
+}
+
+//Provides: _ml_canvas_process_event
+//Requires: _ml_canvas_mlProcessEvent,_ml_canvas_batch,_ml_canvas_call_handler
+//Requires: _ml_canvas_flush_batch,EVENT_TAG
+function _ml_canvas_process_event(mlEvent) {
+  if (_ml_canvas_mlProcessEvent === null) {
+    return false;
+  }
+  if (_ml_canvas_batch === null) {
+    return _ml_canvas_call_handler(mlEvent);
+  }
+  switch (mlEvent[0]) {
+    case EVENT_TAG.FRAME:
+    case EVENT_TAG.CANVAS_CLOSED:
+      // Delivered alone, so that the handler result applies to them
+      _ml_canvas_flush_batch();
+      return _ml_canvas_call_handler([0, mlEvent, 0]);
+    default:
+      _ml_canvas_batch.push(mlEvent);
+      return false;
+  }
+}
+
 //Provides: ml_canvas_run
 //Requires: _ml_canvas_mlProcessEvent,_ml_canvas_mlContinuation,_ml_canvas_mlState
+//Requires: _ml_canvas_batch
 function ml_canvas_run(mlProcessEvent, mlContinuation, mlState) {
   if (_ml_canvas_mlProcessEvent !== null) {
     return;
@@ -1473,6 +2021,20 @@ function ml_canvas_run(mlProcessEvent, mlContinuation, mlState) {
   _ml_canvas_mlProcessEvent = mlProcessEvent;
   _ml_canvas_mlContinuation = mlContinuation;
   _ml_canvas_mlState = mlState;
+  _ml_canvas_batch = null;
+}
+
+//Provides: ml_canvas_run_batched
+//Requires: _ml_canvas_mlProcessEvent,_ml_canvas_mlContinuation,_ml_canvas_mlState
+//Requires: _ml_canvas_batch
+function ml_canvas_run_batched(mlProcessEvent, mlContinuation, mlState) {
+  if (_ml_canvas_mlProcessEvent !== null) {
+    return;
+  }
+  _ml_canvas_mlProcessEvent = mlProcessEvent;
+  _ml_canvas_mlContinuation = mlContinuation;
+  _ml_canvas_mlState = mlState;
+  _ml_canvas_batch = [];
 }
 
 //Provides: ml_canvas_stop
@@ -1489,9 +2051,101 @@ function ml_canvas_stop() {
   }
 }
 
+//Provides: _ml_canvas_timers
+var _ml_canvas_timers = { next_id: 1 };
+
+//Provides: _ml_canvas_watch_fired
+//Requires: _ml_canvas_mlProcessEvent,_ml_canvas_batch,_ml_canvas_call_handler
+//Requires: _ml_canvas_flush_batch,caml_named_value,ml_canvas_stop
+function _ml_canvas_watch_fired(id, flags) {
+  if (_ml_canvas_mlProcessEvent === null) {
+    return;
+  }
+  var mlEvent;
+  try {
+    mlEvent = caml_named_value("ml_canvas_watch_event")(id, flags);
+  } catch (exn) {
+    ml_canvas_stop();
+    return;
+  }
+  if (_ml_canvas_batch === null) {
+    _ml_canvas_call_handler(mlEvent);
+  } else {
+    _ml_canvas_flush_batch();
+    _ml_canvas_call_handler([0, mlEvent, 0]);
+  }
+}
+
+//Provides: ml_canvas_watch_fd
+//Requires: caml_failwith
+function ml_canvas_watch_fd(fd, read, write) {
+  caml_failwith("unable to watch file descriptor");
+}
+
+//Provides: ml_canvas_watch_timer
+//Requires: _ml_canvas_timers,_ml_canvas_watch_fired,caml_int64_to_float
+function ml_canvas_watch_timer(delay, period) {
+  var id = _ml_canvas_timers.next_id++;
+  var p = Math.max(0, caml_int64_to_float(period) / 1000.0);
+  _ml_canvas_timers[id] = window.setTimeout(function () {
+    if (p > 0) {
+      _ml_canvas_timers[id] = window.setInterval(function () {
+        _ml_canvas_watch_fired(id, 4);
+      }, p);
+    } else {
+      delete _ml_canvas_timers[id];
+    }
+    _ml_canvas_watch_fired(id, 4);
+  }, Math.max(0, caml_int64_to_float(delay) / 1000.0));
+  return id;
+}
+
+//Provides: ml_canvas_unwatch
+//Requires: _ml_canvas_timers
+function ml_canvas_unwatch(id) {
+  if (_ml_canvas_timers[id] !== undefined) {
+    // Ids are shared between timeouts and intervals
+    window.clearTimeout(_ml_canvas_timers[id]);
+    delete _ml_canvas_timers[id];
+  }
+}
+
 //Provides: ml_canvas_get_current_timestamp
 //Requires: caml_int64_of_float
 function ml_canvas_get_current_timestamp() {
   var e = new window.Event("dummy");
   return caml_int64_of_float(e.timeStamp * 1000.0);
 }
+
+//Provides: ml_canvas_set_frame_rate
+//Requires: _frame_rate,_frame_interval
+function ml_canvas_set_frame_rate(rate) {
+  _frame_rate = Math.max(1, Math.min(rate, 1000));
+  // Leave some slack, as frame timestamps jitter
+  _frame_interval = 1000.0 / _frame_rate - 1.0;
+}
+
+//Provides: ml_canvas_get_frame_rate
+//Requires: _frame_rate
+function ml_canvas_get_frame_rate() {
+  return _frame_rate;
+}
+
+//Provides: ml_canvas_set_event_coalescing
+function ml_canvas_set_event_coalescing(coalescing) {
+  // Browsers already coalesce pointer events to the display rate
+}
+
+//Provides: ml_canvas_get_event_coalescing
+function ml_canvas_get_event_coalescing() {
+  return 1;
+}
+
+//Provides: ml_canvas_start_trace
+function ml_canvas_start_trace(filename) {
+  // Use the browser's performance tools instead
+}
+
+//Provides: ml_canvas_stop_trace
+function ml_canvas_stop_trace() {
+}
@@ -28,6 +28,7 @@
 #include "../implem/font_desc.h"
 #include "../implem/transform.h"
 #include "../implem/path2d.h"
+#include "../implem/picture.h"
 #include "../implem/polygonize.h"
 #include "../implem/color_composition.h"
 #include "../implem/pixmap.h"
@@ -665,6 +666,9 @@ Val_event(
     case EVENT_PRESENT:
       assert(!"Present event crossing C boundary");
       break;
+    case EVENT_IDLE:
+      assert(!"Idle event crossing C boundary");
+      break;
     case EVENT_FRAME:
       mlEvent = caml_alloc(1, TAG_FRAME);
       Store_field(mlEvent, 0, Val_frame_event(event));
@@ -707,6 +711,18 @@ Val_event(
 int ml_canvas_compare_raw(value mlCanvas1, value mlCanvas2);
 intnat ml_canvas_hash_raw(value mlCanvas);
 
+/* Amount of memory held outside the heap by custom blocks above which
+   the GC should run a full major cycle; only used when resizing
+   canvases, and when allocating them before OCaml 4.08 */
+#define ML_CANVAS_CUSTOM_MAX (64 * 1024 * 1024)
+
+/* The canvas comes first, so that the custom block data
+   can also be used as a pointer to the canvas */
+typedef struct ml_canvas_block_t {
+  canvas_t *canvas; // NULL once destroyed
+  size_t mem; // memory reported to the GC
+} ml_canvas_block_t;
+
 static void
 _ml_canvas_finalize(
   value mlCanvas)
@@ -742,7 +758,8 @@ Val_canvas(
   if (mlWeakPointer_ptr != NULL) {
     mlWeakPointer = *mlWeakPointer_ptr;
   } else {
-    mlWeakPointer = caml_weak_array_create(1);
+    /* Slot 0 holds the canvas, slot 1 its surface view (if any) */
+    mlWeakPointer = caml_weak_array_create(2);
     mlWeakPointer_ptr = (value *)calloc(1, sizeof(value));
     *mlWeakPointer_ptr = mlWeakPointer;
     caml_register_generational_global_root(mlWeakPointer_ptr);
@@ -750,8 +767,19 @@ Val_canvas(
   }
 
   if (caml_weak_array_get(mlWeakPointer, 0, &mlCanvas) == 0) {
-    mlCanvas = caml_alloc_custom(&_ml_canvas_ops, sizeof(canvas_t *), 0, 1);
-    *((canvas_t **)Data_custom_val(mlCanvas)) = canvas_retain(canvas);
+    /* Let the GC know how large the canvas really is,
+       so that it gets collected in a timely manner */
+    size_t mem = canvas_get_memory_size(canvas);
+#if OCAML_VERSION >= 40800
+    mlCanvas = caml_alloc_custom_mem(&_ml_canvas_ops,
+                                     sizeof(ml_canvas_block_t), mem);
+#else
+    mlCanvas = caml_alloc_custom(&_ml_canvas_ops, sizeof(ml_canvas_block_t),
+                                 mem, ML_CANVAS_CUSTOM_MAX);
+#endif
+    ml_canvas_block_t *block = (ml_canvas_block_t *)Data_custom_val(mlCanvas);
+    block->canvas = canvas_retain(canvas);
+    block->mem = mem;
     caml_weak_array_set(mlWeakPointer, 0, mlCanvas);
   }
 
@@ -759,7 +787,7 @@ Val_canvas(
 }
 
 canvas_t *
-Canvas_val(
+Canvas_val_unsynced(
   value mlCanvas)
 {
   CAMLparam1(mlCanvas);
@@ -770,6 +798,130 @@ Canvas_val(
   CAMLreturnT(canvas_t *, canvas);
 }
 
+canvas_t *
+Canvas_val(
+  value mlCanvas)
+{
+  canvas_t *canvas = Canvas_val_unsynced(mlCanvas);
+  canvas_sync(canvas);
+  return canvas;
+}
+
+static void
+_ml_canvas_view_set(
+  value mlView,
+  const pixmap_t *pixmap)
+{
+  assert(pixmap->stride == pixmap->width);
+  struct caml_ba_array *ba = Caml_ba_array_val(mlView);
+  ba->data = (void *)pixmap->data;
+  ba->dim[0] = (intnat)pixmap->height;
+  ba->dim[1] = (intnat)pixmap->width;
+  ba->dim[2] = COLOR_SIZE;
+}
+
+void
+Canvas_memory_update(
+  canvas_t *canvas)
+{
+  CAMLparam0();
+  CAMLlocal1(mlCanvas);
+
+  value *mlWeakPointer_ptr = (value *)canvas_get_data(canvas);
+  if ((mlWeakPointer_ptr != NULL) &&
+      (caml_weak_array_get(*mlWeakPointer_ptr, 0, &mlCanvas) != 0)) {
+    ml_canvas_block_t *block = (ml_canvas_block_t *)Data_custom_val(mlCanvas);
+    size_t mem = canvas_get_memory_size(canvas);
+    if (mem > block->mem) {
+      caml_adjust_gc_speed(mem - block->mem, ML_CANVAS_CUSTOM_MAX);
+    }
+    block->mem = mem;
+  }
+
+  CAMLreturn0;
+}
+
+void
+Canvas_destroy(
+  value mlCanvas)
+{
+  CAMLparam1(mlCanvas);
+  CAMLlocal1(mlView);
+
+  ml_canvas_block_t *block = (ml_canvas_block_t *)Data_custom_val(mlCanvas);
+  canvas_t *canvas = block->canvas;
+  if (canvas == NULL) {
+    CAMLreturn0;
+  }
+
+  /* The view may outlive the surface, make it empty */
+  value *mlWeakPointer_ptr = (value *)canvas_get_data(canvas);
+  if ((mlWeakPointer_ptr != NULL) &&
+      (caml_weak_array_get(*mlWeakPointer_ptr, 1, &mlView) != 0)) {
+    pixmap_t pixmap = pixmap_null();
+    _ml_canvas_view_set(mlView, &pixmap);
+  }
+
+  /* Other references (e.g. from patterns) may keep the canvas alive,
+     but this wrapper (which Val_canvas would still return) is dead */
+  block->canvas = NULL;
+  canvas_close(canvas);
+  canvas_release(canvas);
+
+  CAMLreturn0;
+}
+
+value
+Val_canvas_view(
+  canvas_t *canvas,
+  bool *fresh)
+{
+  CAMLparam0();
+  CAMLlocal2(mlView, mlWeakPointer);
+
+  assert(fresh != NULL);
+
+  value *mlWeakPointer_ptr = (value *)canvas_get_data(canvas);
+  assert(mlWeakPointer_ptr != NULL);
+  mlWeakPointer = *mlWeakPointer_ptr;
+
+  *fresh = false;
+  if (caml_weak_array_get(mlWeakPointer, 1, &mlView) == 0) {
+    pixmap_t pixmap = canvas_get_raw_pixmap(canvas);
+    if (pixmap_valid(pixmap) == false) {
+      caml_failwith("unable to access the canvas pixels");
+    }
+    intnat dims[CAML_BA_MAX_NUM_DIMS] = { (intnat)pixmap.height,
+                                          (intnat)pixmap.width,
+                                          COLOR_SIZE };
+    /* External: the data belongs to the surface, never free it */
+    mlView =
+      caml_ba_alloc(CAML_BA_UINT8 | CAML_BA_C_LAYOUT | CAML_BA_EXTERNAL,
+                    3, (void *)pixmap.data, dims);
+    caml_weak_array_set(mlWeakPointer, 1, mlView);
+    *fresh = true;
+  }
+
+  CAMLreturn(mlView);
+}
+
+void
+Canvas_view_update(
+  canvas_t *canvas)
+{
+  CAMLparam0();
+  CAMLlocal1(mlView);
+
+  value *mlWeakPointer_ptr = (value *)canvas_get_data(canvas);
+  if ((mlWeakPointer_ptr != NULL) &&
+      (caml_weak_array_get(*mlWeakPointer_ptr, 1, &mlView) != 0)) {
+    pixmap_t pixmap = canvas_get_raw_pixmap(canvas);
+    _ml_canvas_view_set(mlView, &pixmap);
+  }
+
+  CAMLreturn0;
+}
+
 void
 _ml_canvas_path2d_finalize(
   value mlPath2d)
@@ -857,6 +1009,78 @@ Path2d_val(
   CAMLreturnT(path2d_t *, path2d);
 }
 
+static void
+_ml_canvas_picture_finalize(
+  value mlPicture)
+{
+  picture_t *picture = *((picture_t **)Data_custom_val(mlPicture));
+  if (picture != NULL) {
+    picture_release(picture);
+  }
+}
+
+int
+_ml_canvas_picture_compare(
+  value mlPicture1,
+  value mlPicture2)
+{
+  picture_t *p1 = *((picture_t **)Data_custom_val(mlPicture1));
+  if (p1 == NULL) {
+    caml_failwith("invalid picture object");
+  }
+  picture_t *p2 = *((picture_t **)Data_custom_val(mlPicture2));
+  if (p2 == NULL) {
+    caml_failwith("invalid picture object");
+  }
+  if (p1 < p2) {
+    return -1;
+  }
+  else if (p1 > p2) {
+    return 1;
+  }
+  else {
+    return 0;
+  }
+}
+
+static struct custom_operations _ml_picture_ops = {
+  "com.ocamlpro.ocaml-canvas.picture",
+  _ml_canvas_picture_finalize,
+  _ml_canvas_picture_compare,
+  custom_hash_default,
+  custom_serialize_default,
+  custom_deserialize_default,
+  custom_compare_ext_default,
+#if OCAML_VERSION >= 40800
+  custom_fixed_length_default
+#endif
+};
+
+/* Pictures are never handed back to OCaml once wrapped,
+   so unlike paths they need no weak pointer */
+value
+Val_picture(
+  picture_t *picture)
+{
+  CAMLparam0();
+  CAMLlocal1(mlPicture);
+  mlPicture = caml_alloc_custom(&_ml_picture_ops, sizeof(picture_t *), 0, 1);
+  *((picture_t **)Data_custom_val(mlPicture)) = picture_retain(picture);
+  CAMLreturn(mlPicture);
+}
+
+picture_t *
+Picture_val(
+  value mlPicture)
+{
+  CAMLparam1(mlPicture);
+  picture_t *picture = *((picture_t **)Data_custom_val(mlPicture));
+  if (picture == NULL) {
+    caml_failwith("invalid picture object");
+  }
+  CAMLreturnT(picture_t *, picture);
+}
+
 static void
 _ml_canvas_gradient_finalize(
   value mlGradient)
@@ -1268,12 +1492,42 @@ Compop_val(
   CAMLreturnT(composite_operation_t, map[Int_val(mlCompOp)]);
 }
 
+impexp_png_options_t
+Png_options_val(
+  value mlOptions)
+{
+  CAMLparam1(mlOptions);
+  static const impexp_filter_t filter_map[6] = {
+    [TAG_PNG_FILTER_ADAPTIVE] = IMPEXP_FILTER_ADAPTIVE,
+    [TAG_PNG_FILTER_NONE]     = IMPEXP_FILTER_NONE,
+    [TAG_PNG_FILTER_SUB]      = IMPEXP_FILTER_SUB,
+    [TAG_PNG_FILTER_UP]       = IMPEXP_FILTER_UP,
+    [TAG_PNG_FILTER_AVERAGE]  = IMPEXP_FILTER_AVERAGE,
+    [TAG_PNG_FILTER_PAETH]    = IMPEXP_FILTER_PAETH
+  };
+  static const impexp_strategy_t strategy_map[5] = {
+    [TAG_PNG_STRATEGY_DEFAULT]      = IMPEXP_STRATEGY_DEFAULT,
+    [TAG_PNG_STRATEGY_FILTERED]     = IMPEXP_STRATEGY_FILTERED,
+    [TAG_PNG_STRATEGY_HUFFMAN_ONLY] = IMPEXP_STRATEGY_HUFFMAN_ONLY,
+    [TAG_PNG_STRATEGY_RLE]          = IMPEXP_STRATEGY_RLE,
+    [TAG_PNG_STRATEGY_FIXED]        = IMPEXP_STRATEGY_FIXED
+  };
+  impexp_png_options_t options = {
+    .level = Int32_val_clip(Field(mlOptions, 0)),
+    .filter = filter_map[Int_val(Field(mlOptions, 1))],
+    .strategy = strategy_map[Int_val(Field(mlOptions, 2))],
+    .parallel = Bool_val(Field(mlOptions, 3))
+  };
+  CAMLreturnT(impexp_png_options_t, options);
+}
+
 value
 Val_pixmap(
   pixmap_t *pixmap)
 {
   CAMLparam0();
   CAMLlocal1(mlImageData);
+  assert(pixmap_is_compact(*pixmap));
   intnat dims[CAML_BA_MAX_NUM_DIMS] = { (intnat)pixmap->height,
                                         (intnat)pixmap->width,
                                         COLOR_SIZE };
@@ -1319,3 +1573,66 @@ Pixmap_val(
               pixmap((int32_t)width, (int32_t)height,
                      (color_t_ *)Caml_ba_data_val(mlPixmap)));
 }
+
+const double *
+Point_array_val(
+  value mlPoints,
+  int32_t *nb_points)
+{
+  CAMLparam1(mlPoints);
+
+  assert(nb_points != NULL);
+
+  struct caml_ba_array *ba = Caml_ba_array_val(mlPoints);
+
+  if ((ba->flags & CAML_BA_KIND_MASK) != CAML_BA_FLOAT64) {
+    caml_invalid_argument("Point array kind must be float64");
+  }
+
+  if ((ba->flags & CAML_BA_LAYOUT_MASK) != CAML_BA_C_LAYOUT) {
+    caml_invalid_argument("Point array layout must be C");
+  }
+
+  intnat n = 0;
+  if (ba->num_dims == 1) {
+    if (ba->dim[0] % 2 != 0) {
+      caml_invalid_argument("Point array length must be even");
+    }
+    n = ba->dim[0] / 2;
+  } else if (ba->num_dims == 2) {
+    if (ba->dim[1] != 2) {
+      caml_invalid_argument("Point array second dimension must be 2");
+    }
+    n = ba->dim[0];
+  } else {
+    caml_invalid_argument("Point array must have 1 or 2 dimensions");
+  }
+
+  if (n > INT32_MAX) {
+    caml_invalid_argument("Point array is too large");
+  }
+
+  *nb_points = (int32_t)n;
+
+  CAMLreturnT(const double *, (const double *)ba->data);
+}
+
+const uint8_t *
+Move_flags_val(
+  value mlMoves,
+  int32_t nb_points)
+{
+  CAMLparam1(mlMoves);
+
+  struct caml_ba_array *ba = Caml_ba_array_val(mlMoves);
+
+  if ((ba->flags & CAML_BA_KIND_MASK) != CAML_BA_UINT8) {
+    caml_invalid_argument("Move flags kind must be uint8");
+  }
+
+  if ((ba->num_dims != 1) || (ba->dim[0] < nb_points)) {
+    caml_invalid_argument("Move flags must have one flag per point");
+  }
+
+  CAMLreturnT(const uint8_t *, (const uint8_t *)ba->data);
+}
@@ -12,6 +12,7 @@
 #define __ML_CONVERT_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 #define CAML_NAME_SPACE
 #include "caml/mlvalues.h"
@@ -23,9 +24,11 @@
 #include "../implem/font_desc.h"
 #include "../implem/transform.h"
 #include "../implem/path2d.h"
+#include "../implem/picture.h"
 #include "../implem/polygonize.h"
 #include "../implem/color_composition.h"
 #include "../implem/pixmap.h"
+#include "../implem/impexp.h"
 #include "../implem/event.h"
 #include "../implem/canvas.h"
 
@@ -37,6 +40,12 @@ CAMLextern value caml_alloc_some(value v);
 
 #endif
 
+#if OCAML_VERSION < 40600
+
+#define Bytes_val(x) ((unsigned char *)Bp_val(x))
+
+#endif
+
 value
 Val_int32_clip(
   int32_t i);
@@ -91,10 +100,45 @@ value
 Val_canvas(
   canvas_t *canvas);
 
+// Waits for the commands submitted to the canvas to have run;
+// every stub that reads or writes the drawing state, the path,
+// the pixels or the statistics must go through this
 canvas_t *
 Canvas_val(
   value mlCanvas);
 
+// Same, without waiting; only for operations that do not touch
+// what the render thread uses (size, position, identifier,
+// visibility, frame scheduling flags, threading mode)
+canvas_t *
+Canvas_val_unsynced(
+  value mlCanvas);
+
+// Returns the Bigarray aliasing the surface of the canvas,
+// creating it if needed (in which case fresh is set to true)
+value
+Val_canvas_view(
+  canvas_t *canvas,
+  bool *fresh);
+
+// Makes the surface view of the canvas (if any) alias
+// the current surface, to be called after a resize
+void
+Canvas_view_update(
+  canvas_t *canvas);
+
+// Reports the memory the canvas gained to the GC,
+// to be called after a resize
+void
+Canvas_memory_update(
+  canvas_t *canvas);
+
+// Releases the canvas held by mlCanvas, which becomes invalid;
+// its surface view (if any) is emptied
+void
+Canvas_destroy(
+  value mlCanvas);
+
 value
 Val_path2d(
   path2d_t *path2d);
@@ -103,6 +147,14 @@ path2d_t *
 Path2d_val(
   value mlPath2d);
 
+value
+Val_picture(
+  picture_t *picture);
+
+picture_t *
+Picture_val(
+  value mlPicture);
+
 value
 Val_gradient(
   gradient_t *gradient);
@@ -167,6 +219,10 @@ composite_operation_t
 Compop_val(
   value mlCompOp);
 
+impexp_png_options_t
+Png_options_val(
+  value mlOptions);
+
 value
 Val_pixmap(
   pixmap_t *pixmap);
@@ -175,4 +231,14 @@ pixmap_t
 Pixmap_val(
   value mlPixmap);
 
+const double *
+Point_array_val(
+  value mlPoints,
+  int32_t *nb_points);
+
+const uint8_t *
+Move_flags_val(
+  value mlMoves,
+  int32_t nb_points);
+
 #endif /* __ML_CONVERT_H */
@@ -259,12 +259,30 @@ typedef enum comp_op_tag_t {
   TAG_OP_LUMINOSITY       = 25
 } comp_op_tag_t;
 
+typedef enum png_filter_tag_t {
+  TAG_PNG_FILTER_ADAPTIVE = 0,
+  TAG_PNG_FILTER_NONE     = 1,
+  TAG_PNG_FILTER_SUB      = 2,
+  TAG_PNG_FILTER_UP       = 3,
+  TAG_PNG_FILTER_AVERAGE  = 4,
+  TAG_PNG_FILTER_PAETH    = 5
+} png_filter_tag_t;
+
+typedef enum png_strategy_tag_t {
+  TAG_PNG_STRATEGY_DEFAULT      = 0,
+  TAG_PNG_STRATEGY_FILTERED     = 1,
+  TAG_PNG_STRATEGY_HUFFMAN_ONLY = 2,
+  TAG_PNG_STRATEGY_RLE          = 3,
+  TAG_PNG_STRATEGY_FIXED        = 4
+} png_strategy_tag_t;
+
 typedef enum backend_tag_t {
-  TAG_CANVAS  = 0,
-  TAG_GDI     = 1,
-  TAG_QUARTZ  = 2,
-  TAG_X11     = 3,
-  TAG_WAYLAND = 4
+  TAG_CANVAS   = 0,
+  TAG_GDI      = 1,
+  TAG_QUARTZ   = 2,
+  TAG_X11      = 3,
+  TAG_WAYLAND  = 4,
+  TAG_HEADLESS = 5
 } backend_tag_t;
 
 #endif /* __ML_TAGS_H */